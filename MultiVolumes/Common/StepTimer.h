@@ -11,7 +11,11 @@
 
 #pragma once
 
-// Helper class for animation and simulation timing.
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+// Helper class for animation and simulation timing, on the portable std::chrono::steady_clock.
 class StepTimer
 {
 public:
@@ -22,43 +26,42 @@ public:
         m_frameCount(0),
         m_framesPerSecond(0),
         m_framesThisSecond(0),
-        m_qpcSecondCounter(0),
+        m_secondCounter(0),
         m_isFixedTimeStep(false),
         m_targetElapsedTicks(TicksPerSecond / 60)
     {
-        QueryPerformanceFrequency(&m_qpcFrequency);
-        QueryPerformanceCounter(&m_qpcLastTime);
+        m_lastTime = Clock::now();
 
         // Initialize max delta to 1/10 of a second.
-        m_qpcMaxDelta = m_qpcFrequency.QuadPart / 10;
+        m_maxDelta = ClockFrequency / 10;
     }
 
     // Get elapsed time since the previous Update call.
-    UINT64 GetElapsedTicks() const                        { return m_elapsedTicks; }
+    uint64_t GetElapsedTicks() const                      { return m_elapsedTicks; }
     double GetElapsedSeconds() const                    { return TicksToSeconds(m_elapsedTicks); }
 
     // Get total time since the start of the program.
-    UINT64 GetTotalTicks() const                        { return m_totalTicks; }
+    uint64_t GetTotalTicks() const                        { return m_totalTicks; }
     double GetTotalSeconds() const                        { return TicksToSeconds(m_totalTicks); }
 
     // Get total number of updates since start of the program.
-    UINT32 GetFrameCount() const                        { return m_frameCount; }
+    uint32_t GetFrameCount() const                        { return m_frameCount; }
 
     // Get the current framerate.
-    UINT32 GetFramesPerSecond() const                    { return m_framesPerSecond; }
+    uint32_t GetFramesPerSecond() const                  { return m_framesPerSecond; }
 
     // Set whether to use fixed or variable timestep mode.
     void SetFixedTimeStep(bool isFixedTimestep)            { m_isFixedTimeStep = isFixedTimestep; }
 
     // Set how often to call Update when in fixed timestep mode.
-    void SetTargetElapsedTicks(UINT64 targetElapsed)    { m_targetElapsedTicks = targetElapsed; }
+    void SetTargetElapsedTicks(uint64_t targetElapsed)  { m_targetElapsedTicks = targetElapsed; }
     void SetTargetElapsedSeconds(double targetElapsed)    { m_targetElapsedTicks = SecondsToTicks(targetElapsed); }
 
     // Integer format represents time using 10,000,000 ticks per second.
-    static const UINT64 TicksPerSecond = 10000000;
+    static const uint64_t TicksPerSecond = 10000000;
 
-    static double TicksToSeconds(UINT64 ticks)            { return static_cast<double>(ticks) / TicksPerSecond; }
-    static UINT64 SecondsToTicks(double seconds)        { return static_cast<UINT64>(seconds * TicksPerSecond); }
+    static double TicksToSeconds(uint64_t ticks)          { return static_cast<double>(ticks) / TicksPerSecond; }
+    static uint64_t SecondsToTicks(double seconds)      { return static_cast<uint64_t>(seconds * TicksPerSecond); }
 
     // After an intentional timing discontinuity (for instance a blocking IO operation)
     // call this to avoid having the fixed timestep logic attempt a set of catch-up 
@@ -66,12 +69,12 @@ public:
 
     void ResetElapsedTime()
     {
-        QueryPerformanceCounter(&m_qpcLastTime);
+        m_lastTime = Clock::now();
 
         m_leftOverTicks = 0;
         m_framesPerSecond = 0;
         m_framesThisSecond = 0;
-        m_qpcSecondCounter = 0;
+        m_secondCounter = 0;
     }
 
     typedef void(*LPUPDATEFUNC) (void);
@@ -80,26 +83,24 @@ public:
     void Tick(LPUPDATEFUNC update = nullptr)
     {
         // Query the current time.
-        LARGE_INTEGER currentTime;
-
-        QueryPerformanceCounter(&currentTime);
+        const auto currentTime = Clock::now();
 
-        UINT64 timeDelta = currentTime.QuadPart - m_qpcLastTime.QuadPart;
+        uint64_t timeDelta = (currentTime - m_lastTime).count();
 
-        m_qpcLastTime = currentTime;
-        m_qpcSecondCounter += timeDelta;
+        m_lastTime = currentTime;
+        m_secondCounter += timeDelta;
 
         // Clamp excessively large time deltas (e.g. after paused in the debugger).
-        if (timeDelta > m_qpcMaxDelta)
+        if (timeDelta > m_maxDelta)
         {
-            timeDelta = m_qpcMaxDelta;
+            timeDelta = m_maxDelta;
         }
 
-        // Convert QPC units into a canonical tick format. This cannot overflow due to the previous clamp.
+        // Convert clock units into a canonical tick format. This cannot overflow due to the previous clamp.
         timeDelta *= TicksPerSecond;
-        timeDelta /= m_qpcFrequency.QuadPart;
+        timeDelta /= ClockFrequency;
 
-        UINT32 lastFrameCount = m_frameCount;
+        uint32_t lastFrameCount = m_frameCount;
 
         if (m_isFixedTimeStep)
         {
@@ -152,32 +153,36 @@ public:
             m_framesThisSecond++;
         }
 
-        if (m_qpcSecondCounter >= static_cast<UINT64>(m_qpcFrequency.QuadPart))
+        if (m_secondCounter >= ClockFrequency)
         {
             m_framesPerSecond = m_framesThisSecond;
             m_framesThisSecond = 0;
-            m_qpcSecondCounter %= m_qpcFrequency.QuadPart;
+            m_secondCounter %= ClockFrequency;
         }
     }
 
 private:
-    // Source timing data uses QPC units.
-    LARGE_INTEGER m_qpcFrequency;
-    LARGE_INTEGER m_qpcLastTime;
-    UINT64 m_qpcMaxDelta;
+    typedef std::chrono::steady_clock Clock;
+
+    // Clock units per second, e.g. 10^9 for nanoseconds.
+    static const uint64_t ClockFrequency = static_cast<uint64_t>(Clock::period::den / Clock::period::num);
+
+    // Source timing data uses clock units.
+    Clock::time_point m_lastTime;
+    uint64_t m_maxDelta;
 
     // Derived timing data uses a canonical tick format.
-    UINT64 m_elapsedTicks;
-    UINT64 m_totalTicks;
-    UINT64 m_leftOverTicks;
+    uint64_t m_elapsedTicks;
+    uint64_t m_totalTicks;
+    uint64_t m_leftOverTicks;
 
     // Members for tracking the framerate.
-    UINT32 m_frameCount;
-    UINT32 m_framesPerSecond;
-    UINT32 m_framesThisSecond;
-    UINT64 m_qpcSecondCounter;
+    uint32_t m_frameCount;
+    uint32_t m_framesPerSecond;
+    uint32_t m_framesThisSecond;
+    uint64_t m_secondCounter;
 
     // Members for configuring fixed timestep mode.
     bool m_isFixedTimeStep;
-    UINT64 m_targetElapsedTicks;
+    uint64_t m_targetElapsedTicks;
 };
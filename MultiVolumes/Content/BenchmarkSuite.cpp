@@ -0,0 +1,442 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "Optional/XUSGObjLoader.h"
+#include "BenchmarkSuite.h"
+#include "HeadlessRenderer.h"
+#include "VolumeTransforms.h"
+#include "VolumeCuller.h"
+#include "VolumeBVH.h"
+#include "SharedConsts.h"
+#include "SHProjector.h"
+#include "SampleSequence.h"
+#include "JobSystem.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <DirectXPackedVector.h>
+
+using namespace std;
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+// Generated inputs
+//--------------------------------------------------------------------------------------
+static bool writeOBJ(const string& fileName, uint32_t numSegments)
+{
+	// UV sphere of 2 * numSegments^2 triangles, with per-vertex normals
+	ofstream file(fileName);
+	if (!file) return false;
+
+	const auto numRings = numSegments + 1;
+	for (auto j = 0u; j < numRings; ++j)
+	{
+		const auto theta = XM_PI * j / numSegments;
+		for (auto i = 0u; i <= numSegments; ++i)
+		{
+			const auto phi = XM_2PI * i / numSegments;
+			const XMFLOAT3 n(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+			file << "v " << n.x << " " << n.y << " " << n.z << "\n";
+			file << "vn " << n.x << " " << n.y << " " << n.z << "\n";
+		}
+	}
+
+	const auto rowLength = numSegments + 1;
+	for (auto j = 0u; j < numSegments; ++j)
+	{
+		for (auto i = 0u; i < numSegments; ++i)
+		{
+			const auto a = rowLength * j + i + 1, b = a + 1, c = a + rowLength, d = c + 1;
+			file << "f " << a << "//" << a << " " << c << "//" << c << " " << b << "//" << b << "\n";
+			file << "f " << b << "//" << b << " " << c << "//" << c << " " << d << "//" << d << "\n";
+		}
+	}
+
+	return static_cast<bool>(file);
+}
+
+static bool writeDDSVolume(const string& fileName, uint32_t size, uint32_t dxgiFormat)
+{
+	ofstream file(fileName, ios::binary);
+	if (!file) return false;
+
+	// DX10 header of a 3D texture without mips
+	const uint32_t magic = 0x20534444;	// "DDS "
+	uint32_t header[31] = {};
+	header[0] = 124;
+	header[1] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x800000;	// Caps, height, width, pixel format, depth
+	header[2] = size;
+	header[3] = size;
+	header[5] = size;
+	header[6] = 1;
+	header[18] = 32;
+	header[19] = 0x4;			// DDPF_FOURCC
+	header[20] = 0x30315844;	// "DX10"
+	header[26] = 0x1000;		// DDSCAPS_TEXTURE
+	header[27] = 0x200000;		// DDSCAPS2_VOLUME
+	const uint32_t headerDX10[] = { dxgiFormat, 4, 0, 1, 0 };	// TEXTURE3D
+	file.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(headerDX10), sizeof(headerDX10));
+
+	// Density falling off from the center
+	const auto texelSize = dxgiFormat == 41 ? 4u : (dxgiFormat == 54 ? 2u : 1u);
+	vector<uint8_t> slice(static_cast<size_t>(texelSize) * size * size);
+	for (auto z = 0u; z < size; ++z)
+	{
+		for (auto i = 0u; i < size * size; ++i)
+		{
+			const auto x = (i % size + 0.5f) / size - 0.5f, y = (i / size + 0.5f) / size - 0.5f;
+			const auto w = (z + 0.5f) / size - 0.5f;
+			const auto value = (max)(1.0f - 4.0f * (x * x + y * y + w * w), 0.0f);
+			if (texelSize == 4) memcpy(&slice[4 * i], &value, sizeof(float));
+			else if (texelSize == 2)
+			{
+				const auto half = PackedVector::XMConvertFloatToHalf(value);
+				memcpy(&slice[2 * i], &half, sizeof(uint16_t));
+			}
+			else slice[i] = static_cast<uint8_t>(value * 255.0f + 0.5f);
+		}
+		file.write(reinterpret_cast<const char*>(slice.data()), slice.size());
+	}
+
+	return static_cast<bool>(file);
+}
+
+//--------------------------------------------------------------------------------------
+// Timing
+//--------------------------------------------------------------------------------------
+static void runCase(const BenchmarkSuite::RunDesc& desc, const string& name, const function<void()>& func,
+	vector<BenchmarkSuite::CaseResult>& results)
+{
+	if (!desc.Filter.empty() && name.find(desc.Filter) == string::npos) return;
+
+	// Warm-up
+	func();
+
+	vector<double> times;
+	auto totalTime = 0.0;
+	const auto maxIterations = (max)(desc.MaxIterations, 1u);
+	while (times.size() < maxIterations && (times.size() < desc.MinIterations || totalTime < desc.MinTime))
+	{
+		const auto startTime = chrono::steady_clock::now();
+		func();
+		times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count());
+		totalTime += times.back();
+	}
+
+	BenchmarkSuite::CaseResult result = {};
+	result.Name = name;
+	result.Iterations = static_cast<uint32_t>(times.size());
+	result.Mean = totalTime / times.size();
+	sort(times.begin(), times.end());
+	result.Min = times.front();
+	result.Median = times.size() % 2 ? times[times.size() / 2] : 0.5 * (times[times.size() / 2 - 1] + times[times.size() / 2]);
+	results.push_back(result);
+}
+
+//--------------------------------------------------------------------------------------
+// Benchmark suite
+//--------------------------------------------------------------------------------------
+BenchmarkSuite::RunDesc BenchmarkSuite::GetDefaultDesc()
+{
+	RunDesc desc;
+	desc.WorkDirectory = ".";
+	desc.MinIterations = 5;
+	desc.MaxIterations = 1000;
+	desc.MinTime = 200.0;
+
+	return desc;
+}
+
+vector<BenchmarkSuite::CaseResult> BenchmarkSuite::Run(const RunDesc& desc)
+{
+	vector<CaseResult> results;
+	const auto workPath = desc.WorkDirectory.empty() ? string(".") : desc.WorkDirectory;
+
+	// OBJ import at 2K, 32K and 512K triangles
+	for (const auto& numSegments : { 32u, 128u, 512u })
+	{
+		const auto fileName = workPath + "/benchmark_" + to_string(numSegments) + ".obj";
+		if (!writeOBJ(fileName, numSegments)) continue;
+		runCase(desc, "obj_import/tris=" + to_string(2 * numSegments * numSegments), [&fileName]()
+		{
+			XUSG::ObjLoader objLoader;
+			objLoader.Import(fileName.c_str(), true, true);
+		}, results);
+		remove(fileName.c_str());
+	}
+
+	// DDS header parsing and texel conversion of 128^3 volumes
+	const struct { const char* Name; uint32_t Format; } ddsFormats[] =
+	{
+		{ "r8", 61 }, { "r16f", 54 }, { "r32f", 41 }
+	};
+	for (const auto& ddsFormat : ddsFormats)
+	{
+		const auto fileName = workPath + "/benchmark_" + ddsFormat.Name + ".dds";
+		if (!writeDDSVolume(fileName, 128, ddsFormat.Format)) continue;
+		const wstring wFileName(fileName.cbegin(), fileName.cend());
+		runCase(desc, string("dds_load/") + ddsFormat.Name + "_128", [&wFileName]()
+		{
+			vector<float> texels;
+			uint32_t width, height, depth;
+			HeadlessRenderer::LoadDDSVolume(wFileName, texels, width, height, depth);
+		}, results);
+		remove(fileName.c_str());
+	}
+
+	const uint32_t volumeCounts[] = { 10, 100, 1000, 10000, 100000 };
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 1000.0f);
+	for (const auto& numVolumes : volumeCounts)
+	{
+		const uint8_t frameCount = 3;
+		const auto rowLength = static_cast<uint32_t>(ceilf(sqrtf(static_cast<float>(numVolumes))));
+		const auto colLength = static_cast<uint32_t>(ceilf(static_cast<float>(numVolumes / rowLength)));
+		VolumeTransforms transforms;
+		transforms.Init(numVolumes, frameCount);
+		vector<XMFLOAT3X4> worlds(numVolumes);
+
+		// Layout as MultiRayCaster::SetVolumesWorld() and SetVolumeWorld()
+		runCase(desc, "volumes_world/n=" + to_string(numVolumes), [&]()
+		{
+			const auto size = 20.0f, halfSize = 0.5f * size;
+			XMFLOAT3 pos(0.0f, 0.0f, -(colLength / 2.0f - 0.5f) * size * 1.5f);
+			for (auto m = 0u; m < colLength; ++m)
+			{
+				pos.x = -(rowLength / 2.0f - 0.5f) * size * 1.5f;
+				for (auto n = 0u; n < rowLength && rowLength * m + n < numVolumes; ++n)
+				{
+					const auto i = rowLength * m + n;
+					const auto world = XMMatrixScaling(halfSize, halfSize, halfSize) * XMMatrixTranslation(pos.x, pos.y, pos.z);
+					XMStoreFloat3x4(&worlds[i], world);
+					transforms.SetWorld(i, XMFLOAT3(halfSize, halfSize, halfSize), pos);
+					pos.x += size * 1.5f;
+				}
+				pos.z += size * 1.5f;
+			}
+		}, results);
+
+		// Per-object batches of MultiRayCaster::UpdateFrame(), with the camera moving every frame
+		vector<PerObject> perObjects(static_cast<size_t>(numVolumes) * frameCount);
+		auto frame = 0u;
+		runCase(desc, "update_frame/n=" + to_string(numVolumes), [&]()
+		{
+			const auto angle = XM_2PI * (frame % 64) / 64.0f;
+			const auto eyePt = XMVectorSet(sinf(angle) * 80.0f, 16.0f, cosf(angle) * 80.0f, 1.0f);
+			const auto view = XMMatrixLookAtLH(eyePt, XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+			const auto frameIndex = static_cast<uint8_t>(frame++ % frameCount);
+			transforms.Update(frameIndex, view * proj, &perObjects[static_cast<size_t>(numVolumes) * frameIndex]);
+		}, results);
+
+		// Culling of the same layout, with the camera moving every frame; n / median is the
+		// throughput in volumes per millisecond
+		VolumeCuller culler;
+		culler.Init(numVolumes);
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto size = 20.0f, halfSize = 0.5f * size;
+			const auto x = (static_cast<float>(i % rowLength) - rowLength / 2.0f + 0.5f) * size * 1.5f;
+			const auto z = (static_cast<float>(i / rowLength) - rowLength / 2.0f + 0.5f) * size * 1.5f;
+
+			XMFLOAT3X4 world;
+			XMStoreFloat3x4(&world, XMMatrixScaling(halfSize, halfSize, halfSize) * XMMatrixTranslation(x, 0.0f, z));
+
+			VolumeDesc volumeDesc;
+			volumeDesc.VolTexId = i % SceneSettings::NumVolumeSrcs;
+			volumeDesc.NumMips = NUM_CUBE_MIP;
+			volumeDesc.CubeMapSize = 128;
+			culler.SetVolume(i, world, volumeDesc);
+		}
+
+		const XMFLOAT2 viewport(1280.0f, 720.0f);
+		frame = 0;
+		runCase(desc, "cull/n=" + to_string(numVolumes), [&]()
+		{
+			const auto angle = XM_2PI * (frame++ % 64) / 64.0f;
+			const XMFLOAT3 eyePt(sinf(angle) * 80.0f, 16.0f, cosf(angle) * 80.0f);
+			const auto view = XMMatrixLookAtLH(XMLoadFloat3(&eyePt), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+			culler.Cull(view * proj, eyePt, viewport, 256);
+		}, results);
+	}
+
+	// BVH of volumes scattered in a cube with a fixed density, so that the visible subset grows
+	// much slower than the scene: full rebuilds, refits of drifting volumes, and frustum culling
+	// with the camera orbiting inside the scene
+	for (const auto& numVolumes : { 10000u, 100000u, 1000000u })
+	{
+		const auto spacing = 20.0f;
+		const auto sideLength = spacing * cbrtf(static_cast<float>(numVolumes));
+		mt19937 rng(numVolumes);
+		uniform_real_distribution<float> dist(-0.5f * sideLength, 0.5f * sideLength);
+
+		vector<XMFLOAT3> positions(numVolumes);
+		vector<XMFLOAT3X4> worlds(numVolumes);
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			positions[i] = XMFLOAT3(dist(rng), dist(rng), dist(rng));
+			XMStoreFloat3x4(&worlds[i], XMMatrixTranslation(positions[i].x, positions[i].y, positions[i].z));
+		}
+
+		VolumeBVH bvh;
+		runCase(desc, "bvh_rebuild/n=" + to_string(numVolumes), [&]()
+		{
+			bvh.Build(worlds.data(), numVolumes);
+		}, results);
+
+		if (bvh.GetNumVolumes() != numVolumes) bvh.Build(worlds.data(), numVolumes);
+		auto frame = 0u;
+		runCase(desc, "bvh_refit/n=" + to_string(numVolumes), [&]()
+		{
+			const auto t = static_cast<float>(frame++ % 64) / 64.0f;
+			for (auto i = 0u; i < numVolumes; ++i)
+			{
+				const auto offset = sinf(t * XM_2PI + i) * spacing * 0.25f;
+				const auto& pos = positions[i];
+				XMStoreFloat3x4(&worlds[i], XMMatrixTranslation(pos.x + offset, pos.y, pos.z - offset));
+			}
+			bvh.Refit(worlds.data());
+		}, results);
+
+		const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, g_zNear, g_zFar);
+		vector<uint32_t> visibleVolumes;
+		frame = 0;
+		runCase(desc, "bvh_cull/n=" + to_string(numVolumes), [&]()
+		{
+			const auto angle = XM_2PI * (frame++ % 64) / 64.0f;
+			const XMFLOAT3 eyePt(sinf(angle) * sideLength * 0.25f, 0.0f, cosf(angle) * sideLength * 0.25f);
+			const auto view = XMMatrixLookAtLH(XMLoadFloat3(&eyePt), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+			bvh.Cull(view * proj, eyePt, visibleVolumes);
+		}, results);
+	}
+
+	// Scheduling of the job system: empty tasks forked and joined, and the chunks of a parallel-for
+	for (const auto& numTasks : { 256u, 65536u })
+	{
+		runCase(desc, "job_spawn/n=" + to_string(numTasks), [numTasks]()
+		{
+			JobSystem::Group group;
+			for (auto i = 0u; i < numTasks; ++i) group.Run([]() {});
+			group.Wait();
+		}, results);
+
+		runCase(desc, "parallel_for/n=" + to_string(numTasks), [numTasks]()
+		{
+			JobSystem::ParallelFor(numTasks, 1, [](uint32_t, uint32_t) {});
+		}, results);
+	}
+
+	// SH projection of order 3 at the face sizes of the radiance mips
+	for (const auto& faceSize : { 32u, 128u, 256u })
+	{
+		vector<XMFLOAT4> texels(6 * faceSize * faceSize);
+		for (size_t i = 0; i < texels.size(); ++i)
+		{
+			const auto t = static_cast<float>(i) / texels.size();
+			texels[i] = XMFLOAT4(t, 1.0f - t, 0.5f + 0.5f * sinf(40.0f * t), 1.0f);
+		}
+
+		SHProjector projector;
+		runCase(desc, "sh_projection/face=" + to_string(faceSize), [&]()
+		{
+			projector.Project(texels.data(), faceSize, 3);
+		}, results);
+	}
+
+	// Halton points, one at a time and in batches
+	for (const auto& numPoints : { 256u, 65536u })
+	{
+		vector<XMFLOAT2> points(numPoints);
+		runCase(desc, "halton_next/n=" + to_string(numPoints), [&]()
+		{
+			SampleSequence sequence(SampleSequence::HALTON);
+			for (auto& point : points) point = sequence.Next();
+		}, results);
+
+		runCase(desc, "halton_batch/n=" + to_string(numPoints), [&]()
+		{
+			const SampleSequence sequence(SampleSequence::HALTON);
+			sequence.Generate(0, numPoints, points.data());
+		}, results);
+	}
+
+	// CPU ray marchers: the light map of the volumes, and the views at 320 x 200
+	SceneSettings settings;
+	settings.VolumeFiles[0] = L"";
+	settings.NumVolumes = 4;
+	for (const auto& gridSize : { 16u, 32u })
+	{
+		settings.GridSize = gridSize;
+		settings.LightGridSize = gridSize;
+		runCase(desc, "ray_march_light/grid=" + to_string(gridSize), [&]()
+		{
+			HeadlessRenderer renderer;
+			renderer.Init(settings, 320, 200);
+		}, results);
+	}
+
+	settings.LightGridSize = 32;
+	for (const auto& gridSize : { 32u, 64u, 128u })
+	{
+		settings.GridSize = gridSize;
+		HeadlessRenderer renderer;
+		if (!renderer.Init(settings, 320, 200)) continue;
+
+		HeadlessRenderer::FrameContext context;
+		renderer.InitFrameContext(context);
+		const XMFLOAT3 eyePt(40.0f, 30.0f, -60.0f), focusPt(0.0f, 0.0f, 0.0f);
+		runCase(desc, "ray_march_view/grid=" + to_string(gridSize), [&]()
+		{
+			renderer.Render(context, eyePt, focusPt);
+		}, results);
+	}
+
+	return results;
+}
+
+bool BenchmarkSuite::WriteCSV(const char* fileName, const vector<CaseResult>& results)
+{
+	ofstream file(fileName);
+	if (!file) return false;
+
+	file << "case,iterations,median_ms,min_ms,mean_ms,baseline_ms,change" << endl;
+	for (const auto& result : results)
+		file << result.Name << "," << result.Iterations << "," << result.Median << "," << result.Min << ","
+			<< result.Mean << "," << result.Baseline << "," << result.Change << endl;
+
+	return static_cast<bool>(file);
+}
+
+int32_t BenchmarkSuite::CompareBaseline(const char* fileName, float threshold, vector<CaseResult>& results)
+{
+	ifstream file(fileName);
+	if (!file) return -1;
+
+	// Medians by case name, from the CSV of WriteCSV()
+	unordered_map<string, double> baselines;
+	string line;
+	getline(file, line);
+	while (getline(file, line))
+	{
+		stringstream row(line);
+		string name, iterations, median;
+		if (getline(row, name, ',') && getline(row, iterations, ',') && getline(row, median, ','))
+			baselines[name] = atof(median.c_str());
+	}
+
+	auto numRegressions = 0;
+	for (auto& result : results)
+	{
+		const auto baseline = baselines.find(result.Name);
+		if (baseline == baselines.cend() || baseline->second <= 0.0) continue;
+
+		result.Baseline = baseline->second;
+		result.Change = static_cast<float>(result.Median / result.Baseline - 1.0);
+		result.IsRegression = result.Change > threshold;
+		numRegressions += result.IsRegression ? 1 : 0;
+	}
+
+	return numRegressions;
+}
@@ -0,0 +1,47 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Microbenchmarks of the CPU hot paths, each parameterized over its problem size: OBJ import,
+// DDS volume parsing and conversion, the per-object transform batches of UpdateFrame, the
+// volume layout of SetVolumesWorld, the volume culler, the rebuilds, refits and culling of the
+// volume BVH, the task scheduling of the job system, SH projection, Halton generation, and the
+// CPU ray marchers of the light map and the views.
+// Every case is timed over enough iterations for a stable median; results are written as CSV,
+// and compared against a baseline CSV, where a case regresses if its median is slower by more
+// than the threshold. The culling throughput in volumes per millisecond is n over the median
+// of cull/n=<n>.
+class BenchmarkSuite
+{
+public:
+	struct RunDesc
+	{
+		std::string WorkDirectory;	// Of the generated OBJ and DDS inputs
+		std::string Filter;			// Substring of the case names to run, all if empty
+		uint32_t MinIterations;
+		uint32_t MaxIterations;
+		double MinTime;				// Per case, in milliseconds
+	};
+
+	struct CaseResult
+	{
+		std::string Name;			// "<path>/<parameter>", e.g. "update_frame/n=1000"
+		uint32_t Iterations;
+		double Median;				// Per iteration, in milliseconds
+		double Min;
+		double Mean;
+		double Baseline;			// Median of the baseline, 0 if not in it
+		float Change;				// Of the median relative to the baseline, e.g. 0.1 if 10% slower
+		bool IsRegression;
+	};
+
+	static RunDesc GetDefaultDesc();
+	static std::vector<CaseResult> Run(const RunDesc& desc);
+
+	static bool WriteCSV(const char* fileName, const std::vector<CaseResult>& results);
+
+	// Returns the number of regressions, or -1 if the baseline cannot be read
+	static int32_t CompareBaseline(const char* fileName, float threshold, std::vector<CaseResult>& results);
+};
@@ -0,0 +1,180 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "BlueNoise.h"
+#include <cfloat>
+
+using namespace std;
+
+static inline uint32_t hashUint(uint32_t x)
+{
+	// PCG hash
+	const auto state = x * 747796405u + 2891336453u;
+	const auto word = ((state >> ((state >> 28) + 4)) ^ state) * 277803737u;
+
+	return (word >> 22) ^ word;
+}
+
+BlueNoise::BlueNoise() :
+	m_size(0),
+	m_depth(0),
+	m_radius(0)
+{
+}
+
+BlueNoise::~BlueNoise()
+{
+}
+
+void BlueNoise::Generate(uint32_t size, uint32_t depth, uint32_t seed, float sigma, float temporalSigma)
+{
+	m_size = (max)(size, 2u);
+	m_depth = (max)(depth, 1u);
+
+	// Gaussians truncated at 3 sigma, wrapped around the torus
+	m_radius = (min)(static_cast<int32_t>(ceilf(3.0f * sigma)), static_cast<int32_t>(m_size / 2));
+	const auto width = 2 * m_radius + 1;
+	m_spatialKernel.resize(width * width);
+	for (auto j = -m_radius; j <= m_radius; ++j)
+		for (auto i = -m_radius; i <= m_radius; ++i)
+			m_spatialKernel[width * (j + m_radius) + i + m_radius] = expf(-(i * i + j * j) / (2.0f * sigma * sigma));
+
+	m_temporalKernel.assign(m_depth, 0.0f);
+	for (auto t = 1u; t < m_depth; ++t)
+	{
+		const auto dt = static_cast<float>((min)(t, m_depth - t));
+		m_temporalKernel[t] = expf(-dt * dt / (2.0f * temporalSigma * temporalSigma));
+	}
+
+	// Initial binary pattern of about a tenth of random points
+	const auto numTexels = m_size * m_size * m_depth;
+	const auto numInitial = (max)(numTexels / 10, 1u);
+	vector<uint8_t> pattern(numTexels, 0);
+	vector<float> energies(numTexels, 0.0f);
+	for (auto n = 0u, i = 0u; n < numInitial; ++i)
+	{
+		const auto idx = hashUint(seed * 0x9e3779b9u + i) % numTexels;
+		if (pattern[idx]) continue;
+		pattern[idx] = 1;
+		splat(energies, idx, 1.0f);
+		++n;
+	}
+
+	// Move the tightest clusters into the largest voids until the pattern is stable
+	for (auto i = 0u; i < numTexels; ++i)
+	{
+		const auto cluster = findTightestCluster(energies, pattern);
+		pattern[cluster] = 0;
+		splat(energies, cluster, -1.0f);
+
+		const auto largestVoid = findLargestVoid(energies, pattern);
+		pattern[largestVoid] = 1;
+		splat(energies, largestVoid, 1.0f);
+		if (largestVoid == cluster) break;
+	}
+
+	vector<uint32_t> ranks(numTexels);
+
+	// Ranks of the initial points, removing the tightest clusters first
+	{
+		auto prototype = pattern;
+		auto prototypeEnergies = energies;
+		for (auto rank = numInitial; rank > 0; --rank)
+		{
+			const auto cluster = findTightestCluster(prototypeEnergies, prototype);
+			prototype[cluster] = 0;
+			splat(prototypeEnergies, cluster, -1.0f);
+			ranks[cluster] = rank - 1;
+		}
+	}
+
+	// Ranks of the rest, filling the largest voids first
+	for (auto rank = numInitial; rank < numTexels; ++rank)
+	{
+		const auto largestVoid = findLargestVoid(energies, pattern);
+		pattern[largestVoid] = 1;
+		splat(energies, largestVoid, 1.0f);
+		ranks[largestVoid] = rank;
+	}
+
+	m_values.resize(numTexels);
+	for (auto i = 0u; i < numTexels; ++i) m_values[i] = (ranks[i] + 0.5f) / numTexels;
+}
+
+float BlueNoise::Get(uint32_t x, uint32_t y, uint32_t z) const
+{
+	if (m_values.empty()) return 0.5f;
+
+	return m_values[(m_size * (z % m_depth) + y % m_size) * m_size + x % m_size];
+}
+
+const vector<float>& BlueNoise::GetValues() const
+{
+	return m_values;
+}
+
+uint32_t BlueNoise::GetSize() const
+{
+	return m_size;
+}
+
+uint32_t BlueNoise::GetDepth() const
+{
+	return m_depth;
+}
+
+void BlueNoise::splat(vector<float>& energies, uint32_t idx, float sign) const
+{
+	const auto size = static_cast<int32_t>(m_size);
+	const auto x = static_cast<int32_t>(idx % m_size);
+	const auto y = static_cast<int32_t>(idx / m_size % m_size);
+	const auto z = idx / (m_size * m_size);
+	const auto width = 2 * m_radius + 1;
+
+	// Spatial energy within the slice
+	const auto pSlice = &energies[m_size * m_size * z];
+	for (auto j = -m_radius; j <= m_radius; ++j)
+	{
+		const auto row = size * ((y + j + size) % size);
+		for (auto i = -m_radius; i <= m_radius; ++i)
+			pSlice[row + (x + i + size) % size] += sign * m_spatialKernel[width * (j + m_radius) + i + m_radius];
+	}
+
+	// Temporal energy along the pixel
+	const auto pixel = idx % (m_size * m_size);
+	for (auto t = 1u; t < m_depth; ++t)
+		energies[m_size * m_size * ((z + t) % m_depth) + pixel] += sign * m_temporalKernel[t];
+}
+
+uint32_t BlueNoise::findTightestCluster(const vector<float>& energies, const vector<uint8_t>& pattern) const
+{
+	auto maxEnergy = -FLT_MAX;
+	auto result = 0u;
+	for (auto i = 0u; i < energies.size(); ++i)
+	{
+		if (pattern[i] && energies[i] > maxEnergy)
+		{
+			maxEnergy = energies[i];
+			result = i;
+		}
+	}
+
+	return result;
+}
+
+uint32_t BlueNoise::findLargestVoid(const vector<float>& energies, const vector<uint8_t>& pattern) const
+{
+	auto minEnergy = FLT_MAX;
+	auto result = 0u;
+	for (auto i = 0u; i < energies.size(); ++i)
+	{
+		if (!pattern[i] && energies[i] < minEnergy)
+		{
+			minEnergy = energies[i];
+			result = i;
+		}
+	}
+
+	return result;
+}
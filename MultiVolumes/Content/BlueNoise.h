@@ -0,0 +1,38 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Tileable blue-noise dither thresholds by void and cluster (Ulichney 1993). With a depth
+// of more than 1, slices are generated as spatiotemporal blue noise (Wolfe et al. 2022):
+// the energy kernel is a spatial Gaussian within each slice plus a temporal Gaussian along
+// each pixel, so that every slice is blue noise and so is the sequence of every pixel.
+class BlueNoise
+{
+public:
+	BlueNoise();
+	virtual ~BlueNoise();
+
+	void Generate(uint32_t size, uint32_t depth = 1, uint32_t seed = 0, float sigma = 1.9f, float temporalSigma = 1.0f);
+
+	// Thresholds in [0, 1), wrapped around in all dimensions
+	float Get(uint32_t x, uint32_t y, uint32_t z = 0) const;
+
+	const std::vector<float>& GetValues() const;
+	uint32_t GetSize() const;
+	uint32_t GetDepth() const;
+
+protected:
+	void splat(std::vector<float>& energies, uint32_t idx, float sign) const;
+	uint32_t findTightestCluster(const std::vector<float>& energies, const std::vector<uint8_t>& pattern) const;
+	uint32_t findLargestVoid(const std::vector<float>& energies, const std::vector<uint8_t>& pattern) const;
+
+	std::vector<float>		m_values;
+	std::vector<float>		m_spatialKernel;	// (2 * radius + 1)^2
+	std::vector<float>		m_temporalKernel;	// Over the depth, 0 at the own slice
+
+	uint32_t				m_size;
+	uint32_t				m_depth;
+	int32_t					m_radius;
+};
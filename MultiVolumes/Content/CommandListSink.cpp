@@ -0,0 +1,89 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CommandListSink.h"
+
+using namespace std;
+using namespace XUSG;
+
+CommandListSink::CommandListSink() :
+	m_pCommandQueue(nullptr),
+	m_numSegments(0),
+	m_frameIndex(0)
+{
+}
+
+CommandListSink::~CommandListSink()
+{
+}
+
+bool CommandListSink::Init(const Device* pDevice, CommandQueue* pCommandQueue,
+	uint8_t frameCount, uint32_t numSegments)
+{
+	m_pCommandQueue = pCommandQueue;
+	m_numSegments = numSegments;
+	m_frameIndex = 0;
+
+	m_commandAllocators.resize(frameCount * numSegments);
+	for (uint8_t n = 0; n < frameCount; ++n)
+	{
+		for (auto i = 0u; i < numSegments; ++i)
+		{
+			auto& commandAllocator = m_commandAllocators[numSegments * n + i];
+			commandAllocator = CommandAllocator::MakeUnique();
+			XUSG_N_RETURN(commandAllocator->Create(pDevice, CommandListType::DIRECT,
+				(L"SegmentAllocator" + to_wstring(n) + L"_" + to_wstring(i)).c_str()), false);
+		}
+	}
+
+	// Command lists are created open; close them for the first Begin() to reset
+	m_commandLists.resize(numSegments);
+	for (auto i = 0u; i < numSegments; ++i)
+	{
+		auto& commandList = m_commandLists[i];
+		commandList = RayTracing::CommandList::MakeUnique();
+		XUSG_N_RETURN(commandList->Create(pDevice, 0, CommandListType::DIRECT, m_commandAllocators[i].get(),
+			nullptr, (L"SegmentCommandList" + to_wstring(i)).c_str()), false);
+		XUSG_N_RETURN(commandList->CreateInterface(), false);
+		XUSG_N_RETURN(commandList->Close(), false);
+	}
+
+	return true;
+}
+
+void CommandListSink::SetFrameIndex(uint8_t frameIndex)
+{
+	m_frameIndex = frameIndex;
+}
+
+bool CommandListSink::Begin(uint32_t segment)
+{
+	// The allocator of the frame index was last used FrameCount frames ago, which the swap
+	// chain has waited on
+	assert(segment < m_numSegments);
+	const auto pCommandAllocator = m_commandAllocators[m_numSegments * m_frameIndex + segment].get();
+	XUSG_N_RETURN(pCommandAllocator->Reset(), false);
+
+	return m_commandLists[segment]->Reset(pCommandAllocator, nullptr);
+}
+
+bool CommandListSink::End(uint32_t segment)
+{
+	return m_commandLists[segment]->Close();
+}
+
+bool CommandListSink::Submit(uint32_t numSegments)
+{
+	assert(numSegments <= m_numSegments);
+	m_submissions.resize(numSegments);
+	for (auto i = 0u; i < numSegments; ++i) m_submissions[i] = m_commandLists[i].get();
+	m_pCommandQueue->ExecuteCommandLists(numSegments, m_submissions.data());
+
+	return true;
+}
+
+RayTracing::CommandList* CommandListSink::GetCommandList(uint32_t segment) const
+{
+	return m_commandLists[segment].get();
+}
@@ -0,0 +1,38 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Core/XUSG.h"
+#include "RayTracing/XUSGRayTracing.h"
+#include "CommandRecorder.h"
+
+// Command lists of the recording segments, with an allocator per segment and frame in flight,
+// so the segment bodies record and close their lists on any thread. Submit() executes the lists in
+// one call, in segment order.
+class CommandListSink :
+	public CommandSink
+{
+public:
+	CommandListSink();
+	virtual ~CommandListSink();
+
+	bool Init(const XUSG::Device* pDevice, XUSG::CommandQueue* pCommandQueue,
+		uint8_t frameCount, uint32_t numSegments);
+	void SetFrameIndex(uint8_t frameIndex);
+
+	virtual bool Begin(uint32_t segment);
+	virtual bool End(uint32_t segment);
+	virtual bool Submit(uint32_t numSegments);
+
+	XUSG::RayTracing::CommandList* GetCommandList(uint32_t segment) const;
+
+protected:
+	std::vector<XUSG::CommandAllocator::uptr>			m_commandAllocators;	// Per frame, then segment
+	std::vector<XUSG::RayTracing::CommandList::uptr>	m_commandLists;
+	std::vector<const XUSG::CommandList*>				m_submissions;
+	XUSG::CommandQueue*	m_pCommandQueue;
+	uint32_t			m_numSegments;
+	uint8_t				m_frameIndex;
+};
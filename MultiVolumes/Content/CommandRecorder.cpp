@@ -0,0 +1,279 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CommandRecorder.h"
+#include <chrono>
+#include <random>
+
+using namespace std;
+
+//--------------------------------------------------------------------------------------
+// Command recorder
+//--------------------------------------------------------------------------------------
+CommandRecorder::CommandRecorder()
+{
+}
+
+CommandRecorder::~CommandRecorder()
+{
+}
+
+void CommandRecorder::Reset()
+{
+	m_segments.clear();
+}
+
+uint32_t CommandRecorder::AddSegment(const char* name, const RecordFunc& body, const RecordFunc& entry)
+{
+	m_segments.push_back({ name, entry, body });
+
+	return static_cast<uint32_t>(m_segments.size() - 1);
+}
+
+bool CommandRecorder::Record(CommandSink* pSink, bool isParallel)
+{
+	const auto numSegments = static_cast<uint32_t>(m_segments.size());
+
+	// Open the lists and record the entries in segment order, as they read and update the
+	// tracked states of the shared resources
+	auto numOpen = 0u;
+	auto isEntered = true;
+	for (; numOpen < numSegments && isEntered; ++numOpen)
+	{
+		if (!pSink->Begin(numOpen)) break;
+		isEntered = !m_segments[numOpen].Entry || m_segments[numOpen].Entry(numOpen);
+	}
+
+	// Close the lists opened so far on failure, so that they can be reset next time
+	if (numOpen < numSegments || !isEntered)
+	{
+		for (auto i = 0u; i < numOpen; ++i) pSink->End(i);
+		return false;
+	}
+
+	// Record the bodies, and close the lists whether or not they succeed
+	m_isRecorded.assign(numSegments, 0);
+	const auto recordBody = [this, pSink](uint32_t i)
+	{
+		const auto isRecorded = m_segments[i].Body(i);
+		m_isRecorded[i] = pSink->End(i) && isRecorded ? 1 : 0;
+	};
+
+	if (isParallel)
+	{
+		JobSystem::Group group;
+		for (auto i = 0u; i < numSegments; ++i) group.Run([&recordBody, i]() { recordBody(i); });
+		group.Wait();
+	}
+	else for (auto i = 0u; i < numSegments; ++i) recordBody(i);
+
+	for (const auto& isRecorded : m_isRecorded) if (!isRecorded) return false;
+
+	return pSink->Submit(numSegments);
+}
+
+uint32_t CommandRecorder::GetNumSegments() const
+{
+	return static_cast<uint32_t>(m_segments.size());
+}
+
+const char* CommandRecorder::GetSegmentName(uint32_t segment) const
+{
+	return m_segments[segment].Name;
+}
+
+//--------------------------------------------------------------------------------------
+// Mock command sink
+//--------------------------------------------------------------------------------------
+MockCommandSink::MockCommandSink() :
+	m_numErrors(0)
+{
+}
+
+MockCommandSink::~MockCommandSink()
+{
+}
+
+bool MockCommandSink::Begin(uint32_t segment)
+{
+	if (segment >= m_lists.size()) m_lists.resize(segment + 1, { vector<uint32_t>(), false });
+
+	auto& list = m_lists[segment];
+	if (list.IsOpen) ++m_numErrors;
+	list.Commands.clear();
+	list.IsOpen = true;
+
+	return true;
+}
+
+bool MockCommandSink::End(uint32_t segment)
+{
+	if (segment >= m_lists.size() || !m_lists[segment].IsOpen)
+	{
+		++m_numErrors;
+		return false;
+	}
+	m_lists[segment].IsOpen = false;
+
+	return true;
+}
+
+bool MockCommandSink::Submit(uint32_t numSegments)
+{
+	if (numSegments > m_lists.size())
+	{
+		++m_numErrors;
+		return false;
+	}
+
+	for (auto i = 0u; i < numSegments; ++i)
+	{
+		const auto& list = m_lists[i];
+		if (list.IsOpen) ++m_numErrors;
+		m_submitted.insert(m_submitted.end(), list.Commands.cbegin(), list.Commands.cend());
+	}
+
+	return true;
+}
+
+void MockCommandSink::Record(uint32_t segment, uint32_t command)
+{
+	if (segment >= m_lists.size() || !m_lists[segment].IsOpen) ++m_numErrors;
+	else m_lists[segment].Commands.push_back(command);
+}
+
+void MockCommandSink::Reset()
+{
+	m_submitted.clear();
+}
+
+const vector<uint32_t>& MockCommandSink::GetSubmitted() const
+{
+	return m_submitted;
+}
+
+uint32_t MockCommandSink::GetNumErrors() const
+{
+	return m_numErrors;
+}
+
+//--------------------------------------------------------------------------------------
+// Evaluation
+//--------------------------------------------------------------------------------------
+static void spin(double time)
+{
+	const auto startTime = chrono::steady_clock::now();
+	while (chrono::duration<double, micro>(chrono::steady_clock::now() - startTime).count() < time);
+}
+
+CommandRecorder::EvaluationResult CommandRecorder::Evaluate(const EvaluationDesc& desc)
+{
+	EvaluationResult result = {};
+
+	// Commands are tagged with their segment, the entries with the high bit
+	static const uint32_t EntryBit = 0x80000000;
+	const auto makeCommand = [](uint32_t segment, uint32_t i) { return (segment << 16) | i; };
+
+	mt19937 rng(desc.Seed);
+	CommandRecorder recorder;
+	MockCommandSink sink;
+	vector<uint32_t> expected, numEntries, numCommands, entryOrder;
+	vector<double> recordTimes;
+	atomic<uint32_t> numRecording(0), peakConcurrency(0), numEarlyBodies(0);
+	const auto maxSegments = (max)(desc.MaxSegments, 1u);
+	for (auto i = 0u; i < desc.NumFrames; ++i)
+	{
+		// Segments of random lengths and recording times, so they finish out of order. Every body
+		// must start after all the entries, which leave the tracked states as of the frame end.
+		const auto numSegments = 1 + rng() % maxSegments;
+		numEntries.resize(numSegments);
+		numCommands.resize(numSegments);
+		recordTimes.resize(numSegments);
+		recorder.Reset();
+		sink.Reset();
+		expected.clear();
+		entryOrder.clear();
+		for (auto j = 0u; j < numSegments; ++j)
+		{
+			numEntries[j] = rng() % 3;
+			numCommands[j] = rng() % (desc.MaxCommands + 1);
+			recordTimes[j] = (rng() % 64) * desc.RecordTime / 64.0;
+			for (auto k = 0u; k < numEntries[j]; ++k) expected.push_back(makeCommand(j, k) | EntryBit);
+			for (auto k = 0u; k < numCommands[j]; ++k) expected.push_back(makeCommand(j, k));
+			result.NumCommands += numEntries[j] + numCommands[j];
+
+			recorder.AddSegment("Segment", [&](uint32_t segment)
+			{
+				numEarlyBodies += entryOrder.size() < numSegments ? 1 : 0;
+				const auto concurrency = ++numRecording;
+				auto peak = peakConcurrency.load();
+				while (peak < concurrency && !peakConcurrency.compare_exchange_weak(peak, concurrency));
+
+				spin(recordTimes[segment]);
+				for (auto k = 0u; k < numCommands[segment]; ++k) sink.Record(segment, makeCommand(segment, k));
+				--numRecording;
+
+				return true;
+			}, [&](uint32_t segment)
+			{
+				entryOrder.push_back(segment);
+				for (auto k = 0u; k < numEntries[segment]; ++k) sink.Record(segment, makeCommand(segment, k) | EntryBit);
+
+				return true;
+			});
+		}
+
+		const auto numErrors = sink.GetNumErrors();
+		numEarlyBodies = 0;
+		auto isFailed = !recorder.Record(&sink) || numEarlyBodies > 0;
+		isFailed = isFailed || sink.GetSubmitted() != expected || sink.GetNumErrors() != numErrors;
+		for (auto j = 0u; j < entryOrder.size(); ++j) isFailed = isFailed || entryOrder[j] != j;
+		isFailed = isFailed || entryOrder.size() != numSegments;
+
+		result.NumFailed += isFailed ? 1 : 0;
+		result.NumSegments += numSegments;
+		++result.NumFrames;
+	}
+
+	// A failing entry or body fails the frame without submitting, and leaves the lists closed
+	for (const auto& isEntryFailing : { false, true })
+	{
+		recorder.Reset();
+		sink.Reset();
+		recorder.AddSegment("Passing", [](uint32_t) { return true; });
+		recorder.AddSegment("Failing", [isEntryFailing](uint32_t) { return isEntryFailing; },
+			[isEntryFailing](uint32_t) { return !isEntryFailing; });
+		result.NumFailed += recorder.Record(&sink) || !sink.GetSubmitted().empty() ? 1 : 0;
+	}
+	result.PeakConcurrency = peakConcurrency;
+
+	// Recording concurrency: full frames of equally costly segments, recorded serially, and on
+	// the job system
+	const auto numTimedFrames = (max)(desc.NumTimedFrames, 1u);
+	recorder.Reset();
+	for (auto i = 0u; i < maxSegments; ++i)
+		recorder.AddSegment("Timed", [&desc, &sink](uint32_t segment)
+		{
+			spin(desc.RecordTime);
+			sink.Record(segment, segment);
+
+			return true;
+		});
+
+	for (const auto& isParallel : { false, true })
+	{
+		const auto startTime = chrono::steady_clock::now();
+		for (auto i = 0u; i < numTimedFrames; ++i)
+		{
+			sink.Reset();
+			result.NumFailed += recorder.Record(&sink, isParallel) ? 0 : 1;
+		}
+		const auto time = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count() / numTimedFrames;
+		if (isParallel) result.ParallelTime = time;
+		else result.SerialTime = time;
+	}
+	result.NumFailed += sink.GetNumErrors() > 0 ? 1 : 0;
+
+	return result;
+}
@@ -0,0 +1,109 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "JobSystem.h"
+
+// Command lists of a frame, one per segment of the recording: Begin() resets and opens the
+// list of a segment, End() closes it, and Submit() executes the lists of the first segments
+// in segment order.
+class CommandSink
+{
+public:
+	virtual ~CommandSink() {}
+
+	virtual bool Begin(uint32_t segment) = 0;
+	virtual bool End(uint32_t segment) = 0;
+	virtual bool Submit(uint32_t numSegments) = 0;
+};
+
+// Records the segments of a frame into command lists of their own, concurrently on the job
+// system, and submits them in the order they were added, whichever finishes first. The
+// resource states tracked on the CPU are shared by the segments, so each segment has an entry,
+// recorded first into its list, serially and in segment order, which transitions the resources
+// other segments also use; its body, recorded concurrently with the other bodies, may only
+// transition the resources no other segment of the frame uses.
+class CommandRecorder
+{
+public:
+	using RecordFunc = std::function<bool(uint32_t segment)>;
+
+	struct EvaluationDesc
+	{
+		uint32_t NumFrames;
+		uint32_t MaxSegments;		// Per frame
+		uint32_t MaxCommands;		// Per segment body
+		uint32_t NumTimedFrames;	// Of the concurrency timing, at MaxSegments segments
+		double RecordTime;			// Of a timed segment body, in microseconds
+		uint32_t Seed;
+	};
+
+	struct EvaluationResult
+	{
+		uint32_t NumFrames;
+		uint32_t NumSegments;
+		uint32_t NumCommands;
+		uint32_t NumFailed;			// Frames submitting other than the serial recording, or recording
+									// entries out of order, or misusing the sink
+		uint32_t PeakConcurrency;	// Of the segment bodies recording at once
+		double SerialTime;			// Per timed frame, in milliseconds
+		double ParallelTime;
+	};
+
+	CommandRecorder();
+	virtual ~CommandRecorder();
+
+	void Reset();
+	uint32_t AddSegment(const char* name, const RecordFunc& body, const RecordFunc& entry = nullptr);
+	bool Record(CommandSink* pSink, bool isParallel = true);
+
+	uint32_t GetNumSegments() const;
+	const char* GetSegmentName(uint32_t segment) const;
+
+	static EvaluationResult Evaluate(const EvaluationDesc& desc);
+
+protected:
+	struct Segment
+	{
+		const char* Name;
+		RecordFunc Entry;
+		RecordFunc Body;
+	};
+
+	std::vector<Segment> m_segments;
+	std::vector<uint8_t> m_isRecorded;	// Of the bodies, written by their tasks
+};
+
+// Sink of integer commands per list, for validating the recorder without a GPU. Beginning an
+// open list, ending a closed one, recording into a closed one, and submitting open or missing
+// lists count as errors.
+class MockCommandSink :
+	public CommandSink
+{
+public:
+	MockCommandSink();
+	virtual ~MockCommandSink();
+
+	virtual bool Begin(uint32_t segment);
+	virtual bool End(uint32_t segment);
+	virtual bool Submit(uint32_t numSegments);
+
+	void Record(uint32_t segment, uint32_t command);	// From the recording thread of the segment
+	void Reset();
+
+	const std::vector<uint32_t>& GetSubmitted() const;	// Commands in execution order
+	uint32_t GetNumErrors() const;
+
+protected:
+	struct List
+	{
+		std::vector<uint32_t> Commands;
+		bool IsOpen;
+	};
+
+	std::vector<List>		m_lists;
+	std::vector<uint32_t>	m_submitted;
+	std::atomic<uint32_t>	m_numErrors;
+};
@@ -0,0 +1,255 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SharedConsts.h"
+#include "CubeMapCache.h"
+#include "VolumeCuller.h"
+#include <cfloat>
+
+using namespace std;
+using namespace DirectX;
+
+CubeMapCache::CubeMapCache() :
+	m_tolerance(0.5f),
+	m_maxTolerance(2.0f),
+	m_cubeMapSize(0),
+	m_maxRefreshFaces(UINT32_MAX),
+	m_lightMapVersion(0)
+{
+}
+
+CubeMapCache::~CubeMapCache()
+{
+}
+
+void CubeMapCache::Init(uint32_t numVolumes, uint32_t cubeMapSize)
+{
+	m_entries.assign(numVolumes, Entry());
+	for (auto& entry : m_entries) entry.ValidMask = 0;
+	m_candidates.clear();
+	m_candidates.reserve(numVolumes);
+	m_cubeMapSize = cubeMapSize;
+}
+
+void CubeMapCache::SetTolerance(float tolerance, float maxTolerance)
+{
+	m_tolerance = tolerance;
+	m_maxTolerance = (max)(maxTolerance, tolerance);
+}
+
+void CubeMapCache::SetMaxRefreshFaces(uint32_t maxRefreshFaces)
+{
+	m_maxRefreshFaces = maxRefreshFaces;
+}
+
+void CubeMapCache::SetLightMapVersion(uint32_t version)
+{
+	m_lightMapVersion = version;
+}
+
+void CubeMapCache::Invalidate(uint32_t i)
+{
+	m_entries[i].ValidMask = 0;
+}
+
+void CubeMapCache::InvalidateAll()
+{
+	for (auto& entry : m_entries) entry.ValidMask = 0;
+}
+
+uint32_t CubeMapCache::Update(const uint32_t* pVisibleVolumes, uint32_t numVisible, const XMFLOAT3X4* pWorlds,
+	const XMFLOAT3& eyePt, const VolumeInfo* pVolumeInfos, uint8_t* pRefreshMasks)
+{
+	const auto eye = XMLoadFloat3(&eyePt);
+	auto numRefreshed = 0u;
+	m_candidates.clear();
+
+	for (auto n = 0u; n < numVisible; ++n)
+	{
+		const auto i = pVisibleVolumes[n];
+		const auto& volumeInfo = pVolumeInfos[i];
+		auto& refreshMask = pRefreshMasks[i];
+		refreshMask = 0;
+
+		// Volumes rendered by direct ray marching have no cube map to reuse
+		if (!(volumeInfo.FaceMask & g_cubeMapRayMarchBit)) continue;
+
+		// Light-map updates and LOD changes invalidate all faces
+		auto& entry = m_entries[i];
+		if (entry.LightMapVersion != m_lightMapVersion || entry.MipLevel != volumeInfo.MipLevel)
+		{
+			entry.ValidMask = 0;
+			entry.LightMapVersion = m_lightMapVersion;
+			entry.MipLevel = volumeInfo.MipLevel;
+		}
+
+		const auto worldI = XMMatrixInverse(nullptr, XMLoadFloat3x4(&pWorlds[i]));
+		XMFLOAT3 localEyePt;
+		XMStoreFloat3(&localEyePt, XMVector3TransformCoord(eye, worldI));
+
+		const auto faceSize = (max)(m_cubeMapSize >> volumeInfo.MipLevel, 1u);
+		Candidate candidate = { i, 0, 0.0f, localEyePt };
+		for (uint8_t f = 0; f < 6; ++f)
+		{
+			const uint8_t faceBit = 1 << f;
+			if (!(volumeInfo.FaceMask & faceBit)) continue;
+
+			// Faces never marched or beyond the max tolerance must be re-marched now
+			auto& error = entry.Errors[f];
+			error = (entry.ValidMask & faceBit) ? EstimateFaceError(entry.LocalEyePts[f], localEyePt, f, faceSize) : FLT_MAX;
+			if (error > m_maxTolerance)
+			{
+				refreshMask |= faceBit;
+				entry.LocalEyePts[f] = localEyePt;
+				entry.ValidMask |= faceBit;
+				error = 0.0f;
+				++numRefreshed;
+			}
+			else if (error > m_tolerance && error > candidate.Error)
+			{
+				candidate.Face = f;
+				candidate.Error = error;
+			}
+		}
+
+		// Only the stalest face of each volume competes for the remaining budget
+		if (candidate.Error > 0.0f) m_candidates.push_back(candidate);
+	}
+
+	// Amortize the stale faces over the frames, stalest first
+	const auto numCandidates = static_cast<uint32_t>(m_candidates.size());
+	const auto numAmortized = m_maxRefreshFaces > numRefreshed ? (min)(m_maxRefreshFaces - numRefreshed, numCandidates) : 0;
+	partial_sort(m_candidates.begin(), m_candidates.begin() + numAmortized, m_candidates.end(),
+		[](const Candidate& a, const Candidate& b) { return a.Error > b.Error; });
+
+	for (auto n = 0u; n < numAmortized; ++n)
+	{
+		const auto& candidate = m_candidates[n];
+		auto& entry = m_entries[candidate.VolumeId];
+		pRefreshMasks[candidate.VolumeId] |= 1 << candidate.Face;
+		entry.LocalEyePts[candidate.Face] = candidate.LocalEyePt;
+		entry.Errors[candidate.Face] = 0.0f;
+	}
+
+	return numRefreshed + numAmortized;
+}
+
+uint32_t CubeMapCache::GetNumVolumes() const
+{
+	return static_cast<uint32_t>(m_entries.size());
+}
+
+float CubeMapCache::GetFaceError(uint32_t i, uint8_t face) const
+{
+	return m_entries[i].Errors[face];
+}
+
+float CubeMapCache::EstimateFaceError(const XMFLOAT3& cachedLocalEyePt,
+	const XMFLOAT3& localEyePt, uint8_t face, uint32_t faceSize)
+{
+	// Sample the face center and corners of the unit cube
+	const auto axis = face >> 1;
+	const auto side = (face & 0x1) ? -1.0f : 1.0f;
+	static const float offsets[][2] = { { 0.0f, 0.0f }, { -1.0f, -1.0f }, { 1.0f, -1.0f }, { -1.0f, 1.0f }, { 1.0f, 1.0f } };
+
+	const auto e0 = XMLoadFloat3(&cachedLocalEyePt);
+	const auto e1 = XMLoadFloat3(&localEyePt);
+	auto maxAngle = 0.0f;
+	for (const auto& offset : offsets)
+	{
+		float p[3];
+		p[axis] = side;
+		p[(axis + 1) % 3] = offset[0];
+		p[(axis + 2) % 3] = offset[1];
+		const auto pt = XMVectorSet(p[0], p[1], p[2], 0.0f);
+
+		const auto angle = XMVectorGetX(XMVector3AngleBetweenVectors(XMVectorSubtract(pt, e0), XMVectorSubtract(pt, e1)));
+		maxAngle = (max)(maxAngle, angle);
+	}
+
+	// A ray through a texel turned by the angle drifts by up to the cube depth of 2 at
+	// its exit, while a texel spans 2 / faceSize on the face
+	return maxAngle * faceSize;
+}
+
+CubeMapCache::EvaluationResult CubeMapCache::Evaluate(const EvaluationDesc& desc)
+{
+	EvaluationResult result = {};
+
+	const auto maxSamples = 256u;
+	const auto cubeMapSize = 128u;
+	const XMFLOAT2 viewport(1280.0f, 720.0f);
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, viewport.x / viewport.y, g_zNear, g_zFar);
+
+	// Scene as laid out by MultiRayCaster::SetVolumesWorld()
+	VolumeCuller culler;
+	culler.Init(desc.NumVolumes);
+	vector<XMFLOAT3X4> worlds(desc.NumVolumes);
+	const auto size = 20.0f;
+	const auto rowLength = static_cast<uint32_t>(ceilf(sqrtf(static_cast<float>(desc.NumVolumes))));
+	for (auto i = 0u; i < desc.NumVolumes; ++i)
+	{
+		const auto x = (static_cast<float>(i % rowLength) - (rowLength - 1) / 2.0f) * size * 1.5f;
+		const auto z = (static_cast<float>(i / rowLength) - (rowLength - 1) / 2.0f) * size * 1.5f;
+		XMStoreFloat3x4(&worlds[i], XMMatrixScaling(size * 0.5f, size * 0.5f, size * 0.5f) * XMMatrixTranslation(x, 0.0f, z));
+
+		VolumeDesc volumeDesc;
+		volumeDesc.VolTexId = i;
+		volumeDesc.NumMips = NUM_CUBE_MIP;
+		volumeDesc.CubeMapSize = cubeMapSize;
+		culler.SetVolume(i, worlds[i], volumeDesc);
+	}
+
+	CubeMapCache cache;
+	cache.Init(desc.NumVolumes, cubeMapSize);
+	cache.SetTolerance(desc.Tolerance, desc.MaxTolerance);
+	cache.SetMaxRefreshFaces(desc.MaxRefreshFaces);
+
+	vector<uint8_t> refreshMasks(desc.NumVolumes);
+	const auto radius = rowLength * size * 1.5f + 60.0f;
+	auto errorSum = 0.0;
+	for (auto f = 0u; f < desc.NumFrames; ++f)
+	{
+		if (desc.LightInterval > 0 && f % desc.LightInterval == 0) cache.SetLightMapVersion(f / desc.LightInterval);
+
+		const auto angle = XM_2PI * f / (max)(desc.OrbitFrames, 1u);
+		const auto eye = XMVectorSet(sinf(angle) * radius, 16.0f, -cosf(angle) * radius, 1.0f);
+		const auto view = XMMatrixLookAtLH(eye, XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		XMFLOAT3 eyePt;
+		XMStoreFloat3(&eyePt, eye);
+
+		culler.Cull(view * proj, eyePt, viewport, maxSamples);
+		const auto& visibleVolumes = culler.GetVisibleVolumes();
+		const auto pVolumeInfos = culler.GetVolumeInfos();
+		const auto numRefreshed = cache.Update(visibleVolumes.data(), static_cast<uint32_t>(visibleVolumes.size()),
+			worlds.data(), eyePt, pVolumeInfos, refreshMasks.data());
+
+		// The error of the faces that are displayed without re-marching
+		for (const auto& i : visibleVolumes)
+		{
+			const auto& volumeInfo = pVolumeInfos[i];
+			if (!(volumeInfo.FaceMask & g_cubeMapRayMarchBit)) continue;
+
+			for (uint8_t face = 0; face < 6; ++face)
+			{
+				if (!(volumeInfo.FaceMask & (1 << face))) continue;
+				++result.NumVisibleFaces;
+				if (refreshMasks[i] & (1 << face)) continue;
+
+				const auto error = cache.GetFaceError(i, face);
+				errorSum += error;
+				result.MaxError = (max)(result.MaxError, error);
+			}
+		}
+
+		result.NumRefreshedFaces += numRefreshed;
+		result.PeakRefreshedFaces = (max)(result.PeakRefreshedFaces, numRefreshed);
+	}
+
+	const auto numReused = result.NumVisibleFaces - result.NumRefreshedFaces;
+	result.ReuseRatio = result.NumVisibleFaces > 0 ? static_cast<float>(numReused) / result.NumVisibleFaces : 0.0f;
+	result.MeanError = numReused > 0 ? static_cast<float>(errorSum / numReused) : 0.0f;
+
+	return result;
+}
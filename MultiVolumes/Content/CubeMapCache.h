@@ -0,0 +1,88 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VolumeTypes.h"
+
+// Decides per volume and per face whether the radiance cube map marched in an earlier
+// frame is still valid. Faces are keyed on the local-space eye position they were marched
+// from and on the light-map version, and only faces beyond the error tolerance are
+// re-marched, at most one stale face per volume and frame unless the error is too large.
+// By default, faces whose view rays turned by more than 2 texels are re-marched, and the
+// stalest face of each volume beyond 0.5 texels is refreshed.
+class CubeMapCache
+{
+public:
+	struct EvaluationDesc
+	{
+		uint32_t NumVolumes;
+		uint32_t NumFrames;
+		uint32_t OrbitFrames;		// Frames per full camera orbit
+		uint32_t LightInterval;		// Frames between light-map updates, 0 for a static light
+		float Tolerance;			// In texels
+		float MaxTolerance;			// In texels
+		uint32_t MaxRefreshFaces;	// Per frame
+	};
+
+	struct EvaluationResult
+	{
+		uint64_t NumVisibleFaces;	// Visible cube-map faces summed over all frames
+		uint64_t NumRefreshedFaces;	// Re-marched faces summed over all frames
+		uint32_t PeakRefreshedFaces;
+		float ReuseRatio;			// Ratio of the visible faces that were reused
+		float MeanError;			// Mean texel error of the reused faces
+		float MaxError;				// Max texel error of the reused faces
+	};
+
+	CubeMapCache();
+	virtual ~CubeMapCache();
+
+	void Init(uint32_t numVolumes, uint32_t cubeMapSize);
+	void SetTolerance(float tolerance, float maxTolerance);
+	void SetMaxRefreshFaces(uint32_t maxRefreshFaces);
+	void SetLightMapVersion(uint32_t version);
+	void Invalidate(uint32_t i);
+	void InvalidateAll();
+
+	// Writes a mask of the faces to re-march per visible volume, and returns the face count
+	uint32_t Update(const uint32_t* pVisibleVolumes, uint32_t numVisible, const DirectX::XMFLOAT3X4* pWorlds,
+		const DirectX::XMFLOAT3& eyePt, const VolumeInfo* pVolumeInfos, uint8_t* pRefreshMasks);
+
+	uint32_t GetNumVolumes() const;
+	float GetFaceError(uint32_t i, uint8_t face) const;	// In texels as of the last update, 0 if refreshed
+
+	// Angular change of the view rays through a face in texels
+	static float EstimateFaceError(const DirectX::XMFLOAT3& cachedLocalEyePt,
+		const DirectX::XMFLOAT3& localEyePt, uint8_t face, uint32_t faceSize);
+
+	static EvaluationResult Evaluate(const EvaluationDesc& desc);
+
+protected:
+	struct Entry
+	{
+		DirectX::XMFLOAT3 LocalEyePts[6];	// Per face, as of its last march
+		float Errors[6];
+		uint32_t LightMapVersion;
+		uint16_t MipLevel;
+		uint8_t ValidMask;
+	};
+
+	struct Candidate
+	{
+		uint32_t VolumeId;
+		uint8_t Face;
+		float Error;
+		DirectX::XMFLOAT3 LocalEyePt;
+	};
+
+	std::vector<Entry>		m_entries;
+	std::vector<Candidate>	m_candidates;
+
+	float		m_tolerance;
+	float		m_maxTolerance;
+	uint32_t	m_cubeMapSize;
+	uint32_t	m_maxRefreshFaces;
+	uint32_t	m_lightMapVersion;
+};
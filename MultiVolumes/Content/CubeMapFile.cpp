@@ -0,0 +1,296 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CubeMapFile.h"
+#include <cfloat>
+#include <DirectXPackedVector.h>
+
+using namespace std;
+using namespace DirectX;
+
+enum TexelFormat : uint8_t
+{
+	TEXEL_UNKNOWN,
+	TEXEL_RGBA32F,
+	TEXEL_RGB32F,
+	TEXEL_RGBA16F,
+	TEXEL_R11G11B10F,
+	TEXEL_RGB9E5,
+	TEXEL_RGB10A2,
+	TEXEL_RGBA8,
+	TEXEL_RGBA8_SRGB,
+	TEXEL_BGRA8,
+	TEXEL_BGRA8_SRGB,
+
+	NUM_TEXEL_FORMAT
+};
+
+static const uint8_t g_texelSizes[NUM_TEXEL_FORMAT] = { 0, 16, 12, 8, 4, 4, 4, 4, 4, 4, 4 };
+
+static const uint32_t g_hashTag = 0x48535243;	// "CRSH", marks the source hash in dwReserved1
+
+//--------------------------------------------------------------------------------------
+// Texel decoding
+//--------------------------------------------------------------------------------------
+static float halfToFloat(uint16_t half)
+{
+	const auto exp = static_cast<int32_t>((half >> 10) & 0x1f);
+	const auto mant = static_cast<float>(half & 0x3ff) / 1024.0f;
+	const auto value = exp == 31 ? FLT_MAX : (exp > 0 ? ldexpf(1.0f + mant, exp - 15) : ldexpf(mant, -14));
+
+	return (half & 0x8000) ? -value : value;
+}
+
+static float unpackUFloat(uint32_t bits, uint32_t mantBits)
+{
+	const auto exp = static_cast<int32_t>(bits >> mantBits);
+	const auto mant = static_cast<float>(bits & ((1u << mantBits) - 1)) / (1u << mantBits);
+
+	return exp > 0 ? ldexpf(1.0f + mant, exp - 15) : ldexpf(mant, -14);
+}
+
+static float srgbToLinear(uint8_t value)
+{
+	const auto c = value / 255.0f;
+
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static XMFLOAT4 decodeTexel(const uint8_t* pTexel, TexelFormat format)
+{
+	uint32_t packed;
+	memcpy(&packed, pTexel, sizeof(uint32_t));
+
+	switch (format)
+	{
+	case TEXEL_RGBA32F:
+	{
+		XMFLOAT4 texel;
+		memcpy(&texel, pTexel, sizeof(XMFLOAT4));
+		return texel;
+	}
+	case TEXEL_RGB32F:
+	{
+		XMFLOAT4 texel(0.0f, 0.0f, 0.0f, 1.0f);
+		memcpy(&texel, pTexel, sizeof(XMFLOAT3));
+		return texel;
+	}
+	case TEXEL_RGBA16F:
+	{
+		uint16_t halves[4];
+		memcpy(halves, pTexel, sizeof(halves));
+		return XMFLOAT4(halfToFloat(halves[0]), halfToFloat(halves[1]), halfToFloat(halves[2]), halfToFloat(halves[3]));
+	}
+	case TEXEL_R11G11B10F:
+		return XMFLOAT4(unpackUFloat(packed & 0x7ff, 6), unpackUFloat((packed >> 11) & 0x7ff, 6),
+			unpackUFloat(packed >> 22, 5), 1.0f);
+	case TEXEL_RGB9E5:
+	{
+		const auto scale = ldexpf(1.0f, static_cast<int32_t>(packed >> 27) - 15 - 9);
+		return XMFLOAT4((packed & 0x1ff) * scale, ((packed >> 9) & 0x1ff) * scale, ((packed >> 18) & 0x1ff) * scale, 1.0f);
+	}
+	case TEXEL_RGB10A2:
+		return XMFLOAT4((packed & 0x3ff) / 1023.0f, ((packed >> 10) & 0x3ff) / 1023.0f,
+			((packed >> 20) & 0x3ff) / 1023.0f, (packed >> 30) / 3.0f);
+	case TEXEL_RGBA8:
+		return XMFLOAT4(pTexel[0] / 255.0f, pTexel[1] / 255.0f, pTexel[2] / 255.0f, pTexel[3] / 255.0f);
+	case TEXEL_RGBA8_SRGB:
+		return XMFLOAT4(srgbToLinear(pTexel[0]), srgbToLinear(pTexel[1]), srgbToLinear(pTexel[2]), pTexel[3] / 255.0f);
+	case TEXEL_BGRA8:
+		return XMFLOAT4(pTexel[2] / 255.0f, pTexel[1] / 255.0f, pTexel[0] / 255.0f, pTexel[3] / 255.0f);
+	case TEXEL_BGRA8_SRGB:
+		return XMFLOAT4(srgbToLinear(pTexel[2]), srgbToLinear(pTexel[1]), srgbToLinear(pTexel[0]), pTexel[3] / 255.0f);
+	default:
+		return XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+	}
+}
+
+bool CubeMapFile::ReadFile(const wstring& fileName, vector<uint8_t>& data)
+{
+	string name(fileName.size(), '\0');
+	for (size_t i = 0; i < name.size(); ++i) name[i] = static_cast<char>(fileName[i]);
+
+	ifstream file(name, ios::binary | ios::ate);
+	if (!file) return false;
+
+	data.resize(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(data.data()), data.size());
+
+	return static_cast<bool>(file);
+}
+
+bool CubeMapFile::Decode(const uint8_t* pData, size_t dataSize, uint32_t maxSize, vector<XMFLOAT4>& texels, uint32_t& size)
+{
+	uint32_t magic, header[31];
+	if (dataSize < sizeof(magic) + sizeof(header)) return false;
+	memcpy(&magic, pData, sizeof(magic));
+	memcpy(header, pData + sizeof(magic), sizeof(header));
+	if (magic != 0x20534444) return false;	// "DDS "
+
+	auto offset = sizeof(magic) + sizeof(header);
+	const auto pfFlags = header[19], fourCC = header[20], bitCount = header[21], redMask = header[22];
+	auto isCube = (header[27] & 0x200) != 0;	// DDSCAPS2_CUBEMAP
+	auto format = TEXEL_UNKNOWN;
+	if (fourCC == 0x30315844)	// "DX10"
+	{
+		uint32_t headerDX10[5];
+		if (dataSize < offset + sizeof(headerDX10)) return false;
+		memcpy(headerDX10, pData + offset, sizeof(headerDX10));
+		offset += sizeof(headerDX10);
+
+		isCube = (headerDX10[2] & 0x4) != 0;	// RESOURCE_MISC_TEXTURECUBE
+		switch (headerDX10[0])
+		{
+		case 2: format = TEXEL_RGBA32F; break;
+		case 6: format = TEXEL_RGB32F; break;
+		case 10: format = TEXEL_RGBA16F; break;
+		case 24: format = TEXEL_RGB10A2; break;
+		case 26: format = TEXEL_R11G11B10F; break;
+		case 28: format = TEXEL_RGBA8; break;
+		case 29: format = TEXEL_RGBA8_SRGB; break;
+		case 67: format = TEXEL_RGB9E5; break;
+		case 87: format = TEXEL_BGRA8; break;
+		case 91: format = TEXEL_BGRA8_SRGB; break;
+		}
+	}
+	else if (fourCC == 116) format = TEXEL_RGBA32F;	// D3DFMT_A32B32G32R32F
+	else if (fourCC == 113) format = TEXEL_RGBA16F;	// D3DFMT_A16B16G16R16F
+	else if ((pfFlags & 0x40) && bitCount == 32)	// DDPF_RGB
+		format = redMask == 0xff ? TEXEL_RGBA8 : (redMask == 0xff0000 ? TEXEL_BGRA8 : TEXEL_UNKNOWN);
+	if (format == TEXEL_UNKNOWN || !isCube) return false;
+
+	const auto faceSize = header[3];
+	const auto numMips = (header[1] & 0x20000) ? (max)(header[6], 1u) : 1u;	// DDSD_MIPMAPCOUNT
+	if (faceSize == 0 || header[2] != faceSize) return false;
+
+	// Pick the mip level, and the box filter down from it
+	auto level = 0u;
+	while (level + 1 < numMips && (faceSize >> level) > maxSize) ++level;
+	const auto levelSize = (max)(faceSize >> level, 1u);
+	auto factor = 1u;
+	while (levelSize / factor > maxSize && levelSize / factor > 1) factor *= 2;
+	size = levelSize / factor;
+
+	size_t levelOffset = 0, faceStride = 0;
+	for (auto i = 0u; i < numMips; ++i)
+	{
+		const auto mipSize = static_cast<size_t>((max)(faceSize >> i, 1u));
+		if (i < level) levelOffset += mipSize * mipSize * g_texelSizes[format];
+		faceStride += mipSize * mipSize * g_texelSizes[format];
+	}
+	if (dataSize < offset + faceStride * FaceCount) return false;
+
+	texels.resize(FaceCount * size * size);
+	const auto weight = 1.0f / (factor * factor);
+	for (uint8_t face = 0; face < FaceCount; ++face)
+	{
+		const auto pLevel = pData + offset + faceStride * face + levelOffset;
+		for (auto y = 0u; y < size; ++y)
+		{
+			for (auto x = 0u; x < size; ++x)
+			{
+				auto sum = XMVectorZero();
+				for (auto j = 0u; j < factor; ++j)
+				{
+					for (auto i = 0u; i < factor; ++i)
+					{
+						const auto idx = static_cast<size_t>(levelSize) * (factor * y + j) + factor * x + i;
+						const auto texel = decodeTexel(&pLevel[idx * g_texelSizes[format]], format);
+						sum += XMLoadFloat4(&texel);
+					}
+				}
+				XMStoreFloat4(&texels[size * (size * face + y) + x], sum * weight);
+			}
+		}
+	}
+
+	return true;
+}
+
+bool CubeMapFile::Load(const wstring& fileName, uint32_t maxSize, vector<XMFLOAT4>& texels, uint32_t& size)
+{
+	vector<uint8_t> data;
+	if (!ReadFile(fileName, data)) return false;
+
+	return Decode(data.data(), data.size(), maxSize, texels, size);
+}
+
+bool CubeMapFile::Save(const wstring& fileName, const vector<vector<XMFLOAT4>>& mips, uint32_t size, uint64_t sourceHash)
+{
+	if (mips.empty() || size == 0) return false;
+
+	string name(fileName.size(), '\0');
+	for (size_t i = 0; i < name.size(); ++i) name[i] = static_cast<char>(fileName[i]);
+
+	ofstream file(name, ios::binary);
+	if (!file) return false;
+
+	// DDS_HEADER and DDS_HEADER_DXT10 of a DXGI_FORMAT_R16G16B16A16_FLOAT cube
+	const auto numMips = static_cast<uint32_t>(mips.size());
+	uint32_t header[31] = {};
+	header[0] = sizeof(header);
+	header[1] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x8 | 0x20000;	// CAPS, HEIGHT, WIDTH, PIXELFORMAT, PITCH, MIPMAPCOUNT
+	header[2] = size;
+	header[3] = size;
+	header[4] = size * 8;
+	header[6] = numMips;
+	header[7] = g_hashTag;
+	header[8] = static_cast<uint32_t>(sourceHash);
+	header[9] = static_cast<uint32_t>(sourceHash >> 32);
+	header[18] = 32;				// DDS_PIXELFORMAT size
+	header[19] = 0x4;				// DDPF_FOURCC
+	header[20] = 0x30315844;		// "DX10"
+	header[26] = 0x1000 | 0x8 | 0x400000;	// TEXTURE, COMPLEX, MIPMAP
+	header[27] = 0x200 | 0xfc00;	// CUBEMAP and all faces
+	const uint32_t headerDX10[5] = { 10, 3, 0x4, 1, 0 };	// TEXTURE2D, TEXTURECUBE, array size 1
+
+	const uint32_t magic = 0x20534444;	// "DDS "
+	file.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(headerDX10), sizeof(headerDX10));
+
+	// Faces are stored one after another, each with all its mip levels
+	vector<uint16_t> halves;
+	for (uint8_t face = 0; face < FaceCount; ++face)
+	{
+		for (auto level = 0u; level < numMips; ++level)
+		{
+			const auto mipSize = static_cast<size_t>((max)(size >> level, 1u));
+			const auto numTexels = mipSize * mipSize;
+			if (mips[level].size() < numTexels * FaceCount) return false;
+
+			halves.resize(numTexels * 4);
+			const auto pSrc = &mips[level][numTexels * face];
+			for (size_t i = 0; i < numTexels; ++i)
+			{
+				halves[4 * i] = PackedVector::XMConvertFloatToHalf(pSrc[i].x);
+				halves[4 * i + 1] = PackedVector::XMConvertFloatToHalf(pSrc[i].y);
+				halves[4 * i + 2] = PackedVector::XMConvertFloatToHalf(pSrc[i].z);
+				halves[4 * i + 3] = PackedVector::XMConvertFloatToHalf(pSrc[i].w);
+			}
+			file.write(reinterpret_cast<const char*>(halves.data()), sizeof(uint16_t) * halves.size());
+		}
+	}
+
+	return static_cast<bool>(file);
+}
+
+bool CubeMapFile::ReadSourceHash(const wstring& fileName, uint64_t& sourceHash)
+{
+	string name(fileName.size(), '\0');
+	for (size_t i = 0; i < name.size(); ++i) name[i] = static_cast<char>(fileName[i]);
+
+	ifstream file(name, ios::binary);
+	if (!file) return false;
+
+	uint32_t magic, header[31];
+	file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!file || magic != 0x20534444 || header[7] != g_hashTag) return false;
+
+	sourceHash = static_cast<uint64_t>(header[9]) << 32 | header[8];
+
+	return true;
+}
@@ -0,0 +1,30 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// DDS cube maps on the CPU, decoded to linear RGBA32F faces in the D3D face order
+// (+X, -X, +Y, -Y, +Z, -Z). Uncompressed float, shared-exponent and 8-bit formats are
+// supported, as used for radiance probes; block-compressed files are rejected. Mip chains
+// are written as RGBA16F.
+class CubeMapFile
+{
+public:
+	static bool ReadFile(const std::wstring& fileName, std::vector<uint8_t>& data);
+
+	// Decodes the largest mip level no larger than maxSize. If the file holds no such
+	// level, the smallest larger one is box-filtered down to it.
+	static bool Decode(const uint8_t* pData, size_t dataSize, uint32_t maxSize,
+		std::vector<DirectX::XMFLOAT4>& texels, uint32_t& size);
+	static bool Load(const std::wstring& fileName, uint32_t maxSize,
+		std::vector<DirectX::XMFLOAT4>& texels, uint32_t& size);
+
+	// Each mip level holds the 6 faces in order, halving the size down to the last level.
+	// The source hash is kept in the reserved header words, e.g. to validate caches.
+	static bool Save(const std::wstring& fileName, const std::vector<std::vector<DirectX::XMFLOAT4>>& mips,
+		uint32_t size, uint64_t sourceHash = 0);
+	static bool ReadSourceHash(const std::wstring& fileName, uint64_t& sourceHash);
+
+	static const uint8_t FaceCount = 6;
+};
@@ -0,0 +1,186 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "FrameAllocator.h"
+#include <chrono>
+#include <random>
+
+using namespace std;
+
+//--------------------------------------------------------------------------------------
+// Frame allocator
+//--------------------------------------------------------------------------------------
+FrameAllocator::FrameAllocator() :
+	m_pData(nullptr),
+	m_frameNumber(0),
+	m_frameCount(1)
+{
+}
+
+FrameAllocator::~FrameAllocator()
+{
+}
+
+void FrameAllocator::Init(uint8_t frameCount, uint64_t capacity, void* pData)
+{
+	m_allocator.Init(capacity);
+	m_pData = static_cast<uint8_t*>(pData);
+	m_frameNumber = 0;
+	m_frameCount = frameCount;
+}
+
+void FrameAllocator::BeginFrame()
+{
+	// Close the previous frame under its number, and recycle the frames the GPU has finished
+	m_allocator.Submit(m_frameNumber++);
+	if (m_frameNumber >= m_frameCount) m_allocator.Reclaim(m_frameNumber - m_frameCount);
+}
+
+void* FrameAllocator::Allocate(uint64_t size, uint64_t alignment, uint64_t& offset)
+{
+	return m_pData && m_allocator.Allocate(size, alignment, offset) ? &m_pData[offset] : nullptr;
+}
+
+bool FrameAllocator::Write(const void* pData, uint64_t size, uint64_t alignment, uint64_t& offset)
+{
+	const auto pDst = Allocate(size, alignment, offset);
+	if (!pDst) return false;
+
+	memcpy(pDst, pData, size);
+
+	return true;
+}
+
+uint64_t FrameAllocator::GetCapacity() const
+{
+	return m_allocator.GetCapacity();
+}
+
+uint64_t FrameAllocator::GetUsedBytes() const
+{
+	return m_allocator.GetUsedBytes();
+}
+
+uint64_t FrameAllocator::GetPeakBytes() const
+{
+	return m_allocator.GetPeakBytes();
+}
+
+uint64_t FrameAllocator::GetFrameNumber() const
+{
+	return m_frameNumber;
+}
+
+//--------------------------------------------------------------------------------------
+// Evaluation
+//--------------------------------------------------------------------------------------
+FrameAllocator::EvaluationResult FrameAllocator::Evaluate(const EvaluationDesc& desc)
+{
+	EvaluationResult result = {};
+
+	// Allocations of the frames in flight, filled with a pattern that must survive until retired
+	struct Range
+	{
+		uint64_t Offset;
+		uint64_t Size;
+		uint64_t FrameNumber;
+		uint8_t Pattern;
+	};
+
+	// Vertex and structured data, and constant buffers
+	static const uint64_t alignments[] = { 4, 16, ConstantAlignment };
+	const uint8_t frameCount = 3;
+
+	mt19937 rng(desc.Seed);
+	vector<uint8_t> arena(desc.Capacity), data;
+	FrameAllocator allocator;
+	allocator.Init(frameCount, desc.Capacity, arena.data());
+	vector<Range> ranges;
+
+	const auto retire = [&]()
+	{
+		const auto frameNumber = allocator.GetFrameNumber();
+		const auto isRetired = [frameNumber, frameCount](const Range& range)
+		{ return range.FrameNumber + frameCount <= frameNumber; };
+
+		for (const auto& range : ranges)
+		{
+			if (isRetired(range) && any_of(&arena[range.Offset], &arena[range.Offset] + range.Size,
+				[&range](uint8_t value) { return value != range.Pattern; })) ++result.NumFailed;
+		}
+		ranges.erase(remove_if(ranges.begin(), ranges.end(), isRetired), ranges.end());
+	};
+
+	const uint64_t one = 1;
+	const auto maxSize = (max)((min)(desc.MaxSize, desc.Capacity), one);
+	for (auto i = 0u; i < desc.NumFrames; ++i)
+	{
+		allocator.BeginFrame();
+		retire();
+		++result.NumFrames;
+
+		const auto numAllocations = rng() % (desc.MaxAllocations + 1);
+		for (auto j = 0u; j < numAllocations; ++j)
+		{
+			const auto numBytes = 1 + rng() % maxSize;
+			const auto alignment = alignments[rng() % size(alignments)];
+			const auto pattern = static_cast<uint8_t>(1 + rng() % 255);
+			data.assign(numBytes, pattern);
+
+			const auto freeBytes = desc.Capacity - allocator.GetUsedBytes();
+			++result.NumAllocations;
+
+			uint64_t offset;
+			if (!allocator.Write(data.data(), numBytes, alignment, offset))
+			{
+				// The free bytes are split in at most 2 runs, around the frames in flight
+				++result.NumOverflows;
+				result.NumFailed += freeBytes >= 2 * (numBytes + alignment) ? 1 : 0;
+				continue;
+			}
+
+			if (offset % alignment || offset + numBytes > desc.Capacity) ++result.NumFailed;
+			else ranges.push_back({ offset, numBytes, allocator.GetFrameNumber(), pattern });
+		}
+	}
+
+	// Frame wrap: as many empty frames as in flight retire all the allocations
+	for (uint8_t i = 0; i < frameCount; ++i)
+	{
+		allocator.BeginFrame();
+		retire();
+	}
+	result.NumFailed += allocator.GetUsedBytes() > 0 || !ranges.empty() ? 1 : 0;
+	result.PeakBytes = allocator.GetPeakBytes();
+
+	// Overflow: past the arena, and of a full arena until its frame retires
+	uint64_t offset;
+	result.NumFailed += allocator.Allocate(desc.Capacity + 1, 1, offset) ? 1 : 0;
+	result.NumFailed += allocator.Allocate(desc.Capacity, 1, offset) && offset == 0 ? 0 : 1;
+	result.NumFailed += allocator.Allocate(1, 1, offset) ? 1 : 0;
+	for (uint8_t i = 1; i < frameCount; ++i)
+	{
+		allocator.BeginFrame();
+		result.NumFailed += allocator.Allocate(1, 1, offset) ? 1 : 0;
+	}
+	allocator.BeginFrame();
+	result.NumFailed += allocator.Allocate(1, 1, offset) ? 0 : 1;
+
+	// Steady state of the renderers: a few constant buffers composed on the CPU per frame
+	const auto numFrames = (max)(desc.NumFrames, 1u);
+	const uint8_t numConstantBuffers = 8;
+	data.assign(ConstantAlignment, 0);
+	allocator.Init(frameCount, desc.Capacity, arena.data());
+	const auto startTime = chrono::steady_clock::now();
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		allocator.BeginFrame();
+		for (uint8_t j = 0; j < numConstantBuffers; ++j)
+			result.NumFailed += allocator.Write(data.data(), ConstantAlignment, ConstantAlignment, offset) ? 0 : 1;
+	}
+	result.AllocateTime = chrono::duration<double, nano>(chrono::steady_clock::now() - startTime).count() /
+		(numFrames * numConstantBuffers);
+
+	return result;
+}
@@ -0,0 +1,60 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "RingAllocator.h"
+
+// Per-frame bump allocator over a persistently mapped arena shared by the renderers. The
+// allocations of a frame are bumped from where the previous frame ended, and BeginFrame()
+// retires the frame recorded FrameCount frames ago, whose GPU work the swap chain has already
+// waited on, so a frame only takes the memory it uses instead of a fixed slice per frame.
+// Write() copies data composed on the CPU in one go, as the arena is write-combined memory
+// that should neither be read back nor written field by field.
+class FrameAllocator
+{
+public:
+	struct EvaluationDesc
+	{
+		uint32_t NumFrames;
+		uint64_t Capacity;
+		uint32_t MaxAllocations;	// Per frame
+		uint64_t MaxSize;			// Of an allocation
+		uint32_t Seed;
+	};
+
+	struct EvaluationResult
+	{
+		uint32_t NumFrames;
+		uint32_t NumAllocations;
+		uint32_t NumFailed;			// Misaligned, out of the arena, overwritten before retiring, or
+									// overflowing with enough room, or failing the fixed cases
+		uint32_t NumOverflows;		// Rejected for a full arena
+		uint64_t PeakBytes;			// Of the arena
+		double AllocateTime;		// Per constant buffer, in nanoseconds
+	};
+
+	FrameAllocator();
+	virtual ~FrameAllocator();
+
+	void Init(uint8_t frameCount, uint64_t capacity, void* pData);
+	void BeginFrame();
+	void* Allocate(uint64_t size, uint64_t alignment, uint64_t& offset);
+	bool Write(const void* pData, uint64_t size, uint64_t alignment, uint64_t& offset);
+
+	uint64_t GetCapacity() const;
+	uint64_t GetUsedBytes() const;	// By the frames in flight
+	uint64_t GetPeakBytes() const;
+	uint64_t GetFrameNumber() const;
+
+	static EvaluationResult Evaluate(const EvaluationDesc& desc);
+
+	static const uint64_t ConstantAlignment = 256;
+
+protected:
+	RingAllocator	m_allocator;
+	uint8_t*		m_pData;
+	uint64_t		m_frameNumber;
+	uint8_t			m_frameCount;
+};
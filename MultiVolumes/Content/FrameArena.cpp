@@ -0,0 +1,93 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "FrameArena.h"
+#include "MemoryBudget.h"
+#include <cassert>
+
+using namespace std;
+using namespace XUSG;
+
+FrameArena::FrameArena() :
+	m_pData(nullptr),
+	m_hasOverflowed(false),
+	m_isClosed(false)
+{
+}
+
+FrameArena::~FrameArena()
+{
+	if (m_pData) m_buffer->Unmap();
+}
+
+bool FrameArena::Init(const Device* pDevice, uint8_t frameCount, uint64_t capacity)
+{
+	m_buffer = Buffer::MakeUnique();
+	XUSG_N_RETURN(m_buffer->Create(pDevice, capacity, ResourceFlag::NONE, MemoryType::UPLOAD,
+		0, nullptr, 0, nullptr, MemoryFlag::NONE, L"FrameArena"), false);
+	MemoryBudget::Register("FrameArena", MemoryBudget::GetBufferSize(capacity), MemoryBudget::BUFFERS);
+
+	// Upload heaps stay mapped for their lifetime
+	m_pData = m_buffer->Map();
+	m_allocator.Init(frameCount, capacity, m_pData);
+
+	return m_pData != nullptr;
+}
+
+void FrameArena::BeginFrame()
+{
+	m_allocator.BeginFrame();
+	m_hasOverflowed = false;
+	m_isClosed = false;
+}
+
+void FrameArena::Close()
+{
+	m_isClosed = true;
+}
+
+void* FrameArena::Allocate(uint64_t size, uint64_t alignment, uint64_t& offset)
+{
+	assert(!m_isClosed && "FrameArena allocation while recording the command lists");
+	const auto pDst = m_allocator.Allocate(size, alignment, offset);
+	if (!pDst)
+	{
+		// The offset is left as it was, which may be of a recycled frame
+		stringstream ss;
+		ss << "FrameArena: " << size << " bytes overflow the " << m_allocator.GetCapacity() <<
+			"-byte arena with " << m_allocator.GetUsedBytes() << " bytes in flight" << endl;
+		OutputDebugStringA(ss.str().c_str());
+		assert(!"FrameArena overflow");
+		m_hasOverflowed = true;
+	}
+
+	return pDst;
+}
+
+bool FrameArena::WriteConstants(const void* pData, uint64_t size, uint64_t& offset)
+{
+	// CBVs span whole multiples of the placement alignment
+	const auto alignment = FrameAllocator::ConstantAlignment;
+	const auto pDst = Allocate((size + alignment - 1) / alignment * alignment, alignment, offset);
+	if (!pDst) return false;
+
+	memcpy(pDst, pData, size);
+
+	return true;
+}
+
+const Resource* FrameArena::GetResource() const
+{
+	return m_buffer.get();
+}
+
+uint64_t FrameArena::GetPeakBytes() const
+{
+	return m_allocator.GetPeakBytes();
+}
+
+bool FrameArena::HasOverflowed() const
+{
+	return m_hasOverflowed;
+}
@@ -0,0 +1,43 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Core/XUSG.h"
+#include "FrameAllocator.h"
+
+// Persistently mapped upload buffer, suballocated per frame by a FrameAllocator, from which the
+// renderers bind their constants as root CBVs at the returned offsets. MultiVolumes calls
+// BeginFrame() once per frame, before the renderers write their constants. An overflow is logged
+// and asserted, and HasOverflowed() stays true until the next BeginFrame(), so MultiVolumes fails
+// the frame rather than binding offsets of a frame that may already have been recycled.
+// The arena is not thread safe: Close() seals it while the command lists are recorded in
+// parallel, and allocating before the next BeginFrame() asserts.
+// MultiRayCaster keeps its per-frame constants and volume matrices in slots of its own per frame
+// in flight: the culling shader reads the matrices of every volume, and VolumeTransforms only
+// rewrites the slots of the volumes that changed since the slot was last written.
+class FrameArena
+{
+public:
+	FrameArena();
+	virtual ~FrameArena();
+
+	bool Init(const XUSG::Device* pDevice, uint8_t frameCount, uint64_t capacity);
+	void BeginFrame();
+	void Close();
+
+	void* Allocate(uint64_t size, uint64_t alignment, uint64_t& offset);
+	bool WriteConstants(const void* pData, uint64_t size, uint64_t& offset);
+
+	const XUSG::Resource* GetResource() const;
+	uint64_t GetPeakBytes() const;
+	bool HasOverflowed() const;
+
+protected:
+	FrameAllocator		m_allocator;
+	XUSG::Buffer::uptr	m_buffer;
+	void*				m_pData;
+	bool				m_hasOverflowed;
+	bool				m_isClosed;
+};
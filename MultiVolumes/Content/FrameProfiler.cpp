@@ -0,0 +1,303 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "FrameProfiler.h"
+#include "TraceRecorder.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+//--------------------------------------------------------------------------------------
+// Per-thread ring buffers, written by their threads and drained by the aggregator
+//--------------------------------------------------------------------------------------
+struct TimingSample
+{
+	float Time;
+	uint8_t Scope;
+};
+
+struct ThreadRing
+{
+	TimingSample Samples[FrameProfiler::RingSize];
+	atomic<uint32_t> Head;		// Written by the owner thread
+	atomic<uint32_t> Tail;		// Written by the aggregator
+	atomic<uint32_t> NumDropped;
+	atomic<bool> IsInUse;
+};
+
+struct RingHolder
+{
+	~RingHolder()
+	{
+		// Hand the ring to a later thread, with its samples still to be drained
+		if (pRing) pRing->IsInUse.store(false, memory_order_release);
+	}
+
+	ThreadRing* pRing;
+};
+
+struct ScopeWindow
+{
+	vector<float> Times;
+	uint64_t Count;
+};
+
+static const char* g_scopeNames[] =
+{
+	"RayMarchL",
+	"cullVolumes",
+	"rayMarchV",
+	"renderCube",
+	"resolveOIT",
+	"TemporalAA",
+	"ToneMap",
+	"Frame",
+	"RayMarchL.record",
+	"cullVolumes.record",
+	"rayMarchV.record",
+	"renderCube.record",
+	"resolveOIT.record",
+	"TemporalAA.record",
+	"ToneMap.record"
+};
+
+static atomic<bool> g_isEnabled(true);
+static mutex g_ringMutex;
+static vector<unique_ptr<ThreadRing>> g_rings;
+static thread_local RingHolder g_ringHolder = { nullptr };
+
+static mutex g_windowMutex;
+static ScopeWindow g_windows[FrameProfiler::NUM_SCOPE];
+static uint32_t g_windowSize = FrameProfiler::DefaultWindowSize;
+static uint64_t g_numDropped = 0;
+
+static ThreadRing* getThreadRing()
+{
+	if (g_ringHolder.pRing) return g_ringHolder.pRing;
+
+	// First sample of the thread: reuse the ring of an exited thread, or add one
+	lock_guard<mutex> lock(g_ringMutex);
+	for (auto& ring : g_rings)
+	{
+		auto isInUse = false;
+		if (ring->IsInUse.compare_exchange_strong(isInUse, true, memory_order_acquire))
+			return g_ringHolder.pRing = ring.get();
+	}
+
+	unique_ptr<ThreadRing> ring(new ThreadRing);
+	ring->Head.store(0, memory_order_relaxed);
+	ring->Tail.store(0, memory_order_relaxed);
+	ring->NumDropped.store(0, memory_order_relaxed);
+	ring->IsInUse.store(true, memory_order_relaxed);
+	g_rings.push_back(move(ring));
+
+	return g_ringHolder.pRing = g_rings.back().get();
+}
+
+static void resetWindows()
+{
+	for (auto& window : g_windows)
+	{
+		window.Times.clear();
+		window.Times.reserve(g_windowSize);
+		window.Count = 0;
+	}
+	g_numDropped = 0;
+}
+
+static float getPercentile(const vector<float>& sortedTimes, float percentile)
+{
+	// Nearest rank
+	const auto rank = static_cast<size_t>(ceilf(percentile / 100.0f * sortedTimes.size()));
+
+	return sortedTimes[(min)((max)(rank, static_cast<size_t>(1)), sortedTimes.size()) - 1];
+}
+
+//--------------------------------------------------------------------------------------
+// Scoped timer
+//--------------------------------------------------------------------------------------
+FrameProfiler::ScopedTimer::ScopedTimer(Scope scope) :
+	m_startTime(chrono::steady_clock::now()),
+	m_scope(scope)
+{
+	// The timed passes are also on the trace timeline
+	TRACE_BEGIN(GetScopeName(scope));
+}
+
+FrameProfiler::ScopedTimer::~ScopedTimer()
+{
+	TRACE_END(GetScopeName(m_scope));
+	Record(m_scope, chrono::duration<double, milli>(chrono::steady_clock::now() - m_startTime).count());
+}
+
+//--------------------------------------------------------------------------------------
+// Frame profiler
+//--------------------------------------------------------------------------------------
+void FrameProfiler::SetEnabled(bool enabled)
+{
+	g_isEnabled.store(enabled, memory_order_relaxed);
+}
+
+void FrameProfiler::SetWindowSize(uint32_t windowSize)
+{
+	lock_guard<mutex> lock(g_windowMutex);
+	g_windowSize = (max)(windowSize, 1u);
+	resetWindows();
+}
+
+void FrameProfiler::Record(Scope scope, double time)
+{
+	if (scope >= NUM_SCOPE || !g_isEnabled.load(memory_order_relaxed)) return;
+
+	// Drop the sample rather than wait for the aggregator if the ring is full
+	const auto pRing = getThreadRing();
+	const auto head = pRing->Head.load(memory_order_relaxed);
+	if (head - pRing->Tail.load(memory_order_acquire) >= RingSize)
+	{
+		pRing->NumDropped.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	auto& sample = pRing->Samples[head % RingSize];
+	sample.Time = static_cast<float>(time);
+	sample.Scope = scope;
+	pRing->Head.store(head + 1, memory_order_release);
+}
+
+void FrameProfiler::Aggregate()
+{
+	lock_guard<mutex> windowLock(g_windowMutex);
+	lock_guard<mutex> ringLock(g_ringMutex);
+
+	for (auto& ring : g_rings)
+	{
+		const auto head = ring->Head.load(memory_order_acquire);
+		auto tail = ring->Tail.load(memory_order_relaxed);
+		for (; tail != head; ++tail)
+		{
+			const auto& sample = ring->Samples[tail % RingSize];
+			auto& window = g_windows[sample.Scope];
+			if (window.Times.size() < g_windowSize) window.Times.push_back(sample.Time);
+			else window.Times[window.Count % g_windowSize] = sample.Time;
+			++window.Count;
+		}
+		ring->Tail.store(tail, memory_order_release);
+		g_numDropped += ring->NumDropped.exchange(0, memory_order_relaxed);
+	}
+}
+
+void FrameProfiler::Reset()
+{
+	Aggregate();
+
+	lock_guard<mutex> lock(g_windowMutex);
+	resetWindows();
+}
+
+bool FrameProfiler::IsEnabled()
+{
+	return g_isEnabled.load(memory_order_relaxed);
+}
+
+FrameProfiler::Stats FrameProfiler::GetStats(Scope scope)
+{
+	Stats stats = {};
+	if (scope >= NUM_SCOPE) return stats;
+
+	vector<float> times;
+	{
+		lock_guard<mutex> lock(g_windowMutex);
+		const auto& window = g_windows[scope];
+		stats.Count = window.Count;
+		times = window.Times;
+	}
+	if (times.empty()) return stats;
+
+	sort(times.begin(), times.end());
+	auto sum = 0.0;
+	for (const auto& time : times)
+	{
+		sum += time;
+
+		const auto us = static_cast<uint32_t>((min)(time * 1000.0f, static_cast<float>(UINT32_MAX)));
+		auto bucket = 0u;
+		for (auto n = us; n > 0 && bucket + 1 < NumBuckets; n >>= 1) ++bucket;
+		++stats.Histogram[bucket];
+	}
+
+	stats.WindowCount = static_cast<uint32_t>(times.size());
+	stats.Mean = static_cast<float>(sum / times.size());
+	stats.P50 = getPercentile(times, 50.0f);
+	stats.P95 = getPercentile(times, 95.0f);
+	stats.P99 = getPercentile(times, 99.0f);
+	stats.Max = times.back();
+
+	return stats;
+}
+
+uint64_t FrameProfiler::GetNumDropped()
+{
+	lock_guard<mutex> lock(g_windowMutex);
+
+	return g_numDropped;
+}
+
+const char* FrameProfiler::GetScopeName(Scope scope)
+{
+	return scope < NUM_SCOPE ? g_scopeNames[scope] : "";
+}
+
+bool FrameProfiler::ExportCSV(const char* fileName)
+{
+	ofstream file(fileName);
+	if (!file) return false;
+
+	Aggregate();
+	file << "scope,count,window,mean_ms,p50_ms,p95_ms,p99_ms,max_ms" << endl;
+	for (uint8_t i = 0; i < NUM_SCOPE; ++i)
+	{
+		const auto scope = static_cast<Scope>(i);
+		const auto stats = GetStats(scope);
+		file << GetScopeName(scope) << "," << stats.Count << "," << stats.WindowCount << "," << stats.Mean << ","
+			<< stats.P50 << "," << stats.P95 << "," << stats.P99 << "," << stats.Max << endl;
+	}
+
+	return static_cast<bool>(file);
+}
+
+bool FrameProfiler::ExportJSON(const char* fileName)
+{
+	ofstream file(fileName);
+	if (!file) return false;
+
+	Aggregate();
+	uint32_t windowSize;
+	{
+		lock_guard<mutex> lock(g_windowMutex);
+		windowSize = g_windowSize;
+	}
+
+	file << "{" << endl;
+	file << "\t\"windowSize\": " << windowSize << "," << endl;
+	file << "\t\"dropped\": " << GetNumDropped() << "," << endl;
+	file << "\t\"histogramBuckets\": \"log2 microseconds\"," << endl;
+	file << "\t\"scopes\": [" << endl;
+	for (uint8_t i = 0; i < NUM_SCOPE; ++i)
+	{
+		const auto scope = static_cast<Scope>(i);
+		const auto stats = GetStats(scope);
+		file << "\t\t{ \"name\": \"" << GetScopeName(scope) << "\", \"count\": " << stats.Count
+			<< ", \"window\": " << stats.WindowCount << ", \"meanMs\": " << stats.Mean
+			<< ", \"p50Ms\": " << stats.P50 << ", \"p95Ms\": " << stats.P95 << ", \"p99Ms\": " << stats.P99
+			<< ", \"maxMs\": " << stats.Max << ", \"histogram\": [";
+		for (auto b = 0u; b < NumBuckets; ++b) file << (b > 0 ? ", " : "") << stats.Histogram[b];
+		file << "] }" << (i + 1 < NUM_SCOPE ? "," : "") << endl;
+	}
+	file << "\t]" << endl;
+	file << "}" << endl;
+
+	return static_cast<bool>(file);
+}
@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+
+// CPU timings of the named passes, for the tail latency rather than an average FPS. Scoped
+// timers push into a ring buffer of the calling thread without locks (a ring is only shared
+// with the aggregator, and is handed to a new thread after its thread exits); Aggregate()
+// drains the rings into a rolling window per pass, of which the percentiles and a log2
+// histogram are taken and exported as CSV or JSON. The passes are timed on the CPU by the
+// headless renderer, and on the GPU by GPUProfiler, while the RECORD_ scopes time the command
+// recording of the passes on the D3D12 path. MultiVolumes shows the p99 frame time next to
+// the FPS, and MultiVolumesHeadless -profile writes the p50/p95/p99 of every pass.
+class FrameProfiler
+{
+public:
+	enum Scope : uint8_t
+	{
+		RAY_MARCH_L,
+		CULL_VOLUMES,
+		RAY_MARCH_V,
+		RENDER_CUBE,
+		RESOLVE_OIT,
+		TEMPORAL_AA,
+		TONE_MAP,
+		FRAME,
+		RECORD_RAY_MARCH_L,
+		RECORD_CULL_VOLUMES,
+		RECORD_RAY_MARCH_V,
+		RECORD_RENDER_CUBE,
+		RECORD_RESOLVE_OIT,
+		RECORD_TEMPORAL_AA,
+		RECORD_TONE_MAP,
+
+		NUM_SCOPE
+	};
+
+	static const uint32_t NumBuckets = 24;	// Bucket b counts [2^(b - 1), 2^b) us, bucket 0 < 1 us
+
+	struct Stats
+	{
+		uint64_t Count;			// Since the last reset
+		uint32_t WindowCount;	// Of the rolling window, which the rest are over
+		float Mean;				// In milliseconds
+		float P50;
+		float P95;
+		float P99;
+		float Max;
+		uint32_t Histogram[NumBuckets];
+	};
+
+	class ScopedTimer
+	{
+	public:
+		ScopedTimer(Scope scope);
+		~ScopedTimer();
+
+	protected:
+		std::chrono::steady_clock::time_point m_startTime;
+		Scope m_scope;
+	};
+
+	static void SetEnabled(bool enabled);
+	static void SetWindowSize(uint32_t windowSize);	// Also resets the windows
+	static void Record(Scope scope, double time);	// In milliseconds
+	static void Aggregate();
+	static void Reset();
+
+	static bool IsEnabled();
+	static Stats GetStats(Scope scope);		// Of the samples aggregated so far
+	static uint64_t GetNumDropped();		// Samples lost to full rings between aggregations
+	static const char* GetScopeName(Scope scope);
+
+	static bool ExportCSV(const char* fileName);
+	static bool ExportJSON(const char* fileName);
+
+	static const uint32_t RingSize = 4096;
+	static const uint32_t DefaultWindowSize = 1024;
+};
@@ -0,0 +1,102 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "GPUProfiler.h"
+#include "MemoryBudget.h"
+
+using namespace std;
+using namespace XUSG;
+
+static com_ptr<ID3D12QueryHeap> g_queryHeap;
+static Buffer::uptr g_timestamps;			// Readback, a pair per pass and frame in flight
+static const uint64_t* g_pTimestamps = nullptr;
+static vector<uint8_t> g_isTimed;			// Per frame in flight and pass, by the recording threads
+static double g_ticksPerMillisecond = 0.0;
+static uint8_t g_frameIndex = 0;
+
+static inline uint32_t getQueryIndex(uint8_t frameIndex, FrameProfiler::Scope scope)
+{
+	return (GPUProfiler::NumPasses * frameIndex + scope) * 2;
+}
+
+//--------------------------------------------------------------------------------------
+// Scoped timer
+//--------------------------------------------------------------------------------------
+GPUProfiler::ScopedTimer::ScopedTimer(const CommandList* pCommandList, FrameProfiler::Scope scope) :
+	m_pCommandList(g_queryHeap && scope < NumPasses ? pCommandList : nullptr),
+	m_scope(scope)
+{
+	if (m_pCommandList) m_pCommandList->EndQuery(g_queryHeap.get(), QueryType::TIMESTAMP,
+		getQueryIndex(g_frameIndex, m_scope));
+}
+
+GPUProfiler::ScopedTimer::~ScopedTimer()
+{
+	if (!m_pCommandList) return;
+
+	const auto queryIndex = getQueryIndex(g_frameIndex, m_scope);
+	m_pCommandList->EndQuery(g_queryHeap.get(), QueryType::TIMESTAMP, queryIndex + 1);
+	m_pCommandList->ResolveQueryData(g_queryHeap.get(), QueryType::TIMESTAMP, queryIndex, 2,
+		g_timestamps.get(), sizeof(uint64_t) * queryIndex);
+	g_isTimed[NumPasses * g_frameIndex + m_scope] = 1;
+}
+
+//--------------------------------------------------------------------------------------
+// GPU profiler
+//--------------------------------------------------------------------------------------
+bool GPUProfiler::Init(const Device* pDevice, const CommandQueue* pCommandQueue, uint8_t frameCount)
+{
+	const uint32_t numQueries = NumPasses * frameCount * 2;
+	D3D12_QUERY_HEAP_DESC desc = {};
+	desc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	desc.Count = numQueries;
+	const auto pD3DDevice = static_cast<ID3D12Device*>(pDevice->GetHandle());
+	XUSG_N_RETURN(SUCCEEDED(pD3DDevice->CreateQueryHeap(&desc, IID_PPV_ARGS(g_queryHeap.put()))), false);
+
+	uint64_t frequency;
+	const auto pD3DCommandQueue = static_cast<ID3D12CommandQueue*>(pCommandQueue->GetHandle());
+	XUSG_N_RETURN(SUCCEEDED(pD3DCommandQueue->GetTimestampFrequency(&frequency)), false);
+	g_ticksPerMillisecond = frequency / 1000.0;
+
+	const auto byteWidth = sizeof(uint64_t) * numQueries;
+	g_timestamps = Buffer::MakeUnique();
+	XUSG_N_RETURN(g_timestamps->Create(pDevice, byteWidth, ResourceFlag::NONE, MemoryType::READBACK,
+		0, nullptr, 0, nullptr, MemoryFlag::NONE, L"GPUProfiler.Timestamps"), false);
+	MemoryBudget::Register("GPUProfiler.Timestamps", MemoryBudget::GetBufferSize(byteWidth), MemoryBudget::BUFFERS);
+
+	// Readback heaps stay mapped for their lifetime, and are only read after the fence of a frame
+	g_pTimestamps = static_cast<const uint64_t*>(g_timestamps->Map(nullptr));
+	g_isTimed.assign(NumPasses * frameCount, 0);
+	g_frameIndex = 0;
+
+	return g_pTimestamps != nullptr;
+}
+
+void GPUProfiler::BeginFrame(uint8_t frameIndex)
+{
+	if (!g_pTimestamps) return;
+
+	for (uint8_t i = 0; i < NumPasses; ++i)
+	{
+		auto& isTimed = g_isTimed[NumPasses * frameIndex + i];
+		if (!isTimed) continue;
+
+		const auto scope = static_cast<FrameProfiler::Scope>(i);
+		const auto pTimestamps = &g_pTimestamps[getQueryIndex(frameIndex, scope)];
+		if (pTimestamps[1] >= pTimestamps[0])
+			FrameProfiler::Record(scope, (pTimestamps[1] - pTimestamps[0]) / g_ticksPerMillisecond);
+		isTimed = 0;
+	}
+
+	g_frameIndex = frameIndex;
+}
+
+void GPUProfiler::Destroy()
+{
+	if (g_pTimestamps) g_timestamps->Unmap();
+	g_pTimestamps = nullptr;
+	g_timestamps.reset();
+	g_queryHeap = nullptr;
+	g_isTimed.clear();
+}
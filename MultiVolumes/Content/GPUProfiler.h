@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Core/XUSG.h"
+#include "FrameProfiler.h"
+
+// GPU execution times of the passes of FrameProfiler, from a pair of timestamp queries written
+// around each pass into its command list and resolved right after it, into a readback slot of
+// the frame in flight. BeginFrame() records the passes last timed at the frame index, which
+// the swap chain has waited on, into FrameProfiler before the frame is recorded. A pass is
+// recorded by a single segment, so scoped timers may run on any recording thread.
+class GPUProfiler
+{
+public:
+	class ScopedTimer
+	{
+	public:
+		ScopedTimer(const XUSG::CommandList* pCommandList, FrameProfiler::Scope scope);
+		~ScopedTimer();
+
+	protected:
+		const XUSG::CommandList* m_pCommandList;
+		FrameProfiler::Scope m_scope;
+	};
+
+	static bool Init(const XUSG::Device* pDevice, const XUSG::CommandQueue* pCommandQueue, uint8_t frameCount);
+	static void BeginFrame(uint8_t frameIndex);
+	static void Destroy();
+
+	static const uint8_t NumPasses = FrameProfiler::FRAME;	// The scopes before FRAME
+};
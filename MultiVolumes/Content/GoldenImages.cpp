@@ -0,0 +1,356 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "GoldenImages.h"
+#include "HeadlessRenderer.h"
+#include "ParallelFor.h"
+#include <chrono>
+#include <limits>
+
+using namespace std;
+using namespace DirectX;
+
+const uint32_t GoldenImages::NumVolumeCounts;
+const uint32_t GoldenImages::NumTAAFrames;
+const uint32_t GoldenImages::VolumeCounts[] = { 1, 4, 16 };
+
+// Order-3 SH of a warm sky over a darker ground, standing in for a radiance probe
+static const XMFLOAT3 g_skySH[] =
+{
+	{ 1.2f, 1.0f, 0.8f },
+	{ 0.3f, 0.4f, 0.6f },
+	{ 0.0f, 0.0f, 0.0f },
+	{ 0.1f, 0.05f, 0.0f },
+	{ 0.0f, 0.0f, 0.0f },
+	{ 0.0f, 0.0f, 0.0f },
+	{ -0.1f, -0.1f, -0.05f },
+	{ 0.0f, 0.0f, 0.0f },
+	{ 0.05f, 0.0f, -0.05f }
+};
+
+static const char* g_oitMethodNames[] = { "kbuffer", "linkedlist", "weighted", "adaptive" };
+
+//--------------------------------------------------------------------------------------
+// Torus about the y axis, of unit major radius, standing in for the mesh
+//--------------------------------------------------------------------------------------
+static void generateTorus(float minorRadius, uint32_t numRings, uint32_t numSides,
+	vector<XMFLOAT3>& positions, vector<XMFLOAT3>& normals, vector<uint32_t>& indices)
+{
+	const auto numVertices = (numRings + 1) * (numSides + 1);
+	positions.resize(numVertices);
+	normals.resize(numVertices);
+	for (auto i = 0u; i <= numRings; ++i)
+	{
+		const auto u = XM_2PI * i / numRings;
+		for (auto j = 0u; j <= numSides; ++j)
+		{
+			const auto v = XM_2PI * j / numSides;
+			const auto k = (numSides + 1) * i + j;
+			normals[k] = XMFLOAT3(cosf(v) * cosf(u), sinf(v), cosf(v) * sinf(u));
+			positions[k] = XMFLOAT3(cosf(u) + minorRadius * normals[k].x, minorRadius * normals[k].y,
+				sinf(u) + minorRadius * normals[k].z);
+		}
+	}
+
+	// Clockwise from the outside, as front faces
+	indices.clear();
+	for (auto i = 0u; i < numRings; ++i)
+	{
+		for (auto j = 0u; j < numSides; ++j)
+		{
+			const auto k00 = (numSides + 1) * i + j, k01 = k00 + 1;
+			const auto k10 = k00 + numSides + 1, k11 = k10 + 1;
+			for (const auto& k : { k00, k01, k11, k00, k11, k10 }) indices.push_back(k);
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Binary PNM header: magic, width, height and max value, with comments
+//--------------------------------------------------------------------------------------
+static bool readPNM(const char* fileName, const char* magic, uint8_t numChannels,
+	vector<uint8_t>& values, uint32_t& width, uint32_t& height)
+{
+	ifstream file(fileName, ios::binary);
+	if (!file) return false;
+
+	string tokens[4];
+	for (auto& token : tokens)
+	{
+		while (file >> ws && file.peek() == '#') file.ignore(numeric_limits<streamsize>::max(), '\n');
+		if (!(file >> token)) return false;
+	}
+	file.get();
+
+	if (tokens[0] != magic || stoul(tokens[3]) != 255) return false;
+	width = static_cast<uint32_t>(stoul(tokens[1]));
+	height = static_cast<uint32_t>(stoul(tokens[2]));
+
+	values.resize(static_cast<size_t>(numChannels) * width * height);
+	file.read(reinterpret_cast<char*>(values.data()), values.size());
+
+	return static_cast<bool>(file);
+}
+
+//--------------------------------------------------------------------------------------
+// Separable 11-tap Gaussian (sigma 1.5) with clamped borders
+//--------------------------------------------------------------------------------------
+static void gaussianBlur(const vector<float>& src, vector<float>& dst, uint32_t width, uint32_t height)
+{
+	static const int32_t radius = 5;
+	float weights[2 * radius + 1], weightSum = 0.0f;
+	for (auto i = -radius; i <= radius; ++i)
+	{
+		weights[i + radius] = expf(-(i * i) / (2.0f * 1.5f * 1.5f));
+		weightSum += weights[i + radius];
+	}
+	for (auto& weight : weights) weight /= weightSum;
+
+	const auto w = static_cast<int32_t>(width), h = static_cast<int32_t>(height);
+	vector<float> temp(src.size());
+	ParallelFor(height, 16, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto y = static_cast<int32_t>(begin); y < static_cast<int32_t>(end); ++y)
+			for (auto x = 0; x < w; ++x)
+			{
+				auto sum = 0.0f;
+				for (auto i = -radius; i <= radius; ++i) sum += weights[i + radius] * src[w * y + (min)((max)(x + i, 0), w - 1)];
+				temp[w * y + x] = sum;
+			}
+	});
+
+	dst.resize(src.size());
+	ParallelFor(height, 16, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto y = static_cast<int32_t>(begin); y < static_cast<int32_t>(end); ++y)
+			for (auto x = 0; x < w; ++x)
+			{
+				auto sum = 0.0f;
+				for (auto i = -radius; i <= radius; ++i) sum += weights[i + radius] * temp[w * (min)((max)(y + i, 0), h - 1) + x];
+				dst[w * y + x] = sum;
+			}
+	});
+}
+
+GoldenImages::RunDesc GoldenImages::GetDefaultDesc()
+{
+	RunDesc desc;
+	desc.Directory = "Headless/Golden";
+	desc.Update = false;
+	desc.Width = 320;
+	desc.Height = 200;
+	desc.MinPSNR = 40.0f;
+	desc.MinSSIM = 0.98f;
+	desc.MaxFailedRatio = 0.001f;
+	desc.BaseTolerance = 4;
+
+	return desc;
+}
+
+vector<GoldenImages::CaseResult> GoldenImages::Run(const RunDesc& desc)
+{
+	vector<CaseResult> results;
+	const auto numPixels = desc.Width * desc.Height;
+	vector<uint8_t> rgbs(3 * numPixels), refs, tolerances, diffs(numPixels);
+
+	for (const auto& numVolumes : VolumeCounts)
+	{
+		// Procedural volumes and reduced grids, so that the goldens need no assets
+		SceneSettings settings;
+		settings.VolumeFiles[0] = L"";
+		settings.NumVolumes = numVolumes;
+		settings.GridSize = 64;
+		settings.LightGridSize = 128;
+		settings.MaxRaySamples = 128;
+		settings.MaxLightSamples = 64;
+
+		// Framing the volume grid as laid out by MultiRayCaster::SetVolumesWorld()
+		const auto rowLength = static_cast<uint32_t>(ceilf(sqrtf(static_cast<float>(numVolumes))));
+		const auto radius = 20.0f + 35.0f * rowLength;
+		const XMFLOAT3 eyePt(sinf(0.6f) * radius, 0.4f * radius, -cosf(0.6f) * radius);
+		const XMFLOAT3 focusPt(0.0f, 0.0f, 0.0f);
+
+		for (uint8_t hasLightProbe = 0; hasLightProbe < 2; ++hasLightProbe)
+		{
+			HeadlessRenderer renderer;
+			if (!renderer.Init(settings, desc.Width, desc.Height, hasLightProbe ? g_skySH : nullptr)) continue;
+
+			// Each OIT method, then the K-buffer over the mesh, in one frame and after the TAA
+			// of a static camera over the jittered frames
+			for (uint8_t i = 0; i < OITEngine::NUM_METHOD + 2; ++i)
+			{
+				const auto hasMesh = i >= OITEngine::NUM_METHOD;
+				const auto numFrames = i > OITEngine::NUM_METHOD ? NumTAAFrames : 1;
+				const auto method = hasMesh ? OITEngine::METHOD_K_BUFFER : static_cast<OITEngine::Method>(i);
+				if (i == OITEngine::NUM_METHOD)
+				{
+					// A torus about the base of the volume grid
+					vector<XMFLOAT3> positions, normals;
+					vector<uint32_t> indices;
+					generateTorus(0.3f, 48, 24, positions, normals, indices);
+					renderer.SetMesh(positions.data(), normals.data(), static_cast<uint32_t>(positions.size()),
+						indices.data(), static_cast<uint32_t>(indices.size()), XMFLOAT4(0.0f, -10.0f, 0.0f, 15.0f * rowLength));
+				}
+
+				CaseResult result = {};
+				result.Name = "volumes" + to_string(numVolumes) + "_" + g_oitMethodNames[method] + (hasMesh ? "_mesh" : "") +
+					(numFrames > 1 ? "_taa" : "") + (hasLightProbe ? "_probe" : "");
+
+				const auto startTime = chrono::steady_clock::now();
+				HeadlessRenderer::FrameContext context;
+				renderer.InitFrameContext(context, method);
+				context.UseTemporalAA = numFrames > 1;
+				for (auto f = 0u; f < numFrames; ++f)
+				{
+					context.FrameIndex = f;
+					renderer.Render(context, eyePt, focusPt);
+				}
+				HeadlessRenderer::ToneMap(context.SceneColors.data(), numPixels, rgbs.data());
+				result.RenderTime = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+
+				const auto path = desc.Directory + "/" + result.Name;
+				if (desc.Update)
+				{
+					tolerances.resize(numPixels);
+					GenerateToleranceMap(rgbs.data(), desc.Width, desc.Height, desc.BaseTolerance, tolerances.data());
+					result.Passed = HeadlessRenderer::WritePPM((path + ".ppm").c_str(), rgbs.data(), desc.Width, desc.Height) &&
+						WritePGM((path + ".tol.pgm").c_str(), tolerances.data(), desc.Width, desc.Height);
+					results.push_back(result);
+					continue;
+				}
+
+				uint32_t width, height, tolWidth, tolHeight;
+				result.HasGolden = ReadPPM((path + ".ppm").c_str(), refs, width, height) &&
+					width == desc.Width && height == desc.Height;
+				if (result.HasGolden)
+				{
+					// Missing tolerance maps fall back to the base tolerance
+					if (!ReadPGM((path + ".tol.pgm").c_str(), tolerances, tolWidth, tolHeight) ||
+						tolWidth != width || tolHeight != height)
+						tolerances.assign(numPixels, desc.BaseTolerance);
+
+					result.PSNR = ComputePSNR(rgbs.data(), refs.data(), numPixels);
+					result.SSIM = ComputeSSIM(rgbs.data(), refs.data(), width, height);
+					result.FailedRatio = ComputeFailedRatio(rgbs.data(), refs.data(), tolerances.data(), numPixels, diffs.data());
+					result.Passed = result.PSNR >= desc.MinPSNR && result.SSIM >= desc.MinSSIM &&
+						result.FailedRatio <= desc.MaxFailedRatio;
+				}
+
+				// Keep the render and its difference for inspection
+				if (!result.Passed)
+				{
+					HeadlessRenderer::WritePPM((path + ".out.ppm").c_str(), rgbs.data(), desc.Width, desc.Height);
+					if (result.HasGolden) WritePGM((path + ".diff.pgm").c_str(), diffs.data(), desc.Width, desc.Height);
+				}
+
+				results.push_back(result);
+			}
+		}
+	}
+
+	return results;
+}
+
+float GoldenImages::ComputePSNR(const uint8_t* pRGBs, const uint8_t* pRefs, uint32_t numPixels)
+{
+	auto errorSum = 0.0;
+	for (auto i = 0u; i < 3 * numPixels; ++i)
+	{
+		const auto error = static_cast<double>(pRGBs[i]) - pRefs[i];
+		errorSum += error * error;
+	}
+
+	// Identical images are capped at 100 dB
+	const auto mse = errorSum / (3.0 * numPixels);
+
+	return mse > 0.0 ? static_cast<float>(10.0 * log10(255.0 * 255.0 / mse)) : 100.0f;
+}
+
+float GoldenImages::ComputeSSIM(const uint8_t* pRGBs, const uint8_t* pRefs, uint32_t width, uint32_t height)
+{
+	// On the luma, with the constants of Wang et al. 2004
+	const auto numPixels = width * height;
+	vector<float> x(numPixels), y(numPixels), xx(numPixels), yy(numPixels), xy(numPixels);
+	for (auto i = 0u; i < numPixels; ++i)
+	{
+		x[i] = 0.299f * pRGBs[3 * i] + 0.587f * pRGBs[3 * i + 1] + 0.114f * pRGBs[3 * i + 2];
+		y[i] = 0.299f * pRefs[3 * i] + 0.587f * pRefs[3 * i + 1] + 0.114f * pRefs[3 * i + 2];
+		xx[i] = x[i] * x[i];
+		yy[i] = y[i] * y[i];
+		xy[i] = x[i] * y[i];
+	}
+
+	for (auto plane : { &x, &y, &xx, &yy, &xy }) gaussianBlur(*plane, *plane, width, height);
+
+	const auto c1 = (0.01f * 255.0f) * (0.01f * 255.0f);
+	const auto c2 = (0.03f * 255.0f) * (0.03f * 255.0f);
+	auto ssimSum = 0.0;
+	for (auto i = 0u; i < numPixels; ++i)
+	{
+		const auto varX = xx[i] - x[i] * x[i];
+		const auto varY = yy[i] - y[i] * y[i];
+		const auto covXY = xy[i] - x[i] * y[i];
+		ssimSum += (2.0f * x[i] * y[i] + c1) * (2.0f * covXY + c2) /
+			((x[i] * x[i] + y[i] * y[i] + c1) * (varX + varY + c2));
+	}
+
+	return static_cast<float>(ssimSum / numPixels);
+}
+
+float GoldenImages::ComputeFailedRatio(const uint8_t* pRGBs, const uint8_t* pRefs, const uint8_t* pTolerances,
+	uint32_t numPixels, uint8_t* pDiffs)
+{
+	auto numFailed = 0u;
+	for (auto i = 0u; i < numPixels; ++i)
+	{
+		auto diff = 0;
+		for (uint8_t j = 0; j < 3; ++j) diff = (max)(diff, abs(pRGBs[3 * i + j] - pRefs[3 * i + j]));
+		if (diff > pTolerances[i]) ++numFailed;
+		if (pDiffs) pDiffs[i] = static_cast<uint8_t>((min)(diff * 4, 255));
+	}
+
+	return static_cast<float>(numFailed) / numPixels;
+}
+
+void GoldenImages::GenerateToleranceMap(const uint8_t* pRGBs, uint32_t width, uint32_t height,
+	uint8_t baseTolerance, uint8_t* pTolerances)
+{
+	const auto w = static_cast<int32_t>(width), h = static_cast<int32_t>(height);
+	for (auto y = 0; y < h; ++y)
+	{
+		for (auto x = 0; x < w; ++x)
+		{
+			// Max channel difference to the 3x3 neighbors
+			const auto pCenter = &pRGBs[3 * (w * y + x)];
+			auto contrast = 0;
+			for (auto j = (max)(y - 1, 0); j <= (min)(y + 1, h - 1); ++j)
+				for (auto i = (max)(x - 1, 0); i <= (min)(x + 1, w - 1); ++i)
+					for (uint8_t k = 0; k < 3; ++k)
+						contrast = (max)(contrast, abs(pRGBs[3 * (w * j + i) + k] - pCenter[k]));
+
+			pTolerances[w * y + x] = static_cast<uint8_t>((min)(baseTolerance + contrast / 2, 255));
+		}
+	}
+}
+
+bool GoldenImages::ReadPPM(const char* fileName, vector<uint8_t>& rgbs, uint32_t& width, uint32_t& height)
+{
+	return readPNM(fileName, "P6", 3, rgbs, width, height);
+}
+
+bool GoldenImages::ReadPGM(const char* fileName, vector<uint8_t>& values, uint32_t& width, uint32_t& height)
+{
+	return readPNM(fileName, "P5", 1, values, width, height);
+}
+
+bool GoldenImages::WritePGM(const char* fileName, const uint8_t* pValues, uint32_t width, uint32_t height)
+{
+	ofstream file(fileName, ios::binary);
+	if (!file) return false;
+
+	file << "P5\n" << width << " " << height << "\n255\n";
+	file.write(reinterpret_cast<const char*>(pValues), static_cast<streamsize>(width) * height);
+
+	return static_cast<bool>(file);
+}
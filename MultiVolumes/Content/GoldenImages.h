@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "OITEngine.h"
+
+// Golden-image regression of the headless renderer. A fixed set of cases, i.e. 1, 4 and
+// 16 volumes with each OIT method, and over a mesh without and with TAA, all with and
+// without a light probe, is rendered and compared to the stored 8-bit images by PSNR,
+// SSIM and per-pixel tolerance maps. The goldens are kept in Headless/Golden; a missing
+// golden fails its case. After an intended change of the rendering, regenerate them from
+// the MultiVolumes directory with MultiVolumesHeadless -golden Headless/Golden -updateGolden,
+// check the new images, and commit them with the change.
+class GoldenImages
+{
+public:
+	struct RunDesc
+	{
+		std::string Directory;		// Holding <case>.ppm and the tolerance maps <case>.tol.pgm
+		bool Update;				// Store the renders as the new goldens instead of comparing
+		uint32_t Width;
+		uint32_t Height;
+		float MinPSNR;				// In dB
+		float MinSSIM;
+		float MaxFailedRatio;		// Of the pixels beyond their tolerances
+		uint8_t BaseTolerance;		// Of generated tolerance maps, in 8-bit units
+	};
+
+	struct CaseResult
+	{
+		std::string Name;
+		float PSNR;
+		float SSIM;
+		float FailedRatio;
+		double RenderTime;			// In milliseconds
+		bool HasGolden;
+		bool Passed;
+	};
+
+	static RunDesc GetDefaultDesc();
+	static std::vector<CaseResult> Run(const RunDesc& desc);
+
+	static float ComputePSNR(const uint8_t* pRGBs, const uint8_t* pRefs, uint32_t numPixels);
+	static float ComputeSSIM(const uint8_t* pRGBs, const uint8_t* pRefs, uint32_t width, uint32_t height);
+	static float ComputeFailedRatio(const uint8_t* pRGBs, const uint8_t* pRefs, const uint8_t* pTolerances,
+		uint32_t numPixels, uint8_t* pDiffs = nullptr);
+
+	// Tolerances grow with the local contrast, where sampling changes shift edges
+	static void GenerateToleranceMap(const uint8_t* pRGBs, uint32_t width, uint32_t height,
+		uint8_t baseTolerance, uint8_t* pTolerances);
+
+	static bool ReadPPM(const char* fileName, std::vector<uint8_t>& rgbs, uint32_t& width, uint32_t& height);
+	static bool ReadPGM(const char* fileName, std::vector<uint8_t>& values, uint32_t& width, uint32_t& height);
+	static bool WritePGM(const char* fileName, const uint8_t* pValues, uint32_t width, uint32_t height);
+
+	static const uint32_t NumVolumeCounts = 3;
+	static const uint32_t VolumeCounts[NumVolumeCounts];
+	static const uint32_t NumTAAFrames = 8;		// Rendered by the TAA cases, of which the last is compared
+};
@@ -0,0 +1,1421 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "Optional/XUSGObjLoader.h"
+#include "SharedConsts.h"
+#include "HeadlessRenderer.h"
+#include "ParallelFor.h"
+#include "FrameProfiler.h"
+#include "TraceRecorder.h"
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+
+using namespace std;
+using namespace DirectX;
+
+#define ZERO_THRESHOLD	0.01f
+
+static const float g_maxDist = 2.0f * sqrtf(3.0f);
+static const uint32_t g_shadowMapSize = 1024;	// As ObjectRenderer
+
+//--------------------------------------------------------------------------------------
+// Transforms with the stored (transposed) 3x4 matrices
+//--------------------------------------------------------------------------------------
+static inline XMFLOAT3 transformCoord(const XMFLOAT3X4& m, const XMFLOAT3& p)
+{
+	return XMFLOAT3(
+		m.m[0][0] * p.x + m.m[0][1] * p.y + m.m[0][2] * p.z + m.m[0][3],
+		m.m[1][0] * p.x + m.m[1][1] * p.y + m.m[1][2] * p.z + m.m[1][3],
+		m.m[2][0] * p.x + m.m[2][1] * p.y + m.m[2][2] * p.z + m.m[2][3]);
+}
+
+static inline XMFLOAT3 transformNormal(const XMFLOAT3X4& m, const XMFLOAT3& v)
+{
+	return XMFLOAT3(
+		m.m[0][0] * v.x + m.m[0][1] * v.y + m.m[0][2] * v.z,
+		m.m[1][0] * v.x + m.m[1][1] * v.y + m.m[1][2] * v.z,
+		m.m[2][0] * v.x + m.m[2][1] * v.y + m.m[2][2] * v.z);
+}
+
+static inline XMFLOAT3 normalize(const XMFLOAT3& v)
+{
+	const auto len = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+
+	return len > 0.0f ? XMFLOAT3(v.x / len, v.y / len, v.z / len) : v;
+}
+
+static inline bool isInside(const XMFLOAT3& pos)
+{
+	return fabsf(pos.x) <= 1.0f && fabsf(pos.y) <= 1.0f && fabsf(pos.z) <= 1.0f;
+}
+
+static inline XMFLOAT3 localToTex3DSpace(const XMFLOAT3& pos)
+{
+	return XMFLOAT3(pos.x * 0.5f + 0.5f, pos.y * 0.5f + 0.5f, pos.z * 0.5f + 0.5f);
+}
+
+//--------------------------------------------------------------------------------------
+// Same as ComputeRayOrigin() in RayMarch.hlsli
+//--------------------------------------------------------------------------------------
+static bool computeRayOrigin(XMFLOAT3& rayOrigin, const XMFLOAT3& rayDir)
+{
+	if (isInside(rayOrigin)) return true;
+
+	const float o[] = { rayOrigin.x, rayOrigin.y, rayOrigin.z };
+	const float d[] = { rayDir.x, rayDir.y, rayDir.z };
+
+	auto U = FLT_MAX;
+	auto isHit = false;
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto sign = d[i] > 0.0f ? 1.0f : (d[i] < 0.0f ? -1.0f : 0.0f);
+		const auto u = (-sign - o[i]) / d[i];
+		if (u < 0.0f) continue;
+
+		const auto j = (i + 1) % 3, k = (i + 2) % 3;
+		if (fabsf(d[j] * u + o[j]) > 1.0f) continue;
+		if (fabsf(d[k] * u + o[k]) > 1.0f) continue;
+		if (u < U)
+		{
+			U = u;
+			isHit = true;
+		}
+	}
+
+	rayOrigin.x = (min)((max)(d[0] * U + o[0], -1.0f), 1.0f);
+	rayOrigin.y = (min)((max)(d[1] * U + o[1], -1.0f), 1.0f);
+	rayOrigin.z = (min)((max)(d[2] * U + o[2], -1.0f), 1.0f);
+
+	return isHit;
+}
+
+//--------------------------------------------------------------------------------------
+// Same as GetOpacity() and GetStep() in RayMarch.hlsli
+//--------------------------------------------------------------------------------------
+static inline float getOpacity(float density, float stepScale)
+{
+	return (min)((max)(density * stepScale * 4.0f, 0.0f), 1.0f);
+}
+
+static inline float getStep(float transm, float opacity, float stepScale)
+{
+	auto step = (max)((1.0f - transm) * 2.0f, 0.8f) * stepScale;
+	step *= (min)((max)(1.0f - opacity * 4.0f, 0.5f), 2.0f);
+
+	return step;
+}
+
+//--------------------------------------------------------------------------------------
+// Ray sample count of the culler, scaled and kept non-zero
+//--------------------------------------------------------------------------------------
+static inline uint32_t scaleSampleCount(uint32_t sampleCount, float scale)
+{
+	return sampleCount > 0 ? (max)(static_cast<uint32_t>(sampleCount * scale + 0.5f), 1u) : 0;
+}
+
+//--------------------------------------------------------------------------------------
+// Linear filtering with clamp addressing
+//--------------------------------------------------------------------------------------
+static inline void getTexelCoords(float u, uint32_t size, uint32_t& i0, uint32_t& i1, float& w)
+{
+	const auto x = u * size - 0.5f;
+	const auto xf = floorf(x);
+	const auto i = static_cast<int32_t>(xf);
+	const auto maxIdx = static_cast<int32_t>(size) - 1;
+	w = x - xf;
+	i0 = static_cast<uint32_t>((min)((max)(i, 0), maxIdx));
+	i1 = static_cast<uint32_t>((min)((max)(i + 1, 0), maxIdx));
+}
+
+template<typename T, typename F>
+static T sampleLinear3D(const F& fetch, uint32_t width, uint32_t height, uint32_t depth, const XMFLOAT3& uvw)
+{
+	uint32_t x0, x1, y0, y1, z0, z1;
+	float wx, wy, wz;
+	getTexelCoords(uvw.x, width, x0, x1, wx);
+	getTexelCoords(uvw.y, height, y0, y1, wy);
+	getTexelCoords(uvw.z, depth, z0, z1, wz);
+
+	const auto slice0 = width * height * z0, slice1 = width * height * z1;
+	const auto row00 = slice0 + width * y0, row01 = slice0 + width * y1;
+	const auto row10 = slice1 + width * y0, row11 = slice1 + width * y1;
+
+	const auto c00 = fetch(row00 + x0) * (1.0f - wx) + fetch(row00 + x1) * wx;
+	const auto c01 = fetch(row01 + x0) * (1.0f - wx) + fetch(row01 + x1) * wx;
+	const auto c10 = fetch(row10 + x0) * (1.0f - wx) + fetch(row10 + x1) * wx;
+	const auto c11 = fetch(row11 + x0) * (1.0f - wx) + fetch(row11 + x1) * wx;
+	const auto c0 = c00 * (1.0f - wy) + c01 * wy;
+	const auto c1 = c10 * (1.0f - wy) + c11 * wy;
+
+	return c0 * (1.0f - wz) + c1 * wz;
+}
+
+//--------------------------------------------------------------------------------------
+// R11G11B10_FLOAT packing: 5-bit exponents, no sign
+//--------------------------------------------------------------------------------------
+static uint32_t packUFloat(float value, uint32_t mantBits)
+{
+	if (!(value > 0.0f)) return 0;
+
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(float));
+	const auto exp = static_cast<int32_t>(bits >> 23) - 127 + 15;
+	const auto maxValue = (31u << mantBits) - 1;
+	if (exp >= 31) return maxValue;
+
+	if (exp <= 0)
+	{
+		// Denormalized
+		const auto shift = static_cast<int32_t>(23 - mantBits) + 1 - exp;
+		if (shift >= 32) return 0;
+
+		return ((bits & 0x7fffff) | 0x800000) >> shift;
+	}
+
+	// Round to nearest
+	bits = (static_cast<uint32_t>(exp) << 23 | (bits & 0x7fffff)) + (1u << (22 - mantBits));
+
+	return (min)(bits >> (23 - mantBits), maxValue);
+}
+
+static float unpackUFloat(uint32_t bits, uint32_t mantBits)
+{
+	const auto exp = static_cast<int32_t>(bits >> mantBits);
+	const auto mant = static_cast<float>(bits & ((1u << mantBits) - 1)) / (1u << mantBits);
+
+	return exp > 0 ? ldexpf(1.0f + mant, exp - 15) : ldexpf(mant, -14);
+}
+
+static inline uint32_t packR11G11B10(const XMFLOAT3& color)
+{
+	return packUFloat(color.x, 6) | packUFloat(color.y, 6) << 11 | packUFloat(color.z, 5) << 22;
+}
+
+static inline XMFLOAT3 unpackR11G11B10(uint32_t packed)
+{
+	return XMFLOAT3(unpackUFloat(packed & 0x7ff, 6), unpackUFloat((packed >> 11) & 0x7ff, 6), unpackUFloat(packed >> 22, 5));
+}
+
+//--------------------------------------------------------------------------------------
+// DDS volume files of single-channel formats, as loaded by CSR32FToRGBA16F.hlsl
+//--------------------------------------------------------------------------------------
+static float halfToFloat(uint16_t half)
+{
+	const auto exp = static_cast<int32_t>((half >> 10) & 0x1f);
+	const auto mant = static_cast<float>(half & 0x3ff) / 1024.0f;
+	const auto value = exp == 31 ? FLT_MAX : (exp > 0 ? ldexpf(1.0f + mant, exp - 15) : ldexpf(mant, -14));
+
+	return (half & 0x8000) ? -value : value;
+}
+
+static bool loadDDSVolume(const wstring& fileName, vector<float>& texels, uint32_t& width, uint32_t& height, uint32_t& depth)
+{
+	string name(fileName.size(), '\0');
+	for (size_t i = 0; i < name.size(); ++i) name[i] = static_cast<char>(fileName[i]);
+
+	ifstream file(name, ios::binary);
+	if (!file) return false;
+
+	uint32_t magic, header[31];
+	file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!file || magic != 0x20534444) return false;	// "DDS "
+
+	enum TexelType : uint8_t { TEXEL_UNKNOWN, TEXEL_FLOAT, TEXEL_HALF, TEXEL_UNORM8, TEXEL_UNORM16 };
+	const auto pfFlags = header[19], fourCC = header[20], bitCount = header[21];
+	auto texelType = TEXEL_UNKNOWN;
+	if (fourCC == 0x30315844)	// "DX10"
+	{
+		uint32_t headerDX10[5];
+		file.read(reinterpret_cast<char*>(headerDX10), sizeof(headerDX10));
+		switch (headerDX10[0])
+		{
+		case 41: texelType = TEXEL_FLOAT; break;	// R32_FLOAT
+		case 54: texelType = TEXEL_HALF; break;		// R16_FLOAT
+		case 56: texelType = TEXEL_UNORM16; break;	// R16_UNORM
+		case 61: case 65: texelType = TEXEL_UNORM8; break;	// R8_UNORM, A8_UNORM
+		}
+	}
+	else if (fourCC == 114) texelType = TEXEL_FLOAT;	// D3DFMT_R32F
+	else if (fourCC == 111) texelType = TEXEL_HALF;		// D3DFMT_R16F
+	else if (pfFlags & 0x20002)	// Luminance or alpha only
+		texelType = bitCount == 8 ? TEXEL_UNORM8 : (bitCount == 16 ? TEXEL_UNORM16 : TEXEL_UNKNOWN);
+	if (texelType == TEXEL_UNKNOWN) return false;
+
+	height = header[2];
+	width = header[3];
+	depth = (header[1] & 0x800000) ? (max)(header[5], 1u) : 1;	// DDSD_DEPTH
+	const auto numTexels = static_cast<size_t>(width) * height * depth;
+	if (numTexels == 0) return false;
+
+	// Only the top mip level
+	const uint8_t texelSizes[] = { 0, 4, 2, 1, 2 };
+	vector<uint8_t> data(numTexels * texelSizes[texelType]);
+	file.read(reinterpret_cast<char*>(data.data()), data.size());
+	if (!file) return false;
+
+	texels.resize(numTexels);
+	for (size_t i = 0; i < numTexels; ++i)
+	{
+		switch (texelType)
+		{
+		case TEXEL_FLOAT:
+			memcpy(&texels[i], &data[sizeof(float) * i], sizeof(float));
+			break;
+		case TEXEL_HALF:
+		{
+			uint16_t half;
+			memcpy(&half, &data[sizeof(uint16_t) * i], sizeof(uint16_t));
+			texels[i] = halfToFloat(half);
+			break;
+		}
+		case TEXEL_UNORM8:
+			texels[i] = data[i] / 255.0f;
+			break;
+		default:
+		{
+			uint16_t unorm;
+			memcpy(&unorm, &data[sizeof(uint16_t) * i], sizeof(uint16_t));
+			texels[i] = unorm / 65535.0f;
+		}
+		}
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Same as EvaluateSHIrradiance() in SHIrradianceTypeless.hlsli
+//--------------------------------------------------------------------------------------
+static XMFLOAT3 evaluateSHIrradiance(const XMFLOAT3* shCoeffs, const XMFLOAT3& norm)
+{
+	const auto c1 = 0.429042765f;	// 4 * A2.Y22 = 1/16 * sqrt(15.PI)
+	const auto c2 = 0.511663354f;	// 0.5 * A1.Y10 = 1/2 * sqrt(PI/3)
+	const auto c3 = 0.247707956f;	// A2.Y20 = 1/16 * sqrt(5.PI)
+	const auto c4 = 0.886226925f;	// A0.Y00 = 1/2 * sqrt(PI)
+
+	const auto x = -norm.x;
+	const auto y = -norm.y;
+	const auto z = norm.z;
+
+	float irradiance[3];
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto sh = [&](uint8_t j) { return (&shCoeffs[j].x)[i]; };
+		irradiance[i] = (max)(0.0f,
+			(c1 * (x * x - y * y)) * sh(8)
+			+ (c3 * (3.0f * z * z - 1.0f)) * sh(6)
+			+ c4 * sh(0)
+			+ 2.0f * c1 * (sh(4) * x * y + sh(7) * x * z + sh(5) * y * z)
+			+ 2.0f * c2 * (sh(3) * x + sh(1) * y + sh(2) * z)) / XM_PI;
+	}
+
+	return XMFLOAT3(irradiance[0], irradiance[1], irradiance[2]);
+}
+
+//--------------------------------------------------------------------------------------
+// Cube-map texel to local position, as GetLocalPos() in CSRayMarch.hlsl
+//--------------------------------------------------------------------------------------
+static XMFLOAT3 getLocalPos(uint32_t x, uint32_t y, uint8_t face, uint32_t size)
+{
+	const auto u = (x + 0.5f) / size * 2.0f - 1.0f;
+	const auto v = -((y + 0.5f) / size * 2.0f - 1.0f);
+
+	switch (face)
+	{
+	case 0: return XMFLOAT3(1.0f, v, -u);	// +X
+	case 1: return XMFLOAT3(-1.0f, v, u);	// -X
+	case 2: return XMFLOAT3(u, 1.0f, -v);	// +Y
+	case 3: return XMFLOAT3(u, -1.0f, v);	// -Y
+	case 4: return XMFLOAT3(u, v, 1.0f);	// +Z
+	default: return XMFLOAT3(-u, v, -1.0f);	// -Z
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Cube-map lookup with bilinear filtering, clamped at the face edges as GetDomain()
+// clamps the exterior edges in PSCube.hlsli
+//--------------------------------------------------------------------------------------
+static XMFLOAT4 cubeCast(const vector<XMFLOAT4>& cubeMap, uint32_t size, const XMFLOAT3& pos)
+{
+	const auto ax = fabsf(pos.x), ay = fabsf(pos.y), az = fabsf(pos.z);
+	uint32_t face;
+	float sc, tc, ma;
+	if (ax >= ay && ax >= az)
+	{
+		face = pos.x > 0.0f ? 0 : 1;
+		sc = pos.x > 0.0f ? -pos.z : pos.z;
+		tc = -pos.y;
+		ma = ax;
+	}
+	else if (ay >= az)
+	{
+		face = pos.y > 0.0f ? 2 : 3;
+		sc = pos.x;
+		tc = pos.y > 0.0f ? pos.z : -pos.z;
+		ma = ay;
+	}
+	else
+	{
+		face = pos.z > 0.0f ? 4 : 5;
+		sc = pos.z > 0.0f ? pos.x : -pos.x;
+		tc = -pos.y;
+		ma = az;
+	}
+
+	uint32_t x0, x1, y0, y1;
+	float wx, wy;
+	getTexelCoords((sc / ma + 1.0f) * 0.5f, size, x0, x1, wx);
+	getTexelCoords((tc / ma + 1.0f) * 0.5f, size, y0, y1, wy);
+
+	const auto pFace = &cubeMap[size * size * face];
+	const auto c00 = XMLoadFloat4(&pFace[size * y0 + x0]);
+	const auto c01 = XMLoadFloat4(&pFace[size * y0 + x1]);
+	const auto c10 = XMLoadFloat4(&pFace[size * y1 + x0]);
+	const auto c11 = XMLoadFloat4(&pFace[size * y1 + x1]);
+
+	XMFLOAT4 result;
+	XMStoreFloat4(&result, XMVectorLerp(XMVectorLerp(c00, c01, wx), XMVectorLerp(c10, c11, wx), wy));
+
+	return result;
+}
+
+//--------------------------------------------------------------------------------------
+// Triangle rasterization as the D3D12 rasterizer with back-face culling: triangles clockwise
+// on screen are front facing, the pixel centers are sampled, and z / w passes a LESS test.
+// Triangles are not clipped at the near plane, but dropped if any vertex is behind the eye.
+//--------------------------------------------------------------------------------------
+struct RasterVertex
+{
+	float X, Y;		// In pixels
+	float Z;
+	float InvW;
+};
+
+static void setupRasterVertices(const vector<XMFLOAT3>& positions, CXMMATRIX viewProj, const XMFLOAT2& projBias,
+	uint32_t width, uint32_t height, vector<RasterVertex>& vertices)
+{
+	vertices.resize(positions.size());
+	for (size_t i = 0; i < positions.size(); ++i)
+	{
+		XMFLOAT4 hPos;
+		XMStoreFloat4(&hPos, XMVector3Transform(XMLoadFloat3(&positions[i]), viewProj));
+
+		// The bias is in NDC, as ProjBias in VSBasePass.hlsl
+		auto& vertex = vertices[i];
+		vertex.InvW = hPos.w > 0.0f ? 1.0f / hPos.w : 0.0f;
+		vertex.X = ((hPos.x * vertex.InvW + projBias.x) * 0.5f + 0.5f) * width;
+		vertex.Y = (0.5f - (hPos.y * vertex.InvW + projBias.y) * 0.5f) * height;
+		vertex.Z = hPos.z * vertex.InvW;
+	}
+}
+
+// Rasterizes the rows [begin, end), calling shade(x, y, triangle, b1, b2) for every fragment
+// that passes the depth test, with the perspective-correct barycentrics of vertices 1 and 2
+template<typename F>
+static void rasterizeRows(const vector<RasterVertex>& vertices, const vector<uint32_t>& indices, uint32_t width,
+	uint32_t begin, uint32_t end, float* pDepths, const F& shade)
+{
+	const auto numTriangles = static_cast<uint32_t>(indices.size() / 3);
+	for (auto t = 0u; t < numTriangles; ++t)
+	{
+		const auto& v0 = vertices[indices[3 * t]];
+		const auto& v1 = vertices[indices[3 * t + 1]];
+		const auto& v2 = vertices[indices[3 * t + 2]];
+		if (v0.InvW <= 0.0f || v1.InvW <= 0.0f || v2.InvW <= 0.0f) continue;
+
+		const auto area = (v1.X - v0.X) * (v2.Y - v0.Y) - (v2.X - v0.X) * (v1.Y - v0.Y);
+		if (!(area > 0.0f)) continue;
+
+		// Bounds of the pixel centers, clamped before the conversions
+		const auto top = (max)(ceilf((min)((min)(v0.Y, v1.Y), v2.Y) - 0.5f), static_cast<float>(begin));
+		const auto bottom = (min)(floorf((max)((max)(v0.Y, v1.Y), v2.Y) - 0.5f), end - 1.0f);
+		const auto left = (max)(ceilf((min)((min)(v0.X, v1.X), v2.X) - 0.5f), 0.0f);
+		const auto right = (min)(floorf((max)((max)(v0.X, v1.X), v2.X) - 0.5f), width - 1.0f);
+		if (top > bottom || left > right) continue;
+
+		const auto invArea = 1.0f / area;
+		for (auto y = static_cast<uint32_t>(top); y <= static_cast<uint32_t>(bottom); ++y)
+		{
+			const auto py = y + 0.5f;
+			for (auto x = static_cast<uint32_t>(left); x <= static_cast<uint32_t>(right); ++x)
+			{
+				const auto px = x + 0.5f;
+				const auto l0 = ((v2.X - v1.X) * (py - v1.Y) - (px - v1.X) * (v2.Y - v1.Y)) * invArea;
+				const auto l1 = ((v0.X - v2.X) * (py - v2.Y) - (px - v2.X) * (v0.Y - v2.Y)) * invArea;
+				const auto l2 = 1.0f - l0 - l1;
+				if (l0 < 0.0f || l1 < 0.0f || l2 < 0.0f) continue;
+
+				const auto z = l0 * v0.Z + l1 * v1.Z + l2 * v2.Z;
+				auto& depth = pDepths[width * y + x];
+				if (z < 0.0f || z >= depth) continue;
+				depth = z;
+
+				const auto w0 = l0 * v0.InvW, w1 = l1 * v1.InvW, w2 = l2 * v2.InvW;
+				const auto invSum = 1.0f / (w0 + w1 + w2);
+				shade(x, y, t, w1 * invSum, w2 * invSum);
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// HeadlessRenderer
+//--------------------------------------------------------------------------------------
+HeadlessRenderer::HeadlessRenderer() :
+	m_hasLightProbe(false),
+	m_pRayJitters(nullptr),
+	m_width(0),
+	m_height(0),
+	m_gridSize(0),
+	m_lightGridSize(0)
+{
+}
+
+HeadlessRenderer::~HeadlessRenderer()
+{
+}
+
+bool HeadlessRenderer::Init(const SceneSettings& settings, uint32_t width, uint32_t height, const XMFLOAT3* pSHCoeffs,
+	const BlueNoise* pRayJitters)
+{
+	TRACE_SCOPE("HeadlessRenderer::Init");
+
+	if (width == 0 || height == 0 || settings.GridSize == 0 || settings.LightGridSize == 0 ||
+		settings.NumVolumes == 0) return false;
+
+	m_settings = settings;
+	m_width = width;
+	m_height = height;
+	m_gridSize = settings.GridSize;
+	m_lightGridSize = settings.LightGridSize;
+	m_pRayJitters = pRayJitters;
+
+	// Same light and ambient as MultiVolumes::OnUpdate()
+	m_lightPt = XMFLOAT3(75.0f, 75.0f, -75.0f);
+	m_lightColor = XMFLOAT4(1.0f, 0.7f, 0.3f, 2.0f);
+	m_ambient = XMFLOAT4(0.4f, 0.6f, 1.0f, 0.4f);
+	m_hasLightProbe = pSHCoeffs != nullptr;
+	if (m_hasLightProbe) memcpy(m_shCoeffs, pSHCoeffs, sizeof(m_shCoeffs));
+
+	// Same clear color as MultiVolumes::LoadAssets(), in the space before tone mapping
+	const auto clearColor = settings.VolumeFiles[0].empty() ? XMVectorSet(0.2f, 0.2f, 0.2f, 0.0f) :
+		XMVectorSet(0.392156899f, 0.584313750f, 0.929411829f, 0.0f);
+	auto color = XMVectorPow(clearColor, XMVectorReplicate(1.0f / 1.25f));
+	color = XMVectorScale(color, 0.7f) / (XMVectorReplicate(1.25f) - color);
+	XMStoreFloat3(&m_clearColor, color);
+
+	// Volume worlds as MultiRayCaster::SetVolumesWorld(), also placing a partial last row
+	const auto numVolumes = settings.NumVolumes;
+	const auto size = settings.VolPosScale.w * 2.0f;
+	const auto rowLength = static_cast<uint32_t>(ceilf(sqrtf(static_cast<float>(numVolumes))));
+	const auto colLength = (numVolumes + rowLength - 1) / rowLength;
+	m_worlds.resize(numVolumes);
+	m_worldIs.resize(numVolumes);
+	m_localToLights.resize(numVolumes);
+
+	const auto lightWorld = XMMatrixScaling(settings.LightMapScale, settings.LightMapScale, settings.LightMapScale);
+	const auto lightWorldI = XMMatrixInverse(nullptr, lightWorld);
+	XMStoreFloat3x4(&m_lightMapWorld, lightWorld);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		const auto x = settings.VolPosScale.x + (static_cast<float>(i % rowLength) - (rowLength / 2.0f - 0.5f)) * size * 1.5f;
+		const auto z = settings.VolPosScale.z + (static_cast<float>(i / rowLength) - (colLength / 2.0f - 0.5f)) * size * 1.5f;
+		const auto world = XMMatrixScaling(size * 0.5f, size * 0.5f, size * 0.5f) * XMMatrixTranslation(x, settings.VolPosScale.y, z);
+		XMStoreFloat3x4(&m_worlds[i], world);
+		XMStoreFloat3x4(&m_worldIs[i], XMMatrixInverse(nullptr, world));
+		XMStoreFloat3x4(&m_localToLights[i], world * lightWorldI);
+	}
+
+	// Volume sources, procedural when no files are given as in MultiVolumes::LoadAssets()
+	m_grids.resize((min)(numVolumes, SceneSettings::NumVolumeSrcs));
+	for (auto i = 0u; i < m_grids.size(); ++i)
+	{
+		if (settings.VolumeFiles[0].empty()) initVolumeData(i);
+		else if (!loadVolumeData(i, settings.VolumeFiles[i]))
+		{
+			wcerr << L"Failed to load volume " << settings.VolumeFiles[i] << L", using the procedural volume." << endl;
+			initVolumeData(i);
+		}
+	}
+
+	// The light and the volumes are static, so the light map is shared by all frames
+	computeLightMap();
+
+	return true;
+}
+
+void HeadlessRenderer::InitFrameContext(FrameContext& context, OITEngine::Method oitMethod) const
+{
+	const auto numVolumes = m_settings.NumVolumes;
+	context.Culler.Init(numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		VolumeDesc volumeDesc;
+		volumeDesc.VolTexId = i % SceneSettings::NumVolumeSrcs;
+		volumeDesc.NumMips = NUM_CUBE_MIP;
+		volumeDesc.CubeMapSize = m_gridSize;
+		context.Culler.SetVolume(i, m_worlds[i], volumeDesc);
+	}
+
+	// The linked list holds all fragments, as the ray-traced OIT sorts all intersections
+	const auto numLayers = oitMethod == OITEngine::METHOD_LINKED_LIST ? numVolumes : NUM_OIT_LAYERS;
+	context.OIT.Init(m_width, m_height, oitMethod, numLayers);
+	context.Scheduler.Init(numVolumes, 0.0f, m_settings.MaxRaySamples);
+	context.VolumeInfos.resize(numVolumes);
+	context.VolumeStats.resize(numVolumes);
+	context.FaceCache.Init(numVolumes, m_gridSize);
+	context.CubeMaps.resize(numVolumes);
+	context.RefreshMasks.assign(numVolumes, 0);
+	context.SceneColors.resize(m_width * m_height);
+	context.BaseColors.assign(m_width * m_height, XMFLOAT4(m_clearColor.x, m_clearColor.y, m_clearColor.z, 0.0f));
+	context.Velocities.assign(m_width * m_height, XMFLOAT2(0.0f, 0.0f));
+	context.Depths.assign(m_width * m_height, 1.0f);
+	context.ViewProjPrev = XMFLOAT4X4();
+	context.TAA.Init(m_width, m_height);
+	context.FrameIndex = 0;
+	context.RaySampleScale = 1.0f;
+	context.FrameBudget = 0.0f;
+	context.ReuseCubeMaps = false;
+	context.UseTemporalAA = false;
+}
+
+bool HeadlessRenderer::LoadMesh(const char* fileName, const XMFLOAT4& posScale)
+{
+	TRACE_SCOPE("HeadlessRenderer::LoadMesh");
+
+	XUSG::ObjLoader objLoader;
+	if (!objLoader.Import(fileName, true, true)) return false;
+
+	// Interleaved positions and normals, as the vertex buffer of ObjectRenderer
+	const auto numVertices = objLoader.GetNumVertices();
+	const auto stride = objLoader.GetVertexStride();
+	const auto pVertices = objLoader.GetVertices();
+	vector<XMFLOAT3> positions(numVertices), normals(numVertices);
+	for (auto i = 0u; i < numVertices; ++i)
+	{
+		memcpy(&positions[i], &pVertices[stride * i], sizeof(XMFLOAT3));
+		memcpy(&normals[i], &pVertices[stride * i + sizeof(XMFLOAT3)], sizeof(XMFLOAT3));
+	}
+
+	SetMesh(positions.data(), normals.data(), numVertices, objLoader.GetIndices(), objLoader.GetNumIndices(), posScale);
+
+	return true;
+}
+
+void HeadlessRenderer::SetMesh(const XMFLOAT3* pPositions, const XMFLOAT3* pNormals, uint32_t numVertices,
+	const uint32_t* pIndices, uint32_t numIndices, const XMFLOAT4& posScale)
+{
+	TRACE_SCOPE("HeadlessRenderer::SetMesh");
+
+	// The mesh is static, so it is kept in world space
+	XMFLOAT3X4 world;
+	XMStoreFloat3x4(&world, XMMatrixScaling(posScale.w, posScale.w, posScale.w) *
+		XMMatrixTranslation(posScale.x, posScale.y, posScale.z));
+	m_meshPositions.resize(numVertices);
+	m_meshNormals.resize(numVertices);
+	XMFLOAT3 boundMin(FLT_MAX, FLT_MAX, FLT_MAX), boundMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (auto i = 0u; i < numVertices; ++i)
+	{
+		const auto& pos = pPositions[i];
+		boundMin = XMFLOAT3((min)(boundMin.x, pos.x), (min)(boundMin.y, pos.y), (min)(boundMin.z, pos.z));
+		boundMax = XMFLOAT3((max)(boundMax.x, pos.x), (max)(boundMax.y, pos.y), (max)(boundMax.z, pos.z));
+		m_meshPositions[i] = transformCoord(world, pos);
+		m_meshNormals[i] = normalize(transformNormal(world, pNormals[i]));
+	}
+	m_meshIndices.assign(pIndices, pIndices + numIndices);
+
+	// Shadow frustum of ObjectRenderer::UpdateFrame(), over the radius of ObjLoader::GetRadius()
+	const auto radius = (max)((max)(boundMax.x - boundMin.x, boundMax.y - boundMin.y), boundMax.z - boundMin.z) * 0.5f;
+	const auto size = radius * posScale.w * 2.0f * 1.5f;
+	const auto lightView = XMMatrixLookAtLH(XMLoadFloat3(&m_lightPt), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 1.0f));
+	XMStoreFloat4x4(&m_shadowViewProj, lightView * XMMatrixOrthographicLH(size, size, 1.0f, 200.0f));
+
+	renderShadowMap();
+	computeLightMap();
+}
+
+void HeadlessRenderer::Render(FrameContext& context, const XMFLOAT3& eyePt, const XMFLOAT3& focusPt) const
+{
+	TRACE_SCOPE("HeadlessRenderer::Render");
+
+	const auto view = XMMatrixLookAtLH(XMLoadFloat3(&eyePt), XMLoadFloat3(&focusPt), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, static_cast<float>(m_width) / m_height, g_zNear, g_zFar);
+	const auto viewProj = view * proj;
+
+	renderMesh(context, viewProj, eyePt);
+
+	const XMFLOAT2 viewport(static_cast<float>(m_width), static_cast<float>(m_height));
+	{
+		const FrameProfiler::ScopedTimer timer(FrameProfiler::CULL_VOLUMES);
+		context.Culler.Cull(viewProj, eyePt, viewport, m_settings.MaxRaySamples);
+	}
+
+	scheduleSamples(context, eyePt);
+	const auto startTime = chrono::steady_clock::now();
+	rayMarchCubeMaps(context, eyePt);
+	renderCubes(context, viewProj, eyePt);
+	if (context.FrameBudget > 0.0f)
+		context.Scheduler.Feedback(chrono::duration<float, milli>(chrono::steady_clock::now() - startTime).count());
+
+	resolveOIT(context);
+	if (context.UseTemporalAA) resolveTemporalAA(context);
+}
+
+void HeadlessRenderer::BakeIrradianceVolume(uint32_t gridSize, uint32_t numRays)
+{
+	IrradianceVolume::BakeDesc desc;
+	desc.World = m_lightMapWorld;
+	desc.GridSize = gridSize;
+	desc.NumRays = numRays;
+	desc.pEnvSH = m_hasLightProbe ? m_shCoeffs : nullptr;
+	desc.Ambient = XMFLOAT3(m_ambient.x * m_ambient.w, m_ambient.y * m_ambient.w, m_ambient.z * m_ambient.w);
+
+	m_irradianceVolume.Bake(desc, [this](const XMFLOAT3& rayOrigin, const XMFLOAT3& rayDir)
+	{
+		return getTransmittance(rayOrigin, rayDir);
+	});
+
+	computeLightMap();
+}
+
+const IrradianceVolume& HeadlessRenderer::GetIrradianceVolume() const
+{
+	return m_irradianceVolume;
+}
+
+uint32_t HeadlessRenderer::GetWidth() const
+{
+	return m_width;
+}
+
+uint32_t HeadlessRenderer::GetHeight() const
+{
+	return m_height;
+}
+
+void HeadlessRenderer::ToneMap(const XMFLOAT4* pColors, uint32_t numPixels, uint8_t* pRGBs)
+{
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::TONE_MAP);
+
+	for (auto i = 0u; i < numPixels; ++i)
+	{
+		const float src[] = { pColors[i].x, pColors[i].y, pColors[i].z };
+		for (uint8_t j = 0; j < 3; ++j)
+		{
+			auto result = (max)(src[j], 0.0f);
+			result *= 1.25f / (result + 0.7f);
+			result = powf(result, 1.25f);
+			pRGBs[3 * i + j] = static_cast<uint8_t>((min)(result, 1.0f) * 255.0f + 0.5f);
+		}
+	}
+}
+
+bool HeadlessRenderer::LoadDDSVolume(const wstring& fileName, vector<float>& texels,
+	uint32_t& width, uint32_t& height, uint32_t& depth)
+{
+	return loadDDSVolume(fileName, texels, width, height, depth);
+}
+
+bool HeadlessRenderer::WritePPM(const char* fileName, const uint8_t* pRGBs, uint32_t width, uint32_t height)
+{
+	ofstream file(fileName, ios::binary);
+	if (!file) return false;
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+	file.write(reinterpret_cast<const char*>(pRGBs), 3ull * width * height);
+
+	return static_cast<bool>(file);
+}
+
+bool HeadlessRenderer::WritePFM(const char* fileName, const XMFLOAT4* pColors, uint32_t width, uint32_t height)
+{
+	ofstream file(fileName, ios::binary);
+	if (!file) return false;
+
+	// Little-endian, bottom-to-top rows
+	file << "PF\n" << width << " " << height << "\n-1.0\n";
+	vector<float> row(3 * width);
+	for (auto y = height; y-- > 0;)
+	{
+		for (auto x = 0u; x < width; ++x)
+		{
+			const auto& color = pColors[width * y + x];
+			row[3 * x] = color.x;
+			row[3 * x + 1] = color.y;
+			row[3 * x + 2] = color.z;
+		}
+		file.write(reinterpret_cast<const char*>(row.data()), sizeof(float) * row.size());
+	}
+
+	return static_cast<bool>(file);
+}
+
+bool HeadlessRenderer::loadVolumeData(uint32_t i, const wstring& fileName)
+{
+	TRACE_SCOPE("HeadlessRenderer::loadVolumeData");
+
+	vector<float> texels;
+	uint32_t width, height, depth;
+	if (!loadDDSVolume(fileName, texels, width, height, depth)) return false;
+
+	// Resample to the grid as CSR32FToRGBA16F.hlsl
+	const auto fetch = [&texels](uint32_t idx) { return texels[idx]; };
+	auto& grid = m_grids[i];
+	grid.resize(m_gridSize * m_gridSize * m_gridSize);
+	ParallelFor(m_gridSize * m_gridSize, 16, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto row = begin; row < end; ++row)
+		{
+			const auto y = row % m_gridSize, z = row / m_gridSize;
+			for (auto x = 0u; x < m_gridSize; ++x)
+			{
+				const XMFLOAT3 uvw((x + 0.5f) / m_gridSize, (y + 0.5f) / m_gridSize, (z + 0.5f) / m_gridSize);
+				const auto a = sampleLinear3D<float>(fetch, width, height, depth, uvw);
+				grid[m_gridSize * row + x] = XMFLOAT4(1.0f, 1.0f, 1.0f, a * 2.0f);
+			}
+		}
+	});
+
+	return true;
+}
+
+void HeadlessRenderer::initVolumeData(uint32_t i)
+{
+	// Same as CSInitGridData.hlsl
+	auto& grid = m_grids[i];
+	grid.resize(m_gridSize * m_gridSize * m_gridSize);
+	ParallelFor(m_gridSize * m_gridSize, 16, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto row = begin; row < end; ++row)
+		{
+			const auto y = row % m_gridSize, z = row / m_gridSize;
+			for (auto x = 0u; x < m_gridSize; ++x)
+			{
+				const XMFLOAT3 pos((x + 0.5f) / m_gridSize * 2.0f - 1.0f,
+					(y + 0.5f) / m_gridSize * 2.0f - 1.0f, (z + 0.5f) / m_gridSize * 2.0f - 1.0f);
+				auto a = 1.0f - (pos.x * pos.x + pos.y * pos.y + pos.z * pos.z);
+				a *= a;
+				a = (min)((max)(a * a * 2.0f, 0.0f), 1.0f);
+
+				const auto t = (min)((max)(pos.y * 0.5f + 0.2f, 0.0f), 1.0f);
+				grid[m_gridSize * row + x] = XMFLOAT4(0.5f + 0.5f * t, 0.8f - 0.2f * t, 1.0f - t, a);
+			}
+		}
+	});
+}
+
+void HeadlessRenderer::computeLightMap()
+{
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::RAY_MARCH_L);
+
+	// Same as CSRayMarchL.hlsl with a directional light and no shadow map
+	const auto size = m_lightGridSize;
+	const auto numVolumes = m_settings.NumVolumes;
+	const auto numSamples = m_settings.MaxLightSamples;
+	const auto stepScale = g_maxDist / numSamples;
+	const XMFLOAT3 lightColor(m_lightColor.x * m_lightColor.w, m_lightColor.y * m_lightColor.w, m_lightColor.z * m_lightColor.w);
+	const XMFLOAT3 ambient(m_ambient.x * m_ambient.w, m_ambient.y * m_ambient.w, m_ambient.z * m_ambient.w);
+
+	vector<XMFLOAT3> lightDirs(numVolumes);
+	for (auto n = 0u; n < numVolumes; ++n) lightDirs[n] = normalize(transformNormal(m_worldIs[n], m_lightPt));
+	const auto hasIrradianceVolume = m_irradianceVolume.GetGridSize() > 0;
+	const auto hasMesh = !m_meshIndices.empty();
+	const auto shadowViewProj = XMLoadFloat4x4(&m_shadowViewProj);
+
+	m_lightMap.resize(static_cast<size_t>(size) * size * size);
+	ParallelFor(size * size, 4, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto row = begin; row < end; ++row)
+		{
+			const auto y = row % size, z = row / size;
+			for (auto x = 0u; x < size; ++x)
+			{
+				XMFLOAT3 rayOrigin((x + 0.5f) / size * 2.0f - 1.0f, (y + 0.5f) / size * 2.0f - 1.0f, (z + 0.5f) / size * 2.0f - 1.0f);
+				rayOrigin = transformCoord(m_lightMapWorld, rayOrigin);	// Light-map space to world space
+
+				// Find the volume of which the current position is nonempty
+				auto hasDensity = false;
+				auto volTexId = 0u, n = 0u;
+				XMFLOAT3 uvw(0.0f, 0.0f, 0.0f);
+				for (; n < numVolumes && !hasDensity; ++n)
+				{
+					const auto localRayOrigin = transformCoord(m_worldIs[n], rayOrigin);
+					if (isInside(localRayOrigin))
+					{
+						volTexId = n % SceneSettings::NumVolumeSrcs;
+						uvw = localToTex3DSpace(localRayOrigin);
+						hasDensity = sampleGrid(volTexId, uvw).w >= ZERO_THRESHOLD;
+					}
+				}
+
+				// Rays start within the second step, at the jitter of the voxel
+				const auto tStart = m_pRayJitters ? stepScale * (0.5f + m_pRayJitters->Get(x, y, z)) : stepScale;
+
+				// Occluded by the mesh, as ShadowTest() in CSRayMarchL.hlsl
+				auto shadow = 1.0f, ao = 1.0f;
+				if (hasMesh)
+				{
+					XMFLOAT3 lsPos;
+					XMStoreFloat3(&lsPos, XMVector3TransformCoord(XMLoadFloat3(&rayOrigin), shadowViewProj));
+					shadow = lsPos.z < sampleShadowMap(lsPos, false) ? 1.0f : 0.0f;
+				}
+				XMFLOAT3 irradiance(0.0f, 0.0f, 0.0f);
+				XMFLOAT3 aoRayDir(0.0f, 0.0f, 0.0f);
+				if (hasDensity && (m_hasLightProbe || hasIrradianceVolume))
+				{
+					// Avoid 0-gradient caused by uniform density field
+					const auto gradient = getDensityGradient(volTexId, uvw);
+					aoRayDir = gradient.x != 0.0f || gradient.y != 0.0f || gradient.z != 0.0f ?
+						XMFLOAT3(-gradient.x, -gradient.y, -gradient.z) : rayOrigin;
+					aoRayDir = normalize(aoRayDir);
+
+					// The baked probes already hold the occlusion by all volumes
+					const auto norm = normalize(transformNormal(m_worlds[n - 1], aoRayDir));
+					irradiance = hasIrradianceVolume ? m_irradianceVolume.GetIrradiance(rayOrigin, norm) :
+						evaluateSHIrradiance(m_shCoeffs, norm);
+				}
+
+				for (n = 0; hasDensity && n < numVolumes; ++n)
+				{
+					auto localRayOrigin = transformCoord(m_worldIs[n], rayOrigin);
+					if (shadow >= ZERO_THRESHOLD)
+					{
+						const auto& rayDir = lightDirs[n];
+						if (!computeRayOrigin(localRayOrigin, rayDir)) continue;
+						const auto lightVolTexId = n % SceneSettings::NumVolumeSrcs;
+
+						auto t = tStart;
+						auto step = stepScale;
+						for (auto i = 0u; i < numSamples; ++i)
+						{
+							const XMFLOAT3 pos(localRayOrigin.x + rayDir.x * t, localRayOrigin.y + rayDir.y * t, localRayOrigin.z + rayDir.z * t);
+							if (!isInside(pos)) break;
+
+							// Attenuate ray-throughput along light direction
+							const auto opacity = getOpacity(sampleGrid(lightVolTexId, localToTex3DSpace(pos)).w, step);
+							shadow *= 1.0f - opacity;
+							if (shadow < ZERO_THRESHOLD) break;
+
+							// Update position along light ray
+							step = getStep(shadow, opacity, stepScale);
+							t += step;
+						}
+					}
+
+					if (m_hasLightProbe && !hasIrradianceVolume)
+					{
+						// Occlusion of the probe along the AO ray, in the density of the found volume as the shader does
+						auto t = tStart;
+						auto step = stepScale;
+						for (auto i = 0u; i < numSamples; ++i)
+						{
+							const XMFLOAT3 pos(localRayOrigin.x + aoRayDir.x * t, localRayOrigin.y + aoRayDir.y * t, localRayOrigin.z + aoRayDir.z * t);
+							if (!isInside(pos)) break;
+
+							const auto opacity = getOpacity(sampleGrid(volTexId, localToTex3DSpace(pos)).w, step);
+							ao *= 1.0f - opacity;
+							if (ao < ZERO_THRESHOLD) break;
+
+							step = getStep(ao, opacity, stepScale);
+							t += step;
+						}
+					}
+				}
+
+				const auto amb = m_hasLightProbe || hasIrradianceVolume ? XMFLOAT3(irradiance.x * ao, irradiance.y * ao, irradiance.z * ao) : ambient;
+				const XMFLOAT3 light(lightColor.x * shadow + amb.x, lightColor.y * shadow + amb.y, lightColor.z * shadow + amb.z);
+				m_lightMap[static_cast<size_t>(size) * row + x] = packR11G11B10(light);
+			}
+		}
+	});
+}
+
+void HeadlessRenderer::renderShadowMap()
+{
+	vector<RasterVertex> vertices;
+	setupRasterVertices(m_meshPositions, XMLoadFloat4x4(&m_shadowViewProj), XMFLOAT2(0.0f, 0.0f),
+		g_shadowMapSize, g_shadowMapSize, vertices);
+
+	vector<float> depths(g_shadowMapSize * g_shadowMapSize, 1.0f);
+	ParallelFor(g_shadowMapSize, 16, [&](uint32_t begin, uint32_t end)
+	{
+		rasterizeRows(vertices, m_meshIndices, g_shadowMapSize, begin, end, depths.data(),
+			[](uint32_t, uint32_t, uint32_t, float, float) {});
+	});
+
+	m_shadowMap.resize(depths.size());
+	for (size_t i = 0; i < depths.size(); ++i) m_shadowMap[i] = static_cast<uint16_t>(depths[i] * 65535.0f + 0.5f);
+}
+
+void HeadlessRenderer::renderMesh(FrameContext& context, CXMMATRIX viewProj, const XMFLOAT3& eyePt) const
+{
+	if (m_meshIndices.empty()) return;
+
+	// Jitter of ObjectRenderer::UpdateFrame(), indexed by the frame so that the frame jobs agree
+	const auto halton = m_jitterSequence.Get(context.FrameIndex);
+	const XMFLOAT2 jitter((halton.x * 2.0f - 1.0f) / m_width, (halton.y * 2.0f - 1.0f) / m_height);
+	vector<RasterVertex> vertices;
+	setupRasterVertices(m_meshPositions, viewProj, jitter, m_width, m_height, vertices);
+
+	const XMFLOAT4 clearColor(m_clearColor.x, m_clearColor.y, m_clearColor.z, 0.0f);
+	fill(context.BaseColors.begin(), context.BaseColors.end(), clearColor);
+	fill(context.Velocities.begin(), context.Velocities.end(), XMFLOAT2(0.0f, 0.0f));
+	fill(context.Depths.begin(), context.Depths.end(), 1.0f);
+
+	// Constants of PSBasePass.hlsl
+	const auto baseColor = XMVectorSet(1.0f, 0.6f, 0.2f, 0.0f);
+	const auto lightDir = XMVector3Normalize(XMLoadFloat3(&m_lightPt));
+	const auto lightColor = XMVectorScale(XMLoadFloat4(&m_lightColor), m_lightColor.w);
+	const auto ambient = XMVectorScale(XMLoadFloat4(&m_ambient), m_ambient.w);
+	const auto eye = XMLoadFloat3(&eyePt);
+	const auto shadowViewProj = XMLoadFloat4x4(&m_shadowViewProj);
+	const auto viewProjPrev = XMLoadFloat4x4(&context.ViewProjPrev);
+
+	ParallelFor(m_height, 8, [&](uint32_t begin, uint32_t end)
+	{
+		rasterizeRows(vertices, m_meshIndices, m_width, begin, end, context.Depths.data(),
+			[&](uint32_t x, uint32_t y, uint32_t t, float b1, float b2)
+		{
+			const auto i0 = m_meshIndices[3 * t], i1 = m_meshIndices[3 * t + 1], i2 = m_meshIndices[3 * t + 2];
+			const auto b0 = 1.0f - b1 - b2;
+			const auto pos = XMLoadFloat3(&m_meshPositions[i0]) * b0 + XMLoadFloat3(&m_meshPositions[i1]) * b1 +
+				XMLoadFloat3(&m_meshPositions[i2]) * b2;
+			const auto norm = XMVector3Normalize(XMLoadFloat3(&m_meshNormals[i0]) * b0 +
+				XMLoadFloat3(&m_meshNormals[i1]) * b1 + XMLoadFloat3(&m_meshNormals[i2]) * b2);
+
+			// Unjittered velocity in texture space, none before the first frame
+			const auto csPos = XMVector3Transform(pos, viewProj);
+			const auto tsPos = XMVector3Transform(pos, viewProjPrev);
+			const auto pixel = m_width * y + x;
+			if (XMVectorGetW(tsPos) > 0.0f)
+			{
+				const auto velocity = (csPos / XMVectorSplatW(csPos) - tsPos / XMVectorSplatW(tsPos)) * XMVectorSet(0.5f, -0.5f, 0.0f, 0.0f);
+				XMStoreFloat2(&context.Velocities[pixel], velocity);
+			}
+
+			XMFLOAT3 lsPos;
+			XMStoreFloat3(&lsPos, XMVector3TransformCoord(pos, shadowViewProj));
+			const auto shadow = sampleShadowMap(lsPos, true);
+
+			const auto viewDir = XMVector3Normalize(eye - pos);
+			const auto halfDir = XMVector3Normalize(viewDir + lightDir);
+			const auto NoL = XMVectorSaturate(XMVector3Dot(norm, lightDir));
+			const auto NoH = XMVectorSaturate(XMVector3Dot(norm, halfDir));
+			const auto NoV = XMVectorSaturate(XMVector3Dot(norm, viewDir));
+
+			// Irradiance of the light probe, or the hemispheric ambient; the headless renderer
+			// has no radiance cube, so the specular probe term is left out
+			XMVECTOR amb;
+			if (m_hasLightProbe)
+			{
+				XMFLOAT3 n;
+				XMStoreFloat3(&n, norm);
+				const auto irradiance = evaluateSHIrradiance(m_shCoeffs, n);
+				amb = XMLoadFloat3(&irradiance);
+			}
+			else amb = ambient * (0.5f + 0.5f * (XMVectorGetY(norm) * 0.5f + 0.5f));
+
+			// Schlick's approximation
+			const auto fresnel = XMVectorPow(XMVectorReplicate(1.0f) - NoV, XMVectorReplicate(5.0f));
+			const auto specular = XMVectorPow(NoH, XMVectorReplicate(64.0f)) * XMVectorLerp(fresnel, XMVectorReplicate(1.0f), 0.08f) * XM_PI;
+			const auto result = (baseColor * NoL + specular) * lightColor * shadow + baseColor * amb;
+
+			auto& color = context.BaseColors[pixel];
+			XMStoreFloat4(&color, result);
+			color.w = 1.0f;
+		});
+	});
+
+	XMStoreFloat4x4(&context.ViewProjPrev, viewProj);
+}
+
+void HeadlessRenderer::scheduleSamples(FrameContext& context, const XMFLOAT3& eyePt) const
+{
+	const auto& visibleVolumes = context.Culler.GetVisibleVolumes();
+	const auto pVolumeInfos = context.Culler.GetVolumeInfos();
+	for (const auto& i : visibleVolumes) context.VolumeInfos[i] = pVolumeInfos[i];
+	if (context.FrameBudget <= 0.0f) return;
+
+	// Distribute the frame budget over the visible volumes, from the LODs of the culler
+	const auto pProjCoverages = context.Culler.GetProjCoverages();
+	const auto pMaxEdgeLengths = context.Culler.GetMaxEdgeLengths();
+	for (const auto& i : visibleVolumes)
+	{
+		const auto& world = m_worlds[i];
+		const auto dx = world.m[0][3] - eyePt.x, dy = world.m[1][3] - eyePt.y, dz = world.m[2][3] - eyePt.z;
+
+		auto& stats = context.VolumeStats[i];
+		stats.ProjCoverage = pProjCoverages[i];
+		stats.MaxEdgeLength = pMaxEdgeLengths[i];
+		stats.Distance = sqrtf(dx * dx + dy * dy + dz * dz);
+		stats.CubeMapSize = m_gridSize;
+		stats.NumMips = NUM_CUBE_MIP;
+	}
+
+	context.Scheduler.SetBudget(context.FrameBudget);
+	context.Scheduler.Schedule(visibleVolumes.data(), static_cast<uint32_t>(visibleVolumes.size()),
+		context.VolumeStats.data(), context.VolumeInfos.data());
+}
+
+void HeadlessRenderer::rayMarchCubeMaps(FrameContext& context, const XMFLOAT3& eyePt) const
+{
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::RAY_MARCH_V);
+
+	const auto& visibleVolumes = context.Culler.GetVisibleVolumes();
+	const auto pVolumeInfos = context.VolumeInfos.data();
+	if (context.ReuseCubeMaps) context.FaceCache.Update(visibleVolumes.data(), static_cast<uint32_t>(visibleVolumes.size()),
+		m_worlds.data(), eyePt, pVolumeInfos, context.RefreshMasks.data());
+
+	// Face rows of the cube maps to ray march, as CSRayMarch.hlsl dispatches
+	vector<uint32_t> marchedVolumes;
+	vector<uint8_t> marchedFaceMasks;
+	vector<XMFLOAT3> localEyePts;
+	vector<uint32_t> rowOffsets(1, 0);
+	for (const auto& i : visibleVolumes)
+	{
+		const auto& volumeInfo = pVolumeInfos[i];
+		if (!(volumeInfo.FaceMask & g_cubeMapRayMarchBit)) continue;
+
+		const auto faceMask = static_cast<uint8_t>(context.ReuseCubeMaps ? context.RefreshMasks[i] : volumeInfo.FaceMask & 0x3f);
+		if (!faceMask) continue;
+
+		// The cache invalidates all faces of a volume on a change of its mip level
+		const auto size = (max)(m_gridSize >> volumeInfo.MipLevel, 1u);
+		auto& cubeMap = context.CubeMaps[i];
+		if (!context.ReuseCubeMaps || cubeMap.size() != 6 * size * size)
+			cubeMap.assign(6 * size * size, XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+		marchedVolumes.push_back(i);
+		marchedFaceMasks.push_back(faceMask);
+		localEyePts.push_back(transformCoord(m_worldIs[i], eyePt));
+		rowOffsets.push_back(rowOffsets.back() + 6 * size);
+	}
+
+	ParallelFor(rowOffsets.back(), 4, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto row = begin; row < end; ++row)
+		{
+			const auto n = static_cast<uint32_t>(upper_bound(rowOffsets.cbegin(), rowOffsets.cend(), row) - rowOffsets.cbegin()) - 1;
+			const auto i = marchedVolumes[n];
+			const auto& volumeInfo = pVolumeInfos[i];
+			const auto size = (max)(m_gridSize >> volumeInfo.MipLevel, 1u);
+			const auto face = static_cast<uint8_t>((row - rowOffsets[n]) / size);
+			const auto y = (row - rowOffsets[n]) % size;
+			if (!(marchedFaceMasks[n] & (1 << face))) continue;
+
+			const auto& rayOrigin = localEyePts[n];
+			const auto numSamples = scaleSampleCount(volumeInfo.SmpCount, context.RaySampleScale);
+			auto pDst = &context.CubeMaps[i][size * (size * face + y)];
+			for (auto x = 0u; x < size; ++x)
+			{
+				const auto target = getLocalPos(x, y, face, size);
+				const auto rayDir = normalize(XMFLOAT3(target.x - rayOrigin.x, target.y - rayOrigin.y, target.z - rayOrigin.z));
+				const auto jitter = m_pRayJitters ? m_pRayJitters->Get(x, size * face + y, context.FrameIndex) : 0.0f;
+				pDst[x] = rayMarch(i, rayOrigin, rayDir, numSamples, jitter);
+			}
+		}
+	});
+}
+
+void HeadlessRenderer::renderCubes(FrameContext& context, CXMMATRIX viewProj, const XMFLOAT3& eyePt) const
+{
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::RENDER_CUBE);
+
+	struct Cube
+	{
+		uint32_t VolumeId;
+		XMFLOAT3 LocalEyePt;
+		int32_t Left, Top, Right, Bottom;	// Inclusive pixel bounds
+	};
+
+	const auto& visibleVolumes = context.Culler.GetVisibleVolumes();
+	const auto pVolumeInfos = context.VolumeInfos.data();
+	const auto width = static_cast<int32_t>(m_width);
+	const auto height = static_cast<int32_t>(m_height);
+
+	// Screen bounds of the visible cubes
+	vector<Cube> cubes;
+	cubes.reserve(visibleVolumes.size());
+	for (const auto& i : visibleVolumes)
+	{
+		Cube cube = { i, transformCoord(m_worldIs[i], eyePt), width, height, -1, -1 };
+		const auto worldViewProj = XMLoadFloat3x4(&m_worlds[i]) * viewProj;
+		auto isClipped = false;
+		for (uint8_t j = 0; j < 8 && !isClipped; ++j)
+		{
+			const auto corner = XMVectorSet(j & 1 ? 1.0f : -1.0f, j & 2 ? 1.0f : -1.0f, j & 4 ? 1.0f : -1.0f, 1.0f);
+			const auto hPos = XMVector4Transform(corner, worldViewProj);
+			const auto w = XMVectorGetW(hPos);
+			isClipped = w < g_zNear;
+			if (isClipped) break;
+
+			const auto x = (XMVectorGetX(hPos) / w * 0.5f + 0.5f) * m_width;
+			const auto y = (0.5f - XMVectorGetY(hPos) / w * 0.5f) * m_height;
+			cube.Left = (min)(cube.Left, static_cast<int32_t>(floorf(x)));
+			cube.Top = (min)(cube.Top, static_cast<int32_t>(floorf(y)));
+			cube.Right = (max)(cube.Right, static_cast<int32_t>(ceilf(x)));
+			cube.Bottom = (max)(cube.Bottom, static_cast<int32_t>(ceilf(y)));
+		}
+
+		if (isClipped)
+		{
+			cube.Left = cube.Top = 0;
+			cube.Right = width - 1;
+			cube.Bottom = height - 1;
+		}
+
+		cube.Left = (max)(cube.Left, 0);
+		cube.Top = (max)(cube.Top, 0);
+		cube.Right = (min)(cube.Right, width - 1);
+		cube.Bottom = (min)(cube.Bottom, height - 1);
+		if (cube.Left <= cube.Right && cube.Top <= cube.Bottom) cubes.push_back(cube);
+	}
+
+	// The view depth is the clip-space w, linear in the ray parameter from the eye
+	XMFLOAT4X4 viewProjT;
+	XMStoreFloat4x4(&viewProjT, viewProj);
+	const auto viewProjI = XMMatrixInverse(nullptr, viewProj);
+	const auto eye = XMLoadFloat3(&eyePt);
+
+	// Render the interior faces as with front-face culling, one fragment per volume and pixel
+	auto& oit = context.OIT;
+	oit.Clear();
+	ParallelFor(m_height, 4, [&](uint32_t begin, uint32_t end)
+	{
+		vector<XMFLOAT3> rayDirs(m_width);
+		for (auto y = begin; y < end; ++y)
+		{
+			for (auto x = 0u; x < m_width; ++x)
+			{
+				const auto ndcX = (x + 0.5f) / m_width * 2.0f - 1.0f;
+				const auto ndcY = 1.0f - (y + 0.5f) / m_height * 2.0f;
+				const auto farPt = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), viewProjI);
+				XMStoreFloat3(&rayDirs[x], farPt - eye);
+			}
+
+			for (const auto& cube : cubes)
+			{
+				if (static_cast<int32_t>(y) < cube.Top || static_cast<int32_t>(y) > cube.Bottom) continue;
+
+				const auto i = cube.VolumeId;
+				const auto& volumeInfo = pVolumeInfos[i];
+				const auto isCubeMapped = (volumeInfo.FaceMask & g_cubeMapRayMarchBit) != 0;
+				if (!isCubeMapped && volumeInfo.SmpCount == 0) continue;
+
+				const auto& o = cube.LocalEyePt;
+				const auto cubeMapSize = (max)(m_gridSize >> volumeInfo.MipLevel, 1u);
+				for (auto x = static_cast<uint32_t>(cube.Left); x <= static_cast<uint32_t>(cube.Right); ++x)
+				{
+					// Exit point of the ray on the back faces
+					const auto& rayDirW = rayDirs[x];
+					const auto d = transformNormal(m_worldIs[i], rayDirW);
+					auto tEnter = 0.0f, tExit = FLT_MAX;
+					const float od[][2] = { { o.x, d.x }, { o.y, d.y }, { o.z, d.z } };
+					for (const auto& c : od)
+					{
+						const auto t0 = (-1.0f - c[0]) / c[1], t1 = (1.0f - c[0]) / c[1];
+						tEnter = (max)(tEnter, (min)(t0, t1));
+						tExit = (min)(tExit, (max)(t0, t1));
+					}
+					if (!(tExit >= tEnter)) continue;
+
+					const auto depth = tExit * (rayDirW.x * viewProjT._14 + rayDirW.y * viewProjT._24 + rayDirW.z * viewProjT._34);
+					if (depth < g_zNear || depth > g_zFar) continue;
+
+					const XMFLOAT3 localPt(
+						(min)((max)(o.x + d.x * tExit, -1.0f), 1.0f),
+						(min)((max)(o.y + d.y * tExit, -1.0f), 1.0f),
+						(min)((max)(o.z + d.z * tExit, -1.0f), 1.0f));
+
+					XMFLOAT4 color;
+					if (isCubeMapped) color = cubeCast(context.CubeMaps[i], cubeMapSize, localPt);
+					else
+					{
+						const auto rayDir = normalize(XMFLOAT3(localPt.x - o.x, localPt.y - o.y, localPt.z - o.z));
+						const auto jitter = m_pRayJitters ? m_pRayJitters->Get(x, y, context.FrameIndex) : 0.0f;
+						color = rayMarch(i, o, rayDir, scaleSampleCount(volumeInfo.SmpCount, context.RaySampleScale), jitter);
+					}
+
+					if (color.w > 0.0f && color.w <= 1.0f) oit.AddFragment(x, y, depth, color);
+				}
+			}
+		}
+	});
+}
+
+void HeadlessRenderer::resolveOIT(FrameContext& context) const
+{
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::RESOLVE_OIT);
+
+	// Resolve and blend over the base pass, as the premultiplied blending of the resolve
+	context.OIT.Resolve(context.SceneColors.data());
+	for (size_t i = 0; i < context.SceneColors.size(); ++i)
+	{
+		auto& color = context.SceneColors[i];
+		const auto& base = context.BaseColors[i];
+		const auto transm = 1.0f - color.w;
+		color.x += base.x * transm;
+		color.y += base.y * transm;
+		color.z += base.z * transm;
+		color.w += base.w * transm;
+	}
+}
+
+void HeadlessRenderer::resolveTemporalAA(FrameContext& context) const
+{
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::TEMPORAL_AA);
+
+	// The volumes leave the cleared zero velocities, and their alphas below 1 mostly pass
+	// the current frame through, as on the GPU
+	const auto pOutput = context.TAA.Resolve(context.SceneColors.data(), context.Velocities.data());
+	copy(pOutput, pOutput + context.SceneColors.size(), context.SceneColors.begin());
+}
+
+XMFLOAT4 HeadlessRenderer::rayMarch(uint32_t i, XMFLOAT3 rayOrigin, const XMFLOAT3& rayDir,
+	uint32_t numSamples, float jitter) const
+{
+	// Same as RayCast() in RayCast.hlsli and the loop of CSRayMarch.hlsl
+	if (!computeRayOrigin(rayOrigin, rayDir) || numSamples == 0) return XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+
+	const auto volTexId = i % SceneSettings::NumVolumeSrcs;
+	const auto& localToLight = m_localToLights[i];
+	const auto stepScale = g_maxDist / numSamples;
+
+	// Transmittance
+	auto transm = 1.0f;
+
+	// In-scattered radiance
+	XMFLOAT3 scatter(0.0f, 0.0f, 0.0f);
+
+	auto t = jitter * stepScale;
+	auto step = stepScale;
+	for (auto n = 0u; n < numSamples; ++n)
+	{
+		const XMFLOAT3 pos(rayOrigin.x + rayDir.x * t, rayOrigin.y + rayDir.y * t, rayOrigin.z + rayDir.z * t);
+		if (!isInside(pos)) break;
+
+		// Get a sample
+		auto color = sampleGrid(volTexId, localToTex3DSpace(pos));
+
+		// Skip empty space
+		if (color.w > ZERO_THRESHOLD)
+		{
+			// Sample light
+			const auto light = sampleLightMap(localToTex3DSpace(transformCoord(localToLight, pos)));
+
+			// Accumulate color
+			color.w = getOpacity(color.w, step);
+			const auto weight = transm * color.w;
+			scatter.x += light.x * color.x * weight;
+			scatter.y += light.y * color.y * weight;
+			scatter.z += light.z * color.z * weight;
+
+			// Attenuate ray-throughput
+			transm *= 1.0f - color.w;
+			if (transm < ZERO_THRESHOLD) break;
+		}
+
+		// Update position along ray
+		step = getStep(transm, color.w, stepScale);
+		t += step;
+	}
+
+	return XMFLOAT4(scatter.x, scatter.y, scatter.z, 1.0f - transm);
+}
+
+XMFLOAT4 HeadlessRenderer::sampleGrid(uint32_t volTexId, const XMFLOAT3& uvw) const
+{
+	const auto pGrid = m_grids[volTexId].data();
+	const auto fetch = [pGrid](uint32_t idx) { return XMLoadFloat4(&pGrid[idx]); };
+
+	XMFLOAT4 color;
+	XMStoreFloat4(&color, sampleLinear3D<XMVECTOR>(fetch, m_gridSize, m_gridSize, m_gridSize, uvw));
+
+	return color;
+}
+
+XMFLOAT3 HeadlessRenderer::getDensityGradient(uint32_t volTexId, const XMFLOAT3& uvw) const
+{
+	// Same as GetDensityGradient() in RayMarch.hlsli, with the texel offsets in texture space
+	const auto texel = 1.0f / m_gridSize;
+	const auto q = [&](float du, float dv, float dw) { return sampleGrid(volTexId, XMFLOAT3(uvw.x + du, uvw.y + dv, uvw.z + dw)).w; };
+
+	return XMFLOAT3(q(texel, 0.0f, 0.0f) - q(-texel, 0.0f, 0.0f),
+		q(0.0f, texel, 0.0f) - q(0.0f, -texel, 0.0f),
+		q(0.0f, 0.0f, texel) - q(0.0f, 0.0f, -texel));
+}
+
+float HeadlessRenderer::getTransmittance(const XMFLOAT3& rayOrigin, const XMFLOAT3& rayDir) const
+{
+	// Through all volumes along a world-space ray, marched as the shadow rays
+	const auto numSamples = m_settings.MaxLightSamples;
+	const auto stepScale = g_maxDist / numSamples;
+
+	auto transm = 1.0f;
+	for (auto n = 0u; n < m_settings.NumVolumes && transm >= ZERO_THRESHOLD; ++n)
+	{
+		auto localRayOrigin = transformCoord(m_worldIs[n], rayOrigin);
+		const auto localRayDir = normalize(transformNormal(m_worldIs[n], rayDir));
+		if (!computeRayOrigin(localRayOrigin, localRayDir)) continue;
+		const auto volTexId = n % SceneSettings::NumVolumeSrcs;
+
+		auto t = stepScale;
+		auto step = stepScale;
+		for (auto i = 0u; i < numSamples; ++i)
+		{
+			const XMFLOAT3 pos(localRayOrigin.x + localRayDir.x * t, localRayOrigin.y + localRayDir.y * t, localRayOrigin.z + localRayDir.z * t);
+			if (!isInside(pos)) break;
+
+			const auto opacity = getOpacity(sampleGrid(volTexId, localToTex3DSpace(pos)).w, step);
+			transm *= 1.0f - opacity;
+			if (transm < ZERO_THRESHOLD) break;
+
+			step = getStep(transm, opacity, stepScale);
+			t += step;
+		}
+	}
+
+	return transm < ZERO_THRESHOLD ? 0.0f : transm;
+}
+
+float HeadlessRenderer::sampleShadowMap(const XMFLOAT3& lsPos, bool isComparison) const
+{
+	// Bilinear with clamp addressing: of the LESS_EQUAL comparisons with the bias, as
+	// ShadowMap() in PSBasePass.hlsl, or of the depths, as ShadowTest() in RayMarch.hlsli
+	const auto u = (min)((max)(lsPos.x * 0.5f + 0.5f, 0.0f), 1.0f);
+	const auto v = (min)((max)(0.5f - lsPos.y * 0.5f, 0.0f), 1.0f);
+	uint32_t x0, x1, y0, y1;
+	float wx, wy;
+	getTexelCoords(u, g_shadowMapSize, x0, x1, wx);
+	getTexelCoords(v, g_shadowMapSize, y0, y1, wy);
+
+	const auto ref = lsPos.z - 0.0027f;
+	const auto fetch = [&](uint32_t x, uint32_t y)
+	{
+		const auto depth = m_shadowMap[g_shadowMapSize * y + x] / 65535.0f;
+
+		return isComparison ? (ref <= depth ? 1.0f : 0.0f) : depth;
+	};
+
+	const auto top = fetch(x0, y0) + (fetch(x1, y0) - fetch(x0, y0)) * wx;
+	const auto bottom = fetch(x0, y1) + (fetch(x1, y1) - fetch(x0, y1)) * wx;
+
+	return top + (bottom - top) * wy;
+}
+
+XMFLOAT3 HeadlessRenderer::sampleLightMap(const XMFLOAT3& uvw) const
+{
+	const auto pLightMap = m_lightMap.data();
+	const auto fetch = [pLightMap](uint32_t idx)
+	{
+		const auto light = unpackR11G11B10(pLightMap[idx]);
+		return XMLoadFloat3(&light);
+	};
+
+	XMFLOAT3 light;
+	XMStoreFloat3(&light, sampleLinear3D<XMVECTOR>(fetch, m_lightGridSize, m_lightGridSize, m_lightGridSize, uvw));
+
+	return light;
+}
@@ -0,0 +1,142 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SceneSettings.h"
+#include "VolumeCuller.h"
+#include "SampleScheduler.h"
+#include "CubeMapCache.h"
+#include "OITEngine.h"
+#include "TemporalAA.h"
+#include "SampleSequence.h"
+#include "IrradianceVolume.h"
+#include "BlueNoise.h"
+
+// Offline CPU renderer of the MultiRayCaster pipeline: light pass, culling, cube-map ray
+// marching, interior-face cube rendering into the OIT buffers and the OIT resolve. The scene
+// is read-only after Init(), so frames may be rendered concurrently with one context each.
+// With a frame budget, the sample scheduler of the context reassigns the per-volume sample
+// counts and mip levels of the culler every frame, fed back with the measured render time.
+// With cube-map reuse, only the faces the cube-map cache of the context finds stale for the
+// eye are re-marched, and the other faces keep the radiance of an earlier frame.
+// With a mesh, the shadow map and base pass of ObjectRenderer draw it under the volumes, with
+// the TAA jitter and velocities. With temporal AA, the TAA of ObjectRenderer::Postprocess()
+// resolves every frame against the history of the context, which needs the frames in order.
+class HeadlessRenderer
+{
+public:
+	struct FrameContext
+	{
+		VolumeCuller Culler;
+		SampleScheduler Scheduler;
+		OITEngine OIT;
+		std::vector<VolumeInfo> VolumeInfos;					// Of the culler, or as scheduled
+		std::vector<SampleScheduler::VolumeStats> VolumeStats;
+		CubeMapCache FaceCache;
+		std::vector<std::vector<DirectX::XMFLOAT4>> CubeMaps;	// 6 faces at the current mip level
+		std::vector<uint8_t> RefreshMasks;						// Faces re-marched in the frame
+		std::vector<DirectX::XMFLOAT4> SceneColors;				// Linear HDR, before tone mapping
+		std::vector<DirectX::XMFLOAT4> BaseColors;				// Of the base pass, under the volumes
+		std::vector<DirectX::XMFLOAT2> Velocities;				// In texture space, as the velocity target
+		std::vector<float> Depths;								// Of the base pass
+		DirectX::XMFLOAT4X4 ViewProjPrev;						// Of the mesh velocities, 0 before the first frame
+		TemporalAA TAA;
+		uint32_t FrameIndex;									// Slice of the ray jitters
+		float RaySampleScale;									// Of the ray sample counts of the culler, at the same LODs
+		float FrameBudget;										// Of the ray marching and cube rendering, in milliseconds;
+																// 0 keeps the sample counts of the culler
+		bool ReuseCubeMaps;										// Only re-march the stale faces
+		bool UseTemporalAA;										// Resolve into the TAA history, so frames must
+																// be rendered in order
+	};
+
+	HeadlessRenderer();
+	virtual ~HeadlessRenderer();
+
+	// The light probe is given as the order-3 SH coefficients of its radiance. With the ray
+	// jitters, every ray starts within its first step at the blue-noise offset of its texel
+	// (and frame), which turns the banding of few samples into noise.
+	bool Init(const SceneSettings& settings, uint32_t width, uint32_t height, const DirectX::XMFLOAT3* pSHCoeffs = nullptr,
+		const BlueNoise* pRayJitters = nullptr);
+	void InitFrameContext(FrameContext& context, OITEngine::Method oitMethod = OITEngine::METHOD_K_BUFFER) const;
+
+	// Shows the mesh, as [M] in MultiVolumes, from its object-space positions, normals and
+	// triangles placed by the position and scale of SceneSettings::MeshPosScale. Its shadow
+	// map is rendered once, and the light map is recomputed with its shadow.
+	bool LoadMesh(const char* fileName, const DirectX::XMFLOAT4& posScale);
+	void SetMesh(const DirectX::XMFLOAT3* pPositions, const DirectX::XMFLOAT3* pNormals, uint32_t numVertices,
+		const uint32_t* pIndices, uint32_t numIndices, const DirectX::XMFLOAT4& posScale);
+
+	void Render(FrameContext& context, const DirectX::XMFLOAT3& eyePt, const DirectX::XMFLOAT3& focusPt) const;
+
+	// Bakes the irradiance probes over the light map through the volume densities, and
+	// recomputes the light map with them in place of the per-voxel AO rays
+	void BakeIrradianceVolume(uint32_t gridSize, uint32_t numRays);
+	const IrradianceVolume& GetIrradianceVolume() const;
+
+	uint32_t GetWidth() const;
+	uint32_t GetHeight() const;
+
+	// Same operator as PSToneMap.hlsl, into 8-bit RGB
+	static void ToneMap(const DirectX::XMFLOAT4* pColors, uint32_t numPixels, uint8_t* pRGBs);
+	static bool WritePPM(const char* fileName, const uint8_t* pRGBs, uint32_t width, uint32_t height);
+	static bool WritePFM(const char* fileName, const DirectX::XMFLOAT4* pColors, uint32_t width, uint32_t height);
+
+	// DDS volume files of single-channel formats, as loaded by CSR32FToRGBA16F.hlsl
+	static bool LoadDDSVolume(const std::wstring& fileName, std::vector<float>& texels,
+		uint32_t& width, uint32_t& height, uint32_t& depth);
+
+protected:
+	bool loadVolumeData(uint32_t i, const std::wstring& fileName);
+	void initVolumeData(uint32_t i);
+	void computeLightMap();
+	void renderShadowMap();
+	void renderMesh(FrameContext& context, DirectX::CXMMATRIX viewProj, const DirectX::XMFLOAT3& eyePt) const;
+	void scheduleSamples(FrameContext& context, const DirectX::XMFLOAT3& eyePt) const;
+	void rayMarchCubeMaps(FrameContext& context, const DirectX::XMFLOAT3& eyePt) const;
+	void renderCubes(FrameContext& context, DirectX::CXMMATRIX viewProj, const DirectX::XMFLOAT3& eyePt) const;
+	void resolveOIT(FrameContext& context) const;
+	void resolveTemporalAA(FrameContext& context) const;
+
+	DirectX::XMFLOAT4 rayMarch(uint32_t i, DirectX::XMFLOAT3 rayOrigin, const DirectX::XMFLOAT3& rayDir,
+		uint32_t numSamples, float jitter = 0.0f) const;
+	DirectX::XMFLOAT4 sampleGrid(uint32_t volTexId, const DirectX::XMFLOAT3& uvw) const;
+	DirectX::XMFLOAT3 sampleLightMap(const DirectX::XMFLOAT3& uvw) const;
+	DirectX::XMFLOAT3 getDensityGradient(uint32_t volTexId, const DirectX::XMFLOAT3& uvw) const;
+	float getTransmittance(const DirectX::XMFLOAT3& rayOrigin, const DirectX::XMFLOAT3& rayDir) const;
+	float sampleShadowMap(const DirectX::XMFLOAT3& lsPos, bool isComparison) const;
+
+	SceneSettings			m_settings;
+
+	std::vector<std::vector<DirectX::XMFLOAT4>> m_grids;	// RGB and density, as the RGBA16F volumes
+	std::vector<uint32_t>	m_lightMap;						// R11G11B10_FLOAT, as on the GPU
+
+	std::vector<DirectX::XMFLOAT3X4> m_worlds;
+	std::vector<DirectX::XMFLOAT3X4> m_worldIs;
+	std::vector<DirectX::XMFLOAT3X4> m_localToLights;
+	DirectX::XMFLOAT3X4		m_lightMapWorld;
+
+	DirectX::XMFLOAT3		m_lightPt;
+	DirectX::XMFLOAT4		m_lightColor;
+	DirectX::XMFLOAT4		m_ambient;
+	DirectX::XMFLOAT3		m_clearColor;
+	DirectX::XMFLOAT3		m_shCoeffs[9];
+	bool					m_hasLightProbe;
+
+	std::vector<DirectX::XMFLOAT3> m_meshPositions;			// In world space
+	std::vector<DirectX::XMFLOAT3> m_meshNormals;
+	std::vector<uint32_t>	m_meshIndices;
+	std::vector<uint16_t>	m_shadowMap;					// D16_UNORM, as ObjectRenderer
+	DirectX::XMFLOAT4X4		m_shadowViewProj;
+	SampleSequence			m_jitterSequence;				// Halton (2, 3) of the TAA jitters
+
+	IrradianceVolume		m_irradianceVolume;
+	const BlueNoise*		m_pRayJitters;
+
+	uint32_t				m_width;
+	uint32_t				m_height;
+	uint32_t				m_gridSize;
+	uint32_t				m_lightGridSize;
+};
@@ -0,0 +1,205 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "IrradianceVolume.h"
+#include "SHProjector.h"
+#include "ParallelFor.h"
+#include <DirectXPackedVector.h>
+
+using namespace std;
+using namespace DirectX;
+using namespace PackedVector;
+
+//--------------------------------------------------------------------------------------
+// Deterministic jitter of the strata, so that bakes are reproducible
+//--------------------------------------------------------------------------------------
+static inline uint32_t hashUint(uint32_t x)
+{
+	// PCG hash
+	const auto state = x * 747796405u + 2891336453u;
+	const auto word = ((state >> ((state >> 28) + 4)) ^ state) * 277803737u;
+
+	return (word >> 22) ^ word;
+}
+
+static inline float toUnitFloat(uint32_t x)
+{
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+//--------------------------------------------------------------------------------------
+// Uniform direction on the sphere of the stratum (i, j) of a strata x strata grid
+//--------------------------------------------------------------------------------------
+static inline XMFLOAT3 getStratifiedDir(uint32_t i, uint32_t j, uint32_t strata, uint32_t seed)
+{
+	const auto u = (i + toUnitFloat(hashUint(seed))) / strata;
+	const auto v = (j + toUnitFloat(hashUint(seed ^ 0x9e3779b9u))) / strata;
+	const auto z = 1.0f - 2.0f * u;
+	const auto r = sqrtf((max)(1.0f - z * z, 0.0f));
+	const auto phi = XM_2PI * v;
+
+	return XMFLOAT3(r * cosf(phi), r * sinf(phi), z);
+}
+
+//--------------------------------------------------------------------------------------
+// Same as EvaluateSHIrradiance() in SHIrradianceTypeless.hlsli
+//--------------------------------------------------------------------------------------
+static XMFLOAT3 evaluateSHIrradiance(const XMFLOAT3* shCoeffs, const XMFLOAT3& norm)
+{
+	const auto c1 = 0.429042765f;	// 4 * A2.Y22 = 1/16 * sqrt(15.PI)
+	const auto c2 = 0.511663354f;	// 0.5 * A1.Y10 = 1/2 * sqrt(PI/3)
+	const auto c3 = 0.247707956f;	// A2.Y20 = 1/16 * sqrt(5.PI)
+	const auto c4 = 0.886226925f;	// A0.Y00 = 1/2 * sqrt(PI)
+
+	const auto x = -norm.x;
+	const auto y = -norm.y;
+	const auto z = norm.z;
+
+	float irradiance[3];
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto sh = [&](uint8_t j) { return (&shCoeffs[j].x)[i]; };
+		irradiance[i] = (max)(0.0f,
+			(c1 * (x * x - y * y)) * sh(8)
+			+ (c3 * (3.0f * z * z - 1.0f)) * sh(6)
+			+ c4 * sh(0)
+			+ 2.0f * c1 * (sh(4) * x * y + sh(7) * x * z + sh(5) * y * z)
+			+ 2.0f * c2 * (sh(3) * x + sh(1) * y + sh(2) * z)) / XM_PI;
+	}
+
+	return XMFLOAT3(irradiance[0], irradiance[1], irradiance[2]);
+}
+
+//--------------------------------------------------------------------------------------
+// Irradiance volume
+//--------------------------------------------------------------------------------------
+IrradianceVolume::IrradianceVolume() :
+	m_gridSize(0)
+{
+	XMStoreFloat3x4(&m_worldI, XMMatrixIdentity());
+}
+
+IrradianceVolume::~IrradianceVolume()
+{
+}
+
+void IrradianceVolume::Bake(const BakeDesc& desc, const TransmittanceFunc& getTransmittance)
+{
+	const auto gridSize = (max)(desc.GridSize, 1u);
+	const auto strata = (max)(static_cast<uint32_t>(ceilf(sqrtf(static_cast<float>(desc.NumRays)))), 1u);
+	const auto numRays = strata * strata;
+	const auto numProbes = gridSize * gridSize * gridSize;
+	const auto weight = 4.0f * XM_PI / numRays;
+	const auto world = XMLoadFloat3x4(&desc.World);
+
+	m_gridSize = gridSize;
+	XMStoreFloat3x4(&m_worldI, XMMatrixInverse(nullptr, world));
+	m_coeffs.resize(static_cast<size_t>(numProbes) * NumCoeffs * 3);
+
+	ParallelFor(numProbes, 1, [&](uint32_t begin, uint32_t end)
+	{
+		float basis[NumCoeffs];
+		for (auto p = begin; p < end; ++p)
+		{
+			// Probes at the corners of the box and evenly in between
+			const auto x = p % gridSize, y = (p / gridSize) % gridSize, z = p / (gridSize * gridSize);
+			const auto toLocal = [gridSize](uint32_t i) { return gridSize > 1 ? i / (gridSize - 1.0f) * 2.0f - 1.0f : 0.0f; };
+			XMFLOAT3 probePos;
+			XMStoreFloat3(&probePos, XMVector3TransformCoord(XMVectorSet(toLocal(x), toLocal(y), toLocal(z), 1.0f), world));
+
+			XMFLOAT3 coeffs[NumCoeffs] = {};
+			for (auto i = 0u; i < strata; ++i)
+			{
+				for (auto j = 0u; j < strata; ++j)
+				{
+					const auto dir = getStratifiedDir(i, j, strata, hashUint(p * numRays + strata * i + j));
+					SHProjector::EvaluateBasis(dir, 3, basis);
+
+					// Incoming radiance of the environment, attenuated by the volumes on the way
+					auto radiance = desc.Ambient;
+					if (desc.pEnvSH)
+					{
+						auto sum = XMVectorZero();
+						for (uint8_t k = 0; k < NumCoeffs; ++k)
+							sum = XMVectorMultiplyAdd(XMLoadFloat3(&desc.pEnvSH[k]), XMVectorReplicate(basis[k]), sum);
+						XMStoreFloat3(&radiance, XMVectorMax(sum, XMVectorZero()));
+					}
+
+					const auto transm = getTransmittance(probePos, dir);
+					if (transm <= 0.0f) continue;
+
+					const auto scaled = XMLoadFloat3(&radiance) * (transm * weight);
+					for (uint8_t k = 0; k < NumCoeffs; ++k)
+						XMStoreFloat3(&coeffs[k], XMVectorMultiplyAdd(scaled, XMVectorReplicate(basis[k]), XMLoadFloat3(&coeffs[k])));
+				}
+			}
+
+			auto pDst = &m_coeffs[static_cast<size_t>(p) * NumCoeffs * 3];
+			for (uint8_t k = 0; k < NumCoeffs; ++k)
+			{
+				*pDst++ = XMConvertFloatToHalf(coeffs[k].x);
+				*pDst++ = XMConvertFloatToHalf(coeffs[k].y);
+				*pDst++ = XMConvertFloatToHalf(coeffs[k].z);
+			}
+		}
+	});
+}
+
+void IrradianceVolume::GetSH(const XMFLOAT3& pos, XMFLOAT3* pCoeffs) const
+{
+	for (uint8_t k = 0; k < NumCoeffs; ++k) pCoeffs[k] = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	if (m_gridSize == 0) return;
+
+	XMFLOAT3 local;
+	XMStoreFloat3(&local, XMVector3TransformCoord(XMLoadFloat3(&pos), XMLoadFloat3x4(&m_worldI)));
+
+	// Trilinear interpolation of the 8 surrounding probes
+	const float coords[] = { local.x, local.y, local.z };
+	const auto maxIdx = m_gridSize - 1;
+	uint32_t i0[3], i1[3];
+	float w[3];
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto u = (min)((max)(coords[i] * 0.5f + 0.5f, 0.0f), 1.0f) * maxIdx;
+		i0[i] = (min)(static_cast<uint32_t>(u), maxIdx);
+		i1[i] = (min)(i0[i] + 1, maxIdx);
+		w[i] = u - i0[i];
+	}
+
+	for (uint8_t c = 0; c < 8; ++c)
+	{
+		const auto x = (c & 1) ? i1[0] : i0[0];
+		const auto y = (c & 2) ? i1[1] : i0[1];
+		const auto z = (c & 4) ? i1[2] : i0[2];
+		const auto weight = ((c & 1) ? w[0] : 1.0f - w[0]) * ((c & 2) ? w[1] : 1.0f - w[1]) * ((c & 4) ? w[2] : 1.0f - w[2]);
+		if (weight <= 0.0f) continue;
+
+		const auto p = (static_cast<size_t>(m_gridSize) * z + y) * m_gridSize + x;
+		const auto pSrc = &m_coeffs[p * NumCoeffs * 3];
+		for (uint8_t k = 0; k < NumCoeffs; ++k)
+		{
+			pCoeffs[k].x += XMConvertHalfToFloat(pSrc[3 * k]) * weight;
+			pCoeffs[k].y += XMConvertHalfToFloat(pSrc[3 * k + 1]) * weight;
+			pCoeffs[k].z += XMConvertHalfToFloat(pSrc[3 * k + 2]) * weight;
+		}
+	}
+}
+
+XMFLOAT3 IrradianceVolume::GetIrradiance(const XMFLOAT3& pos, const XMFLOAT3& normal) const
+{
+	XMFLOAT3 coeffs[NumCoeffs];
+	GetSH(pos, coeffs);
+
+	return evaluateSHIrradiance(coeffs, normal);
+}
+
+uint32_t IrradianceVolume::GetGridSize() const
+{
+	return m_gridSize;
+}
+
+size_t IrradianceVolume::GetMemorySize() const
+{
+	return m_coeffs.size() * sizeof(uint16_t);
+}
@@ -0,0 +1,47 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Grid of order-3 SH irradiance probes over a box, such as the light-map volume, baked on
+// the CPU. Stratified rays from each probe gather the environment radiance (a radiance SH,
+// or a constant ambient) through the transmittance of the scene, so that neighboring
+// volumes occlude each other. Probes are stored as half-precision RGB coefficients and
+// looked up with trilinear interpolation.
+class IrradianceVolume
+{
+public:
+	// Transmittance from a world position along a normalized world direction
+	using TransmittanceFunc = std::function<float(const DirectX::XMFLOAT3&, const DirectX::XMFLOAT3&)>;
+
+	struct BakeDesc
+	{
+		DirectX::XMFLOAT3X4 World;			// Unit box [-1, 1]^3 to world, as the light-map world
+		uint32_t GridSize;					// Probes per axis, at the box corners and in between
+		uint32_t NumRays;					// Per probe, rounded to a square of strata
+		const DirectX::XMFLOAT3* pEnvSH;	// Order-3 radiance SH, or nullptr for the ambient
+		DirectX::XMFLOAT3 Ambient;			// Constant radiance without the radiance SH
+	};
+
+	IrradianceVolume();
+	virtual ~IrradianceVolume();
+
+	void Bake(const BakeDesc& desc, const TransmittanceFunc& getTransmittance);
+
+	// Interpolated radiance SH at a world position, clamped to the box
+	void GetSH(const DirectX::XMFLOAT3& pos, DirectX::XMFLOAT3* pCoeffs) const;
+
+	// Same as EvaluateSHIrradiance() of the interpolated SH, i.e. divided by PI
+	DirectX::XMFLOAT3 GetIrradiance(const DirectX::XMFLOAT3& pos, const DirectX::XMFLOAT3& normal) const;
+
+	uint32_t GetGridSize() const;
+	size_t GetMemorySize() const;
+
+	static const uint8_t NumCoeffs = 9;
+
+protected:
+	std::vector<uint16_t>	m_coeffs;	// RGB of the coefficients per probe, as half floats
+	DirectX::XMFLOAT3X4		m_worldI;
+	uint32_t				m_gridSize;
+};
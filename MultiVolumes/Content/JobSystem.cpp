@@ -0,0 +1,522 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "JobSystem.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+
+using namespace std;
+
+struct TaskArena;
+
+struct JobSystem::Task
+{
+	Func Function;
+	Group* pGroup;
+	TaskArena* pArena;			// Of the thread that forked it
+	Task* pNext;				// In the group, or in the free list of the arena
+	atomic<uint32_t> NumPending;	// Dependencies not yet done, plus one while forking
+	mutex Mutex;				// Of the completion and the successors
+	vector<Task*> Successors;
+	bool IsDone;
+};
+
+//--------------------------------------------------------------------------------------
+// Per-thread task arenas, grown by blocks and never shrunk
+//--------------------------------------------------------------------------------------
+static const uint32_t TaskBlockSize = 256;
+
+struct TaskArena
+{
+	vector<unique_ptr<JobSystem::Task[]>> Blocks;
+	JobSystem::Task* pFree;					// Of the owner thread
+	atomic<JobSystem::Task*> pReturned;		// Released by other threads, taken over when pFree runs dry
+	atomic<bool> IsInUse;
+};
+
+struct TaskArenaHolder
+{
+	~TaskArenaHolder()
+	{
+		// Hand the arena to a later thread; its tasks still out keep being returned to it
+		if (pArena) pArena->IsInUse.store(false, memory_order_release);
+	}
+
+	TaskArena* pArena;
+};
+
+static mutex g_arenaMutex;
+static vector<unique_ptr<TaskArena>> g_arenas;
+static thread_local TaskArenaHolder g_arenaHolder = { nullptr };
+static thread_local uint32_t g_workerIndex = UINT32_MAX;	// Of the pool, UINT32_MAX outside of it
+static thread_local uint32_t g_victim = 0;					// First queue to steal from, outside the pool
+
+static TaskArena* getThreadArena()
+{
+	if (g_arenaHolder.pArena) return g_arenaHolder.pArena;
+
+	// First fork of the thread: take over the arena of an exited thread, or add one
+	lock_guard<mutex> lock(g_arenaMutex);
+	for (auto& arena : g_arenas)
+	{
+		auto isInUse = false;
+		if (arena->IsInUse.compare_exchange_strong(isInUse, true, memory_order_acquire))
+			return g_arenaHolder.pArena = arena.get();
+	}
+
+	unique_ptr<TaskArena> arena(new TaskArena);
+	arena->pFree = nullptr;
+	arena->pReturned.store(nullptr, memory_order_relaxed);
+	arena->IsInUse.store(true, memory_order_relaxed);
+	g_arenas.push_back(move(arena));
+
+	return g_arenaHolder.pArena = g_arenas.back().get();
+}
+
+static JobSystem::Task* allocateTask()
+{
+	const auto pArena = getThreadArena();
+	if (!pArena->pFree) pArena->pFree = pArena->pReturned.exchange(nullptr, memory_order_acquire);
+	if (!pArena->pFree)
+	{
+		unique_ptr<JobSystem::Task[]> block(new JobSystem::Task[TaskBlockSize]);
+		for (auto i = 0u; i < TaskBlockSize; ++i)
+		{
+			block[i].pArena = pArena;
+			block[i].pNext = i + 1 < TaskBlockSize ? &block[i + 1] : nullptr;
+		}
+		pArena->pFree = block.get();
+		pArena->Blocks.push_back(move(block));
+	}
+
+	const auto pTask = pArena->pFree;
+	pArena->pFree = pTask->pNext;
+
+	return pTask;
+}
+
+static void releaseTask(JobSystem::Task* pTask)
+{
+	pTask->Function = nullptr;
+	pTask->Successors.clear();
+
+	const auto pArena = pTask->pArena;
+	if (pArena == g_arenaHolder.pArena)
+	{
+		pTask->pNext = pArena->pFree;
+		pArena->pFree = pTask;
+	}
+	else
+	{
+		auto pHead = pArena->pReturned.load(memory_order_relaxed);
+		do pTask->pNext = pHead;
+		while (!pArena->pReturned.compare_exchange_weak(pHead, pTask, memory_order_release, memory_order_relaxed));
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Scheduler
+//--------------------------------------------------------------------------------------
+struct WorkQueue
+{
+	// The owner takes the newest task, thieves take the oldest
+	bool Pop(JobSystem::Task*& pTask, bool isOwner)
+	{
+		lock_guard<mutex> lock(Mutex);
+		if (Tasks.empty()) return false;
+
+		if (isOwner)
+		{
+			pTask = Tasks.back();
+			Tasks.pop_back();
+		}
+		else
+		{
+			pTask = Tasks.front();
+			Tasks.pop_front();
+		}
+
+		return true;
+	}
+
+	mutex Mutex;
+	deque<JobSystem::Task*> Tasks;
+};
+
+struct JobSystem::Scheduler
+{
+	Scheduler();
+	~Scheduler();
+
+	void Push(Task* pTask);
+	bool Pop(Task*& pTask);
+	void WorkerLoop(uint32_t index);
+
+	static Scheduler& Get();
+
+	static const uint32_t SpinCount = 64;	// Yields before a worker sleeps
+
+	vector<unique_ptr<WorkQueue>> Queues;	// Per worker
+	WorkQueue Injection;					// Of the threads outside the pool
+	vector<thread> Workers;
+	atomic<int32_t> NumQueued;				// Transiently off by the pushes and pops in flight
+	atomic<uint32_t> NumSleeping;
+	atomic<bool> IsQuitting;
+	mutex SleepMutex;
+	condition_variable WakeCondition;
+};
+
+JobSystem::Scheduler::Scheduler() :
+	NumQueued(0),
+	NumSleeping(0),
+	IsQuitting(false)
+{
+	// The threads joining groups make up for the missing worker
+	const auto numThreads = (max)(thread::hardware_concurrency(), 1u);
+	const auto numWorkers = (min)(numThreads, MaxWorkers + 1) - 1;
+	for (auto i = 0u; i < numWorkers; ++i) Queues.emplace_back(new WorkQueue);
+
+	Workers.reserve(numWorkers);
+	for (auto i = 0u; i < numWorkers; ++i) Workers.emplace_back(&Scheduler::WorkerLoop, this, i);
+}
+
+JobSystem::Scheduler::~Scheduler()
+{
+	{
+		lock_guard<mutex> lock(SleepMutex);
+		IsQuitting = true;
+		WakeCondition.notify_all();
+	}
+
+	for (auto& worker : Workers) worker.join();
+}
+
+void JobSystem::Scheduler::Push(Task* pTask)
+{
+	auto& queue = g_workerIndex < Queues.size() ? *Queues[g_workerIndex] : Injection;
+	{
+		lock_guard<mutex> lock(queue.Mutex);
+		queue.Tasks.push_back(pTask);
+	}
+	++NumQueued;
+
+	// A worker going to sleep either sees the count above, or is counted as sleeping here
+	if (NumSleeping > 0)
+	{
+		lock_guard<mutex> lock(SleepMutex);
+		WakeCondition.notify_one();
+	}
+}
+
+bool JobSystem::Scheduler::Pop(Task*& pTask)
+{
+	if (NumQueued <= 0) return false;
+
+	const auto numQueues = static_cast<uint32_t>(Queues.size());
+	const auto self = g_workerIndex;
+	auto isFound = self < numQueues && Queues[self]->Pop(pTask, true);
+	isFound = isFound || Injection.Pop(pTask, false);
+
+	// Steal from the next workers in turn, so thieves spread over the victims
+	const auto start = self < numQueues ? self + 1 : g_victim++;
+	for (auto i = 0u; i < numQueues && !isFound; ++i)
+	{
+		const auto victim = (start + i) % numQueues;
+		isFound = victim != self && Queues[victim]->Pop(pTask, false);
+	}
+	if (isFound) --NumQueued;
+
+	return isFound;
+}
+
+void JobSystem::Scheduler::WorkerLoop(uint32_t index)
+{
+	g_workerIndex = index;
+	while (!IsQuitting)
+	{
+		Task* pTask;
+		if (Pop(pTask))
+		{
+			execute(pTask);
+			continue;
+		}
+
+		// Spin a while before sleeping, as the tasks of a frame come in bursts
+		auto isQueued = false;
+		for (auto i = 0u; i < SpinCount && !isQueued; ++i)
+		{
+			this_thread::yield();
+			isQueued = NumQueued > 0;
+		}
+		if (isQueued) continue;
+
+		unique_lock<mutex> lock(SleepMutex);
+		++NumSleeping;
+		WakeCondition.wait(lock, [this]() { return NumQueued > 0 || IsQuitting; });
+		--NumSleeping;
+	}
+}
+
+JobSystem::Scheduler& JobSystem::Scheduler::Get()
+{
+	static Scheduler scheduler;
+
+	return scheduler;
+}
+
+//--------------------------------------------------------------------------------------
+// Task group
+//--------------------------------------------------------------------------------------
+JobSystem::Group::Group() :
+	m_numPending(0),
+	m_pTasks(nullptr)
+{
+}
+
+JobSystem::Group::~Group()
+{
+	Wait();
+}
+
+JobSystem::Task* JobSystem::Group::Run(const Func& func, Task* const* ppDependencies, uint32_t numDependencies)
+{
+	const auto pTask = allocateTask();
+	pTask->Function = func;
+	pTask->pGroup = this;
+	pTask->IsDone = false;
+	pTask->NumPending = 1;
+	++m_numPending;
+
+	auto pHead = m_pTasks.load(memory_order_relaxed);
+	do pTask->pNext = pHead;
+	while (!m_pTasks.compare_exchange_weak(pHead, pTask, memory_order_release, memory_order_relaxed));
+
+	for (auto i = 0u; i < numDependencies; ++i)
+	{
+		const auto pDependency = ppDependencies[i];
+		assert(pDependency->pGroup == this);
+
+		lock_guard<mutex> lock(pDependency->Mutex);
+		if (!pDependency->IsDone)
+		{
+			pDependency->Successors.push_back(pTask);
+			++pTask->NumPending;
+		}
+	}
+
+	// Drop the hold of the fork; the last dependency done queues the task otherwise
+	if (--pTask->NumPending == 0) Scheduler::Get().Push(pTask);
+
+	return pTask;
+}
+
+void JobSystem::Group::Wait()
+{
+	// Run queued tasks, of this group or any other, until the group is done
+	while (m_numPending.load(memory_order_acquire) > 0)
+		if (!runOne()) this_thread::yield();
+
+	for (auto pTask = m_pTasks.exchange(nullptr, memory_order_acquire); pTask;)
+	{
+		const auto pNext = pTask->pNext;
+		releaseTask(pTask);
+		pTask = pNext;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Job system
+//--------------------------------------------------------------------------------------
+uint32_t JobSystem::GetNumWorkers()
+{
+	return static_cast<uint32_t>(Scheduler::Get().Workers.size());
+}
+
+static void forkChunks(JobSystem::Group& group, uint32_t first, uint32_t last,
+	uint32_t count, uint32_t grainSize, const JobSystem::RangeFunc& func)
+{
+	// Fork the upper halves for thieves, keeping the lower ones down to a single chunk
+	while (last - first > 1)
+	{
+		const auto mid = first + (last - first) / 2;
+		group.Run([&group, mid, last, count, grainSize, &func]()
+		{
+			forkChunks(group, mid, last, count, grainSize, func);
+		});
+		last = mid;
+	}
+
+	const auto begin = grainSize * first;
+	func(begin, (min)(begin + grainSize, count));
+}
+
+void JobSystem::ParallelFor(uint32_t count, uint32_t grainSize, const RangeFunc& func)
+{
+	grainSize = (max)(grainSize, 1u);
+	const auto numChunks = (count + grainSize - 1) / grainSize;
+	if (numChunks == 0) return;
+
+	Group group;
+	forkChunks(group, 0, numChunks, count, grainSize, func);
+	group.Wait();
+}
+
+void JobSystem::execute(Task* pTask)
+{
+	pTask->Function();
+
+	// Queue the successors this task was the last dependency of
+	const auto pGroup = pTask->pGroup;
+	{
+		lock_guard<mutex> lock(pTask->Mutex);
+		pTask->IsDone = true;
+		for (const auto& pSuccessor : pTask->Successors)
+			if (--pSuccessor->NumPending == 0) Scheduler::Get().Push(pSuccessor);
+	}
+
+	// Last access to the task and its group, as Wait() may return right after
+	pGroup->m_numPending.fetch_sub(1, memory_order_acq_rel);
+}
+
+bool JobSystem::runOne()
+{
+	Task* pTask;
+	if (!Scheduler::Get().Pop(pTask)) return false;
+
+	execute(pTask);
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Evaluation
+//--------------------------------------------------------------------------------------
+static uint32_t evaluateNestedFor(uint32_t numOuter, uint32_t numInner)
+{
+	// Parallel-fors within the chunks of a parallel-for, at varying grain sizes; every index
+	// must be covered once, by chunks aligned to the grain size
+	unique_ptr<atomic<uint32_t>[]> numVisits(new atomic<uint32_t>[numOuter * numInner]);
+	for (auto i = 0u; i < numOuter * numInner; ++i) numVisits[i].store(0, memory_order_relaxed);
+
+	atomic<uint32_t> numFailed(0);
+	JobSystem::ParallelFor(numOuter, 3, [&](uint32_t begin, uint32_t end)
+	{
+		numFailed += begin % 3 || end != (min)(begin + 3, numOuter) ? 1 : 0;
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto grainSize = 1 + i % 8;
+			JobSystem::ParallelFor(numInner, grainSize, [&, i, grainSize](uint32_t innerBegin, uint32_t innerEnd)
+			{
+				numFailed += innerBegin % grainSize || innerEnd != (min)(innerBegin + grainSize, numInner) ? 1 : 0;
+				for (auto j = innerBegin; j < innerEnd; ++j) ++numVisits[numInner * i + j];
+			});
+		}
+	});
+
+	auto result = numFailed.load();
+	for (auto i = 0u; i < numOuter * numInner; ++i) result += numVisits[i] == 1 ? 0 : 1;
+
+	return result;
+}
+
+JobSystem::EvaluationResult JobSystem::Evaluate(const EvaluationDesc& desc)
+{
+	EvaluationResult result = {};
+	result.NumWorkers = GetNumWorkers();
+
+	// Random DAGs in task order: each task depends on up to MaxDependencies earlier tasks, with
+	// repeats, and may be forked after some of them are done. A task must start after all its
+	// dependencies have finished, and run exactly once.
+	mt19937 rng(desc.Seed);
+	vector<vector<uint32_t>> dependencies(desc.NumTasks);
+	vector<Task*> tasks(desc.NumTasks), taskDependencies;
+	unique_ptr<atomic<uint32_t>[]> numRuns(new atomic<uint32_t>[desc.NumTasks]);
+	atomic<uint32_t> numFailed(0);
+	for (auto i = 0u; i < desc.NumGraphs; ++i)
+	{
+		for (auto j = 0u; j < desc.NumTasks; ++j)
+		{
+			numRuns[j].store(0, memory_order_relaxed);
+			dependencies[j].resize(j > 0 ? rng() % (desc.MaxDependencies + 1) : 0);
+			for (auto& dependency : dependencies[j]) dependency = rng() % j;
+			result.NumDependencies += static_cast<uint32_t>(dependencies[j].size());
+		}
+
+		Group group;
+		for (auto j = 0u; j < desc.NumTasks; ++j)
+		{
+			taskDependencies.clear();
+			for (const auto& dependency : dependencies[j]) taskDependencies.push_back(tasks[dependency]);
+
+			// Uneven work shuffles the completion order; some tasks fork and join a nested group
+			const auto work = rng() % 1024;
+			tasks[j] = group.Run([&, j, work]()
+			{
+				for (const auto& dependency : dependencies[j])
+					numFailed += numRuns[dependency].load(memory_order_acquire) > 0 ? 0 : 1;
+
+				if (work % 16 == 0)
+				{
+					atomic<uint32_t> numChunks(0);
+					ParallelFor(64, 4, [&numChunks](uint32_t, uint32_t) { ++numChunks; });
+					numFailed += numChunks == 16 ? 0 : 1;
+				}
+				else
+				{
+					volatile auto sum = 0u;
+					for (auto k = 0u; k < work; ++k) sum = sum + k;
+				}
+
+				numRuns[j].fetch_add(1, memory_order_release);
+			}, taskDependencies.data(), static_cast<uint32_t>(taskDependencies.size()));
+		}
+		group.Wait();
+
+		for (auto j = 0u; j < desc.NumTasks; ++j) numFailed += numRuns[j] == 1 ? 0 : 1;
+		result.NumTasks += desc.NumTasks;
+		++result.NumGraphs;
+	}
+	result.NumFailed = numFailed;
+
+	// Nested fork/join, from the calling thread and from threads outside the pool at once, as
+	// the frame jobs of the headless renderer do
+	vector<uint32_t> numThreadFailed(3);
+	vector<thread> threads;
+	for (auto i = 0u; i < numThreadFailed.size(); ++i)
+		threads.emplace_back([&numThreadFailed, i]() { numThreadFailed[i] = evaluateNestedFor(97 + i, 131); });
+	result.NumFailed += evaluateNestedFor(257, 131);
+	for (auto i = 0u; i < threads.size(); ++i)
+	{
+		threads[i].join();
+		result.NumFailed += numThreadFailed[i];
+	}
+
+	// Scheduling overhead, best of a few rounds: empty tasks forked from one thread and joined,
+	// and the empty chunks of a parallel-for at a grain size of 1
+	const auto numSpawns = (max)(desc.NumSpawns, 1u);
+	for (auto i = 0u; i < 5; ++i)
+	{
+		auto startTime = chrono::steady_clock::now();
+		{
+			Group group;
+			for (auto j = 0u; j < numSpawns; ++j) group.Run([]() {});
+			group.Wait();
+		}
+		const auto spawnTime = chrono::duration<double, nano>(chrono::steady_clock::now() - startTime).count() / numSpawns;
+
+		startTime = chrono::steady_clock::now();
+		ParallelFor(numSpawns, 1, [](uint32_t, uint32_t) {});
+		const auto chunkTime = chrono::duration<double, nano>(chrono::steady_clock::now() - startTime).count() / numSpawns;
+
+		result.SpawnTime = i > 0 ? (min)(result.SpawnTime, spawnTime) : spawnTime;
+		result.ChunkTime = i > 0 ? (min)(result.ChunkTime, chunkTime) : chunkTime;
+	}
+
+	return result;
+}
@@ -0,0 +1,79 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+// Work-stealing scheduler of the per-frame CPU work, on a pool of persistent workers started
+// on first use, one per hardware thread but the caller's. Each worker runs its own queue
+// newest first, and steals the oldest tasks of the others when it runs dry, which are the
+// largest halves of a split range. Tasks are forked into a group with the tasks of the group
+// they depend on, and joined by Wait(), which runs queued tasks instead of blocking, so tasks
+// may fork and join nested groups, and threads outside the pool may fork and join as well.
+// Tasks are pooled in per-thread arenas, so forking a task takes no lock besides the queue's.
+class JobSystem
+{
+public:
+	struct Task;
+
+	using Func = std::function<void()>;
+	using RangeFunc = std::function<void(uint32_t, uint32_t)>;
+
+	// Tasks forked together and joined by Wait(). Dependencies must be tasks of the same group,
+	// which stay valid until Wait() returns; a group may be reused afterwards.
+	class Group
+	{
+	public:
+		Group();
+		virtual ~Group();
+
+		Task* Run(const Func& func, Task* const* ppDependencies = nullptr, uint32_t numDependencies = 0);
+		void Wait();
+
+	protected:
+		friend class JobSystem;
+
+		std::atomic<uint32_t>	m_numPending;
+		std::atomic<Task*>		m_pTasks;	// Forked, released by Wait()
+	};
+
+	struct EvaluationDesc
+	{
+		uint32_t NumGraphs;
+		uint32_t NumTasks;			// Per graph
+		uint32_t MaxDependencies;	// Per task, on earlier tasks of its graph
+		uint32_t NumSpawns;			// Of the empty tasks timed
+		uint32_t Seed;
+	};
+
+	struct EvaluationResult
+	{
+		uint32_t NumGraphs;
+		uint32_t NumTasks;
+		uint32_t NumDependencies;
+		uint32_t NumFailed;			// Tasks run before a dependency was done, not run, or run more
+									// than once, and the ranges of nested parallel-fors covered wrong
+		uint32_t NumWorkers;
+		double SpawnTime;			// Per empty task, forked and joined, in nanoseconds
+		double ChunkTime;			// Per empty chunk of a parallel-for, in nanoseconds
+	};
+
+	static uint32_t GetNumWorkers();
+
+	// Splits [0, count) into chunks of grainSize and calls func(begin, end) for each chunk,
+	// halving the range into tasks down to single chunks. Returns after all chunks are done.
+	static void ParallelFor(uint32_t count, uint32_t grainSize, const RangeFunc& func);
+
+	static EvaluationResult Evaluate(const EvaluationDesc& desc);
+
+	static const uint32_t MaxWorkers = 64;
+
+protected:
+	struct Scheduler;
+
+	static void execute(Task* pTask);
+	static bool runOne();
+};
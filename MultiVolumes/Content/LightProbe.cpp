@@ -3,6 +3,10 @@
 //--------------------------------------------------------------------------------------
 
 #include "LightProbe.h"
+#include "SHProjector.h"
+#include "MemoryBudget.h"
+#include "RadiancePrefilter.h"
+#include "TraceRecorder.h"
 #include "Advanced/XUSGSHSharedConsts.h"
 #define _INDEPENDENT_DDS_LOADER_
 #include "Advanced/XUSGDDSLoader.h"
@@ -18,9 +22,29 @@ struct CBPerFrame
 	DirectX::XMFLOAT4X4	ScreenToWorld;
 };
 
-LightProbe::LightProbe()
+//--------------------------------------------------------------------------------------
+// Memory accounting
+//--------------------------------------------------------------------------------------
+static void registerTexture(const char* name, const Texture* pTexture)
+{
+	MemoryBudget::Register(name, MemoryBudget::GetTextureSize(static_cast<uint32_t>(pTexture->GetWidth()),
+		pTexture->GetHeight(), 1, pTexture->GetArraySize(), pTexture->GetNumMips(),
+		static_cast<uint32_t>(DDS::Loader::BitsPerPixel(pTexture->GetFormat()))), MemoryBudget::LIGHT_PROBE);
+}
+
+//--------------------------------------------------------------------------------------
+// Light probe
+//--------------------------------------------------------------------------------------
+LightProbe::LightProbe() :
+	m_pFrameArena(nullptr),
+	m_cbPerFrameOffset(0),
+	m_shOffset(0),
+	m_isRotated(false),
+	m_isSHStaged(false)
 {
 	m_shaderPool = ShaderPool::MakeShared();
+	XMStoreFloat3x3(&m_rotation, XMMatrixIdentity());
+	m_shRotation.Init(XMMatrixIdentity(), SHOrder);
 }
 
 LightProbe::~LightProbe()
@@ -28,13 +52,16 @@ LightProbe::~LightProbe()
 }
 
 bool LightProbe::Init(CommandList* pCommandList, const DescriptorTableCache::sptr& descriptorTableCache,
-	vector<Resource::uptr>& uploaders, const wchar_t* fileName, Format rtFormat, Format dsFormat)
+	vector<Resource::uptr>& uploaders, FrameArena* pFrameArena, const wchar_t* fileName, Format rtFormat, Format dsFormat)
 {
+	TRACE_SCOPE("LightProbe::Init");
+
 	const auto pDevice = pCommandList->GetDevice();
 	m_graphicsPipelineCache = Graphics::PipelineCache::MakeUnique(pDevice);
 	m_computePipelineCache = Compute::PipelineCache::MakeShared(pDevice);
 	m_pipelineLayoutCache = PipelineLayoutCache::MakeShared(pDevice);
 	m_descriptorTableCache = descriptorTableCache;
+	m_pFrameArena = pFrameArena;
 
 	// Load input image
 	auto texWidth = 1u, texHeight = 1u;
@@ -46,15 +73,51 @@ bool LightProbe::Init(CommandList* pCommandList, const DescriptorTableCache::spt
 		XUSG_N_RETURN(textureLoader.CreateTextureFromFile(pCommandList, fileName,
 			8192, false, m_radiance, uploaders.back().get(), &alphaMode), false);
 
+		registerTexture("Radiance", m_radiance.get());
+
 		texWidth = static_cast<uint32_t>(m_radiance->GetWidth());
 		texHeight = m_radiance->GetHeight();
 	}
 
-	// Create resources and pipelines
-	m_cbPerFrame = ConstantBuffer::MakeUnique();
-	XUSG_N_RETURN(m_cbPerFrame->Create(pDevice, sizeof(CBPerFrame[FrameCount]), FrameCount,
-		nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"LightProbe.CBPerFrame"), false);
+	// Load the prefiltered radiance cached next to the input image, prefiltering it on the CPU once
+	{
+		RadiancePrefilter prefilter;
+		if (prefilter.Load(fileName) && !prefilter.GetCacheFileName().empty())
+		{
+			DDS::Loader textureLoader;
+			DDS::AlphaMode alphaMode;
+
+			uploaders.emplace_back(Resource::MakeUnique());
+			XUSG_N_RETURN(textureLoader.CreateTextureFromFile(pCommandList, prefilter.GetCacheFileName().c_str(),
+				8192, false, m_prefilteredRadiance, uploaders.back().get(), &alphaMode), false);
+			registerTexture("PrefilteredRadiance", m_prefilteredRadiance.get());
+		}
+	}
+
+	// Project SH on the CPU or load the cached coefficients, which skips TransformSH()
+	{
+		SHProjector shProjector;
+		if (shProjector.Load(fileName, SHOrder))
+		{
+			const uint32_t numCoeffs = SHOrder * SHOrder;
+			m_coeffSH = StructuredBuffer::MakeShared();
+			XUSG_N_RETURN(m_coeffSH->Create(pDevice, numCoeffs, sizeof(XMFLOAT3), ResourceFlag::NONE,
+				MemoryType::DEFAULT, 1, nullptr, 0, nullptr, MemoryFlag::NONE, L"LightProbe.SHCoefficients"), false);
+
+			uploaders.emplace_back(Resource::MakeUnique());
+			XUSG_N_RETURN(m_coeffSH->Upload(pCommandList, uploaders.back().get(), shProjector.GetSHCoefficients(),
+				sizeof(XMFLOAT3) * numCoeffs, 0, ResourceState::NON_PIXEL_SHADER_RESOURCE |
+				ResourceState::PIXEL_SHADER_RESOURCE), false);
+
+			// Kept for UpdateFrame(), which stages the rotated coefficients in the frame arena
+			m_shCoeffs.assign(shProjector.GetSHCoefficients(), shProjector.GetSHCoefficients() + numCoeffs);
 
+			MemoryBudget::Register("LightProbe.SHCoefficients", MemoryBudget::GetBufferSize(sizeof(XMFLOAT3) * numCoeffs),
+				MemoryBudget::LIGHT_PROBE);
+		}
+	}
+
+	// Create pipelines
 	XUSG_N_RETURN(createPipelineLayouts(), false);
 	XUSG_N_RETURN(createPipelines(rtFormat, dsFormat), false);
 
@@ -63,31 +126,84 @@ bool LightProbe::Init(CommandList* pCommandList, const DescriptorTableCache::spt
 
 bool LightProbe::CreateDescriptorTables(Device* pDevice)
 {
-	m_sphericalHarmonics = SphericalHarmonics::MakeUnique();
-	XUSG_N_RETURN(m_sphericalHarmonics->Init(pDevice, m_shaderPool, m_computePipelineCache,
-		m_pipelineLayoutCache, m_descriptorTableCache, 0), false);
+	if (!m_coeffSH)
+	{
+		m_sphericalHarmonics = SphericalHarmonics::MakeUnique();
+		XUSG_N_RETURN(m_sphericalHarmonics->Init(pDevice, m_shaderPool, m_computePipelineCache,
+			m_pipelineLayoutCache, m_descriptorTableCache, 0), false);
+	}
 
 	return createDescriptorTables();
 }
 
 void LightProbe::UpdateFrame(uint8_t frameIndex, CXMMATRIX viewProj, const XMFLOAT3& eyePt)
 {
-	const auto projToWorld = XMMatrixInverse(nullptr, viewProj);
-	const auto pCbData = reinterpret_cast<CBPerFrame*>(m_cbPerFrame->Map(frameIndex));
-	pCbData->EyePos = XMFLOAT4(eyePt.x, eyePt.y, eyePt.z, 1.0f);
-	XMStoreFloat4x4(&pCbData->ScreenToWorld, XMMatrixTranspose(projToWorld));
+	// The environment is looked up at the directions rotated back
+	const auto rotationI = XMMatrixTranspose(XMLoadFloat3x3(&m_rotation));
+	const auto projToWorld = XMMatrixInverse(nullptr, viewProj) * rotationI;
+	CBPerFrame cbData;
+	XMStoreFloat4(&cbData.EyePos, XMVector3TransformCoord(XMLoadFloat3(&eyePt), rotationI));
+	XMStoreFloat4x4(&cbData.ScreenToWorld, XMMatrixTranspose(projToWorld));
+	m_pFrameArena->WriteConstants(&cbData, sizeof(cbData), m_cbPerFrameOffset);
+
+	// The frame arena is not thread safe, so the rotated coefficients are staged here rather
+	// than in the recorded segments.
+	m_isSHStaged = false;
+	if (m_isRotated)
+	{
+		const auto numCoeffs = static_cast<uint32_t>(m_shCoeffs.size());
+		const auto pCoeffs = m_pFrameArena->Allocate(sizeof(XMFLOAT3) * numCoeffs, sizeof(XMFLOAT3), m_shOffset);
+		if (pCoeffs)
+		{
+			m_shRotation.Rotate(m_shCoeffs.data(), static_cast<XMFLOAT3*>(pCoeffs));
+			m_isRotated = false;
+			m_isSHStaged = true;
+		}
+	}
 }
 
 void LightProbe::TransformSH(CommandList* pCommandList)
 {
-	m_sphericalHarmonics->Transform(pCommandList, m_radiance.get(), m_srvTable);
+	if (m_sphericalHarmonics) m_sphericalHarmonics->Transform(pCommandList, m_radiance.get(), m_srvTable, SHOrder);
+}
+
+bool LightProbe::SetRotation(FXMMATRIX rotation)
+{
+	// Only the coefficients projected on the CPU can be rotated, and the sky is left unrotated
+	// otherwise, so that it never spins apart from the diffuse lighting.
+	if (m_shCoeffs.empty()) return false;
+
+	XMStoreFloat3x3(&m_rotation, rotation);
+	m_shRotation.Init(rotation, SHOrder);
+	m_isRotated = true;
+
+	return true;
+}
+
+bool LightProbe::RotateSH(const CommandList* pCommandList, uint8_t frameIndex)
+{
+	// The coefficients rotated by UpdateFrame()
+	if (!m_isSHStaged) return false;
+
+	const auto numCoeffs = static_cast<uint32_t>(m_shCoeffs.size());
+	ResourceBarrier barrier;
+	auto numBarriers = m_coeffSH->SetBarrier(&barrier, ResourceState::COPY_DEST);
+	pCommandList->Barrier(numBarriers, &barrier);
+
+	pCommandList->CopyBufferRegion(m_coeffSH.get(), 0, m_pFrameArena->GetResource(), m_shOffset, sizeof(XMFLOAT3) * numCoeffs);
+
+	numBarriers = m_coeffSH->SetBarrier(&barrier, ResourceState::NON_PIXEL_SHADER_RESOURCE |
+		ResourceState::PIXEL_SHADER_RESOURCE);
+	pCommandList->Barrier(numBarriers, &barrier);
+
+	return true;
 }
 
 void LightProbe::RenderEnvironment(const CommandList* pCommandList, uint8_t frameIndex)
 {
 	// Set descriptor tables
 	pCommandList->SetGraphicsPipelineLayout(m_pipelineLayouts[ENVIRONMENT]);
-	pCommandList->SetGraphicsRootConstantBufferView(0, m_cbPerFrame.get(), m_cbPerFrame->GetCBVOffset(frameIndex));
+	pCommandList->SetGraphicsRootConstantBufferView(0, m_pFrameArena->GetResource(), static_cast<int>(m_cbPerFrameOffset));
 	pCommandList->SetGraphicsDescriptorTable(1, m_srvTable);
 
 	// Set pipeline state
@@ -102,9 +218,19 @@ ShaderResource* LightProbe::GetRadiance() const
 	return m_radiance.get();
 }
 
+ShaderResource* LightProbe::GetSpecularRadiance() const
+{
+	return m_prefilteredRadiance ? m_prefilteredRadiance.get() : m_radiance.get();
+}
+
+bool LightProbe::IsRadiancePrefiltered() const
+{
+	return m_prefilteredRadiance != nullptr;
+}
+
 StructuredBuffer::sptr LightProbe::GetSH() const
 {
-	return m_sphericalHarmonics->GetSHCoefficients();
+	return m_coeffSH ? m_coeffSH : m_sphericalHarmonics->GetSHCoefficients();
 }
 
 bool LightProbe::createPipelineLayouts()
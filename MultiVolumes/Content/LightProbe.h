@@ -6,6 +6,8 @@
 
 #include "Core/XUSG.h"
 #include "Advanced/XUSGSphericalHarmonics.h"
+#include "SHRotation.h"
+#include "FrameArena.h"
 
 class LightProbe
 {
@@ -14,19 +16,26 @@ public:
 	virtual ~LightProbe();
 
 	bool Init(XUSG::CommandList* pCommandList, const XUSG::DescriptorTableCache::sptr& descriptorTableCache,
-		std::vector<XUSG::Resource::uptr>& uploaders, const wchar_t* fileName,
+		std::vector<XUSG::Resource::uptr>& uploaders, FrameArena* pFrameArena, const wchar_t* fileName,
 		XUSG::Format rtFormat, XUSG::Format dsFormat);
 	bool CreateDescriptorTables(XUSG::Device* pDevice);
 
+	// Also rotates the SH coefficients after SetRotation() into the frame arena, so that
+	// RotateSH() only records their copy and may be recorded concurrently
 	void UpdateFrame(uint8_t frameIndex, DirectX::CXMMATRIX viewProj, const DirectX::XMFLOAT3& eyePt);
 	void TransformSH(XUSG::CommandList* pCommandList);
+	bool SetRotation(DirectX::FXMMATRIX rotation);	// Fails for the SH transformed on the GPU
+	bool RotateSH(const XUSG::CommandList* pCommandList, uint8_t frameIndex);
 	void RenderEnvironment(const XUSG::CommandList* pCommandList, uint8_t frameIndex);
 
 	XUSG::ShaderResource* GetRadiance() const;
+	XUSG::ShaderResource* GetSpecularRadiance() const;	// Prefiltered if possible
+	bool IsRadiancePrefiltered() const;
 	XUSG::StructuredBuffer::sptr GetSH() const;
 
 	static const uint8_t FrameCount = 3;
 	static const uint8_t CubeMapFaceCount = 6;
+	static const uint8_t SHOrder = 3;	// SH_ORDER of the shaders
 
 protected:
 	enum PipelineIndex : uint8_t
@@ -50,10 +59,20 @@ protected:
 	XUSG::Pipeline			m_pipelines[NUM_PIPELINE];
 
 	XUSG::SphericalHarmonics::uptr m_sphericalHarmonics;
+	XUSG::StructuredBuffer::sptr m_coeffSH;	// Projected on the CPU, if the radiance format is supported
+
+	std::vector<DirectX::XMFLOAT3> m_shCoeffs;
+	SHRotation				m_shRotation;
+	DirectX::XMFLOAT3X3		m_rotation;
 
 	XUSG::DescriptorTable	m_srvTable;
 
 	XUSG::Texture::sptr	m_radiance;
+	XUSG::Texture::sptr	m_prefilteredRadiance;	// GGX mip chain, by roughness
 
-	XUSG::ConstantBuffer::uptr m_cbPerFrame;
+	FrameArena*	m_pFrameArena;	// Of the constants and the rotated coefficients per frame
+	uint64_t	m_cbPerFrameOffset;
+	uint64_t	m_shOffset;		// Of the rotated coefficients of the frame
+	bool		m_isRotated;	// By SetRotation(), until UpdateFrame() rotates the coefficients
+	bool		m_isSHStaged;	// In the frame arena for RotateSH()
 };
@@ -0,0 +1,379 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SharedConsts.h"
+#include "MemoryBudget.h"
+#include "SceneScaling.h"
+#include <chrono>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+static const char* g_categoryNames[] =
+{
+	"Volumes",
+	"CubeMaps",
+	"LightMap",
+	"KBuffers",
+	"RenderTargets",
+	"LightProbe",
+	"Buffers"
+};
+
+static mutex g_allocationMutex;
+static map<string, MemoryBudget::Allocation> g_allocations;
+
+// Of ObjectRenderer (shadow, per-object and per-frame) and LightProbe (per-frame)
+static const uint32_t g_numConstantBuffers = 4;
+
+static inline double toMB(uint64_t bytes)
+{
+	return bytes / 1048576.0;
+}
+
+static uint32_t stepDown(uint32_t size, uint32_t minSize)
+{
+	// Three quarters, at the granularity of the grid sizes
+	const auto granularity = MemoryBudget::SizeGranularity;
+	const auto next = size * 3 / 4 / granularity * granularity;
+
+	return (max)((min)(next, size), minSize);
+}
+
+static bool stepCategory(MemoryBudget::Category category, const MemoryBudget::Quality& minQuality,
+	MemoryBudget::Quality& settings, ostream* pDescription = nullptr)
+{
+	const auto quality = settings;
+	switch (category)
+	{
+	case MemoryBudget::VOLUMES:
+		settings.GridSize = stepDown(settings.GridSize, minQuality.GridSize);
+		break;
+	case MemoryBudget::CUBE_MAPS:
+		// Fewer mips only once the grid is at its floor, as they save a third at most
+		if (settings.GridSize > minQuality.GridSize) settings.GridSize = stepDown(settings.GridSize, minQuality.GridSize);
+		else settings.NumCubeMips = (max)(settings.NumCubeMips - 1, minQuality.NumCubeMips);
+		break;
+	case MemoryBudget::LIGHT_MAP:
+		settings.LightGridSize = stepDown(settings.LightGridSize, minQuality.LightGridSize);
+		break;
+	case MemoryBudget::K_BUFFERS:
+		settings.NumOITLayers = (max)(settings.NumOITLayers / 2, minQuality.NumOITLayers);
+		break;
+	default:
+		return false;
+	}
+
+	if (pDescription)
+	{
+		auto& description = *pDescription;
+		if (settings.GridSize < quality.GridSize) description << "grid " << quality.GridSize << " -> " << settings.GridSize;
+		if (settings.NumCubeMips < quality.NumCubeMips)
+			description << "cube-map mips " << quality.NumCubeMips << " -> " << settings.NumCubeMips;
+		if (settings.LightGridSize < quality.LightGridSize)
+			description << "light grid " << quality.LightGridSize << " -> " << settings.LightGridSize;
+		if (settings.NumOITLayers < quality.NumOITLayers)
+			description << "K-buffer layers " << quality.NumOITLayers << " -> " << settings.NumOITLayers;
+	}
+
+	return settings.GridSize < quality.GridSize || settings.NumCubeMips < quality.NumCubeMips ||
+		settings.LightGridSize < quality.LightGridSize || settings.NumOITLayers < quality.NumOITLayers;
+}
+
+static uint64_t estimateTotal(const MemoryBudget::PlanDesc& desc, const MemoryBudget::Quality& quality,
+	uint64_t bytes[MemoryBudget::NUM_CATEGORY])
+{
+	MemoryBudget::Estimate(desc, quality, bytes);
+
+	auto total = desc.ReservedBytes;
+	for (uint8_t i = 0; i < MemoryBudget::NUM_CATEGORY; ++i) total += bytes[i];
+
+	return total;
+}
+
+//--------------------------------------------------------------------------------------
+// Accountant
+//--------------------------------------------------------------------------------------
+void MemoryBudget::Register(const string& name, uint64_t bytes, Category category)
+{
+	lock_guard<mutex> lock(g_allocationMutex);
+
+	auto& allocation = g_allocations[name];
+	allocation.Name = name;
+	allocation.Bytes = bytes;
+	allocation.Category = category;
+}
+
+void MemoryBudget::Reset()
+{
+	lock_guard<mutex> lock(g_allocationMutex);
+	g_allocations.clear();
+}
+
+vector<MemoryBudget::Allocation> MemoryBudget::GetAllocations()
+{
+	lock_guard<mutex> lock(g_allocationMutex);
+
+	vector<Allocation> allocations;
+	allocations.reserve(g_allocations.size());
+	for (const auto& allocation : g_allocations) allocations.push_back(allocation.second);
+
+	return allocations;
+}
+
+uint64_t MemoryBudget::GetTotal()
+{
+	lock_guard<mutex> lock(g_allocationMutex);
+
+	uint64_t total = 0;
+	for (const auto& allocation : g_allocations) total += allocation.second.Bytes;
+
+	return total;
+}
+
+uint64_t MemoryBudget::GetTotal(Category category)
+{
+	lock_guard<mutex> lock(g_allocationMutex);
+
+	uint64_t total = 0;
+	for (const auto& allocation : g_allocations)
+		if (allocation.second.Category == category) total += allocation.second.Bytes;
+
+	return total;
+}
+
+void MemoryBudget::PrintAllocations(ostream& stream)
+{
+	auto allocations = GetAllocations();
+	sort(allocations.begin(), allocations.end(), [](const Allocation& a, const Allocation& b)
+	{
+		return a.Bytes > b.Bytes;
+	});
+
+	stream << fixed << setprecision(2);
+	for (const auto& allocation : allocations)
+		stream << left << setw(36) << allocation.Name << setw(16) << GetCategoryName(static_cast<Category>(allocation.Category))
+			<< right << setw(12) << toMB(allocation.Bytes) << " MB" << endl;
+	stream << left << setw(52) << "Total" << right << setw(12) << toMB(GetTotal()) << " MB" << endl;
+	stream << defaultfloat;
+}
+
+//--------------------------------------------------------------------------------------
+// Planner
+//--------------------------------------------------------------------------------------
+MemoryBudget::PlanDesc MemoryBudget::GetDefaultPlanDesc(const SceneSettings& settings, uint32_t width, uint32_t height)
+{
+	PlanDesc desc = {};
+	desc.Budget = static_cast<uint64_t>(settings.MemoryBudget) << 20;
+	desc.NumVolumes = settings.NumVolumes;
+	desc.NumVolumeSrcs = SceneSettings::NumVolumeSrcs;
+	desc.Width = width;
+	desc.Height = height;
+	desc.ShadowMapSize = 1024;
+
+	desc.MaxQuality.GridSize = settings.GridSize;
+	desc.MaxQuality.NumCubeMips = NUM_CUBE_MIP;
+	desc.MaxQuality.LightGridSize = settings.LightGridSize;
+	desc.MaxQuality.NumOITLayers = NUM_OIT_LAYERS;
+
+	// The mip count and K-buffer depth are compiled into the shaders
+	desc.MinQuality.GridSize = (min)(settings.GridSize, 32u);
+	desc.MinQuality.NumCubeMips = NUM_CUBE_MIP;
+	desc.MinQuality.LightGridSize = (min)(settings.LightGridSize, 64u);
+	desc.MinQuality.NumOITLayers = NUM_OIT_LAYERS;
+
+	return desc;
+}
+
+MemoryBudget::Plan MemoryBudget::MakePlan(const PlanDesc& desc)
+{
+	Plan plan = {};
+	plan.Settings = desc.MaxQuality;
+
+	for (;;)
+	{
+		plan.Total = estimateTotal(desc, plan.Settings, plan.Bytes);
+		plan.Fits = desc.Budget == 0 || plan.Total <= desc.Budget;
+		if (plan.Fits) break;
+
+		// Downscale the largest consumer that still can be
+		Category categories[] = { VOLUMES, CUBE_MAPS, LIGHT_MAP, K_BUFFERS };
+		stable_sort(begin(categories), end(categories), [&plan](Category a, Category b)
+		{
+			return plan.Bytes[a] > plan.Bytes[b];
+		});
+
+		PlanStep step = {};
+		step.Settings = plan.Settings;
+		step.Total = plan.Total;
+		stringstream description;
+		auto isStepped = false;
+		for (const auto& category : categories)
+		{
+			isStepped = stepCategory(category, desc.MinQuality, plan.Settings, &description);
+			if (isStepped)
+			{
+				step.Category = category;
+				step.CategoryBytes = plan.Bytes[category];
+				break;
+			}
+		}
+
+		if (!isStepped) break;
+		step.Description = description.str();
+		plan.Steps.push_back(step);
+	}
+
+	return plan;
+}
+
+void MemoryBudget::Estimate(const PlanDesc& desc, const Quality& quality, uint64_t bytes[NUM_CATEGORY])
+{
+	// MultiRayCaster, as swept by SceneScaling
+	SceneScaling::SceneDesc scene;
+	scene.NumVolumes = desc.NumVolumes;
+	scene.NumVolumeSrcs = desc.NumVolumeSrcs;
+	scene.GridSize = quality.GridSize;
+	scene.LightGridSize = quality.LightGridSize;
+	scene.NumCubeMips = quality.NumCubeMips;
+	scene.NumOITLayers = quality.NumOITLayers;
+	scene.Width = desc.Width;
+	scene.Height = desc.Height;
+	const auto footprint = SceneScaling::ComputeFootprint(scene);
+
+	bytes[VOLUMES] = footprint.Bytes[SceneScaling::VOLUMES];
+	bytes[CUBE_MAPS] = footprint.Bytes[SceneScaling::RADIANCE_CUBES] + footprint.Bytes[SceneScaling::DEPTH_CUBES];
+	bytes[LIGHT_MAP] = footprint.Bytes[SceneScaling::LIGHT_MAP];
+	bytes[K_BUFFERS] = footprint.Bytes[SceneScaling::K_BUFFERS];
+
+	// ObjectRenderer: RGBA16F color, RG16F velocity, 2 RGBA16F temporal views, D32 depth and
+	// the D16 shadow map, with the depth of the ray caster
+	bytes[RENDER_TARGETS] = footprint.Bytes[SceneScaling::DEPTH] +
+		GetTextureSize(desc.Width, desc.Height, 1, 1, 1, 64) +
+		GetTextureSize(desc.Width, desc.Height, 1, 1, 1, 32) +
+		GetTextureSize(desc.Width, desc.Height, 1, 1, 1, 64) * 2 +
+		GetTextureSize(desc.Width, desc.Height, 1, 1, 1, 32) +
+		GetTextureSize(desc.ShadowMapSize, desc.ShadowMapSize, 1, 1, 1, 16);
+
+	bytes[LIGHT_PROBE] = desc.LightProbeBytes;
+
+	// Constant buffers of ObjectRenderer and LightProbe, each under the alignment
+	bytes[BUFFERS] = footprint.Bytes[SceneScaling::BUFFERS] + GetBufferSize(1) * g_numConstantBuffers;
+}
+
+void MemoryBudget::PrintPlan(ostream& stream, const PlanDesc& desc, const Plan& plan)
+{
+	stream << fixed << setprecision(1);
+	stream << "Memory plan for " << (desc.Budget > 0 ? to_string(desc.Budget >> 20) + " MB" : string("an unlimited budget"))
+		<< ": " << toMB(plan.Total) << " MB" << (plan.Fits ? "" : ", OVER BUDGET at the minimum quality") << endl;
+	for (const auto& step : plan.Steps)
+		stream << "  " << setw(16) << left << GetCategoryName(static_cast<Category>(step.Category)) << right
+			<< setw(10) << toMB(step.CategoryBytes) << " MB: " << step.Description << endl;
+
+	const auto& settings = plan.Settings;
+	stream << "  grid " << settings.GridSize << ", " << settings.NumCubeMips << " cube-map mips, light grid "
+		<< settings.LightGridSize << ", " << settings.NumOITLayers << " K-buffer layers" << endl;
+	for (uint8_t i = 0; i < NUM_CATEGORY; ++i)
+		stream << "  " << setw(16) << left << GetCategoryName(static_cast<Category>(i)) << right
+			<< setw(10) << toMB(plan.Bytes[i]) << " MB" << endl;
+	if (desc.ReservedBytes > 0) stream << "  " << setw(16) << left << "Reserved" << right
+		<< setw(10) << toMB(desc.ReservedBytes) << " MB" << endl;
+	stream << defaultfloat;
+}
+
+uint64_t MemoryBudget::GetTextureSize(uint32_t width, uint32_t height, uint32_t depth,
+	uint32_t arraySize, uint32_t numMips, uint32_t bitsPerTexel)
+{
+	// Mips stop at 1x1x1, as D3D12 clamps them
+	uint64_t bits = 0;
+	for (auto i = 0u; i < numMips; ++i)
+	{
+		bits += static_cast<uint64_t>(width) * height * depth * bitsPerTexel;
+		if (width == 1 && height == 1 && depth == 1) break;
+		width = (max)(width >> 1, 1u);
+		height = (max)(height >> 1, 1u);
+		depth = (max)(depth >> 1, 1u);
+	}
+
+	return GetBufferSize((bits + 7) / 8 * arraySize);
+}
+
+uint64_t MemoryBudget::GetBufferSize(uint64_t byteWidth)
+{
+	return (byteWidth + ResourceAlignment - 1) / ResourceAlignment * ResourceAlignment;
+}
+
+const char* MemoryBudget::GetCategoryName(Category category)
+{
+	return category < NUM_CATEGORY ? g_categoryNames[category] : "";
+}
+
+MemoryBudget::EvaluationResult MemoryBudget::Evaluate(const EvaluationDesc& desc)
+{
+	EvaluationResult result = {};
+
+	// A large scene, with the shader-compiled settings free to downscale as well
+	SceneSettings settings;
+	settings.NumVolumes = 1024;
+	settings.GridSize = 256;
+	settings.LightGridSize = 768;
+	auto planDesc = GetDefaultPlanDesc(settings, 1920, 1080);
+	planDesc.MinQuality.NumCubeMips = 1;
+	planDesc.MinQuality.NumOITLayers = 2;
+	planDesc.LightProbeBytes = 96ull << 20;
+	planDesc.ReservedBytes = 32ull << 20;
+
+	const auto& minQuality = planDesc.MinQuality;
+	const auto& maxQuality = planDesc.MaxQuality;
+	const auto isInRange = [&minQuality, &maxQuality](const Quality& quality)
+	{
+		return quality.GridSize >= minQuality.GridSize && quality.GridSize <= maxQuality.GridSize &&
+			quality.NumCubeMips >= minQuality.NumCubeMips && quality.NumCubeMips <= maxQuality.NumCubeMips &&
+			quality.LightGridSize >= minQuality.LightGridSize && quality.LightGridSize <= maxQuality.LightGridSize &&
+			quality.NumOITLayers >= minQuality.NumOITLayers && quality.NumOITLayers <= maxQuality.NumOITLayers;
+	};
+
+	uint64_t bytes[NUM_CATEGORY];
+	const auto minTotal = estimateTotal(planDesc, minQuality, bytes);
+	const auto maxTotal = estimateTotal(planDesc, maxQuality, bytes);
+	const auto numBudgets = (max)(desc.NumBudgets, 2u);
+	auto planTime = 0.0;
+	for (auto i = 0u; i <= numBudgets; ++i)
+	{
+		// From half the minimum footprint to past the maximum, and unlimited last
+		planDesc.Budget = i < numBudgets ? minTotal / 2 + (maxTotal + maxTotal / 8 - minTotal / 2) * i / (numBudgets - 1) : 0;
+
+		const auto startTime = chrono::steady_clock::now();
+		const auto plan = MakePlan(planDesc);
+		planTime += chrono::duration<double, micro>(chrono::steady_clock::now() - startTime).count();
+		++result.NumPlans;
+
+		auto isPassed = isInRange(plan.Settings) && plan.Total == estimateTotal(planDesc, plan.Settings, bytes);
+		if (planDesc.Budget == 0 || planDesc.Budget >= maxTotal)
+			isPassed = isPassed && plan.Fits && plan.Steps.empty();
+		else if (planDesc.Budget < minTotal)
+			isPassed = isPassed && !plan.Fits && plan.Total == minTotal;
+		else isPassed = isPassed && plan.Fits && plan.Total <= planDesc.Budget;
+
+		for (const auto& step : plan.Steps)
+		{
+			// Over budget before each step
+			isPassed = isPassed && step.Total > planDesc.Budget;
+
+			// No larger consumer could have been downscaled instead
+			estimateTotal(planDesc, step.Settings, bytes);
+			for (const auto& category : { VOLUMES, CUBE_MAPS, LIGHT_MAP, K_BUFFERS })
+			{
+				auto quality = step.Settings;
+				if (bytes[category] > step.CategoryBytes && stepCategory(category, minQuality, quality)) isPassed = false;
+			}
+		}
+
+		result.NumFailed += isPassed ? 0 : 1;
+	}
+	result.PlanTime = planTime / result.NumPlans;
+
+	return result;
+}
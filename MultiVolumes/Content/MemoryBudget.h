@@ -0,0 +1,118 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SceneSettings.h"
+
+// Accountant of the GPU memory of the renderers, and planner of the quality settings that fit
+// a budget. MultiRayCaster::Init(), ObjectRenderer::Init() and SetViewport(), and
+// LightProbe::Init() register every resource they create by name, size and category; a later
+// registration of the same name replaces the earlier one, as SetViewport() recreates its
+// resources on resizing. MakePlan() estimates the same allocations before any is made, and
+// downscales the setting of the largest consumer a step at a time until the total fits. Sizes
+// are of the texels, rounded per resource to the 64KB placement alignment of D3D12.
+// With -memoryBudget, MultiVolumes steps down the grid or light-grid size before creating the
+// scene and logs the plan to the debugger output; the cube-map mips and K-buffer layers are
+// compiled into the shaders, so they are kept.
+class MemoryBudget
+{
+public:
+	enum Category : uint8_t
+	{
+		VOLUMES,
+		CUBE_MAPS,
+		LIGHT_MAP,
+		K_BUFFERS,
+		RENDER_TARGETS,
+		LIGHT_PROBE,
+		BUFFERS,
+
+		NUM_CATEGORY
+	};
+
+	struct Allocation
+	{
+		std::string Name;
+		uint64_t Bytes;
+		uint8_t Category;
+	};
+
+	struct Quality
+	{
+		uint32_t GridSize;			// Of the volumes and their cube maps
+		uint32_t NumCubeMips;
+		uint32_t LightGridSize;
+		uint32_t NumOITLayers;		// K-buffer depth
+	};
+
+	struct PlanDesc
+	{
+		uint64_t Budget;			// In bytes, 0 if unlimited
+		uint32_t NumVolumes;
+		uint32_t NumVolumeSrcs;
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t ShadowMapSize;
+		uint64_t LightProbeBytes;	// Of the radiance, its prefiltered cache, and the SH buffers
+		uint64_t ReservedBytes;		// Not registered by the renderers, e.g. the swap chain
+		Quality MaxQuality;			// As requested
+		Quality MinQuality;			// Floors of the downscaling
+	};
+
+	struct PlanStep
+	{
+		Quality Settings;			// Before the step
+		uint64_t Total;
+		uint8_t Category;			// Largest downscalable consumer, which the step downscaled
+		uint64_t CategoryBytes;
+		std::string Description;
+	};
+
+	struct Plan
+	{
+		Quality Settings;
+		uint64_t Bytes[NUM_CATEGORY];
+		uint64_t Total;				// Including the reserved bytes
+		bool Fits;
+		std::vector<PlanStep> Steps;
+	};
+
+	struct EvaluationDesc
+	{
+		uint32_t NumBudgets;		// Swept from below the minimum to above the maximum footprint
+	};
+
+	struct EvaluationResult
+	{
+		uint32_t NumPlans;
+		uint32_t NumFailed;			// Plans out of range, over a budget they could fit, downscaled past
+									// fitting, or not downscaling the largest consumer first
+		double PlanTime;			// Per plan, in microseconds
+	};
+
+	// Accountant
+	static void Register(const std::string& name, uint64_t bytes, Category category);
+	static void Reset();
+	static std::vector<Allocation> GetAllocations();
+	static uint64_t GetTotal();
+	static uint64_t GetTotal(Category category);
+	static void PrintAllocations(std::ostream& stream);
+
+	// Planner
+	static PlanDesc GetDefaultPlanDesc(const SceneSettings& settings, uint32_t width, uint32_t height);
+	static Plan MakePlan(const PlanDesc& desc);
+	static void Estimate(const PlanDesc& desc, const Quality& quality, uint64_t bytes[NUM_CATEGORY]);
+	static void PrintPlan(std::ostream& stream, const PlanDesc& desc, const Plan& plan);
+
+	static uint64_t GetTextureSize(uint32_t width, uint32_t height, uint32_t depth,
+		uint32_t arraySize, uint32_t numMips, uint32_t bitsPerTexel);
+	static uint64_t GetBufferSize(uint64_t byteWidth);
+	static const char* GetCategoryName(Category category);
+
+	static EvaluationResult Evaluate(const EvaluationDesc& desc);
+
+	static const uint64_t ResourceAlignment = 65536;
+	static const uint32_t SizeGranularity = 16;	// Of the downscaled grid sizes
+};
@@ -4,6 +4,11 @@
 
 #include "SharedConsts.h"
 #include "MultiRayCaster.h"
+#include "VolumeTypes.h"
+#include "MemoryBudget.h"
+#include "FrameProfiler.h"
+#include "GPUProfiler.h"
+#include "TraceRecorder.h"
 #define _INDEPENDENT_DDS_LOADER_
 #include "Advanced/XUSGDDSLoader.h"
 #undef _INDEPENDENT_DDS_LOADER_
@@ -31,30 +36,6 @@ struct CBPerFrame
 	XMFLOAT4 Ambient;
 };
 
-struct PerObject
-{
-	XMFLOAT4X4 WorldViewProj;
-	XMFLOAT4X4 WorldViewProjI;
-	XMFLOAT3X4 WorldI;
-	XMFLOAT3X4 World;
-	XMFLOAT3X4 LocalToLight;
-};
-
-struct VolumeDesc
-{
-	uint32_t VolTexId : 14;
-	uint32_t NumMips : 4;
-	uint32_t CubeMapSize : 14;
-};
-
-struct VolumeInfo
-{
-	uint16_t MipLevel;
-	uint16_t SmpCount;
-	uint16_t FaceMask;
-	uint16_t VolTexId;
-};
-
 const uint8_t g_numCubeMips = NUM_CUBE_MIP;
 
 MultiRayCaster::MultiRayCaster() :
@@ -81,7 +62,7 @@ MultiRayCaster::~MultiRayCaster()
 
 bool MultiRayCaster::Init(RayTracing::CommandList* pCommandList, const DescriptorTableCache::sptr& descriptorTableCache,
 	Format rtFormat, Format dsFormat, uint32_t gridSize, uint32_t lightGridSize, uint32_t numVolumes, uint32_t numVolumeSrcs,
-	vector<Resource::uptr>& uploaders, RayTracing::GeometryBuffer* pGeometry, uint8_t rtSupport)
+	UploadRing* pUploadRing, RayTracing::GeometryBuffer* pGeometry, uint8_t rtSupport)
 {
 	const auto pDevice = pCommandList->GetRTDevice();
 	m_rayTracingPipelineCache = RayTracing::PipelineCache::MakeUnique(pDevice);
@@ -95,7 +76,7 @@ bool MultiRayCaster::Init(RayTracing::CommandList* pCommandList, const Descripto
 	m_lightGridSize = lightGridSize;
 
 	// Create resources
-	XUSG_N_RETURN(createVolumeInfoBuffers(pCommandList, numVolumes, numVolumeSrcs, uploaders), false);
+	XUSG_N_RETURN(createVolumeInfoBuffers(pCommandList, numVolumes, numVolumeSrcs, pUploadRing), false);
 
 	m_volumes.resize(numVolumeSrcs);
 	for (auto i = 0u; i < numVolumeSrcs; ++i)
@@ -104,6 +85,8 @@ bool MultiRayCaster::Init(RayTracing::CommandList* pCommandList, const Descripto
 		XUSG_N_RETURN(m_volumes[i]->Create(pDevice, gridSize, gridSize, gridSize, Format::R16G16B16A16_FLOAT,
 			ResourceFlag::ALLOW_UNORDERED_ACCESS | ResourceFlag::ALLOW_SIMULTANEOUS_ACCESS, 1,
 			MemoryFlag::NONE, (L"Volume" + to_wstring(i)).c_str()), false);
+		MemoryBudget::Register("Volume" + to_string(i), MemoryBudget::GetTextureSize(gridSize,
+			gridSize, gridSize, 1, 1, 64), MemoryBudget::VOLUMES);
 	}
 
 	m_cubeMaps.resize(numVolumes);
@@ -119,16 +102,25 @@ bool MultiRayCaster::Init(RayTracing::CommandList* pCommandList, const Descripto
 		XUSG_N_RETURN(m_cubeDepths[i]->Create(pDevice, gridSize, gridSize, Format::R32_FLOAT, 6,
 			ResourceFlag::ALLOW_UNORDERED_ACCESS, g_numCubeMips, 1, true, MemoryFlag::NONE,
 			(L"DepthCubeMap" + to_wstring(i)).c_str()), false);
+
+		MemoryBudget::Register("RadianceCubeMap" + to_string(i), MemoryBudget::GetTextureSize(gridSize,
+			gridSize, 1, 6, g_numCubeMips, 64), MemoryBudget::CUBE_MAPS);
+		MemoryBudget::Register("DepthCubeMap" + to_string(i), MemoryBudget::GetTextureSize(gridSize,
+			gridSize, 1, 6, g_numCubeMips, 32), MemoryBudget::CUBE_MAPS);
 	}
 
 	m_lightMap = Texture3D::MakeUnique();
 	XUSG_N_RETURN(m_lightMap->Create(pDevice, m_lightGridSize, m_lightGridSize, m_lightGridSize,
 		Format::R11G11B10_FLOAT,ResourceFlag::ALLOW_UNORDERED_ACCESS | ResourceFlag::ALLOW_SIMULTANEOUS_ACCESS,
 		1, MemoryFlag::NONE, L"LightMap"), false);
+	MemoryBudget::Register("LightMap", MemoryBudget::GetTextureSize(m_lightGridSize, m_lightGridSize,
+		m_lightGridSize, 1, 1, 32), MemoryBudget::LIGHT_MAP);
 
 	m_cbPerFrame = ConstantBuffer::MakeUnique();
 	XUSG_N_RETURN(m_cbPerFrame->Create(pDevice, sizeof(CBPerFrame[FrameCount]), FrameCount,
 		nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"RayCaster.CBPerFrame"), false);
+	MemoryBudget::Register("RayCaster.CBPerFrame", MemoryBudget::GetBufferSize(sizeof(CBPerFrame[FrameCount])),
+		MemoryBudget::BUFFERS);
 
 	/*m_cbPerObject = ConstantBuffer::MakeUnique();
 	XUSG_N_RETURN(m_cbPerObject->Create(pDevice, sizeof(CBPerObject[FrameCount]), FrameCount,
@@ -141,10 +133,13 @@ bool MultiRayCaster::Init(RayTracing::CommandList* pCommandList, const Descripto
 	// create command layout
 	XUSG_N_RETURN(createCommandLayouts(pDevice), false);
 
-	XUSG_N_RETURN(createCubeVB(pCommandList, uploaders), false);
-	XUSG_N_RETURN(createCubeIB(pCommandList, uploaders), false);
+	XUSG_N_RETURN(createCubeVB(pCommandList, pUploadRing), false);
+	XUSG_N_RETURN(createCubeIB(pCommandList, pUploadRing), false);
 
 	// Set world transforms
+	m_volumeTransforms = make_unique<VolumeTransforms>();
+	m_volumeTransforms->Init(numVolumes, FrameCount);
+	m_volumeTransforms->SetLightWorld(m_lightMapWorld);
 	m_volumeWorlds.resize(numVolumes);
 	SetVolumesWorld(20.0f, XMFLOAT3(0.0f, 0.0f, 0.0f));
 
@@ -162,6 +157,8 @@ bool MultiRayCaster::Init(RayTracing::CommandList* pCommandList, const Descripto
 
 bool MultiRayCaster::LoadVolumeData(XUSG::CommandList* pCommandList, uint32_t i, const wchar_t* fileName, vector<Resource::uptr>& uploaders)
 {
+	TRACE_SCOPE("MultiRayCaster::LoadVolumeData");
+
 	// Load input image
 	{
 		DDS::Loader textureLoader;
@@ -209,6 +206,8 @@ bool MultiRayCaster::SetRenderTargets(const XUSG::Device* pDevice, const RenderT
 	m_depth = DepthStencil::MakeUnique();
 	XUSG_N_RETURN(m_depth->Create(pDevice, width, height, Format::D32_FLOAT, ResourceFlag::NONE,
 		1, 1, 1, 1.0f, 0, false, MemoryFlag::NONE, L"DepthIncCubes"), false);
+	MemoryBudget::Register("DepthIncCubes", MemoryBudget::GetTextureSize(width, height, 1, 1, 1, 32),
+		MemoryBudget::RENDER_TARGETS);
 
 	return SetViewport(pDevice, width, height, pColorOut);
 }
@@ -226,6 +225,11 @@ bool MultiRayCaster::SetViewport(const XUSG::Device* pDevice, uint32_t width, ui
 	XUSG_N_RETURN(m_kColors->Create(pDevice, width, height, Format::R16G16B16A16_FLOAT, NUM_OIT_LAYERS,
 		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, 1, false, MemoryFlag::NONE, L"ColorKBuffer"), false);
 
+	MemoryBudget::Register("DepthKBuffer", MemoryBudget::GetTextureSize(width, height, 1, NUM_OIT_LAYERS, 1, 32),
+		MemoryBudget::K_BUFFERS);
+	MemoryBudget::Register("ColorKBuffer", MemoryBudget::GetTextureSize(width, height, 1, NUM_OIT_LAYERS, 1, 64),
+		MemoryBudget::K_BUFFERS);
+
 	XUSG_N_RETURN(createDescriptorTables(pColorOut),false);
 
 	return true;
@@ -287,6 +291,7 @@ void MultiRayCaster::SetVolumeWorld(uint32_t i, float size, const XMFLOAT3& pos)
 	auto world = XMMatrixScaling(size, size, size);
 	world = world * XMMatrixTranslation(pos.x, pos.y, pos.z);
 	XMStoreFloat3x4(&m_volumeWorlds[i], world);
+	m_volumeTransforms->SetWorld(i, XMFLOAT3(size, size, size), pos);
 }
 
 void MultiRayCaster::SetLightMapWorld(float size, const XMFLOAT3& pos)
@@ -295,6 +300,7 @@ void MultiRayCaster::SetLightMapWorld(float size, const XMFLOAT3& pos)
 	auto world = XMMatrixScaling(size, size, size);
 	world = world * XMMatrixTranslation(pos.x, pos.y, pos.z);
 	XMStoreFloat3x4(&m_lightMapWorld, world);
+	if (m_volumeTransforms) m_volumeTransforms->SetLightWorld(m_lightMapWorld);
 }
 
 void MultiRayCaster::SetLight(const XMFLOAT3& pos, const XMFLOAT3& color, float intensity)
@@ -311,6 +317,8 @@ void MultiRayCaster::SetAmbient(const XMFLOAT3& color, float intensity)
 void MultiRayCaster::UpdateFrame(uint8_t frameIndex, CXMMATRIX viewProj,
 	const XMFLOAT4X4& shadowVP, const XMFLOAT3& eyePt)
 {
+	TRACE_SCOPE("MultiRayCaster::UpdateFrame");
+
 	const auto& depth = m_pDepths[DEPTH_MAP];
 	const auto width = static_cast<float>(depth->GetWidth());
 	const auto height = static_cast<float>(depth->GetHeight());
@@ -329,26 +337,10 @@ void MultiRayCaster::UpdateFrame(uint8_t frameIndex, CXMMATRIX viewProj,
 		XMStoreFloat4x4(&pCbData->ScreenToWorld, XMMatrixTranspose(projToWorld));
 	}
 
-	// Per-object
+	// Per-object, only rewritten for the changed volumes and matrices
 	{
-		const auto numVolumes = static_cast<uint32_t>(m_cubeMaps.size());
-		const auto lightWorld = XMLoadFloat3x4(&m_lightMapWorld);
-		const auto lightWorldI = XMMatrixInverse(nullptr, lightWorld);
-
 		const auto pMappedData = reinterpret_cast<PerObject*>(m_perObject->Map(frameIndex));
-		for (auto i = 0u; i < numVolumes; ++i)
-		{
-			const auto world = XMLoadFloat3x4(&m_volumeWorlds[i]);
-			const auto worldI = XMMatrixInverse(nullptr, world);
-			const auto worldViewProj = world * viewProj;
-			const auto localToLight = world * lightWorldI;
-
-			XMStoreFloat4x4(&pMappedData[i].WorldViewProj, XMMatrixTranspose(worldViewProj));
-			XMStoreFloat4x4(&pMappedData[i].WorldViewProjI, XMMatrixTranspose(XMMatrixInverse(nullptr, worldViewProj)));
-			XMStoreFloat3x4(&pMappedData[i].WorldI, worldI);
-			XMStoreFloat3x4(&pMappedData[i].World, world);
-			XMStoreFloat3x4(&pMappedData[i].LocalToLight, localToLight);
-		}
+		m_volumeTransforms->Update(frameIndex, viewProj, pMappedData);
 	}
 }
 
@@ -377,6 +369,9 @@ void MultiRayCaster::Render(RayTracing::CommandList* pCommandList, uint8_t frame
 
 void MultiRayCaster::RayMarchL(const XUSG::CommandList* pCommandList, uint8_t frameIndex)
 {
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::RECORD_RAY_MARCH_L);
+	const GPUProfiler::ScopedTimer gpuTimer(pCommandList, FrameProfiler::RAY_MARCH_L);
+
 	// Set barrier
 	ResourceBarrier barrier;
 	m_lightMap->SetBarrier(&barrier, ResourceState::UNORDERED_ACCESS);
@@ -409,7 +404,7 @@ Resource* MultiRayCaster::GetLightMap() const
 	return m_lightMap.get();
 }
 
-bool MultiRayCaster::createCubeVB(XUSG::CommandList* pCommandList, vector<Resource::uptr>& uploaders)
+bool MultiRayCaster::createCubeVB(XUSG::CommandList* pCommandList, UploadRing* pUploadRing)
 {
 	static const auto CubeVertices = []()
 	{
@@ -450,13 +445,13 @@ bool MultiRayCaster::createCubeVB(XUSG::CommandList* pCommandList, vector<Resour
 	XUSG_N_RETURN(m_vertexBuffer->Create(pCommandList->GetDevice(), static_cast<uint32_t>(vertices.size()), 
 		static_cast<uint32_t>(sizeof(XMFLOAT3)), ResourceFlag::NONE, MemoryType::DEFAULT, 1,
 		nullptr, 0, nullptr, 0, nullptr, MemoryFlag::NONE, L"CubeVB"), false);
-	uploaders.emplace_back(Resource::MakeUnique());
+	MemoryBudget::Register("CubeVB", MemoryBudget::GetBufferSize(sizeof(XMFLOAT3) * vertices.size()), MemoryBudget::BUFFERS);
 
-	return m_vertexBuffer->Upload(pCommandList, uploaders.back().get(), vertices.data(),
-		vertices.size() * sizeof(XMFLOAT3), 0, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+	return pUploadRing->Upload(pCommandList, m_vertexBuffer.get(), vertices.data(),
+		vertices.size() * sizeof(XMFLOAT3), ResourceState::NON_PIXEL_SHADER_RESOURCE);
 }
 
-bool MultiRayCaster::createCubeIB(XUSG::CommandList* pCommandList, vector<Resource::uptr>& uploaders)
+bool MultiRayCaster::createCubeIB(XUSG::CommandList* pCommandList, UploadRing* pUploadRing)
 {
 	static const uint16_t indices[] =
 	{
@@ -471,14 +466,14 @@ bool MultiRayCaster::createCubeIB(XUSG::CommandList* pCommandList, vector<Resour
 	m_indexBuffer = IndexBuffer::MakeUnique();
 	XUSG_N_RETURN(m_indexBuffer->Create(pCommandList->GetDevice(), sizeof(indices), Format::R16_UINT, ResourceFlag::NONE,
 		MemoryType::DEFAULT, 1, nullptr, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"CubeIB"), false);
-	uploaders.emplace_back(Resource::MakeUnique());
+	MemoryBudget::Register("CubeIB", MemoryBudget::GetBufferSize(sizeof(indices)), MemoryBudget::BUFFERS);
 
-	return m_indexBuffer->Upload(pCommandList, uploaders.back().get(), indices,
-		sizeof(indices), 0, ResourceState::NON_PIXEL_SHADER_RESOURCE | ResourceState::INDEX_BUFFER);
+	return pUploadRing->Upload(pCommandList, m_indexBuffer.get(), indices,
+		sizeof(indices), ResourceState::NON_PIXEL_SHADER_RESOURCE | ResourceState::INDEX_BUFFER);
 }
 
 bool MultiRayCaster::createVolumeInfoBuffers(XUSG::CommandList* pCommandList, uint32_t numVolumes,
-	uint32_t numVolumeSrcs, vector<Resource::uptr>& uploaders)
+	uint32_t numVolumeSrcs, UploadRing* pUploadRing)
 {
 	const auto pDevice = pCommandList->GetDevice();
 
@@ -490,6 +485,8 @@ bool MultiRayCaster::createVolumeInfoBuffers(XUSG::CommandList* pCommandList, ui
 		XUSG_N_RETURN(m_perObject->Create(pDevice, numVolumes * FrameCount,
 			sizeof(PerObject), ResourceFlag::NONE, MemoryType::UPLOAD, FrameCount,
 			firstSRVElements, 0, nullptr, MemoryFlag::NONE, L"RayCaster.Matrices"), false);
+		MemoryBudget::Register("RayCaster.Matrices", MemoryBudget::GetBufferSize(sizeof(PerObject) *
+			numVolumes * FrameCount), MemoryBudget::BUFFERS);
 	}
 
 	{
@@ -507,10 +504,11 @@ bool MultiRayCaster::createVolumeInfoBuffers(XUSG::CommandList* pCommandList, ui
 		XUSG_N_RETURN(m_volumeDescs->Create(pDevice, numVolumes,
 			sizeof(VolumeDesc), ResourceFlag::NONE, MemoryType::DEFAULT, 1,
 			nullptr, 1, nullptr, MemoryFlag::NONE, L"RayCaster.VolumeDescs"), false);
+		MemoryBudget::Register("RayCaster.VolumeDescs", MemoryBudget::GetBufferSize(sizeof(VolumeDesc) * numVolumes),
+			MemoryBudget::BUFFERS);
 
-		uploaders.emplace_back(Resource::MakeUnique());
-		m_volumeDescs->Upload(pCommandList, uploaders.back().get(),
-			volumeDescs.data(), sizeof(VolumeDesc) * volumeDescs.size());
+		XUSG_N_RETURN(pUploadRing->Upload(pCommandList, m_volumeDescs.get(),
+			volumeDescs.data(), sizeof(VolumeDesc) * volumeDescs.size()), false);
 	}
 
 	{
@@ -543,8 +541,7 @@ bool MultiRayCaster::createVolumeInfoBuffers(XUSG::CommandList* pCommandList, ui
 			0, nullptr, MemoryFlag::NONE, L"RayCaster.VisibleVolumeDispatchArg"), false);
 
 		const uint32_t pDispatchReset[] = { XUSG_DIV_UP(m_gridSize, 8), XUSG_DIV_UP(m_gridSize, 4), 0 };
-		uploaders.emplace_back(Resource::MakeUnique());
-		XUSG_N_RETURN(m_volumeDispatchArg->Upload(pCommandList, uploaders.back().get(), pDispatchReset, sizeof(uint32_t[3])), false);
+		XUSG_N_RETURN(pUploadRing->Upload(pCommandList, m_volumeDispatchArg.get(), pDispatchReset, sizeof(uint32_t[3])), false);
 
 		m_volumeDrawArg = RawBuffer::MakeUnique();
 		XUSG_N_RETURN(m_volumeDrawArg->Create(pDevice, sizeof(uint32_t[5]),
@@ -552,12 +549,17 @@ bool MultiRayCaster::createVolumeInfoBuffers(XUSG::CommandList* pCommandList, ui
 			0, nullptr, MemoryFlag::NONE, L"RayCaster.VisibleVolumeDrawArg"), false);
 
 		const uint32_t pDrawReset[] = { 36, 0, 0, 0, 0 };
-		uploaders.emplace_back(Resource::MakeUnique());
-		XUSG_N_RETURN(m_volumeDrawArg->Upload(pCommandList, uploaders.back().get(), pDrawReset, sizeof(uint32_t[5])), false);
+		XUSG_N_RETURN(pUploadRing->Upload(pCommandList, m_volumeDrawArg.get(), pDrawReset, sizeof(uint32_t[5])), false);
 
 		const auto clear = 0u;
-		uploaders.emplace_back(Resource::MakeUnique());
-		XUSG_N_RETURN(m_counterReset->Upload(pCommandList, uploaders.back().get(), &clear, sizeof(uint32_t)), false);
+		XUSG_N_RETURN(pUploadRing->Upload(pCommandList, m_counterReset.get(), &clear, sizeof(uint32_t)), false);
+
+		MemoryBudget::Register("RayCaster.VisibleVolumeCounter", MemoryBudget::GetBufferSize(sizeof(uint32_t)), MemoryBudget::BUFFERS);
+		MemoryBudget::Register("RayCaster.VisibleVolumes", MemoryBudget::GetBufferSize(sizeof(uint32_t) * numVolumes), MemoryBudget::BUFFERS);
+		MemoryBudget::Register("RayCaster.CounterReset", MemoryBudget::GetBufferSize(sizeof(uint32_t)), MemoryBudget::BUFFERS);
+		MemoryBudget::Register("RayCaster.VolumeAttributes", MemoryBudget::GetBufferSize(sizeof(VolumeInfo) * numVolumes), MemoryBudget::BUFFERS);
+		MemoryBudget::Register("RayCaster.VisibleVolumeDispatchArg", MemoryBudget::GetBufferSize(sizeof(uint32_t[3])), MemoryBudget::BUFFERS);
+		MemoryBudget::Register("RayCaster.VisibleVolumeDrawArg", MemoryBudget::GetBufferSize(sizeof(uint32_t[5])), MemoryBudget::BUFFERS);
 	}
 
 	return true;
@@ -1162,6 +1164,9 @@ bool MultiRayCaster::buildShaderTables(const RayTracing::Device* pDevice)
 
 void MultiRayCaster::cullVolumes(XUSG::CommandList* pCommandList, uint8_t frameIndex)
 {
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::RECORD_CULL_VOLUMES);
+	const GPUProfiler::ScopedTimer gpuTimer(pCommandList, FrameProfiler::CULL_VOLUMES);
+
 	// Set barrier
 	ResourceBarrier barriers[1];
 	m_visibleVolumeCounter->SetBarrier(barriers, ResourceState::COPY_DEST);
@@ -1192,15 +1197,16 @@ void MultiRayCaster::cullVolumes(XUSG::CommandList* pCommandList, uint8_t frameI
 
 void MultiRayCaster::rayMarchV(XUSG::CommandList* pCommandList, uint8_t frameIndex)
 {
-	// Set barriers
-	vector<ResourceBarrier> barriers(m_cubeMaps.size() + m_cubeDepths.size() + 5);
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::RECORD_RAY_MARCH_V);
+	const GPUProfiler::ScopedTimer gpuTimer(pCommandList, FrameProfiler::RAY_MARCH_V);
+
+	// Set barriers; the caller transitions the scene depth to a shader resource
+	vector<ResourceBarrier> barriers(m_cubeMaps.size() + m_cubeDepths.size() + 4);
 	m_volumeDispatchArg->SetBarrier(barriers.data(), ResourceState::COPY_DEST);	// Promotion
 	m_volumeDrawArg->SetBarrier(barriers.data(), ResourceState::COPY_DEST);		// Promotion
 	auto numBarriers = m_visibleVolumes->SetBarrier(barriers.data(), ResourceState::NON_PIXEL_SHADER_RESOURCE);
 	numBarriers = m_volumeAttribs->SetBarrier(barriers.data(), ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
 	numBarriers = m_lightMap->SetBarrier(barriers.data(), ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
-	numBarriers = m_pDepths[DEPTH_MAP]->SetBarrier(barriers.data(), ResourceState::NON_PIXEL_SHADER_RESOURCE |
-		ResourceState::PIXEL_SHADER_RESOURCE, numBarriers);
 	for (auto& cubeMap : m_cubeMaps)
 		numBarriers = cubeMap->SetBarrier(barriers.data(), ResourceState::UNORDERED_ACCESS, numBarriers);
 	for (auto& cubeDepth : m_cubeDepths)
@@ -1291,6 +1297,9 @@ void MultiRayCaster::renderDepth(XUSG::CommandList* pCommandList, uint8_t frameI
 
 void MultiRayCaster::renderCube(XUSG::CommandList* pCommandList, uint8_t frameIndex)
 {
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::RECORD_RENDER_CUBE);
+	const GPUProfiler::ScopedTimer gpuTimer(pCommandList, FrameProfiler::RENDER_CUBE);
+
 	// Set barriers
 	vector<ResourceBarrier> barriers(m_cubeMaps.size() + m_cubeDepths.size() + 2);
 	auto numBarriers = m_kColors->SetBarrier(barriers.data(), ResourceState::UNORDERED_ACCESS);
@@ -1329,6 +1338,9 @@ void MultiRayCaster::renderCube(XUSG::CommandList* pCommandList, uint8_t frameIn
 
 void MultiRayCaster::renderCubeRT(XUSG::CommandList* pCommandList, uint8_t frameIndex, RenderTarget* pOutView)
 {
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::RECORD_RENDER_CUBE);
+	const GPUProfiler::ScopedTimer gpuTimer(pCommandList, FrameProfiler::RENDER_CUBE);
+
 	// Set barriers
 	vector<ResourceBarrier> barriers(m_cubeMaps.size() + m_cubeDepths.size() + 1);
 	auto numBarriers = m_depth->SetBarrier(barriers.data(), ResourceState::DEPTH_READ);
@@ -1362,6 +1374,9 @@ void MultiRayCaster::renderCubeRT(XUSG::CommandList* pCommandList, uint8_t frame
 
 void MultiRayCaster::resolveOIT(XUSG::CommandList* pCommandList, uint8_t frameIndex)
 {
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::RECORD_RESOLVE_OIT);
+	const GPUProfiler::ScopedTimer gpuTimer(pCommandList, FrameProfiler::RESOLVE_OIT);
+
 	// Set barrier
 	ResourceBarrier barrier;
 	const auto numBarriers = m_kColors->SetBarrier(&barrier, ResourceState::PIXEL_SHADER_RESOURCE);
@@ -1382,9 +1397,12 @@ void MultiRayCaster::resolveOIT(XUSG::CommandList* pCommandList, uint8_t frameIn
 
 void MultiRayCaster::traceCube(RayTracing::CommandList* pCommandList, uint8_t frameIndex, Texture* pColorOut)
 {
-	// Set barriers
-	vector<ResourceBarrier> barriers(m_cubeMaps.size() + m_cubeDepths.size() + 1);
-	auto numBarriers = pColorOut->SetBarrier(barriers.data(), ResourceState::UNORDERED_ACCESS);
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::RECORD_RENDER_CUBE);
+	const GPUProfiler::ScopedTimer gpuTimer(pCommandList, FrameProfiler::RENDER_CUBE);
+
+	// Set barriers; the caller transitions the color output to UNORDERED_ACCESS
+	vector<ResourceBarrier> barriers(m_cubeMaps.size() + m_cubeDepths.size());
+	auto numBarriers = 0u;
 	for (auto& cubeMap : m_cubeMaps)
 		numBarriers = cubeMap->SetBarrier(barriers.data(), ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
 	for (auto& cubeDepth : m_cubeDepths)
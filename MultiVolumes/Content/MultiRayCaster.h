@@ -6,6 +6,8 @@
 
 #include "Core/XUSG.h"
 #include "RayTracing/XUSGRayTracing.h"
+#include "VolumeTransforms.h"
+#include "UploadRing.h"
 
 class MultiRayCaster
 {
@@ -30,7 +32,7 @@ public:
 
 	bool Init(XUSG::RayTracing::CommandList* pCommandList, const XUSG::DescriptorTableCache::sptr& descriptorTableCache,
 		XUSG::Format rtFormat, XUSG::Format dsFormat, uint32_t gridSize, uint32_t lightGridSize, uint32_t numVolumes,
-		uint32_t numVolumeSrcs, std::vector<XUSG::Resource::uptr>& uploaders, XUSG::RayTracing::GeometryBuffer* pGeometry,
+		uint32_t numVolumeSrcs, UploadRing* pUploadRing, XUSG::RayTracing::GeometryBuffer* pGeometry,
 		uint8_t rtSupport);
 	bool LoadVolumeData(XUSG::CommandList* pCommandList, uint32_t i,
 		const wchar_t* fileName, std::vector<XUSG::Resource::uptr>& uploaders);
@@ -119,10 +121,10 @@ protected:
 		SHADOW_MAP
 	};
 
-	bool createCubeVB(XUSG::CommandList* pCommandList, std::vector<XUSG::Resource::uptr>& uploaders);
-	bool createCubeIB(XUSG::CommandList* pCommandList, std::vector<XUSG::Resource::uptr>& uploaders);
+	bool createCubeVB(XUSG::CommandList* pCommandList, UploadRing* pUploadRing);
+	bool createCubeIB(XUSG::CommandList* pCommandList, UploadRing* pUploadRing);
 	bool createVolumeInfoBuffers(XUSG::CommandList* pCommandList, uint32_t numVolumes,
-		uint32_t numVolumeSrcs, std::vector<XUSG::Resource::uptr>& uploaders);
+		uint32_t numVolumeSrcs, UploadRing* pUploadRing);
 	bool createPipelineLayouts(const XUSG::Device* pDevice);
 	bool createPipelines(XUSG::Format rtFormat, XUSG::Format dsFormat);
 	bool createCommandLayouts(const XUSG::Device* pDevice);
@@ -206,6 +208,7 @@ protected:
 	DirectX::XMFLOAT4		m_ambient;
 	DirectX::XMFLOAT3X4		m_lightMapWorld;
 	std::vector<DirectX::XMFLOAT3X4> m_volumeWorlds;
+	std::unique_ptr<VolumeTransforms> m_volumeTransforms;
 
 	DirectX::XMUINT2		m_viewport;
 
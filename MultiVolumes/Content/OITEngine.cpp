@@ -0,0 +1,413 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "OITEngine.h"
+#include "ParallelFor.h"
+#include <chrono>
+#include <random>
+#include <DirectXPackedVector.h>
+
+using namespace std;
+using namespace DirectX;
+using namespace PackedVector;
+
+static const uint32_t g_nullNode = UINT32_MAX;
+
+// Front-to-back compositing of premultiplied colors, as in PSResolveOIT.hlsl
+static inline void blendUnder(XMFLOAT4& dst, const XMFLOAT4& src)
+{
+	const auto t = 1.0f - dst.w;
+	dst.x += src.x * t;
+	dst.y += src.y * t;
+	dst.z += src.z * t;
+	dst.w += src.w * t;
+}
+
+// Depth weight of weighted blended OIT, equation (9) of McGuire and Bavoil 2013
+static inline float blendWeight(float depth, float alpha)
+{
+	const auto z5 = depth / 5.0f;
+	const auto z200 = depth / 200.0f;
+	const auto z200_2 = z200 * z200;
+	const auto w = 10.0f / (1e-5f + z5 * z5 + z200_2 * z200_2 * z200_2);
+
+	return alpha * (min)((max)(w, 1e-2f), 3e3f);
+}
+
+OITEngine::OITEngine() :
+	m_numNodes(0),
+	m_width(0),
+	m_height(0),
+	m_method(METHOD_K_BUFFER),
+	m_numLayers(0)
+{
+}
+
+OITEngine::~OITEngine()
+{
+}
+
+void OITEngine::Init(uint32_t width, uint32_t height, Method method, uint32_t numLayers)
+{
+	m_width = width;
+	m_height = height;
+	m_method = method;
+	m_numLayers = numLayers;
+
+	const auto numPixels = static_cast<size_t>(width) * height;
+	m_layerDepths.clear();
+	m_layerColors.clear();
+	m_layerCounts.clear();
+	m_heads.clear();
+	m_nodes.clear();
+	m_accums.clear();
+	m_revealages.clear();
+
+	switch (method)
+	{
+	case METHOD_LINKED_LIST:
+		m_heads.resize(numPixels);
+		m_nodes.resize(numPixels * numLayers);
+		break;
+	case METHOD_WEIGHTED_BLENDED:
+		m_accums.resize(4 * numPixels);
+		m_revealages.resize(numPixels);
+		break;
+	default:
+		assert(numLayers <= UINT8_MAX);
+		m_layerDepths.resize(numPixels * numLayers);
+		m_layerColors.resize(numPixels * numLayers);
+		m_layerCounts.resize(numPixels);
+	}
+	m_fragmentCounts.resize(numPixels);
+
+	Clear();
+}
+
+void OITEngine::Clear()
+{
+	fill(m_layerCounts.begin(), m_layerCounts.end(), 0);
+	fill(m_heads.begin(), m_heads.end(), g_nullNode);
+	fill(m_accums.begin(), m_accums.end(), XMConvertFloatToHalf(0.0f));
+	fill(m_revealages.begin(), m_revealages.end(), XMConvertFloatToHalf(1.0f));
+	fill(m_fragmentCounts.begin(), m_fragmentCounts.end(), 0);
+	m_numNodes = 0;
+}
+
+void OITEngine::AddFragment(uint32_t x, uint32_t y, float depth, const XMFLOAT4& color)
+{
+	const auto pixel = m_width * y + x;
+	++m_fragmentCounts[pixel];
+
+	switch (m_method)
+	{
+	case METHOD_LINKED_LIST:
+		insertLinkedList(pixel, depth, color);
+		break;
+	case METHOD_WEIGHTED_BLENDED:
+		insertWeightedBlended(pixel, depth, color);
+		break;
+	case METHOD_ADAPTIVE:
+		insertAdaptive(pixel, depth, color);
+		break;
+	default:
+		insertKBuffer(pixel, depth, color);
+	}
+}
+
+void OITEngine::Resolve(XMFLOAT4* pOut) const
+{
+	ParallelFor(m_height, 8, [&](uint32_t begin, uint32_t end)
+	{
+		vector<Node> fragments;
+		for (auto y = begin; y < end; ++y)
+			for (auto x = 0u; x < m_width; ++x)
+			{
+				const auto pixel = m_width * y + x;
+				pOut[pixel] = resolvePixel(pixel, fragments);
+			}
+	});
+}
+
+OITEngine::Method OITEngine::GetMethod() const
+{
+	return m_method;
+}
+
+uint64_t OITEngine::GetMemorySize() const
+{
+	const auto numPixels = static_cast<uint64_t>(m_width) * m_height;
+
+	switch (m_method)
+	{
+	case METHOD_LINKED_LIST:
+		// R32 heads, a counter, and R32 depth + RGBA16F color + R32 next per node
+		return numPixels * sizeof(uint32_t) + sizeof(uint32_t) + m_nodes.size() * 16;
+	case METHOD_WEIGHTED_BLENDED:
+		// RGBA16F accumulation and R16F revealage
+		return numPixels * (8 + 2);
+	default:
+		// R32 depth and RGBA16F color per layer
+		return numPixels * m_numLayers * (4 + 8);
+	}
+}
+
+uint64_t OITEngine::GetNumDropped() const
+{
+	switch (m_method)
+	{
+	case METHOD_LINKED_LIST:
+	{
+		const auto numNodes = m_numNodes.load();
+		const auto capacity = static_cast<uint32_t>(m_nodes.size());
+
+		return numNodes > capacity ? numNodes - capacity : 0;
+	}
+	case METHOD_K_BUFFER:
+	{
+		uint64_t numDropped = 0;
+		for (const auto& count : m_fragmentCounts)
+			numDropped += count > m_numLayers ? count - m_numLayers : 0;
+
+		return numDropped;
+	}
+	default:
+		// Weighted blended keeps all fragments approximately, and adaptive merges them
+		return 0;
+	}
+}
+
+OITEngine::EvaluationResult OITEngine::Evaluate(const EvaluationDesc& desc)
+{
+	EvaluationResult result = {};
+
+	// Volume proxies are spheres in screen space, being thicker and so more opaque in the centers
+	struct Proxy
+	{
+		float X, Y, Radius, Depth, DepthRadius;
+		XMFLOAT4 Color;
+	};
+
+	mt19937 rng(desc.Seed);
+	uniform_real_distribution<float> unorm(0.0f, 1.0f);
+	vector<Proxy> proxies(desc.NumProxies);
+	const auto minSize = static_cast<float>((min)(desc.Width, desc.Height));
+	for (auto& proxy : proxies)
+	{
+		proxy.X = unorm(rng) * desc.Width;
+		proxy.Y = unorm(rng) * desc.Height;
+		proxy.Radius = minSize * (0.05f + 0.2f * unorm(rng));
+		proxy.Depth = 10.0f + 90.0f * unorm(rng);
+		proxy.DepthRadius = 2.0f + 10.0f * unorm(rng);
+		proxy.Color = XMFLOAT4(unorm(rng), unorm(rng), unorm(rng), 0.2f + 0.6f * unorm(rng));
+	}
+
+	const auto rasterize = [&](const function<void(uint32_t, uint32_t, float, const XMFLOAT4&)>& addFragment)
+	{
+		ParallelFor(desc.Height, 8, [&](uint32_t begin, uint32_t end)
+		{
+			for (auto y = begin; y < end; ++y)
+			{
+				for (const auto& proxy : proxies)
+				{
+					const auto dy = (y + 0.5f - proxy.Y) / proxy.Radius;
+					if (dy * dy >= 1.0f) continue;
+
+					const auto halfSpan = proxy.Radius * sqrtf(1.0f - dy * dy);
+					const auto x0 = static_cast<uint32_t>((max)(proxy.X - halfSpan, 0.0f));
+					const auto x1 = static_cast<uint32_t>((min)(proxy.X + halfSpan, static_cast<float>(desc.Width)));
+					for (auto x = x0; x < x1; ++x)
+					{
+						const auto dx = (x + 0.5f - proxy.X) / proxy.Radius;
+						const auto q = 1.0f - dx * dx - dy * dy;
+						if (q <= 0.0f) continue;
+
+						const auto h = sqrtf(q);
+						const auto a = proxy.Color.w * h;
+						addFragment(x, y, proxy.Depth - proxy.DepthRadius * h,
+							XMFLOAT4(proxy.Color.x * a, proxy.Color.y * a, proxy.Color.z * a, a));
+					}
+				}
+			}
+		});
+	};
+
+	// Baseline pass for the depth complexity and the rasterization cost
+	const auto numPixels = static_cast<size_t>(desc.Width) * desc.Height;
+	vector<uint32_t> depthComplexities(numPixels);
+	auto start = chrono::steady_clock::now();
+	rasterize([&](uint32_t x, uint32_t y, float, const XMFLOAT4&) { ++depthComplexities[desc.Width * y + x]; });
+	result.RasterTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+	uint64_t numFragments = 0;
+	auto numCovered = 0u;
+	for (const auto& count : depthComplexities)
+	{
+		numFragments += count;
+		numCovered += count > 0 ? 1 : 0;
+		result.MaxDepthComplexity = (max)(result.MaxDepthComplexity, count);
+	}
+	result.MeanDepthComplexity = numCovered > 0 ? static_cast<float>(numFragments) / numCovered : 0.0f;
+
+	// Exact reference from a linked list that holds all fragments
+	vector<XMFLOAT4> reference(numPixels), image(numPixels);
+	{
+		OITEngine exact;
+		exact.Init(desc.Width, desc.Height, METHOD_LINKED_LIST, static_cast<uint32_t>((numFragments + numPixels - 1) / numPixels));
+		rasterize([&](uint32_t x, uint32_t y, float depth, const XMFLOAT4& color) { exact.AddFragment(x, y, depth, color); });
+		exact.Resolve(reference.data());
+	}
+
+	const uint32_t numLayers[] = { desc.NumKLayers, desc.NodesPerPixel, 0, desc.NumAdaptiveLayers };
+	for (uint8_t m = 0; m < NUM_METHOD; ++m)
+	{
+		auto& methodResult = result.Methods[m];
+		OITEngine engine;
+		engine.Init(desc.Width, desc.Height, static_cast<Method>(m), numLayers[m]);
+
+		start = chrono::steady_clock::now();
+		rasterize([&](uint32_t x, uint32_t y, float depth, const XMFLOAT4& color) { engine.AddFragment(x, y, depth, color); });
+		auto end = chrono::steady_clock::now();
+		methodResult.InsertTime = chrono::duration<double, milli>(end - start).count();
+
+		start = chrono::steady_clock::now();
+		engine.Resolve(image.data());
+		end = chrono::steady_clock::now();
+		methodResult.ResolveTime = chrono::duration<double, milli>(end - start).count();
+
+		auto errorSum = 0.0;
+		for (size_t i = 0; i < numPixels; ++i)
+		{
+			const auto& a = image[i];
+			const auto& b = reference[i];
+			const float diffs[] = { a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w };
+			for (const auto& diff : diffs)
+			{
+				errorSum += diff * diff;
+				methodResult.MaxError = (max)(methodResult.MaxError, fabsf(diff));
+			}
+		}
+
+		methodResult.MemorySize = engine.GetMemorySize();
+		methodResult.RMSE = numPixels > 0 ? static_cast<float>(sqrt(errorSum / (numPixels * 4))) : 0.0f;
+		methodResult.DroppedRatio = numFragments > 0 ? static_cast<float>(engine.GetNumDropped()) / numFragments : 0.0f;
+	}
+
+	return result;
+}
+
+void OITEngine::insertKBuffer(uint32_t pixel, float depth, const XMFLOAT4& color)
+{
+	// Keep the K nearest fragments sorted, dropping the farthest as PSDepthPeel.hlsl does
+	const auto pDepths = &m_layerDepths[static_cast<size_t>(pixel) * m_numLayers];
+	const auto pColors = &m_layerColors[static_cast<size_t>(pixel) * m_numLayers];
+	auto& count = m_layerCounts[pixel];
+
+	if (count == m_numLayers && depth >= pDepths[count - 1]) return;
+
+	auto i = count < m_numLayers ? count++ : count - 1;
+	for (; i > 0 && pDepths[i - 1] > depth; --i)
+	{
+		pDepths[i] = pDepths[i - 1];
+		pColors[i] = pColors[i - 1];
+	}
+	pDepths[i] = depth;
+	pColors[i] = color;
+}
+
+void OITEngine::insertAdaptive(uint32_t pixel, float depth, const XMFLOAT4& color)
+{
+	// Multi-layer alpha blending: on overflow, the two farthest of the K + 1 layers are merged
+	const auto pDepths = &m_layerDepths[static_cast<size_t>(pixel) * m_numLayers];
+	const auto pColors = &m_layerColors[static_cast<size_t>(pixel) * m_numLayers];
+	auto& count = m_layerCounts[pixel];
+
+	if (count < m_numLayers)
+	{
+		auto i = count++;
+		for (; i > 0 && pDepths[i - 1] > depth; --i)
+		{
+			pDepths[i] = pDepths[i - 1];
+			pColors[i] = pColors[i - 1];
+		}
+		pDepths[i] = depth;
+		pColors[i] = color;
+
+		return;
+	}
+
+	const auto last = count - 1;
+	if (depth >= pDepths[last])
+	{
+		blendUnder(pColors[last], color);
+		return;
+	}
+
+	const auto evicted = pColors[last];
+	auto i = last;
+	for (; i > 0 && pDepths[i - 1] > depth; --i)
+	{
+		pDepths[i] = pDepths[i - 1];
+		pColors[i] = pColors[i - 1];
+	}
+	pDepths[i] = depth;
+	pColors[i] = color;
+	blendUnder(pColors[last], evicted);
+}
+
+void OITEngine::insertLinkedList(uint32_t pixel, float depth, const XMFLOAT4& color)
+{
+	const auto node = m_numNodes++;
+	if (node >= m_nodes.size()) return;
+
+	m_nodes[node].Depth = depth;
+	m_nodes[node].Color = color;
+	m_nodes[node].Next = m_heads[pixel];
+	m_heads[pixel] = node;
+}
+
+void OITEngine::insertWeightedBlended(uint32_t pixel, float depth, const XMFLOAT4& color)
+{
+	// Additive and multiplicative blending, rounded to the half-float targets per fragment
+	const auto w = blendWeight(depth, color.w);
+	const float src[] = { color.x * w, color.y * w, color.z * w, color.w * w };
+	const auto pAccum = &m_accums[4 * static_cast<size_t>(pixel)];
+	for (uint8_t i = 0; i < 4; ++i) pAccum[i] = XMConvertFloatToHalf(XMConvertHalfToFloat(pAccum[i]) + src[i]);
+
+	auto& revealage = m_revealages[pixel];
+	revealage = XMConvertFloatToHalf(XMConvertHalfToFloat(revealage) * (1.0f - color.w));
+}
+
+XMFLOAT4 OITEngine::resolvePixel(uint32_t pixel, vector<Node>& fragments) const
+{
+	XMFLOAT4 result(0.0f, 0.0f, 0.0f, 0.0f);
+
+	switch (m_method)
+	{
+	case METHOD_LINKED_LIST:
+		fragments.clear();
+		for (auto node = m_heads[pixel]; node != g_nullNode; node = m_nodes[node].Next)
+			fragments.push_back(m_nodes[node]);
+		sort(fragments.begin(), fragments.end(), [](const Node& a, const Node& b) { return a.Depth < b.Depth; });
+		for (const auto& fragment : fragments) blendUnder(result, fragment.Color);
+		break;
+	case METHOD_WEIGHTED_BLENDED:
+	{
+		const auto pAccum = &m_accums[4 * static_cast<size_t>(pixel)];
+		const XMFLOAT4 accum(XMConvertHalfToFloat(pAccum[0]), XMConvertHalfToFloat(pAccum[1]),
+			XMConvertHalfToFloat(pAccum[2]), XMConvertHalfToFloat(pAccum[3]));
+		const auto alpha = 1.0f - XMConvertHalfToFloat(m_revealages[pixel]);
+		const auto scale = alpha / (max)(accum.w, 1e-5f);
+		result = XMFLOAT4(accum.x * scale, accum.y * scale, accum.z * scale, alpha);
+		break;
+	}
+	default:
+	{
+		const auto pColors = &m_layerColors[static_cast<size_t>(pixel) * m_numLayers];
+		for (uint8_t i = 0; i < m_layerCounts[pixel]; ++i) blendUnder(result, pColors[i]);
+	}
+	}
+
+	return result;
+}
@@ -0,0 +1,106 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+
+// Host-side order-independent transparency. Fragments carry premultiplied colors and
+// view depths, and may be added concurrently for different pixels. Memory sizes are
+// reported in the GPU formats, e.g. R32 + RGBA16F per K-buffer layer as in MultiRayCaster.
+// K-buffer and linked-list fragments are stored at full precision, while the weighted-blended
+// accumulation and revealage are blended in half floats, as their RGBA16F and R16F targets are.
+class OITEngine
+{
+public:
+	enum Method : uint8_t
+	{
+		METHOD_K_BUFFER,
+		METHOD_LINKED_LIST,
+		METHOD_WEIGHTED_BLENDED,
+		METHOD_ADAPTIVE,
+
+		NUM_METHOD
+	};
+
+	struct EvaluationDesc
+	{
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t NumProxies;
+		uint8_t NumKLayers;			// K-buffer layers
+		uint8_t NumAdaptiveLayers;
+		uint8_t NodesPerPixel;		// Average linked-list nodes per pixel
+		uint32_t Seed;
+	};
+
+	struct MethodResult
+	{
+		uint64_t MemorySize;		// In bytes
+		double InsertTime;			// In milliseconds, including the fragment generation
+		double ResolveTime;			// In milliseconds
+		float RMSE;					// Against the exact sort
+		float MaxError;
+		float DroppedRatio;			// Ratio of the fragments that were dropped
+	};
+
+	struct EvaluationResult
+	{
+		MethodResult Methods[NUM_METHOD];
+		double RasterTime;			// Fragment generation alone, in milliseconds
+		float MeanDepthComplexity;	// Over the covered pixels
+		uint32_t MaxDepthComplexity;
+	};
+
+	OITEngine();
+	virtual ~OITEngine();
+
+	// numLayers is K for the K-buffers, or the average nodes per pixel for the linked list
+	void Init(uint32_t width, uint32_t height, Method method, uint32_t numLayers);
+	void Clear();
+	void AddFragment(uint32_t x, uint32_t y, float depth, const DirectX::XMFLOAT4& color);
+	void Resolve(DirectX::XMFLOAT4* pOut) const;
+
+	Method GetMethod() const;
+	uint64_t GetMemorySize() const;
+	uint64_t GetNumDropped() const;
+
+	static EvaluationResult Evaluate(const EvaluationDesc& desc);
+
+protected:
+	struct Node
+	{
+		float Depth;
+		DirectX::XMFLOAT4 Color;
+		uint32_t Next;
+	};
+
+	void insertKBuffer(uint32_t pixel, float depth, const DirectX::XMFLOAT4& color);
+	void insertAdaptive(uint32_t pixel, float depth, const DirectX::XMFLOAT4& color);
+	void insertLinkedList(uint32_t pixel, float depth, const DirectX::XMFLOAT4& color);
+	void insertWeightedBlended(uint32_t pixel, float depth, const DirectX::XMFLOAT4& color);
+	DirectX::XMFLOAT4 resolvePixel(uint32_t pixel, std::vector<Node>& fragments) const;
+
+	// K-buffer and adaptive layers, pixel-major
+	std::vector<float>		m_layerDepths;
+	std::vector<DirectX::XMFLOAT4> m_layerColors;
+	std::vector<uint8_t>	m_layerCounts;
+
+	// Linked-list A-buffer
+	std::vector<uint32_t>	m_heads;
+	std::vector<Node>		m_nodes;
+	std::atomic<uint32_t>	m_numNodes;
+
+	// Weighted blended accumulation and revealage, as half floats as the RGBA16F and R16F
+	// render targets blend
+	std::vector<uint16_t>	m_accums;			// RGBA per pixel
+	std::vector<uint16_t>	m_revealages;
+
+	std::vector<uint32_t>	m_fragmentCounts;
+
+	uint32_t	m_width;
+	uint32_t	m_height;
+	Method		m_method;
+	uint32_t	m_numLayers;
+};
@@ -4,9 +4,13 @@
 
 #include "Optional/XUSGObjLoader.h"
 #include "ObjectRenderer.h"
-#define _INDEPENDENT_HALTON_
-#include "Advanced/XUSGHalton.h"
-#undef _INDEPENDENT_HALTON_
+#include "MemoryBudget.h"
+#include "FrameProfiler.h"
+#include "GPUProfiler.h"
+#include "TraceRecorder.h"
+#define _INDEPENDENT_DDS_LOADER_
+#include "Advanced/XUSGDDSLoader.h"
+#undef _INDEPENDENT_DDS_LOADER_
 
 using namespace std;
 using namespace DirectX;
@@ -15,7 +19,8 @@ using namespace XUSG;
 enum LightProbeBit : uint8_t
 {
 	IRRADIANCE_BIT = (1 << 0),
-	RADIANCE_BIT = (1 << 1)
+	RADIANCE_BIT = (1 << 1),
+	PREFILTERED_BIT = (1 << 2)
 };
 
 struct CBPerObject
@@ -37,8 +42,11 @@ struct CBPerFrame
 
 ObjectRenderer::ObjectRenderer() :
 	m_srvTables(),
+	m_pFrameArena(nullptr),
+	m_cbOffsets(),
 	m_coeffSH(nullptr),
 	m_frameParity(0),
+	m_isRadiancePrefiltered(false),
 	m_shadowMapSize(1024),
 	m_lightPt(75.0f, 75.0f, -75.0f),
 	m_lightColor(1.0f, 0.7f, 0.3f, 1.0f),
@@ -52,7 +60,7 @@ ObjectRenderer::~ObjectRenderer()
 }
 
 bool ObjectRenderer::Init(CommandList* pCommandList, const DescriptorTableCache::sptr& descriptorTableCache,
-	vector<Resource::uptr>& uploaders, const char* fileName, Format backFormat, Format rtFormat,
+	UploadRing* pUploadRing, FrameArena* pFrameArena, const char* fileName, Format backFormat, Format rtFormat,
 	Format dsFormat, const XMFLOAT4& posScale)
 {
 	const auto pDevice = pCommandList->GetDevice();
@@ -60,14 +68,18 @@ bool ObjectRenderer::Init(CommandList* pCommandList, const DescriptorTableCache:
 	m_computePipelineCache = Compute::PipelineCache::MakeUnique(pDevice);
 	m_pipelineLayoutCache = PipelineLayoutCache::MakeUnique(pDevice);
 	m_descriptorTableCache = descriptorTableCache;
+	m_pFrameArena = pFrameArena;
 
 	SetWorld(posScale.w, XMFLOAT3(posScale.x, posScale.y, posScale.z));
 
 	// Load inputs
 	ObjLoader objLoader;
-	if (!objLoader.Import(fileName, true, true)) return false;
-	XUSG_N_RETURN(createVB(pCommandList, objLoader.GetNumVertices(), objLoader.GetVertexStride(), objLoader.GetVertices(), uploaders), false);
-	XUSG_N_RETURN(createIB(pCommandList, objLoader.GetNumIndices(), objLoader.GetIndices(), uploaders), false);
+	{
+		TRACE_SCOPE("ObjLoader::Import");
+		if (!objLoader.Import(fileName, true, true)) return false;
+	}
+	XUSG_N_RETURN(createVB(pCommandList, objLoader.GetNumVertices(), objLoader.GetVertexStride(), objLoader.GetVertices(), pUploadRing), false);
+	XUSG_N_RETURN(createIB(pCommandList, objLoader.GetNumIndices(), objLoader.GetIndices(), pUploadRing), false);
 	m_sceneSize = objLoader.GetRadius() * posScale.w * 2.0f;
 
 	// Create resources
@@ -75,18 +87,9 @@ bool ObjectRenderer::Init(CommandList* pCommandList, const DescriptorTableCache:
 	m_depths[SHADOW_MAP] = DepthStencil::MakeUnique();
 	XUSG_N_RETURN(m_depths[SHADOW_MAP]->Create(pDevice, m_shadowMapSize, m_shadowMapSize,
 		smFormat, ResourceFlag::NONE, 1, 1, 1, 1.0f, 0, false, MemoryFlag::NONE, L"Shadow"), false);
+	MemoryBudget::Register("Shadow", MemoryBudget::GetTextureSize(m_shadowMapSize, m_shadowMapSize, 1, 1, 1,
+		static_cast<uint32_t>(DDS::Loader::BitsPerPixel(smFormat))), MemoryBudget::RENDER_TARGETS);
 
-	m_cbShadow = ConstantBuffer::MakeUnique();
-	XUSG_N_RETURN(m_cbShadow->Create(pDevice, sizeof(XMFLOAT4X4[FrameCount]), FrameCount,
-		nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"ObjectRenderer.CBshadow"), false);
-
-	m_cbPerObject = ConstantBuffer::MakeUnique();
-	XUSG_N_RETURN(m_cbPerObject->Create(pDevice, sizeof(CBPerObject[FrameCount]), FrameCount,
-		nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"ObjectRenderer.CBPerObject"), false);
-
-	m_cbPerFrame = ConstantBuffer::MakeUnique();
-	XUSG_N_RETURN(m_cbPerFrame->Create(pDevice, sizeof(CBPerFrame[FrameCount]), FrameCount,
-		nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"ObjectRenderer.CBPerFrame"), false);
 
 	// Create window size-dependent resource
 	//XUSG_N_RETURN(SetViewport(width, height, dsFormat), false);
@@ -126,11 +129,24 @@ bool ObjectRenderer::SetViewport(const Device* pDevice, uint32_t width, uint32_t
 	XUSG_N_RETURN(m_depths[DEPTH_MAP]->Create(pDevice, width, height, dsFormat,
 		ResourceFlag::NONE, 1, 1, 1, 1.0f, 0, false, MemoryFlag::NONE, L"Depth"), false);
 
+	const auto registerTarget = [width, height](const char* name, Format format)
+	{
+		MemoryBudget::Register(name, MemoryBudget::GetTextureSize(width, height, 1, 1, 1,
+			static_cast<uint32_t>(DDS::Loader::BitsPerPixel(format))), MemoryBudget::RENDER_TARGETS);
+	};
+	registerTarget("RenderTarget", rtFormat);
+	registerTarget("Velocity", Format::R16G16_FLOAT);
+	registerTarget("TemporalView0", Format::R16G16B16A16_FLOAT);
+	registerTarget("TemporalView1", Format::R16G16B16A16_FLOAT);
+	registerTarget("Depth", dsFormat);
+
 	return createDescriptorTables();
 }
 
-bool ObjectRenderer::SetRadiance(const Descriptor& radiance)
+bool ObjectRenderer::SetRadiance(const Descriptor& radiance, bool isPrefiltered)
 {
+	m_isRadiancePrefiltered = isPrefiltered;
+
 	const auto descriptorTable = Util::DescriptorTable::MakeUnique();
 	descriptorTable->SetDescriptors(0, 1, &radiance);
 	XUSG_X_RETURN(m_srvTables[SRV_TABLE_RADIANCE], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
@@ -164,6 +180,8 @@ void ObjectRenderer::SetSH(const StructuredBuffer::sptr& coeffSH)
 
 void ObjectRenderer::UpdateFrame(uint8_t frameIndex, CXMMATRIX viewProj, const XMFLOAT3& eyePt)
 {
+	TRACE_SCOPE("ObjectRenderer::UpdateFrame");
+
 	XMFLOAT4X4 shadowWVP;
 	const auto world = XMLoadFloat3x4(&m_world);
 
@@ -179,11 +197,10 @@ void ObjectRenderer::UpdateFrame(uint8_t frameIndex, CXMMATRIX viewProj, const X
 		XMStoreFloat4x4(&m_shadowVP, XMMatrixTranspose(lightViewProj));
 		XMStoreFloat4x4(&shadowWVP, XMMatrixTranspose(world * lightViewProj));
 
-		const auto pCbData = reinterpret_cast<XMFLOAT4X4*>(m_cbShadow->Map(frameIndex));
-		*pCbData = shadowWVP;
+		m_pFrameArena->WriteConstants(&shadowWVP, sizeof(shadowWVP), m_cbOffsets[CB_SHADOW]);
 	}
 
-	const auto halton = IncrementalHalton();
+	const auto halton = m_jitterSequence.Next();
 	XMFLOAT2 jitter =
 	{
 		(halton.x * 2.0f - 1.0f) / m_viewport.x,
@@ -191,21 +208,23 @@ void ObjectRenderer::UpdateFrame(uint8_t frameIndex, CXMMATRIX viewProj, const X
 	};
 
 	{
-		const auto pCbData = reinterpret_cast<CBPerObject*>(m_cbPerObject->Map(frameIndex));
-		XMStoreFloat4x4(&pCbData->WorldViewProj, XMMatrixTranspose(world * viewProj));
-		XMStoreFloat3x4(&pCbData->World, world);
-		pCbData->ShadowWVP = shadowWVP;
-		pCbData->ProjBias = jitter;
-		pCbData->WorldViewProjPrev = m_worldViewProj;
-		m_worldViewProj = pCbData->WorldViewProj;
+		CBPerObject cbData;
+		XMStoreFloat4x4(&cbData.WorldViewProj, XMMatrixTranspose(world * viewProj));
+		XMStoreFloat3x4(&cbData.World, world);
+		cbData.ShadowWVP = shadowWVP;
+		cbData.ProjBias = jitter;
+		cbData.WorldViewProjPrev = m_worldViewProj;
+		m_worldViewProj = cbData.WorldViewProj;
+		m_pFrameArena->WriteConstants(&cbData, sizeof(cbData), m_cbOffsets[CB_PER_OBJECT]);
 	}
 
 	{
-		const auto pCbData = reinterpret_cast<CBPerFrame*>(m_cbPerFrame->Map(frameIndex));
-		pCbData->EyePos = XMFLOAT4(eyePt.x, eyePt.y, eyePt.z, 1.0f);
-		pCbData->LightPos = XMFLOAT4(m_lightPt.x, m_lightPt.y, m_lightPt.z, 1.0f);
-		pCbData->LightColor = m_lightColor;
-		pCbData->Ambient = m_ambient;
+		CBPerFrame cbData;
+		cbData.EyePos = XMFLOAT4(eyePt.x, eyePt.y, eyePt.z, 1.0f);
+		cbData.LightPos = XMFLOAT4(m_lightPt.x, m_lightPt.y, m_lightPt.z, 1.0f);
+		cbData.LightColor = m_lightColor;
+		cbData.Ambient = m_ambient;
+		m_pFrameArena->WriteConstants(&cbData, sizeof(cbData), m_cbOffsets[CB_PER_FRAME]);
 	}
 
 	m_frameParity = !m_frameParity;
@@ -213,13 +232,8 @@ void ObjectRenderer::UpdateFrame(uint8_t frameIndex, CXMMATRIX viewProj, const X
 
 void ObjectRenderer::RenderShadow(CommandList* pCommandList, uint8_t frameIndex, bool drawScene)
 {
-	// Set barrier
-	ResourceBarrier barrier;
+	// Clear depth; the caller transitions the shadow map to DEPTH_WRITE
 	const auto& shadow = m_depths[SHADOW_MAP];
-	const auto numBarriers = shadow->SetBarrier(&barrier, ResourceState::DEPTH_WRITE);
-	pCommandList->Barrier(numBarriers, &barrier);
-
-	// Clear depth
 	const auto dsv = shadow->GetDSV();
 	pCommandList->OMSetRenderTargets(0, nullptr, &dsv);
 	pCommandList->ClearDepthStencilView(dsv, ClearFlag::DEPTH, 1.0f);
@@ -232,7 +246,7 @@ void ObjectRenderer::RenderShadow(CommandList* pCommandList, uint8_t frameIndex,
 		pCommandList->RSSetViewports(1, &viewport);
 		pCommandList->RSSetScissorRects(1, &scissorRect);
 
-		renderDepth(pCommandList, frameIndex, m_cbShadow.get());
+		renderDepth(pCommandList, m_cbOffsets[CB_SHADOW]);
 	}
 }
 
@@ -249,12 +263,14 @@ void ObjectRenderer::Postprocess(CommandList* pCommandList, RenderTarget* pColor
 
 void ObjectRenderer::TemporalAA(CommandList* pCommandList)
 {
-	ResourceBarrier barriers[4];
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::RECORD_TEMPORAL_AA);
+	const GPUProfiler::ScopedTimer gpuTimer(pCommandList, FrameProfiler::TEMPORAL_AA);
+
+	// The color and velocity are transitioned by the caller, as the volumes also render to the color
+	ResourceBarrier barriers[2];
 	auto numBarriers = m_temporalViews[m_frameParity]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
-	numBarriers = m_renderTargets[RT_COLOR]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
 	numBarriers = m_temporalViews[!m_frameParity]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE |
 		ResourceState::PIXEL_SHADER_RESOURCE, numBarriers);
-	numBarriers = m_renderTargets[RT_VELOCITY]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
 	//numBarriers = m_temporalViews[!m_frameParity]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE |
 		//ResourceState::PIXEL_SHADER_RESOURCE, numBarriers, BARRIER_ALL_SUBRESOURCES, BarrierFlag::END_ONLY);
 	//numBarriers = m_renderTargets[RT_VELOCITY]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE,
@@ -273,6 +289,9 @@ void ObjectRenderer::TemporalAA(CommandList* pCommandList)
 
 void ObjectRenderer::ToneMap(CommandList* pCommandList, RenderTarget* pColorOut)
 {
+	const FrameProfiler::ScopedTimer timer(FrameProfiler::RECORD_TONE_MAP);
+	const GPUProfiler::ScopedTimer gpuTimer(pCommandList, FrameProfiler::TONE_MAP);
+
 	ResourceBarrier barriers[2];
 	auto numBarriers = pColorOut->SetBarrier(barriers, ResourceState::RENDER_TARGET);
 	numBarriers = m_temporalViews[m_frameParity]->SetBarrier(
@@ -317,18 +336,18 @@ const XMFLOAT4X4& ObjectRenderer::GetShadowVP() const
 }
 
 bool ObjectRenderer::createVB(CommandList* pCommandList, uint32_t numVert,
-	uint32_t stride, const uint8_t* pData, vector<Resource::uptr>& uploaders)
+	uint32_t stride, const uint8_t* pData, UploadRing* pUploadRing)
 {
 	m_vertexBuffer = VertexBuffer::MakeUnique();
 	XUSG_N_RETURN(m_vertexBuffer->Create(pCommandList->GetDevice(), numVert, stride, ResourceFlag::NONE,
 		MemoryType::DEFAULT, 1, nullptr, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"MeshVB"), false);
-	uploaders.emplace_back(Resource::MakeUnique());
+	MemoryBudget::Register("MeshVB", MemoryBudget::GetBufferSize(static_cast<uint64_t>(stride) * numVert), MemoryBudget::BUFFERS);
 
-	return m_vertexBuffer->Upload(pCommandList, uploaders.back().get(), pData, stride * numVert);
+	return pUploadRing->Upload(pCommandList, m_vertexBuffer.get(), pData, stride * numVert);
 }
 
 bool ObjectRenderer::createIB(CommandList* pCommandList, uint32_t numIndices,
-	const uint32_t* pData, vector<Resource::uptr>& uploaders)
+	const uint32_t* pData, UploadRing* pUploadRing)
 {
 	m_numIndices = numIndices;
 
@@ -336,9 +355,9 @@ bool ObjectRenderer::createIB(CommandList* pCommandList, uint32_t numIndices,
 	m_indexBuffer = IndexBuffer::MakeUnique();
 	XUSG_N_RETURN(m_indexBuffer->Create(pCommandList->GetDevice(), byteWidth, Format::R32_UINT, ResourceFlag::NONE,
 		MemoryType::DEFAULT, 1, nullptr, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"MeshIB"), false);
-	uploaders.emplace_back(Resource::MakeUnique());
+	MemoryBudget::Register("MeshIB", MemoryBudget::GetBufferSize(byteWidth), MemoryBudget::BUFFERS);
 
-	return m_indexBuffer->Upload(pCommandList, uploaders.back().get(), pData, byteWidth);
+	return pUploadRing->Upload(pCommandList, m_indexBuffer.get(), pData, byteWidth);
 }
 
 bool ObjectRenderer::createInputLayout()
@@ -537,8 +556,10 @@ void ObjectRenderer::render(const CommandList* pCommandList, uint8_t frameIndex)
 	// Set descriptor tables
 	uint8_t hasLightProbes = m_coeffSH ? IRRADIANCE_BIT : 0;
 	hasLightProbes |= m_srvTables[SRV_TABLE_RADIANCE] ? RADIANCE_BIT : 0;
-	pCommandList->SetGraphicsRootConstantBufferView(0, m_cbPerObject.get(), m_cbPerObject->GetCBVOffset(frameIndex));
-	pCommandList->SetGraphicsRootConstantBufferView(1, m_cbPerFrame.get(), m_cbPerFrame->GetCBVOffset(frameIndex));
+	hasLightProbes |= m_srvTables[SRV_TABLE_RADIANCE] && m_isRadiancePrefiltered ? PREFILTERED_BIT : 0;
+	const auto pConstants = m_pFrameArena->GetResource();
+	pCommandList->SetGraphicsRootConstantBufferView(0, pConstants, static_cast<int>(m_cbOffsets[CB_PER_OBJECT]));
+	pCommandList->SetGraphicsRootConstantBufferView(1, pConstants, static_cast<int>(m_cbOffsets[CB_PER_FRAME]));
 	pCommandList->SetGraphicsDescriptorTable(2, m_srvTables[SRV_TABLE_SHADOW]);
 	pCommandList->SetGraphics32BitConstant(3, hasLightProbes);
 	if (m_coeffSH) pCommandList->SetGraphicsRootShaderResourceView(4, m_coeffSH.get());
@@ -549,7 +570,7 @@ void ObjectRenderer::render(const CommandList* pCommandList, uint8_t frameIndex)
 	pCommandList->DrawIndexed(m_numIndices, 1, 0, 0, 0);
 }
 
-void ObjectRenderer::renderDepth(const CommandList* pCommandList, uint8_t frameIndex, const ConstantBuffer* pCb)
+void ObjectRenderer::renderDepth(const CommandList* pCommandList, uint64_t cbOffset)
 {
 	// Set pipeline state
 	pCommandList->SetGraphicsPipelineLayout(m_pipelineLayouts[DEPTH_PASS]);
@@ -558,7 +579,7 @@ void ObjectRenderer::renderDepth(const CommandList* pCommandList, uint8_t frameI
 	pCommandList->IASetPrimitiveTopology(PrimitiveTopology::TRIANGLELIST);
 
 	// Set descriptor table
-	pCommandList->SetGraphicsRootConstantBufferView(0, pCb, pCb->GetCBVOffset(frameIndex));
+	pCommandList->SetGraphicsRootConstantBufferView(0, m_pFrameArena->GetResource(), static_cast<int>(cbOffset));
 
 	pCommandList->IASetVertexBuffers(0, 1, &m_vertexBuffer->GetVBV());
 	pCommandList->IASetIndexBuffer(m_indexBuffer->GetIBV());
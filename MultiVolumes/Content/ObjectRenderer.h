@@ -5,6 +5,9 @@
 #pragma once
 
 #include "Core/XUSG.h"
+#include "SampleSequence.h"
+#include "UploadRing.h"
+#include "FrameArena.h"
 
 class ObjectRenderer
 {
@@ -29,12 +32,12 @@ public:
 	virtual ~ObjectRenderer();
 
 	bool Init(XUSG::CommandList* pCommandList, const XUSG::DescriptorTableCache::sptr& descriptorTableCache,
-		std::vector<XUSG::Resource::uptr>& uploaders, const char* meshFileName,
+		UploadRing* pUploadRing, FrameArena* pFrameArena, const char* meshFileName,
 		XUSG::Format backFormat, XUSG::Format rtFormat, XUSG::Format dsFormat,
 		const DirectX::XMFLOAT4& posScale = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
 	bool SetViewport(const XUSG::Device* pDevice, uint32_t width, uint32_t height, XUSG::Format rtFormat,
 		XUSG::Format dsFormat, const float* clearColor, bool needUavRT = false);
-	bool SetRadiance(const XUSG::Descriptor& radiance);
+	bool SetRadiance(const XUSG::Descriptor& radiance, bool isPrefiltered = false);
 
 	void SetWorld(float scale, const DirectX::XMFLOAT3& pos, const DirectX::XMFLOAT3* pPitchYawRoll = nullptr);
 	void SetLight(const DirectX::XMFLOAT3& pos, const DirectX::XMFLOAT3& color, float intensity);
@@ -94,17 +97,26 @@ protected:
 		NUM_UAV_TABLE
 	};
 
+	enum ConstantBufferIndex : uint8_t
+	{
+		CB_SHADOW,
+		CB_PER_OBJECT,
+		CB_PER_FRAME,
+
+		NUM_CONSTANT_BUFFER
+	};
+
 	bool createVB(XUSG::CommandList* pCommandList, uint32_t numVert,
-		uint32_t stride, const uint8_t* pData, std::vector<XUSG::Resource::uptr>& uploaders);
+		uint32_t stride, const uint8_t* pData, UploadRing* pUploadRing);
 	bool createIB(XUSG::CommandList* pCommandList, uint32_t numIndices,
-		const uint32_t* pData, std::vector<XUSG::Resource::uptr>& uploaders);
+		const uint32_t* pData, UploadRing* pUploadRing);
 	bool createInputLayout();
 	bool createPipelineLayouts();
 	bool createPipelines(XUSG::Format backFormat, XUSG::Format rtFormat, XUSG::Format dsFormat, XUSG::Format dsFormatH);
 	bool createDescriptorTables();
 
 	void render(const XUSG::CommandList* pCommandList, uint8_t frameIndex);
-	void renderDepth(const XUSG::CommandList* pCommandList, uint8_t frameIndex, const XUSG::ConstantBuffer* pCb);
+	void renderDepth(const XUSG::CommandList* pCommandList, uint64_t cbOffset);
 
 	XUSG::ShaderPool::uptr				m_shaderPool;
 	XUSG::Graphics::PipelineCache::uptr	m_graphicsPipelineCache;
@@ -125,12 +137,14 @@ protected:
 	XUSG::RenderTarget::uptr	m_renderTargets[NUM_RENDER_TARGET];
 	XUSG::Texture2D::uptr		m_temporalViews[2];
 	XUSG::DepthStencil::uptr	m_depths[NUM_DEPTH];
-	XUSG::ConstantBuffer::uptr	m_cbShadow;
-	XUSG::ConstantBuffer::uptr	m_cbPerObject;
-	XUSG::ConstantBuffer::uptr	m_cbPerFrame;
+	FrameArena*					m_pFrameArena;
+	uint64_t					m_cbOffsets[NUM_CONSTANT_BUFFER];	// In the frame arena, of the current frame
 	XUSG::StructuredBuffer::sptr m_coeffSH;
 
+	SampleSequence		m_jitterSequence;	// Halton (2, 3) of the TAA jitters, owned by this view
+
 	uint8_t				m_frameParity;
+	bool				m_isRadiancePrefiltered;
 	uint32_t			m_numIndices;
 	uint32_t			m_shadowMapSize;
 	DirectX::XMUINT2	m_viewport;
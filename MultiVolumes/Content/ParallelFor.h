@@ -0,0 +1,18 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "JobSystem.h"
+
+//--------------------------------------------------------------------------------------
+// Splits [0, count) into chunks of grainSize and calls func(begin, end) for each chunk
+// as tasks of the job system, which the calling thread helps to run. Returns after all
+// chunks are done; func may itself run parallel-fors.
+//--------------------------------------------------------------------------------------
+template<typename T>
+void ParallelFor(uint32_t count, uint32_t grainSize, const T& func)
+{
+	JobSystem::ParallelFor(count, grainSize, [&func](uint32_t begin, uint32_t end) { func(begin, end); });
+}
@@ -0,0 +1,288 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "RadiancePrefilter.h"
+#include "CubeMapFile.h"
+#include "SHProjector.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+// D3D cube addressing, as getTexelDir() in SHProjector.cpp, but for any face coordinates
+// so that texels beyond the face edges can be addressed too
+//--------------------------------------------------------------------------------------
+static inline XMFLOAT3 getFaceDir(float u, float v, uint8_t face)
+{
+	switch (face)
+	{
+	case 0: return XMFLOAT3(1.0f, v, -u);	// +X
+	case 1: return XMFLOAT3(-1.0f, v, u);	// -X
+	case 2: return XMFLOAT3(u, 1.0f, -v);	// +Y
+	case 3: return XMFLOAT3(u, -1.0f, v);	// -Y
+	case 4: return XMFLOAT3(u, v, 1.0f);	// +Z
+	default: return XMFLOAT3(-u, v, -1.0f);	// -Z
+	}
+}
+
+static inline uint8_t getFaceCoords(const XMFLOAT3& dir, float& u, float& v)
+{
+	const auto ax = fabsf(dir.x), ay = fabsf(dir.y), az = fabsf(dir.z);
+	if (ax >= ay && ax >= az)
+	{
+		u = (dir.x > 0.0f ? -dir.z : dir.z) / ax;
+		v = dir.y / ax;
+
+		return dir.x > 0.0f ? 0 : 1;
+	}
+	else if (ay >= az)
+	{
+		u = dir.x / ay;
+		v = (dir.y > 0.0f ? -dir.z : dir.z) / ay;
+
+		return dir.y > 0.0f ? 2 : 3;
+	}
+	else
+	{
+		u = (dir.z > 0.0f ? dir.x : -dir.x) / az;
+		v = dir.y / az;
+
+		return dir.z > 0.0f ? 4 : 5;
+	}
+}
+
+static inline float radicalInverse(uint32_t bits)
+{
+	bits = (bits << 16) | (bits >> 16);
+	bits = ((bits & 0x55555555) << 1) | ((bits & 0xaaaaaaaa) >> 1);
+	bits = ((bits & 0x33333333) << 2) | ((bits & 0xcccccccc) >> 2);
+	bits = ((bits & 0x0f0f0f0f) << 4) | ((bits & 0xf0f0f0f0) >> 4);
+	bits = ((bits & 0x00ff00ff) << 8) | ((bits & 0xff00ff00) >> 8);
+
+	return bits * 2.3283064365386963e-10f;
+}
+
+//--------------------------------------------------------------------------------------
+// Radiance prefilter
+//--------------------------------------------------------------------------------------
+RadiancePrefilter::RadiancePrefilter() :
+	m_faceSize(0),
+	m_isCached(false)
+{
+}
+
+RadiancePrefilter::~RadiancePrefilter()
+{
+}
+
+void RadiancePrefilter::Prefilter(const XMFLOAT4* pTexels, uint32_t faceSize, uint8_t numMips, uint32_t numSamples)
+{
+	m_faceSize = faceSize;
+	generateSourceMips(pTexels, faceSize);
+
+	const auto maxMips = static_cast<uint8_t>(m_srcMips.size());
+	if (numMips == 0)
+	{
+		numMips = 1;
+		while ((faceSize >> numMips) >= MinMipSize && numMips < maxMips) ++numMips;
+	}
+	numMips = (min)(numMips, maxMips);
+
+	// The first level is the mirror reflection of the source
+	m_mips.resize(numMips);
+	m_mips[0] = m_srcMips[0];
+
+	vector<Sample> samples;
+	for (uint8_t level = 1; level < numMips; ++level)
+	{
+		generateSamples(static_cast<float>(level) / (numMips - 1), numSamples, samples);
+
+		const auto size = (max)(faceSize >> level, 1u);
+		auto& mip = m_mips[level];
+		mip.resize(CubeMapFile::FaceCount * size * size);
+		ParallelFor(CubeMapFile::FaceCount * size, 1, [&](uint32_t begin, uint32_t end)
+		{
+			for (auto row = begin; row < end; ++row)
+			{
+				const auto face = static_cast<uint8_t>(row / size);
+				const auto y = row % size;
+				for (auto x = 0u; x < size; ++x)
+				{
+					// Tangent frame of the texel direction
+					const auto faceDir = getFaceDir((x + 0.5f) / size * 2.0f - 1.0f, 1.0f - (y + 0.5f) / size * 2.0f, face);
+					const auto n = XMVector3Normalize(XMLoadFloat3(&faceDir));
+					const auto up = fabsf(XMVectorGetZ(n)) < 0.999f ? g_XMIdentityR2 : g_XMIdentityR0;
+					const auto t = XMVector3Normalize(XMVector3Cross(up, n));
+					const auto b = XMVector3Cross(n, t);
+
+					auto sum = XMVectorZero();
+					auto weight = 0.0f;
+					for (const auto& sample : samples)
+					{
+						XMFLOAT3 dir;
+						auto l = XMVectorScale(n, sample.Dir.z);
+						l = XMVectorMultiplyAdd(t, XMVectorReplicate(sample.Dir.x), l);
+						l = XMVectorMultiplyAdd(b, XMVectorReplicate(sample.Dir.y), l);
+						XMStoreFloat3(&dir, l);
+
+						sum = XMVectorMultiplyAdd(sampleSource(dir, sample.Level), XMVectorReplicate(sample.Weight), sum);
+						weight += sample.Weight;
+					}
+
+					XMStoreFloat4(&mip[size * (size * face + y) + x], weight > 0.0f ? sum / weight : sum);
+				}
+			}
+		});
+	}
+}
+
+bool RadiancePrefilter::Load(const wstring& fileName, const wstring& cacheFileName)
+{
+	vector<uint8_t> data;
+	if (!CubeMapFile::ReadFile(fileName, data)) return false;
+
+	const auto hash = SHProjector::HashFNV1a(data.data(), data.size());
+	const auto cacheFile = cacheFileName.empty() ? fileName + L".ggx.dds" : cacheFileName;
+	uint64_t cachedHash;
+	if (CubeMapFile::ReadSourceHash(cacheFile, cachedHash) && cachedHash == hash)
+	{
+		m_cacheFileName = cacheFile;
+		m_isCached = true;
+
+		return true;
+	}
+
+	vector<XMFLOAT4> texels;
+	uint32_t faceSize;
+	if (!CubeMapFile::Decode(data.data(), data.size(), MaxFaceSize, texels, faceSize)) return false;
+	Prefilter(texels.data(), faceSize);
+
+	// Without a writable cache, the mip chain is only kept in memory
+	m_isCached = false;
+	m_cacheFileName = CubeMapFile::Save(cacheFile, m_mips, m_faceSize, hash) ? cacheFile : L"";
+
+	return true;
+}
+
+const vector<vector<XMFLOAT4>>& RadiancePrefilter::GetMips() const
+{
+	return m_mips;
+}
+
+const wstring& RadiancePrefilter::GetCacheFileName() const
+{
+	return m_cacheFileName;
+}
+
+uint32_t RadiancePrefilter::GetFaceSize() const
+{
+	return m_faceSize;
+}
+
+bool RadiancePrefilter::IsCached() const
+{
+	return m_isCached;
+}
+
+void RadiancePrefilter::generateSourceMips(const XMFLOAT4* pTexels, uint32_t faceSize)
+{
+	m_srcMips.clear();
+	m_srcMips.emplace_back(pTexels, pTexels + CubeMapFile::FaceCount * faceSize * faceSize);
+
+	for (auto size = faceSize / 2; size > 0; size /= 2)
+	{
+		const auto& src = m_srcMips.back();
+		vector<XMFLOAT4> mip(CubeMapFile::FaceCount * size * size);
+		for (auto row = 0u; row < CubeMapFile::FaceCount * size; ++row)
+		{
+			const auto face = row / size, y = row % size;
+			const auto srcSize = size * 2;
+			for (auto x = 0u; x < size; ++x)
+			{
+				const auto pSrc = &src[srcSize * (srcSize * face + 2 * y) + 2 * x];
+				auto sum = XMLoadFloat4(&pSrc[0]) + XMLoadFloat4(&pSrc[1]);
+				sum += XMLoadFloat4(&pSrc[srcSize]) + XMLoadFloat4(&pSrc[srcSize + 1]);
+				XMStoreFloat4(&mip[size * row + x], sum * 0.25f);
+			}
+		}
+		m_srcMips.emplace_back(move(mip));
+	}
+}
+
+void RadiancePrefilter::generateSamples(float roughness, uint32_t numSamples, vector<Sample>& samples) const
+{
+	// GGX importance samples of the half vector from the Hammersley set, reflected about it
+	const auto a = roughness * roughness;
+	const auto a2 = a * a;
+	const auto texelSolidAngle = 4.0f * XM_PI / (CubeMapFile::FaceCount * m_faceSize * m_faceSize);
+	const auto maxLevel = static_cast<float>(m_srcMips.size() - 1);
+
+	samples.clear();
+	samples.reserve(numSamples);
+	for (auto i = 0u; i < numSamples; ++i)
+	{
+		const auto phi = XM_2PI * (i + 0.5f) / numSamples;
+		const auto v = radicalInverse(i);
+		const auto cosTheta = sqrtf((1.0f - v) / (1.0f + (a2 - 1.0f) * v));
+		const auto sinTheta = sqrtf((max)(1.0f - cosTheta * cosTheta, 0.0f));
+
+		Sample sample;
+		const auto NoL = 2.0f * cosTheta * cosTheta - 1.0f;
+		if (NoL <= 0.0f) continue;
+		sample.Dir = XMFLOAT3(2.0f * cosTheta * sinTheta * cosf(phi), 2.0f * cosTheta * sinTheta * sinf(phi), NoL);
+		sample.Weight = NoL;
+
+		// PDF of L is D / 4 with N = V; the sample covers 1 / (N * PDF) steradians
+		const auto d = (cosTheta * cosTheta * (a2 - 1.0f) + 1.0f);
+		const auto pdf = a2 / (XM_PI * d * d) * 0.25f;
+		const auto sampleSolidAngle = 1.0f / (numSamples * pdf);
+		sample.Level = (min)((max)(0.5f * log2f(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f), maxLevel);
+
+		samples.push_back(sample);
+	}
+}
+
+XMVECTOR RadiancePrefilter::sampleSource(const XMFLOAT3& dir, float level) const
+{
+	const auto level0 = static_cast<uint32_t>(level);
+	const auto frac = level - level0;
+	const auto sample0 = sampleSourceLevel(dir, level0);
+	if (frac <= 0.0f || level0 + 1 >= m_srcMips.size()) return sample0;
+
+	return XMVectorLerp(sample0, sampleSourceLevel(dir, level0 + 1), frac);
+}
+
+XMVECTOR RadiancePrefilter::sampleSourceLevel(const XMFLOAT3& dir, uint32_t level) const
+{
+	const auto& mip = m_srcMips[level];
+	const auto size = (max)(m_faceSize >> level, 1u);
+	const auto sizeI = static_cast<int32_t>(size);
+
+	float u, v;
+	const auto face = getFaceCoords(dir, u, v);
+	const auto fx = (u * 0.5f + 0.5f) * size - 0.5f;
+	const auto fy = (0.5f - v * 0.5f) * size - 0.5f;
+	const auto x0 = static_cast<int32_t>(floorf(fx)), y0 = static_cast<int32_t>(floorf(fy));
+	const auto wx = fx - x0, wy = fy - y0;
+
+	// Taps beyond the edges are fetched from the adjacent faces by their directions
+	const auto fetch = [&](int32_t x, int32_t y)
+	{
+		if (x >= 0 && x < sizeI && y >= 0 && y < sizeI) return XMLoadFloat4(&mip[size * (size * face + y) + x]);
+
+		const auto tapDir = getFaceDir((x + 0.5f) / size * 2.0f - 1.0f, 1.0f - (y + 0.5f) / size * 2.0f, face);
+		float tu, tv;
+		const auto tapFace = getFaceCoords(tapDir, tu, tv);
+		const auto tx = (min)((max)(static_cast<int32_t>((tu * 0.5f + 0.5f) * size), 0), sizeI - 1);
+		const auto ty = (min)((max)(static_cast<int32_t>((0.5f - tv * 0.5f) * size), 0), sizeI - 1);
+
+		return XMLoadFloat4(&mip[size * (size * tapFace + ty) + tx]);
+	};
+
+	const auto top = XMVectorLerp(fetch(x0, y0), fetch(x0 + 1, y0), wx);
+	const auto bottom = XMVectorLerp(fetch(x0, y0 + 1), fetch(x0 + 1, y0 + 1), wx);
+
+	return XMVectorLerp(top, bottom, wy);
+}
@@ -0,0 +1,56 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// GGX prefiltering of a radiance cube map on the CPU, for the split-sum specular term.
+// Mip level m is the radiance convolved with the GGX lobe of roughness m / (mips - 1),
+// with N = V = R as in Karis 2013. The importance samples of each level are generated
+// once and only rotated into the frame of each texel; their source mip levels follow the
+// sample PDFs (filtered importance sampling). Bilinear taps that leave a face continue on
+// the adjacent face, so there are no seams. Texels are filtered in parallel over the face
+// rows of each level, with DirectXMath vectors. MultiVolumes prefilters the -radiance cube map
+// on its first run and caches it as <radiance>.ggx.dds, which MultiVolumesHeadless
+// -prefilterRadiance also writes offline.
+class RadiancePrefilter
+{
+public:
+	RadiancePrefilter();
+	virtual ~RadiancePrefilter();
+
+	// Faces in the D3D order, as CubeMapFile. Levels down to 8x8 when numMips is 0.
+	void Prefilter(const DirectX::XMFLOAT4* pTexels, uint32_t faceSize, uint8_t numMips = 0, uint32_t numSamples = 512);
+
+	// Uses the prefiltered DDS cached for the radiance DDS, or prefilters it and writes the
+	// cache. The cache file defaults to <fileName>.ggx.dds and is keyed by a hash of the DDS.
+	bool Load(const std::wstring& fileName, const std::wstring& cacheFileName = L"");
+
+	const std::vector<std::vector<DirectX::XMFLOAT4>>& GetMips() const;
+	const std::wstring& GetCacheFileName() const;
+	uint32_t GetFaceSize() const;
+	bool IsCached() const;
+
+	static const uint32_t MaxFaceSize = 512;
+	static const uint32_t MinMipSize = 8;
+
+protected:
+	struct Sample
+	{
+		DirectX::XMFLOAT3 Dir;	// In the tangent frame of the texel
+		float Weight;			// N dot L
+		float Level;			// Of the source mip chain
+	};
+
+	void generateSourceMips(const DirectX::XMFLOAT4* pTexels, uint32_t faceSize);
+	void generateSamples(float roughness, uint32_t numSamples, std::vector<Sample>& samples) const;
+	DirectX::XMVECTOR sampleSource(const DirectX::XMFLOAT3& dir, float level) const;
+	DirectX::XMVECTOR sampleSourceLevel(const DirectX::XMFLOAT3& dir, uint32_t level) const;
+
+	std::vector<std::vector<DirectX::XMFLOAT4>> m_srcMips;	// Box-filtered down to 1x1
+	std::vector<std::vector<DirectX::XMFLOAT4>> m_mips;
+	std::wstring			m_cacheFileName;
+
+	uint32_t				m_faceSize;
+	bool					m_isCached;
+};
@@ -0,0 +1,908 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SharedConsts.h"
+#include "VolumeTypes.h"
+#include "RenderGraph.h"
+#include "MemoryBudget.h"
+#include <chrono>
+#include <random>
+
+using namespace std;
+
+// As MultiRayCaster::OITMethod
+enum OITMethod : uint8_t
+{
+	OIT_K_BUFFER,
+	OIT_RAY_TRACING,
+	OIT_RAY_QUERY,
+
+	OIT_METHOD_COUNT
+};
+
+static const char* g_stateNames[] =
+{
+	"RENDER_TARGET",
+	"UNORDERED_ACCESS",
+	"DEPTH_WRITE",
+	"DEPTH_READ",
+	"NON_PIXEL_SHADER_RESOURCE",
+	"PIXEL_SHADER_RESOURCE",
+	"INDIRECT_ARGUMENT",
+	"COPY_DEST",
+	"COPY_SOURCE",
+	"PRESENT"
+};
+
+static const char* g_oitMethodNames[] = { "K-buffer", "ray tracing", "ray query" };
+
+static const uint16_t g_shaderResource = RenderGraph::NON_PIXEL_SHADER_RESOURCE | RenderGraph::PIXEL_SHADER_RESOURCE;
+
+static inline uint64_t alignUp(uint64_t size, uint64_t alignment)
+{
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+static inline bool isSingleWriteState(uint16_t state)
+{
+	return (state & RenderGraph::WRITE_STATES) == state && state && (state & (state - 1)) == 0;
+}
+
+static inline bool isLifetimeOverlapping(const RenderGraph::Lifetime& a, const RenderGraph::Lifetime& b)
+{
+	return a.First <= b.Last && b.First <= a.Last;
+}
+
+static inline double toMB(uint64_t bytes)
+{
+	return bytes / 1048576.0;
+}
+
+static const RenderGraph::Use* findUse(const RenderGraph::Pass& pass, uint32_t resource)
+{
+	for (const auto& use : pass.Uses)
+		if (use.Resource == resource) return &use;
+
+	return nullptr;
+}
+
+//--------------------------------------------------------------------------------------
+// Render graph
+//--------------------------------------------------------------------------------------
+RenderGraph::RenderGraph() :
+	m_transientBytes(0),
+	m_heapBytes(0)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+}
+
+void RenderGraph::Reset()
+{
+	m_resources.clear();
+	m_passes.clear();
+	m_compiledPasses.clear();
+	m_finalBarriers.clear();
+	m_lifetimes.clear();
+	m_transientBytes = 0;
+	m_heapBytes = 0;
+	m_error.clear();
+}
+
+uint32_t RenderGraph::CreateResource(const string& name, uint64_t bytes)
+{
+	m_resources.push_back({ name, bytes, false, COMMON, KEEP_STATE });
+
+	return static_cast<uint32_t>(m_resources.size() - 1);
+}
+
+uint32_t RenderGraph::ImportResource(const string& name, uint64_t bytes, uint16_t initialState, uint16_t finalState)
+{
+	m_resources.push_back({ name, bytes, true, initialState, finalState });
+
+	return static_cast<uint32_t>(m_resources.size() - 1);
+}
+
+uint32_t RenderGraph::AddPass(const string& name, bool hasSideEffects)
+{
+	m_passes.push_back({ name, hasSideEffects, vector<Use>() });
+
+	return static_cast<uint32_t>(m_passes.size() - 1);
+}
+
+void RenderGraph::Read(uint32_t pass, uint32_t resource, uint16_t state)
+{
+	use(pass, resource, state, READ);
+}
+
+void RenderGraph::Write(uint32_t pass, uint32_t resource, uint16_t state)
+{
+	use(pass, resource, state, WRITE);
+}
+
+void RenderGraph::Modify(uint32_t pass, uint32_t resource, uint16_t state)
+{
+	use(pass, resource, state, READ_WRITE);
+}
+
+void RenderGraph::BuildFrame(const FrameDesc& desc)
+{
+	const auto& w = desc.Width;
+	const auto& h = desc.Height;
+	const auto& gridSize = desc.GridSize;
+	const auto& lightGridSize = desc.LightGridSize;
+	const auto numVolumes = desc.NumVolumes;
+
+	// Persistent across frames: the volume sources, the shadow and light maps updated on light
+	// changes, the cube maps of the volumes out of view, the indirect arguments with their
+	// prefilled dimensions, the TAA history, and the back buffer
+	const auto volumes = ImportResource("Volumes",
+		desc.NumVolumeSrcs * MemoryBudget::GetTextureSize(gridSize, gridSize, gridSize, 1, 1, 64), g_shaderResource);
+	const auto shadow = ImportResource("Shadow", MemoryBudget::GetTextureSize(1024, 1024, 1, 1, 1, 16),
+		g_shaderResource, g_shaderResource);
+	const auto lightMap = ImportResource("LightMap",
+		MemoryBudget::GetTextureSize(lightGridSize, lightGridSize, lightGridSize, 1, 1, 32), g_shaderResource, g_shaderResource);
+	const auto radianceCubes = ImportResource("RadianceCubes",
+		numVolumes * MemoryBudget::GetTextureSize(gridSize, gridSize, 1, 6, NUM_CUBE_MIP, 64), g_shaderResource, g_shaderResource);
+	const auto depthCubes = ImportResource("DepthCubes",
+		numVolumes * MemoryBudget::GetTextureSize(gridSize, gridSize, 1, 6, NUM_CUBE_MIP, 32), g_shaderResource, g_shaderResource);
+	const auto counterReset = ImportResource("CounterReset", MemoryBudget::GetBufferSize(sizeof(uint32_t)), COPY_SOURCE);
+	const auto dispatchArg = ImportResource("VisibleVolumeDispatchArg", MemoryBudget::GetBufferSize(sizeof(uint32_t[3])),
+		INDIRECT_ARGUMENT, INDIRECT_ARGUMENT);
+	const auto drawArg = ImportResource("VisibleVolumeDrawArg", MemoryBudget::GetBufferSize(sizeof(uint32_t[5])),
+		INDIRECT_ARGUMENT, INDIRECT_ARGUMENT);
+	const auto radiance = desc.HasLightProbe ? ImportResource("Radiance", 0, g_shaderResource) : NotFound;
+	const auto history = ImportResource("TemporalHistory", MemoryBudget::GetTextureSize(w, h, 1, 1, 1, 64), g_shaderResource);
+	const auto temporalView = ImportResource("TemporalView", MemoryBudget::GetTextureSize(w, h, 1, 1, 1, 64),
+		g_shaderResource, g_shaderResource);
+	const auto backBuffer = ImportResource("BackBuffer", MemoryBudget::GetTextureSize(w, h, 1, 1, 1, 32), PRESENT, PRESENT);
+
+	// Transient within the frame; the resources of the other OIT methods stay unused
+	const auto color = CreateResource("RenderTarget", MemoryBudget::GetTextureSize(w, h, 1, 1, 1, 64));
+	const auto velocity = CreateResource("Velocity", MemoryBudget::GetTextureSize(w, h, 1, 1, 1, 32));
+	const auto depth = CreateResource("Depth", MemoryBudget::GetTextureSize(w, h, 1, 1, 1, 32));
+	const auto counter = CreateResource("VisibleVolumeCounter", MemoryBudget::GetBufferSize(sizeof(uint32_t)));
+	const auto visibleVolumes = CreateResource("VisibleVolumes", MemoryBudget::GetBufferSize(sizeof(uint32_t) * numVolumes));
+	const auto volumeAttribs = CreateResource("VolumeAttributes", MemoryBudget::GetBufferSize(sizeof(VolumeInfo) * numVolumes));
+	const auto kDepths = CreateResource("DepthKBuffer", MemoryBudget::GetTextureSize(w, h, 1, NUM_OIT_LAYERS, 1, 32));
+	const auto kColors = CreateResource("ColorKBuffer", MemoryBudget::GetTextureSize(w, h, 1, NUM_OIT_LAYERS, 1, 64));
+	const auto depthIncCubes = CreateResource("DepthIncCubes", MemoryBudget::GetTextureSize(w, h, 1, 1, 1, 32));
+
+	// ObjectRenderer and LightProbe
+	if (desc.UpdateLight) Write(AddPass("RenderShadow"), shadow, DEPTH_WRITE);
+
+	auto pass = AddPass("RenderObjects");
+	Write(pass, color, RENDER_TARGET);
+	Write(pass, velocity, RENDER_TARGET);
+	Write(pass, depth, DEPTH_WRITE);
+
+	if (desc.HasLightProbe)
+	{
+		pass = AddPass("RenderEnvironment");
+		Modify(pass, color, RENDER_TARGET);
+		Read(pass, depth, DEPTH_READ);
+		Read(pass, radiance, PIXEL_SHADER_RESOURCE);
+	}
+
+	// MultiRayCaster
+	if (desc.UpdateLight)
+	{
+		pass = AddPass("RayMarchL");
+		Read(pass, volumes, NON_PIXEL_SHADER_RESOURCE);
+		Read(pass, shadow, NON_PIXEL_SHADER_RESOURCE);
+		Write(pass, lightMap, UNORDERED_ACCESS);
+	}
+
+	pass = AddPass("ResetCounter");
+	Read(pass, counterReset, COPY_SOURCE);
+	Write(pass, counter, COPY_DEST);
+
+	pass = AddPass("CullVolumes");
+	Modify(pass, counter, UNORDERED_ACCESS);
+	Write(pass, visibleVolumes, UNORDERED_ACCESS);
+	Write(pass, volumeAttribs, UNORDERED_ACCESS);
+
+	pass = AddPass("CopyVisibleVolumeCount");
+	Read(pass, counter, COPY_SOURCE);
+	Modify(pass, dispatchArg, COPY_DEST);
+	Modify(pass, drawArg, COPY_DEST);
+
+	pass = AddPass("RayMarchV");
+	Read(pass, dispatchArg, INDIRECT_ARGUMENT);
+	Read(pass, visibleVolumes, NON_PIXEL_SHADER_RESOURCE);
+	Read(pass, volumeAttribs, NON_PIXEL_SHADER_RESOURCE);
+	Read(pass, lightMap, NON_PIXEL_SHADER_RESOURCE);
+	Read(pass, depth, NON_PIXEL_SHADER_RESOURCE);
+	Read(pass, volumes, NON_PIXEL_SHADER_RESOURCE);
+	Write(pass, radianceCubes, UNORDERED_ACCESS);
+	Write(pass, depthCubes, UNORDERED_ACCESS);
+
+	switch (desc.OITMethod)
+	{
+	case OIT_RAY_TRACING:
+		pass = AddPass("TraceCube");
+		Read(pass, volumeAttribs, NON_PIXEL_SHADER_RESOURCE);
+		Read(pass, volumes, NON_PIXEL_SHADER_RESOURCE);
+		Read(pass, depth, NON_PIXEL_SHADER_RESOURCE);
+		Read(pass, radianceCubes, NON_PIXEL_SHADER_RESOURCE);
+		Read(pass, depthCubes, NON_PIXEL_SHADER_RESOURCE);
+		Modify(pass, color, UNORDERED_ACCESS);
+		break;
+	case OIT_RAY_QUERY:
+		pass = AddPass("RenderDepth");
+		Read(pass, drawArg, INDIRECT_ARGUMENT);
+		Read(pass, visibleVolumes, NON_PIXEL_SHADER_RESOURCE);
+		Write(pass, depthIncCubes, DEPTH_WRITE);
+
+		pass = AddPass("RenderCubeRT");
+		Read(pass, drawArg, INDIRECT_ARGUMENT);
+		Read(pass, visibleVolumes, NON_PIXEL_SHADER_RESOURCE);
+		Read(pass, volumeAttribs, PIXEL_SHADER_RESOURCE);
+		Read(pass, volumes, PIXEL_SHADER_RESOURCE);
+		Read(pass, depth, PIXEL_SHADER_RESOURCE);
+		Read(pass, radianceCubes, PIXEL_SHADER_RESOURCE);
+		Read(pass, depthCubes, PIXEL_SHADER_RESOURCE);
+		Read(pass, depthIncCubes, DEPTH_READ);
+		Modify(pass, color, RENDER_TARGET);
+		break;
+	default:
+		pass = AddPass("CubeDepthPeel");
+		Read(pass, drawArg, INDIRECT_ARGUMENT);
+		Read(pass, visibleVolumes, NON_PIXEL_SHADER_RESOURCE);
+		Write(pass, kDepths, UNORDERED_ACCESS);
+
+		pass = AddPass("RenderCube");
+		Read(pass, drawArg, INDIRECT_ARGUMENT);
+		Read(pass, visibleVolumes, NON_PIXEL_SHADER_RESOURCE);
+		Read(pass, kDepths, PIXEL_SHADER_RESOURCE);
+		Read(pass, lightMap, PIXEL_SHADER_RESOURCE);
+		Read(pass, volumes, PIXEL_SHADER_RESOURCE);
+		Read(pass, depth, PIXEL_SHADER_RESOURCE);
+		Read(pass, radianceCubes, PIXEL_SHADER_RESOURCE);
+		Read(pass, depthCubes, PIXEL_SHADER_RESOURCE);
+		Write(pass, kColors, UNORDERED_ACCESS);
+
+		pass = AddPass("ResolveOIT");
+		Read(pass, kColors, PIXEL_SHADER_RESOURCE);
+		Modify(pass, color, RENDER_TARGET);
+	}
+
+	// ObjectRenderer::Postprocess()
+	pass = AddPass("TemporalAA");
+	Read(pass, color, NON_PIXEL_SHADER_RESOURCE);
+	Read(pass, velocity, NON_PIXEL_SHADER_RESOURCE);
+	Read(pass, history, g_shaderResource);
+	Write(pass, temporalView, UNORDERED_ACCESS);
+
+	pass = AddPass("ToneMap");
+	Read(pass, temporalView, PIXEL_SHADER_RESOURCE);
+	Write(pass, backBuffer, RENDER_TARGET);
+}
+
+bool RenderGraph::Compile()
+{
+	m_compiledPasses.clear();
+	m_finalBarriers.clear();
+	m_error.clear();
+
+	// Validate the declared states
+	for (const auto& pass : m_passes)
+	{
+		for (const auto& use : pass.Uses)
+		{
+			const auto isValid = (use.Access & WRITE) ? isSingleWriteState(use.State) :
+				use.State != COMMON && (use.State & WRITE_STATES) == 0;
+			if (!isValid)
+			{
+				m_error = pass.Name + " uses " + m_resources[use.Resource].Name + " as " + GetStateName(use.State);
+
+				return false;
+			}
+		}
+	}
+
+	vector<bool> isLive;
+	if (!cullPasses(isLive)) return false;
+
+	for (auto i = 0u; i < m_passes.size(); ++i)
+		if (isLive[i]) m_compiledPasses.push_back({ i, vector<Barrier>() });
+
+	allocateTransients();
+	placeBarriers();
+
+	return true;
+}
+
+const vector<RenderGraph::Resource>& RenderGraph::GetResources() const
+{
+	return m_resources;
+}
+
+const vector<RenderGraph::Pass>& RenderGraph::GetPasses() const
+{
+	return m_passes;
+}
+
+const vector<RenderGraph::CompiledPass>& RenderGraph::GetCompiledPasses() const
+{
+	return m_compiledPasses;
+}
+
+const vector<RenderGraph::Barrier>& RenderGraph::GetFinalBarriers() const
+{
+	return m_finalBarriers;
+}
+
+const vector<RenderGraph::Lifetime>& RenderGraph::GetLifetimes() const
+{
+	return m_lifetimes;
+}
+
+uint32_t RenderGraph::GetNumBarriers() const
+{
+	auto numBarriers = static_cast<uint32_t>(m_finalBarriers.size());
+	for (const auto& pass : m_compiledPasses) numBarriers += static_cast<uint32_t>(pass.Barriers.size());
+
+	return numBarriers;
+}
+
+uint64_t RenderGraph::GetTransientBytes() const
+{
+	return m_transientBytes;
+}
+
+uint64_t RenderGraph::GetHeapBytes() const
+{
+	return m_heapBytes;
+}
+
+const string& RenderGraph::GetError() const
+{
+	return m_error;
+}
+
+void RenderGraph::Print(ostream& stream) const
+{
+	const auto printBarrier = [&](const Barrier& barrier)
+	{
+		stream << "    " << left << setw(26) << m_resources[barrier.Resource].Name << right;
+		switch (barrier.Type)
+		{
+		case UAV:
+			stream << "UAV" << endl;
+			break;
+		case ALIASING:
+			stream << "aliasing " << m_resources[barrier.ResourceBefore].Name << endl;
+			break;
+		default:
+			stream << GetStateName(barrier.StateBefore) << " -> " << GetStateName(barrier.StateAfter) << endl;
+		}
+	};
+
+	stream << m_compiledPasses.size() << " of " << m_passes.size() << " passes, " << GetNumBarriers() << " barriers, "
+		<< fixed << setprecision(1) << toMB(m_transientBytes) << " MB transient in a " << toMB(m_heapBytes)
+		<< " MB heap" << defaultfloat << endl;
+
+	for (const auto& compiledPass : m_compiledPasses)
+	{
+		for (const auto& barrier : compiledPass.Barriers) printBarrier(barrier);
+		stream << "  " << m_passes[compiledPass.Pass].Name << endl;
+	}
+	for (const auto& barrier : m_finalBarriers) printBarrier(barrier);
+
+	auto isCulled = false;
+	for (auto i = 0u; i < m_passes.size(); ++i)
+	{
+		const auto isLive = any_of(m_compiledPasses.cbegin(), m_compiledPasses.cend(),
+			[i](const CompiledPass& compiledPass) { return compiledPass.Pass == i; });
+		if (!isLive)
+		{
+			stream << (isCulled ? ", " : "Culled: ") << m_passes[i].Name;
+			isCulled = true;
+		}
+	}
+	if (isCulled) stream << endl;
+
+	stream << left << setw(26) << "Transient" << right << setw(12) << "Offset (MB)" << setw(10) << "Size (MB)"
+		<< setw(10) << "Passes" << endl;
+	for (auto i = 0u; i < m_resources.size(); ++i)
+	{
+		const auto& resource = m_resources[i];
+		const auto& lifetime = m_lifetimes[i];
+		if (resource.IsImported) continue;
+
+		stream << left << setw(26) << resource.Name << right;
+		if (lifetime.First > lifetime.Last) stream << setw(12) << "-" << setw(10) << "-" << setw(10) << "unused" << endl;
+		else stream << fixed << setprecision(2) << setw(12) << toMB(lifetime.Offset) << setw(10) << toMB(resource.Bytes)
+			<< setw(10) << (to_string(lifetime.First) + "-" + to_string(lifetime.Last)) << defaultfloat << endl;
+	}
+}
+
+string RenderGraph::GetStateName(uint16_t state)
+{
+	if (state == COMMON) return "COMMON";
+
+	string name;
+	for (uint8_t i = 0; i < size(g_stateNames); ++i)
+	{
+		if (state & (1 << i))
+		{
+			if (!name.empty()) name += "|";
+			name += g_stateNames[i];
+		}
+	}
+
+	return name;
+}
+
+const char* RenderGraph::GetOITMethodName(uint8_t method)
+{
+	return method < OIT_METHOD_COUNT ? g_oitMethodNames[method] : "";
+}
+
+RenderGraph::FrameDesc RenderGraph::GetDefaultFrameDesc()
+{
+	// As MultiVolumes with the default settings
+	FrameDesc desc;
+	desc.Width = 1280;
+	desc.Height = 800;
+	desc.NumVolumes = 2;
+	desc.NumVolumeSrcs = 10;
+	desc.GridSize = 128;
+	desc.LightGridSize = 512;
+	desc.OITMethod = OIT_K_BUFFER;
+	desc.UpdateLight = true;
+	desc.HasLightProbe = true;
+
+	return desc;
+}
+
+void RenderGraph::use(uint32_t pass, uint32_t resource, uint16_t state, uint8_t access)
+{
+	assert(pass < m_passes.size() && resource < m_resources.size());
+
+	// Merge the uses of the same resource in a pass
+	auto& uses = m_passes[pass].Uses;
+	for (auto& use : uses)
+	{
+		if (use.Resource == resource)
+		{
+			use.State |= state;
+			use.Access |= access;
+
+			return;
+		}
+	}
+
+	uses.push_back({ resource, state, access });
+}
+
+bool RenderGraph::cullPasses(vector<bool>& isLive)
+{
+	// Backward from the passes with side effects or writing imported resources, a pass is live if
+	// a live pass reads a version of a resource it wrote
+	const auto numPasses = static_cast<uint32_t>(m_passes.size());
+	vector<bool> isRead(m_resources.size(), false);
+	isLive.assign(numPasses, false);
+	for (auto i = numPasses; i-- > 0;)
+	{
+		const auto& pass = m_passes[i];
+		auto live = pass.HasSideEffects;
+		for (const auto& use : pass.Uses)
+			if (use.Access & WRITE) live = live || m_resources[use.Resource].IsImported || isRead[use.Resource];
+		if (!live) continue;
+
+		isLive[i] = true;
+		for (const auto& use : pass.Uses)
+			if (use.Access & WRITE) isRead[use.Resource] = false;
+		for (const auto& use : pass.Uses)
+			if (use.Access & READ) isRead[use.Resource] = true;
+	}
+
+	// A transient read by a live pass must have been written before
+	vector<bool> isWritten(m_resources.size(), false);
+	for (auto i = 0u; i < numPasses; ++i)
+	{
+		if (!isLive[i]) continue;
+		for (const auto& use : m_passes[i].Uses)
+		{
+			if ((use.Access & READ) && !m_resources[use.Resource].IsImported && !isWritten[use.Resource])
+			{
+				m_error = m_passes[i].Name + " reads " + m_resources[use.Resource].Name + " before it is written";
+
+				return false;
+			}
+			if (use.Access & WRITE) isWritten[use.Resource] = true;
+		}
+	}
+
+	return true;
+}
+
+void RenderGraph::allocateTransients()
+{
+	// Lifetimes over the compiled passes
+	const auto numResources = static_cast<uint32_t>(m_resources.size());
+	m_lifetimes.assign(numResources, { NotFound, 0, 0 });
+	for (auto i = 0u; i < m_compiledPasses.size(); ++i)
+	{
+		for (const auto& use : m_passes[m_compiledPasses[i].Pass].Uses)
+		{
+			auto& lifetime = m_lifetimes[use.Resource];
+			lifetime.First = (min)(lifetime.First, i);
+			lifetime.Last = (max)(lifetime.Last, i);
+		}
+	}
+
+	vector<uint32_t> transients;
+	for (auto i = 0u; i < numResources; ++i)
+		if (!m_resources[i].IsImported && m_lifetimes[i].First <= m_lifetimes[i].Last) transients.push_back(i);
+
+	// Greedy by size: place the largest first, at the lowest offset clear of the placed
+	// resources whose lifetimes overlap
+	sort(transients.begin(), transients.end(), [this](uint32_t a, uint32_t b)
+	{
+		const auto sizeA = alignUp(m_resources[a].Bytes, Alignment);
+		const auto sizeB = alignUp(m_resources[b].Bytes, Alignment);
+
+		return sizeA != sizeB ? sizeA > sizeB : m_lifetimes[a].First != m_lifetimes[b].First ?
+			m_lifetimes[a].First < m_lifetimes[b].First : a < b;
+	});
+
+	m_transientBytes = 0;
+	m_heapBytes = 0;
+	vector<uint32_t> placed;
+	vector<pair<uint64_t, uint64_t>> ranges;
+	for (const auto& i : transients)
+	{
+		auto& lifetime = m_lifetimes[i];
+		const auto size = alignUp(m_resources[i].Bytes, Alignment);
+
+		ranges.clear();
+		for (const auto& j : placed)
+		{
+			const auto& other = m_lifetimes[j];
+			if (isLifetimeOverlapping(lifetime, other))
+				ranges.emplace_back(other.Offset, other.Offset + alignUp(m_resources[j].Bytes, Alignment));
+		}
+		sort(ranges.begin(), ranges.end());
+
+		uint64_t offset = 0;
+		for (const auto& range : ranges)
+		{
+			if (offset + size <= range.first) break;
+			offset = (max)(offset, range.second);
+		}
+
+		lifetime.Offset = offset;
+		placed.push_back(i);
+		m_transientBytes += size;
+		m_heapBytes = (max)(m_heapBytes, offset + size);
+	}
+}
+
+void RenderGraph::placeBarriers()
+{
+	const auto numResources = static_cast<uint32_t>(m_resources.size());
+	const auto numPasses = static_cast<uint32_t>(m_compiledPasses.size());
+	vector<uint16_t> states(numResources);
+	vector<bool> isWritten(numResources, false);	// By the last use, for the UAV barriers
+	for (auto i = 0u; i < numResources; ++i) states[i] = m_resources[i].InitialState;
+
+	for (auto i = 0u; i < numPasses; ++i)
+	{
+		auto& barriers = m_compiledPasses[i].Barriers;
+		for (const auto& use : m_passes[m_compiledPasses[i].Pass].Uses)
+		{
+			const auto r = use.Resource;
+			const auto& resource = m_resources[r];
+			const auto& lifetime = m_lifetimes[r];
+			auto& state = states[r];
+
+			// A transient begins in the state of its first use, which writes it, after the
+			// previous occupant of its memory
+			if (!resource.IsImported && lifetime.First == i)
+			{
+				const auto size = alignUp(resource.Bytes, Alignment);
+				auto resourceBefore = NotFound;
+				for (auto j = 0u; j < numResources; ++j)
+				{
+					const auto& other = m_lifetimes[j];
+					if (j == r || m_resources[j].IsImported || other.First > other.Last || other.Last >= i) continue;
+					const auto otherEnd = other.Offset + alignUp(m_resources[j].Bytes, Alignment);
+					if (other.Offset < lifetime.Offset + size && lifetime.Offset < otherEnd &&
+						(resourceBefore == NotFound || other.Last > m_lifetimes[resourceBefore].Last))
+						resourceBefore = j;
+				}
+				if (resourceBefore != NotFound) barriers.push_back({ ALIASING, r, COMMON, COMMON, resourceBefore });
+
+				state = use.State;
+				isWritten[r] = true;
+				continue;
+			}
+
+			if (use.Access & WRITE)
+			{
+				if (state != use.State) barriers.push_back({ TRANSITION, r, state, use.State, NotFound });
+				else if (use.State == UNORDERED_ACCESS && isWritten[r]) barriers.push_back({ UAV, r, state, state, NotFound });
+				state = use.State;
+				isWritten[r] = true;
+			}
+			else if ((state & WRITE_STATES) || (state & use.State) != use.State)
+			{
+				// Merge the states of the following readers until the next write, or the final state
+				// if none writes
+				auto readStates = use.State;
+				auto isLastRun = true;
+				for (auto j = i + 1; j < numPasses && isLastRun; ++j)
+				{
+					const auto pNextUse = findUse(m_passes[m_compiledPasses[j].Pass], r);
+					if (!pNextUse) continue;
+					if (pNextUse->Access & WRITE) isLastRun = false;
+					else readStates |= pNextUse->State;
+				}
+				if (isLastRun && resource.IsImported && resource.FinalState != KEEP_STATE &&
+					(resource.FinalState & (WRITE_STATES | PRESENT)) == 0) readStates |= resource.FinalState;
+				barriers.push_back({ TRANSITION, r, state, readStates, NotFound });
+				state = readStates;
+				isWritten[r] = false;
+			}
+			else isWritten[r] = false;
+		}
+	}
+
+	for (auto i = 0u; i < numResources; ++i)
+	{
+		const auto& resource = m_resources[i];
+		if (resource.IsImported && resource.FinalState != KEEP_STATE && states[i] != resource.FinalState)
+			m_finalBarriers.push_back({ TRANSITION, i, states[i], resource.FinalState, NotFound });
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Evaluation
+//--------------------------------------------------------------------------------------
+
+// Replays the compiled graph, checking that every pass sees its declared states, that no
+// transition is redundant, that consecutive readers share a single transition, that the
+// transients live at the same time never share memory, and that the culling matches the
+// forward definition of liveness
+static bool validate(const RenderGraph& graph)
+{
+	const auto& resources = graph.GetResources();
+	const auto& passes = graph.GetPasses();
+	const auto& compiledPasses = graph.GetCompiledPasses();
+	const auto& lifetimes = graph.GetLifetimes();
+	const auto numResources = static_cast<uint32_t>(resources.size());
+	const auto numPasses = static_cast<uint32_t>(passes.size());
+
+	// Liveness to a fixed point: the roots, and the last writers before the reads of live passes
+	vector<bool> isLive(numPasses, false);
+	for (auto i = 0u; i < numPasses; ++i)
+	{
+		isLive[i] = passes[i].HasSideEffects;
+		for (const auto& use : passes[i].Uses)
+			if ((use.Access & RenderGraph::WRITE) && resources[use.Resource].IsImported) isLive[i] = true;
+	}
+	for (auto isChanged = true; isChanged;)
+	{
+		isChanged = false;
+		for (auto i = 0u; i < numPasses; ++i)
+		{
+			if (!isLive[i]) continue;
+			for (const auto& use : passes[i].Uses)
+			{
+				if (!(use.Access & RenderGraph::READ)) continue;
+				for (auto j = i; j-- > 0;)
+				{
+					const auto pUse = findUse(passes[j], use.Resource);
+					if (pUse && (pUse->Access & RenderGraph::WRITE))
+					{
+						isChanged = isChanged || !isLive[j];
+						isLive[j] = true;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	auto numLive = 0u;
+	for (auto i = 0u; i < numPasses; ++i) numLive += isLive[i] ? 1 : 0;
+	if (numLive != compiledPasses.size()) return false;
+	for (auto i = 0u; i < compiledPasses.size(); ++i)
+	{
+		if (!isLive[compiledPasses[i].Pass]) return false;
+		if (i > 0 && compiledPasses[i].Pass <= compiledPasses[i - 1].Pass) return false;
+	}
+
+	// Transients live at the same time are apart in memory
+	uint64_t heapBytes = 0;
+	for (auto i = 0u; i < numResources; ++i)
+	{
+		const auto& a = lifetimes[i];
+		if (resources[i].IsImported || a.First > a.Last) continue;
+		const auto endA = a.Offset + alignUp(resources[i].Bytes, RenderGraph::Alignment);
+		if (a.Offset % RenderGraph::Alignment) return false;
+		heapBytes = (max)(heapBytes, endA);
+		for (auto j = i + 1; j < numResources; ++j)
+		{
+			const auto& b = lifetimes[j];
+			if (resources[j].IsImported || b.First > b.Last || !isLifetimeOverlapping(a, b)) continue;
+			const auto endB = b.Offset + alignUp(resources[j].Bytes, RenderGraph::Alignment);
+			if (a.Offset < endB && b.Offset < endA) return false;
+		}
+	}
+	if (heapBytes != graph.GetHeapBytes()) return false;
+
+	// Replay the barriers
+	vector<uint16_t> states(numResources);
+	vector<uint8_t> numReadTransitions(numResources, 0);	// Since the last write
+	for (auto i = 0u; i < numResources; ++i) states[i] = resources[i].InitialState;
+	const auto applyBarrier = [&](const RenderGraph::Barrier& barrier)
+	{
+		const auto r = barrier.Resource;
+		if (barrier.Type == RenderGraph::ALIASING)
+			return !resources[r].IsImported && barrier.ResourceBefore < numResources;
+		if (barrier.StateBefore != states[r]) return false;
+		if (barrier.Type == RenderGraph::UAV) return states[r] == RenderGraph::UNORDERED_ACCESS;
+		if (barrier.StateBefore == barrier.StateAfter) return false;
+		if (!(barrier.StateAfter & RenderGraph::WRITE_STATES) && ++numReadTransitions[r] > 1) return false;
+		states[r] = barrier.StateAfter;
+
+		return true;
+	};
+
+	for (auto i = 0u; i < compiledPasses.size(); ++i)
+	{
+		const auto& pass = passes[compiledPasses[i].Pass];
+		for (const auto& use : pass.Uses)
+			if (!resources[use.Resource].IsImported && lifetimes[use.Resource].First == i) states[use.Resource] = use.State;
+
+		for (const auto& barrier : compiledPasses[i].Barriers)
+			if (!applyBarrier(barrier)) return false;
+
+		for (const auto& use : pass.Uses)
+		{
+			const auto state = states[use.Resource];
+			if (use.Access & RenderGraph::WRITE)
+			{
+				if (state != use.State) return false;
+				numReadTransitions[use.Resource] = 0;
+			}
+			else if ((state & RenderGraph::WRITE_STATES) || (state & use.State) != use.State) return false;
+		}
+	}
+
+	// The final states may need another transition of the last readers
+	fill(numReadTransitions.begin(), numReadTransitions.end(), 0);
+	for (const auto& barrier : graph.GetFinalBarriers())
+		if (!applyBarrier(barrier)) return false;
+	for (auto i = 0u; i < numResources; ++i)
+	{
+		const auto& resource = resources[i];
+		if (resource.IsImported && resource.FinalState != RenderGraph::KEEP_STATE && states[i] != resource.FinalState)
+			return false;
+	}
+
+	return true;
+}
+
+RenderGraph::EvaluationResult RenderGraph::Evaluate(const EvaluationDesc& desc)
+{
+	EvaluationResult result = {};
+	RenderGraph graph;
+
+	// Frame graphs of every OIT method, with and without the light update and the light probe
+	for (uint8_t method = 0; method < OIT_METHOD_COUNT; ++method)
+	{
+		for (uint8_t i = 0; i < 4; ++i)
+		{
+			auto frameDesc = GetDefaultFrameDesc();
+			frameDesc.OITMethod = method;
+			frameDesc.UpdateLight = (i & 1) != 0;
+			frameDesc.HasLightProbe = (i & 2) != 0;
+
+			graph.Reset();
+			graph.BuildFrame(frameDesc);
+			++result.NumGraphs;
+			if (!graph.Compile() || !validate(graph) || graph.GetCompiledPasses().size() != graph.GetPasses().size())
+			{
+				++result.NumFailed;
+				continue;
+			}
+
+			// The K-buffers and the depth of the ray-query cubes only live with their methods
+			auto isExpected = true;
+			for (auto j = 0u; j < graph.GetResources().size(); ++j)
+			{
+				const auto& name = graph.GetResources()[j].Name;
+				const auto& lifetime = graph.GetLifetimes()[j];
+				const auto isUsed = lifetime.First <= lifetime.Last;
+				if (name == "DepthKBuffer" || name == "ColorKBuffer") isExpected = isExpected && isUsed == (method == OIT_K_BUFFER);
+				if (name == "DepthIncCubes") isExpected = isExpected && isUsed == (method == OIT_RAY_QUERY);
+			}
+
+			// A debug view of the light map consumed by nothing is culled with its producer
+			const auto numPasses = graph.GetCompiledPasses().size();
+			const auto lightMap = 2u;
+			assert(graph.GetResources()[lightMap].Name == "LightMap");
+			const auto slices = graph.CreateResource("LightMapSlices", MemoryBudget::GetTextureSize(512, 512, 1, 1, 1, 32));
+			const auto view = graph.CreateResource("LightMapView", MemoryBudget::GetTextureSize(512, 512, 1, 1, 1, 32));
+			auto pass = graph.AddPass("SliceLightMap");
+			graph.Read(pass, lightMap, NON_PIXEL_SHADER_RESOURCE);
+			graph.Write(pass, slices, UNORDERED_ACCESS);
+			pass = graph.AddPass("VisualizeLightMap");
+			graph.Read(pass, slices, PIXEL_SHADER_RESOURCE);
+			graph.Write(pass, view, RENDER_TARGET);
+			isExpected = isExpected && graph.Compile() && validate(graph) && graph.GetCompiledPasses().size() == numPasses;
+
+			if (!isExpected) ++result.NumFailed;
+		}
+	}
+
+	// Random graphs
+	mt19937 rng(desc.Seed);
+	for (auto n = 0u; n < desc.NumRandomGraphs; ++n)
+	{
+		const auto numResources = (max)(desc.NumRandomResources, 1u);
+		graph.Reset();
+		for (auto i = 0u; i < numResources; ++i)
+		{
+			const auto bytes = (1 + rng() % 64) * 32768ull;
+			if (rng() % 4 == 0)
+			{
+				const uint16_t states[] = { g_shaderResource, PIXEL_SHADER_RESOURCE, UNORDERED_ACCESS, COPY_SOURCE };
+				const auto initialState = states[rng() % size(states)];
+				graph.ImportResource("Imported" + to_string(i), bytes, initialState, rng() % 2 ? initialState : static_cast<uint16_t>(KEEP_STATE));
+			}
+			else graph.CreateResource("Transient" + to_string(i), bytes);
+		}
+
+		const uint16_t readStates[] = { NON_PIXEL_SHADER_RESOURCE, PIXEL_SHADER_RESOURCE, DEPTH_READ, INDIRECT_ARGUMENT, COPY_SOURCE };
+		const uint16_t writeStates[] = { RENDER_TARGET, UNORDERED_ACCESS, DEPTH_WRITE, COPY_DEST };
+		vector<bool> isWritten(numResources, false);
+		for (auto i = 0u; i < desc.NumRandomPasses; ++i)
+		{
+			const auto pass = graph.AddPass("Pass" + to_string(i), rng() % 10 == 0);
+			const auto numUses = 1 + rng() % 4;
+			for (auto j = 0u; j < numUses; ++j)
+			{
+				const auto resource = static_cast<uint32_t>(rng() % numResources);
+				const auto& uses = graph.GetPasses()[pass].Uses;
+				if (any_of(uses.cbegin(), uses.cend(), [resource](const Use& use) { return use.Resource == resource; })) continue;
+
+				const auto canRead = graph.GetResources()[resource].IsImported || isWritten[resource];
+				const auto access = canRead ? rng() % 3 : 1;
+				if (access == 0) graph.Read(pass, resource, readStates[rng() % size(readStates)]);
+				else if (access == 1) graph.Write(pass, resource, writeStates[rng() % size(writeStates)]);
+				else graph.Modify(pass, resource, writeStates[rng() % size(writeStates)]);
+				isWritten[resource] = isWritten[resource] || access > 0;
+			}
+		}
+
+		++result.NumGraphs;
+		if (!graph.Compile() || !validate(graph)) ++result.NumFailed;
+	}
+
+	// The K-buffer frame with the light update
+	auto frameDesc = GetDefaultFrameDesc();
+	const auto numIterations = 256u;
+	const auto startTime = chrono::steady_clock::now();
+	for (auto i = 0u; i < numIterations; ++i)
+	{
+		graph.Reset();
+		graph.BuildFrame(frameDesc);
+		graph.Compile();
+	}
+	result.CompileTime = chrono::duration<double, micro>(chrono::steady_clock::now() - startTime).count() / numIterations;
+	result.NumFramePasses = static_cast<uint32_t>(graph.GetCompiledPasses().size());
+	result.NumFrameBarriers = graph.GetNumBarriers();
+	result.FrameTransientBytes = graph.GetTransientBytes();
+	result.FrameHeapBytes = graph.GetHeapBytes();
+
+	return result;
+}
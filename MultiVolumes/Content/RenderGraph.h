@@ -0,0 +1,179 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Frame graph of passes declaring their reads and writes of named resources. Compile() culls
+// the passes whose results are never consumed, keeps the declaration order of the rest, places
+// a batch of barriers before each pass, merging the read states of consecutive readers into a
+// single transition, and aliases the memory of the transient resources whose lifetimes do not
+// overlap, by a greedy first-fit on the interval graph of the lifetimes. Imported resources,
+// e.g. the back buffer, the TAA history and the light map, persist across frames and are never
+// aliased. The compiler is pure CPU logic; BuildFrame() declares the passes of
+// MultiVolumes::PopulateCommandList() with the states of their hand-written barriers.
+class RenderGraph
+{
+public:
+	enum State : uint16_t
+	{
+		COMMON						= 0,
+		RENDER_TARGET				= (1 << 0),
+		UNORDERED_ACCESS			= (1 << 1),
+		DEPTH_WRITE					= (1 << 2),
+		DEPTH_READ					= (1 << 3),
+		NON_PIXEL_SHADER_RESOURCE	= (1 << 4),
+		PIXEL_SHADER_RESOURCE		= (1 << 5),
+		INDIRECT_ARGUMENT			= (1 << 6),
+		COPY_DEST					= (1 << 7),
+		COPY_SOURCE					= (1 << 8),
+		PRESENT						= (1 << 9),
+
+		WRITE_STATES = RENDER_TARGET | UNORDERED_ACCESS | DEPTH_WRITE | COPY_DEST,
+		KEEP_STATE = 0xffff			// Final state of an imported resource left as last used
+	};
+
+	enum Access : uint8_t
+	{
+		READ		= (1 << 0),
+		WRITE		= (1 << 1),
+		READ_WRITE	= READ | WRITE
+	};
+
+	enum BarrierType : uint8_t
+	{
+		TRANSITION,
+		UAV,
+		ALIASING
+	};
+
+	struct Resource
+	{
+		std::string Name;
+		uint64_t Bytes;
+		bool IsImported;
+		uint16_t InitialState;		// Of an imported resource
+		uint16_t FinalState;
+	};
+
+	struct Use
+	{
+		uint32_t Resource;
+		uint16_t State;
+		uint8_t Access;
+	};
+
+	struct Pass
+	{
+		std::string Name;
+		bool HasSideEffects;		// Never culled
+		std::vector<Use> Uses;
+	};
+
+	struct Barrier
+	{
+		uint8_t Type;
+		uint32_t Resource;
+		uint16_t StateBefore;
+		uint16_t StateAfter;
+		uint32_t ResourceBefore;	// Of an aliasing barrier, the previous occupant of the memory
+	};
+
+	struct CompiledPass
+	{
+		uint32_t Pass;
+		std::vector<Barrier> Barriers;	// Batched before the pass
+	};
+
+	struct Lifetime
+	{
+		uint32_t First;				// Indices of the compiled passes
+		uint32_t Last;
+		uint64_t Offset;			// In the transient heap
+	};
+
+	struct FrameDesc
+	{
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t NumVolumes;
+		uint32_t NumVolumeSrcs;
+		uint32_t GridSize;
+		uint32_t LightGridSize;
+		uint8_t OITMethod;			// As MultiRayCaster::OITMethod
+		bool UpdateLight;
+		bool HasLightProbe;
+	};
+
+	struct EvaluationDesc
+	{
+		uint32_t NumRandomGraphs;	// In addition to the frame graphs of every OIT method
+		uint32_t NumRandomPasses;
+		uint32_t NumRandomResources;
+		uint32_t Seed;
+	};
+
+	struct EvaluationResult
+	{
+		uint32_t NumGraphs;
+		uint32_t NumFailed;			// Graphs failing to compile, with a pass seeing a wrong state, a
+									// redundant transition, overlapping live memory, or a wrong culling
+		uint32_t NumFramePasses;	// Of the K-buffer frame with the light update
+		uint32_t NumFrameBarriers;
+		uint64_t FrameTransientBytes;
+		uint64_t FrameHeapBytes;
+		double CompileTime;			// Per frame graph, in microseconds
+	};
+
+	RenderGraph();
+	virtual ~RenderGraph();
+
+	void Reset();
+
+	uint32_t CreateResource(const std::string& name, uint64_t bytes);
+	uint32_t ImportResource(const std::string& name, uint64_t bytes, uint16_t initialState,
+		uint16_t finalState = KEEP_STATE);
+	uint32_t AddPass(const std::string& name, bool hasSideEffects = false);
+	void Read(uint32_t pass, uint32_t resource, uint16_t state);
+	void Write(uint32_t pass, uint32_t resource, uint16_t state);
+	void Modify(uint32_t pass, uint32_t resource, uint16_t state);
+
+	void BuildFrame(const FrameDesc& desc);
+
+	bool Compile();
+
+	const std::vector<Resource>& GetResources() const;
+	const std::vector<Pass>& GetPasses() const;
+	const std::vector<CompiledPass>& GetCompiledPasses() const;
+	const std::vector<Barrier>& GetFinalBarriers() const;
+	const std::vector<Lifetime>& GetLifetimes() const;	// Of the resources, First > Last if unused
+	uint32_t GetNumBarriers() const;
+	uint64_t GetTransientBytes() const;
+	uint64_t GetHeapBytes() const;
+	const std::string& GetError() const;
+
+	void Print(std::ostream& stream) const;
+
+	static std::string GetStateName(uint16_t state);
+	static const char* GetOITMethodName(uint8_t method);
+	static FrameDesc GetDefaultFrameDesc();
+	static EvaluationResult Evaluate(const EvaluationDesc& desc);
+
+	static const uint32_t NotFound = 0xffffffff;
+	static const uint64_t Alignment = 65536;
+
+protected:
+	void use(uint32_t pass, uint32_t resource, uint16_t state, uint8_t access);
+	bool cullPasses(std::vector<bool>& isLive);
+	void allocateTransients();
+	void placeBarriers();
+
+	std::vector<Resource>		m_resources;
+	std::vector<Pass>			m_passes;
+	std::vector<CompiledPass>	m_compiledPasses;
+	std::vector<Barrier>		m_finalBarriers;
+	std::vector<Lifetime>		m_lifetimes;
+	uint64_t					m_transientBytes;
+	uint64_t					m_heapBytes;
+	std::string					m_error;
+};
@@ -0,0 +1,240 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "RingAllocator.h"
+#include <chrono>
+#include <random>
+
+using namespace std;
+
+static inline uint64_t alignUp(uint64_t offset, uint64_t alignment)
+{
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+//--------------------------------------------------------------------------------------
+// Ring allocator
+//--------------------------------------------------------------------------------------
+RingAllocator::RingAllocator() :
+	m_capacity(0),
+	m_head(0),
+	m_tail(0),
+	m_usedBytes(0),
+	m_pendingBytes(0),
+	m_peakBytes(0),
+	m_numWraps(0)
+{
+}
+
+RingAllocator::~RingAllocator()
+{
+}
+
+void RingAllocator::Init(uint64_t capacity)
+{
+	m_submissions.clear();
+	m_capacity = capacity;
+	m_head = 0;
+	m_tail = 0;
+	m_usedBytes = 0;
+	m_pendingBytes = 0;
+	m_peakBytes = 0;
+	m_numWraps = 0;
+}
+
+bool RingAllocator::Allocate(uint64_t size, uint64_t alignment, uint64_t& offset)
+{
+	alignment = alignment ? alignment : 1;
+	if (size > m_capacity || m_usedBytes >= m_capacity) return false;
+
+	// Restart from the beginning of an empty ring
+	if (m_usedBytes == 0) m_head = m_tail = 0;
+
+	const auto alignedHead = alignUp(m_head, alignment);
+	uint64_t head;
+	if (m_head >= m_tail)
+	{
+		// Free are [head, capacity) and [0, tail)
+		if (alignedHead + size <= m_capacity)
+		{
+			offset = alignedHead;
+			head = alignedHead + size;
+		}
+		else if (size <= m_tail)
+		{
+			offset = 0;
+			head = size;
+			++m_numWraps;
+		}
+		else return false;
+	}
+	else
+	{
+		// Free is [head, tail)
+		if (alignedHead + size > m_tail) return false;
+		offset = alignedHead;
+		head = alignedHead + size;
+	}
+
+	// The alignment padding, and the skipped tail of a wrap, are used until reclaimed
+	const auto bytes = head >= m_head ? head - m_head : m_capacity - m_head + head;
+	m_head = head;
+	m_usedBytes += bytes;
+	m_pendingBytes += bytes;
+	m_peakBytes = (max)(m_peakBytes, m_usedBytes);
+
+	return true;
+}
+
+void RingAllocator::Submit(uint64_t fenceValue)
+{
+	if (m_pendingBytes == 0) return;
+
+	assert(m_submissions.empty() || fenceValue >= m_submissions.back().FenceValue);
+	m_submissions.push_back({ fenceValue, m_head, m_pendingBytes });
+	m_pendingBytes = 0;
+}
+
+void RingAllocator::Reclaim(uint64_t completedFenceValue)
+{
+	while (!m_submissions.empty() && m_submissions.front().FenceValue <= completedFenceValue)
+	{
+		const auto& submission = m_submissions.front();
+		m_tail = submission.End;
+		m_usedBytes -= submission.Bytes;
+		m_submissions.pop_front();
+	}
+}
+
+uint64_t RingAllocator::GetCapacity() const
+{
+	return m_capacity;
+}
+
+uint64_t RingAllocator::GetUsedBytes() const
+{
+	return m_usedBytes;
+}
+
+uint64_t RingAllocator::GetPeakBytes() const
+{
+	return m_peakBytes;
+}
+
+uint32_t RingAllocator::GetNumWraps() const
+{
+	return m_numWraps;
+}
+
+bool RingAllocator::HasPending() const
+{
+	return m_pendingBytes > 0;
+}
+
+//--------------------------------------------------------------------------------------
+// Evaluation
+//--------------------------------------------------------------------------------------
+RingAllocator::EvaluationResult RingAllocator::Evaluate(const EvaluationDesc& desc)
+{
+	EvaluationResult result = {};
+
+	// Ranges the simulated GPU may still read, with the fence values of their submissions, 0 if
+	// not yet submitted
+	struct Range
+	{
+		uint64_t Offset;
+		uint64_t Size;
+		uint64_t FenceValue;
+	};
+
+	// Vertex and index data, constants, and the placement of texture data
+	static const uint64_t alignments[] = { 4, 16, 256, 512 };
+
+	mt19937 rng(desc.Seed);
+	RingAllocator ring;
+	ring.Init(desc.Capacity);
+	vector<Range> ranges;
+	uint64_t submittedValue = 0, completedValue = 0;
+
+	const auto submit = [&]()
+	{
+		ring.Submit(++submittedValue);
+		for (auto& range : ranges) range.FenceValue = range.FenceValue ? range.FenceValue : submittedValue;
+	};
+
+	const auto complete = [&](uint64_t fenceValue)
+	{
+		completedValue = fenceValue;
+		ranges.erase(remove_if(ranges.begin(), ranges.end(), [completedValue](const Range& range)
+			{ return range.FenceValue && range.FenceValue <= completedValue; }), ranges.end());
+		ring.Reclaim(completedValue);
+	};
+
+	const uint64_t one = 1;
+	const auto maxSize = (max)((min)(desc.MaxSize, desc.Capacity), one);
+	for (auto i = 0u; i < desc.NumAllocations; ++i)
+	{
+		const auto numBytes = 1 + rng() % maxSize;
+		const auto alignment = alignments[rng() % size(alignments)];
+
+		// On a full ring, submit the pending allocations and wait for the oldest submission
+		uint64_t offset;
+		auto isAllocated = ring.Allocate(numBytes, alignment, offset);
+		while (!isAllocated && (ring.HasPending() || completedValue < submittedValue))
+		{
+			if (ring.HasPending()) submit();
+			complete(completedValue + 1);
+			isAllocated = ring.Allocate(numBytes, alignment, offset);
+			++result.NumStalls;
+		}
+
+		++result.NumAllocations;
+		if (!isAllocated || offset % alignment || offset + numBytes > desc.Capacity ||
+			any_of(ranges.cbegin(), ranges.cend(), [offset, numBytes](const Range& range)
+				{ return offset < range.Offset + range.Size && range.Offset < offset + numBytes; }))
+		{
+			++result.NumFailed;
+			continue;
+		}
+
+		ranges.push_back({ offset, numBytes, 0 });
+		result.TotalBytes += numBytes;
+
+		// Submit every few allocations; the simulated GPU completes at random, lagging at most
+		// the given submissions behind
+		if (rng() % 4 == 0) submit();
+		auto fenceValue = completedValue;
+		while (fenceValue < submittedValue && (submittedValue - fenceValue > desc.MaxInFlight || rng() % 3 == 0)) ++fenceValue;
+		if (fenceValue > completedValue) complete(fenceValue);
+	}
+
+	result.NumWraps = ring.GetNumWraps();
+	result.PeakBytes = ring.GetPeakBytes();
+
+	// Steady streaming of constant-sized allocations, completing a submission behind
+	const auto numAllocations = (max)(desc.NumAllocations, 1u);
+	ring.Init(desc.Capacity);
+	submittedValue = 0;
+	auto numFailed = 0u;
+	const auto startTime = chrono::steady_clock::now();
+	for (auto i = 0u; i < numAllocations; ++i)
+	{
+		uint64_t offset;
+		if (!ring.Allocate(256, 16, offset))
+		{
+			ring.Submit(++submittedValue);
+			ring.Reclaim(submittedValue);
+			numFailed += ring.Allocate(256, 16, offset) ? 0 : 1;
+		}
+		if (i % 8 == 7)
+		{
+			ring.Submit(++submittedValue);
+			ring.Reclaim(submittedValue - 1);
+		}
+	}
+	result.AllocateTime = chrono::duration<double, nano>(chrono::steady_clock::now() - startTime).count() / numAllocations;
+	result.NumFailed += numFailed;
+
+	return result;
+}
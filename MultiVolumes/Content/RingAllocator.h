@@ -0,0 +1,71 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <deque>
+
+// Linear allocator over a fixed-size ring, recycled by fence values. Allocations are made at
+// the head with their alignment, wrapping to the beginning when the end of the ring is too
+// short, in which case the skipped tail counts as used. Submit() closes the allocations made
+// since the previous submission under the fence value signaled after them, and Reclaim() frees
+// the submissions whose fence values have completed, oldest first. The allocator only hands out
+// offsets; UploadRing maps them into an upload buffer.
+class RingAllocator
+{
+public:
+	struct EvaluationDesc
+	{
+		uint32_t NumAllocations;
+		uint64_t Capacity;
+		uint64_t MaxSize;			// Of an allocation
+		uint32_t MaxInFlight;		// Submissions the simulated GPU may lag behind
+		uint32_t Seed;
+	};
+
+	struct EvaluationResult
+	{
+		uint32_t NumAllocations;
+		uint32_t NumFailed;			// Misaligned, out of the ring, over a range in flight, or failing
+									// with nothing in flight
+		uint32_t NumStalls;			// Waits on the simulated fence for a full ring
+		uint32_t NumWraps;
+		uint64_t TotalBytes;		// Of the allocations, as staged by one resource each
+		uint64_t PeakBytes;			// Of the ring
+		double AllocateTime;		// Per allocation, in nanoseconds
+	};
+
+	RingAllocator();
+	virtual ~RingAllocator();
+
+	void Init(uint64_t capacity);
+	bool Allocate(uint64_t size, uint64_t alignment, uint64_t& offset);
+	void Submit(uint64_t fenceValue);
+	void Reclaim(uint64_t completedFenceValue);
+
+	uint64_t GetCapacity() const;
+	uint64_t GetUsedBytes() const;	// Including the skipped tails
+	uint64_t GetPeakBytes() const;
+	uint32_t GetNumWraps() const;
+	bool HasPending() const;		// Allocations not yet submitted
+
+	static EvaluationResult Evaluate(const EvaluationDesc& desc);
+
+protected:
+	struct Submission
+	{
+		uint64_t FenceValue;
+		uint64_t End;				// Head after its last allocation
+		uint64_t Bytes;
+	};
+
+	std::deque<Submission> m_submissions;	// Oldest first
+	uint64_t	m_capacity;
+	uint64_t	m_head;
+	uint64_t	m_tail;
+	uint64_t	m_usedBytes;
+	uint64_t	m_pendingBytes;
+	uint64_t	m_peakBytes;
+	uint32_t	m_numWraps;
+};
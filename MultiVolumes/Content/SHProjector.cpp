@@ -0,0 +1,454 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SHProjector.h"
+#include "CubeMapFile.h"
+#include "ParallelFor.h"
+#include <chrono>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+// Lanes of texels in a row, 8 with AVX2 and 1 otherwise
+//--------------------------------------------------------------------------------------
+#if defined(__AVX2__)
+struct Lanes { __m256 v; };
+static const uint32_t g_numLanes = 8;
+
+static inline Lanes lanes(float s) { return { _mm256_set1_ps(s) }; }
+static inline Lanes load(const float* p) { return { _mm256_loadu_ps(p) }; }
+static inline void store(float* p, Lanes a) { _mm256_storeu_ps(p, a.v); }
+static inline Lanes operator+(Lanes a, Lanes b) { return { _mm256_add_ps(a.v, b.v) }; }
+static inline Lanes operator-(Lanes a, Lanes b) { return { _mm256_sub_ps(a.v, b.v) }; }
+static inline Lanes operator*(Lanes a, Lanes b) { return { _mm256_mul_ps(a.v, b.v) }; }
+static inline Lanes vfma(Lanes a, Lanes b, Lanes c) { return { _mm256_add_ps(_mm256_mul_ps(a.v, b.v), c.v) }; }
+#else
+struct Lanes { float v; };
+static const uint32_t g_numLanes = 1;
+
+static inline Lanes lanes(float s) { return { s }; }
+static inline Lanes load(const float* p) { return { *p }; }
+static inline void store(float* p, Lanes a) { *p = a.v; }
+static inline Lanes operator+(Lanes a, Lanes b) { return { a.v + b.v }; }
+static inline Lanes operator-(Lanes a, Lanes b) { return { a.v - b.v }; }
+static inline Lanes operator*(Lanes a, Lanes b) { return { a.v * b.v }; }
+static inline Lanes vfma(Lanes a, Lanes b, Lanes c) { return { a.v * b.v + c.v }; }
+#endif
+
+static inline float splat(float s, float) { return s; }
+static inline Lanes splat(float s, Lanes) { return lanes(s); }
+
+static const uint8_t g_faceCount = CubeMapFile::FaceCount;
+static const uint8_t g_maxNumCoeffs = SHProjector::MaxOrder * SHProjector::MaxOrder;
+
+//--------------------------------------------------------------------------------------
+// Real SH with the Condon-Shortley phase, the same basis as XMSHEvalDirection(). The
+// associated Legendre polynomials are divided by sin^m(theta), which is carried by
+// cos(m phi) and sin(m phi) in x and y instead.
+//--------------------------------------------------------------------------------------
+struct BasisConsts
+{
+	float Norms[SHProjector::MaxOrder][SHProjector::MaxOrder];	// K(l, m), times sqrt(2) for m > 0
+	float Pmm[SHProjector::MaxOrder];							// (-1)^m (2m - 1)!!
+	float A[SHProjector::MaxOrder][SHProjector::MaxOrder];		// (2l - 1) / (l - m)
+	float B[SHProjector::MaxOrder][SHProjector::MaxOrder];		// (l + m - 1) / (l - m)
+};
+
+static const BasisConsts& getBasisConsts()
+{
+	static const auto consts = []()
+	{
+		BasisConsts c = {};
+		auto pmm = 1.0;
+		for (auto m = 0; m < SHProjector::MaxOrder; ++m)
+		{
+			if (m > 0) pmm *= -(2.0 * m - 1.0);
+			c.Pmm[m] = static_cast<float>(pmm);
+
+			for (auto l = m; l < SHProjector::MaxOrder; ++l)
+			{
+				auto factorialRatio = 1.0;	// (l - m)! / (l + m)!
+				for (auto i = l - m + 1; i <= l + m; ++i) factorialRatio /= i;
+				const auto norm = sqrt((2.0 * l + 1.0) / (4.0 * XM_PI) * factorialRatio);
+				c.Norms[l][m] = static_cast<float>(m > 0 ? sqrt(2.0) * norm : norm);
+
+				if (l > m)
+				{
+					c.A[l][m] = static_cast<float>(2 * l - 1) / (l - m);
+					c.B[l][m] = static_cast<float>(l + m - 1) / (l - m);
+				}
+			}
+		}
+
+		return c;
+	}();
+
+	return consts;
+}
+
+template<typename T>
+static void evaluateBasis(const T& x, const T& y, const T& z, uint8_t order, T* pBasis)
+{
+	const auto& consts = getBasisConsts();
+
+	auto c = splat(1.0f, x), s = splat(0.0f, x);
+	for (uint8_t m = 0; m < order; ++m)
+	{
+		if (m > 0)
+		{
+			const auto cm = x * c - y * s;
+			s = x * s + y * c;
+			c = cm;
+		}
+
+		auto p0 = splat(consts.Pmm[m], x), p1 = p0;
+		for (uint8_t l = m; l < order; ++l)
+		{
+			auto p = p0;
+			if (l == m + 1) p1 = p = z * splat((2.0f * m + 1.0f) * consts.Pmm[m], x);
+			else if (l > m + 1)
+			{
+				p = z * splat(consts.A[l][m], x) * p1 - splat(consts.B[l][m], x) * p0;
+				p0 = p1;
+				p1 = p;
+			}
+
+			const auto kp = splat(consts.Norms[l][m], x) * p;
+			if (m == 0) pBasis[l * l + l] = kp;
+			else
+			{
+				pBasis[l * l + l + m] = kp * c;
+				pBasis[l * l + l - m] = kp * s;
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Cube-map texels
+//--------------------------------------------------------------------------------------
+static XMFLOAT3 getTexelDir(uint32_t x, uint32_t y, uint8_t face, uint32_t size)
+{
+	// D3D cube addressing, as SHProjectCubeMap() in DirectXSH
+	const auto u = (x + 0.5f) / size * 2.0f - 1.0f;
+	const auto v = -((y + 0.5f) / size * 2.0f - 1.0f);
+
+	XMFLOAT3 dir;
+	switch (face)
+	{
+	case 0: dir = XMFLOAT3(1.0f, v, -u); break;		// +X
+	case 1: dir = XMFLOAT3(-1.0f, v, u); break;		// -X
+	case 2: dir = XMFLOAT3(u, 1.0f, -v); break;		// +Y
+	case 3: dir = XMFLOAT3(u, -1.0f, v); break;		// -Y
+	case 4: dir = XMFLOAT3(u, v, 1.0f); break;		// +Z
+	default: dir = XMFLOAT3(-u, v, -1.0f); break;	// -Z
+	}
+
+	const auto rcpLen = 1.0f / sqrtf(dir.x * dir.x + dir.y * dir.y + dir.z * dir.z);
+
+	return XMFLOAT3(dir.x * rcpLen, dir.y * rcpLen, dir.z * rcpLen);
+}
+
+static double areaElement(double x, double y)
+{
+	return atan2(x * y, sqrt(x * x + y * y + 1.0));
+}
+
+static string narrowPath(const wstring& fileName)
+{
+	string name(fileName.size(), '\0');
+	for (size_t i = 0; i < name.size(); ++i) name[i] = static_cast<char>(fileName[i]);
+
+	return name;
+}
+
+//--------------------------------------------------------------------------------------
+// Coefficient cache: magic, order and the hash of the radiance DDS, then the coefficients
+//--------------------------------------------------------------------------------------
+struct SHCacheHeader
+{
+	uint32_t Magic;
+	uint32_t Order;
+	uint64_t Hash;
+};
+
+static const uint32_t g_cacheMagic = 0x31434853;	// "SHC1"
+
+SHProjector::SHProjector() :
+	m_faceSize(0),
+	m_order(0),
+	m_isCached(false)
+{
+}
+
+SHProjector::~SHProjector()
+{
+}
+
+void SHProjector::Project(const XMFLOAT4* pTexels, uint32_t faceSize, uint8_t order)
+{
+	m_order = (min)((max)(order, static_cast<uint8_t>(1)), MaxOrder);
+	m_isCached = false;
+	const uint32_t numCoeffs = m_order * m_order;
+
+	// Exact solid angles of the texels of a face
+	if (m_faceSize != faceSize)
+	{
+		m_faceSize = faceSize;
+		m_solidAngles.resize(faceSize * faceSize);
+		for (auto y = 0u; y < faceSize; ++y)
+		{
+			const auto v0 = 2.0 * y / faceSize - 1.0, v1 = 2.0 * (y + 1) / faceSize - 1.0;
+			for (auto x = 0u; x < faceSize; ++x)
+			{
+				const auto u0 = 2.0 * x / faceSize - 1.0, u1 = 2.0 * (x + 1) / faceSize - 1.0;
+				m_solidAngles[faceSize * y + x] = static_cast<float>(areaElement(u0, v0) -
+					areaElement(u0, v1) - areaElement(u1, v0) + areaElement(u1, v1));
+			}
+		}
+	}
+
+	// Per-row sums of the weighted radiance in RGB per coefficient, then the weight
+	const auto numSums = 3 * numCoeffs + 1;
+	const auto numRows = g_faceCount * faceSize;
+	const auto rowPitch = (faceSize + g_numLanes - 1) / g_numLanes * g_numLanes;
+	vector<double> rowSums(static_cast<size_t>(numSums) * numRows);
+	ParallelFor(numRows, 4, [&](uint32_t begin, uint32_t end)
+	{
+		// Structure of arrays: direction, weighted radiance and weight; the tail has zero weights
+		vector<float> soa(7 * rowPitch, 0.0f);
+		float* const pDirs[] = { &soa[0], &soa[rowPitch], &soa[2 * rowPitch] };
+		float* const pWeighted[] = { &soa[3 * rowPitch], &soa[4 * rowPitch], &soa[5 * rowPitch] };
+		const auto pWeights = &soa[6 * rowPitch];
+
+		Lanes sums[3 * g_maxNumCoeffs + 1], basis[g_maxNumCoeffs];
+		for (auto row = begin; row < end; ++row)
+		{
+			const auto face = static_cast<uint8_t>(row / faceSize);
+			const auto y = row % faceSize;
+			for (auto x = 0u; x < faceSize; ++x)
+			{
+				const auto dir = getTexelDir(x, y, face, faceSize);
+				const auto& texel = pTexels[faceSize * row + x];
+				const auto weight = m_solidAngles[faceSize * y + x];
+				pDirs[0][x] = dir.x;
+				pDirs[1][x] = dir.y;
+				pDirs[2][x] = dir.z;
+				pWeighted[0][x] = texel.x * weight;
+				pWeighted[1][x] = texel.y * weight;
+				pWeighted[2][x] = texel.z * weight;
+				pWeights[x] = weight;
+			}
+
+			for (auto i = 0u; i < numSums; ++i) sums[i] = lanes(0.0f);
+			for (auto x = 0u; x < rowPitch; x += g_numLanes)
+			{
+				evaluateBasis(load(&pDirs[0][x]), load(&pDirs[1][x]), load(&pDirs[2][x]), m_order, basis);
+				const Lanes weighted[] = { load(&pWeighted[0][x]), load(&pWeighted[1][x]), load(&pWeighted[2][x]) };
+				for (auto k = 0u; k < numCoeffs; ++k)
+					for (uint8_t j = 0; j < 3; ++j)
+						sums[3 * k + j] = vfma(basis[k], weighted[j], sums[3 * k + j]);
+				sums[numSums - 1] = sums[numSums - 1] + load(&pWeights[x]);
+			}
+
+			// Lanes are summed in a fixed order
+			const auto pRowSums = &rowSums[static_cast<size_t>(numSums) * row];
+			float laneValues[g_numLanes];
+			for (auto i = 0u; i < numSums; ++i)
+			{
+				store(laneValues, sums[i]);
+				pRowSums[i] = 0.0;
+				for (const auto& value : laneValues) pRowSums[i] += value;
+			}
+		}
+	});
+
+	// Deterministic reduction over the rows, and the normalization of SH_NORMALIZE
+	vector<double> totals(numSums, 0.0);
+	for (auto row = 0u; row < numRows; ++row)
+		for (auto i = 0u; i < numSums; ++i)
+			totals[i] += rowSums[static_cast<size_t>(numSums) * row + i];
+
+	const auto normScale = 4.0 * XM_PI / totals[numSums - 1];
+	m_coeffs.resize(numCoeffs);
+	for (auto k = 0u; k < numCoeffs; ++k)
+		m_coeffs[k] = XMFLOAT3(static_cast<float>(totals[3 * k] * normScale),
+			static_cast<float>(totals[3 * k + 1] * normScale), static_cast<float>(totals[3 * k + 2] * normScale));
+}
+
+bool SHProjector::Load(const wstring& fileName, uint8_t order, const wstring& cacheFileName)
+{
+	order = (min)((max)(order, static_cast<uint8_t>(1)), MaxOrder);
+
+	vector<uint8_t> data;
+	if (!CubeMapFile::ReadFile(fileName, data)) return false;
+
+	const auto hash = HashFNV1a(data.data(), data.size());
+	const auto cacheFile = cacheFileName.empty() ? fileName + L".sh" : cacheFileName;
+	if (loadCache(cacheFile, hash, order)) return true;
+
+	vector<XMFLOAT4> texels;
+	uint32_t faceSize;
+	if (!CubeMapFile::Decode(data.data(), data.size(), MaxFaceSize, texels, faceSize)) return false;
+	Project(texels.data(), faceSize, order);
+
+	// A read-only asset folder only costs the projection at the next startup
+	saveCache(cacheFile, hash);
+
+	return true;
+}
+
+const XMFLOAT3* SHProjector::GetSHCoefficients() const
+{
+	return m_coeffs.data();
+}
+
+uint8_t SHProjector::GetOrder() const
+{
+	return m_order;
+}
+
+bool SHProjector::IsCached() const
+{
+	return m_isCached;
+}
+
+void SHProjector::EvaluateBasis(const XMFLOAT3& dir, uint8_t order, float* pBasis)
+{
+	evaluateBasis(dir.x, dir.y, dir.z, (min)(order, MaxOrder), pBasis);
+}
+
+uint64_t SHProjector::HashFNV1a(const void* pData, size_t size, uint64_t hash)
+{
+	const auto pBytes = static_cast<const uint8_t*>(pData);
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= pBytes[i];
+		hash *= 0x100000001b3;
+	}
+
+	return hash;
+}
+
+SHProjector::EvaluationResult SHProjector::Evaluate(const EvaluationDesc& desc)
+{
+	EvaluationResult result = {};
+	const auto order = (min)((max)(desc.Order, static_cast<uint8_t>(1)), MaxOrder);
+	const uint32_t numCoeffs = order * order;
+	const auto faceSize = (max)(desc.FaceSize, 1u);
+
+	// Band-limited test environment, whose projection is known in closed form
+	vector<XMFLOAT3> refCoeffs(numCoeffs);
+	for (auto k = 0u; k < numCoeffs; ++k)
+		refCoeffs[k] = XMFLOAT3(1.0f / (k + 1), 0.5f * cosf(static_cast<float>(k)), 0.25f * sinf(k + 1.0f));
+
+	vector<XMFLOAT4> texels(g_faceCount * faceSize * faceSize);
+	float basis[g_maxNumCoeffs];
+	for (uint8_t face = 0; face < g_faceCount; ++face)
+	{
+		for (auto y = 0u; y < faceSize; ++y)
+		{
+			for (auto x = 0u; x < faceSize; ++x)
+			{
+				EvaluateBasis(getTexelDir(x, y, face, faceSize), order, basis);
+				auto& texel = texels[faceSize * (faceSize * face + y) + x];
+				texel = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+				for (auto k = 0u; k < numCoeffs; ++k)
+				{
+					texel.x += refCoeffs[k].x * basis[k];
+					texel.y += refCoeffs[k].y * basis[k];
+					texel.z += refCoeffs[k].z * basis[k];
+				}
+			}
+		}
+	}
+
+	SHProjector projector;
+	projector.Project(texels.data(), faceSize, order);	// Warms the solid-angle table
+	auto startTime = chrono::steady_clock::now();
+	projector.Project(texels.data(), faceSize, order);
+	result.ProjectTime = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+
+	// Scalar replica of SH_CUBE_MAP, SH_SUM and SH_NORMALIZE, with differential solid angles
+	startTime = chrono::steady_clock::now();
+	vector<double> shaderSums(3 * numCoeffs, 0.0);
+	auto weightSum = 0.0;
+	for (uint8_t face = 0; face < g_faceCount; ++face)
+	{
+		for (auto y = 0u; y < faceSize; ++y)
+		{
+			const auto v = (y + 0.5f) / faceSize * 2.0f - 1.0f;
+			for (auto x = 0u; x < faceSize; ++x)
+			{
+				const auto u = (x + 0.5f) / faceSize * 2.0f - 1.0f;
+				const auto temp = 1.0f + u * u + v * v;
+				const auto weight = 4.0f / (sqrtf(temp) * temp);
+				const auto& texel = texels[faceSize * (faceSize * face + y) + x];
+				EvaluateBasis(getTexelDir(x, y, face, faceSize), order, basis);
+				for (auto k = 0u; k < numCoeffs; ++k)
+				{
+					shaderSums[3 * k] += basis[k] * texel.x * weight;
+					shaderSums[3 * k + 1] += basis[k] * texel.y * weight;
+					shaderSums[3 * k + 2] += basis[k] * texel.z * weight;
+				}
+				weightSum += weight;
+			}
+		}
+	}
+	result.ShaderTime = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+
+	const auto pCoeffs = projector.GetSHCoefficients();
+	const auto normScale = 4.0 * XM_PI / weightSum;
+	for (auto k = 0u; k < numCoeffs; ++k)
+	{
+		const float* const coeff = &pCoeffs[k].x;
+		const float* const refCoeff = &refCoeffs[k].x;
+		for (uint8_t j = 0; j < 3; ++j)
+		{
+			const auto shaderCoeff = static_cast<float>(shaderSums[3 * k + j] * normScale);
+			result.MaxAnalyticError = (max)(result.MaxAnalyticError, fabsf(coeff[j] - refCoeff[j]));
+			result.MaxShaderError = (max)(result.MaxShaderError, fabsf(coeff[j] - shaderCoeff));
+		}
+	}
+
+	return result;
+}
+
+bool SHProjector::loadCache(const wstring& cacheFileName, uint64_t hash, uint8_t order)
+{
+	ifstream file(narrowPath(cacheFileName), ios::binary);
+	if (!file) return false;
+
+	// Coefficients of a higher order hold those of the lower orders
+	SHCacheHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.Magic != g_cacheMagic || header.Hash != hash ||
+		header.Order < order || header.Order > MaxOrder) return false;
+
+	m_coeffs.resize(order * order);
+	file.read(reinterpret_cast<char*>(m_coeffs.data()), sizeof(XMFLOAT3) * m_coeffs.size());
+	if (!file) return false;
+
+	m_order = order;
+	m_isCached = true;
+
+	return true;
+}
+
+bool SHProjector::saveCache(const wstring& cacheFileName, uint64_t hash) const
+{
+	ofstream file(narrowPath(cacheFileName), ios::binary);
+	if (!file) return false;
+
+	const SHCacheHeader header = { g_cacheMagic, m_order, hash };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(m_coeffs.data()), sizeof(XMFLOAT3) * m_coeffs.size());
+
+	return static_cast<bool>(file);
+}
@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// CPU counterpart of XUSG::SphericalHarmonics::Transform(), projecting a radiance cube map
+// onto SH of orders 1 to 5 with the basis of XMSHEvalDirection(). Texels are weighted by
+// their exact solid angles and accumulated 8 at a time with AVX2, in parallel over face
+// rows; the row sums are reduced in a fixed order, so the results are deterministic. As
+// SH_NORMALIZE, the sums are scaled by 4 PI over the total weight. The coefficients of the
+// -radiance cube map are cached as <radiance>.sh.
+class SHProjector
+{
+public:
+	struct EvaluationDesc
+	{
+		uint32_t FaceSize;
+		uint8_t Order;
+	};
+
+	struct EvaluationResult
+	{
+		float MaxAnalyticError;	// Against the closed-form projection of the test environment
+		float MaxShaderError;	// Against the differential weights of the SH_CUBE_MAP shader
+		double ProjectTime;		// In milliseconds
+		double ShaderTime;		// Of the scalar replica of the shader, in milliseconds
+	};
+
+	SHProjector();
+	virtual ~SHProjector();
+
+	// Faces in the D3D order, as CubeMapFile
+	void Project(const DirectX::XMFLOAT4* pTexels, uint32_t faceSize, uint8_t order);
+
+	// Loads the coefficients cached for the radiance DDS, or projects it and updates the
+	// cache. The cache file defaults to <fileName>.sh and is keyed by a hash of the DDS.
+	bool Load(const std::wstring& fileName, uint8_t order, const std::wstring& cacheFileName = L"");
+
+	const DirectX::XMFLOAT3* GetSHCoefficients() const;
+	uint8_t GetOrder() const;
+	bool IsCached() const;
+
+	static void EvaluateBasis(const DirectX::XMFLOAT3& dir, uint8_t order, float* pBasis);
+	static uint64_t HashFNV1a(const void* pData, size_t size, uint64_t hash = 0xcbf29ce484222325);
+	static EvaluationResult Evaluate(const EvaluationDesc& desc);
+
+	static const uint8_t MaxOrder = 5;
+	static const uint32_t MaxFaceSize = 256;	// SH_TEX_SIZE
+
+protected:
+	bool loadCache(const std::wstring& cacheFileName, uint64_t hash, uint8_t order);
+	bool saveCache(const std::wstring& cacheFileName, uint64_t hash) const;
+
+	std::vector<DirectX::XMFLOAT3> m_coeffs;
+	std::vector<float>		m_solidAngles;	// Of a face, shared by all faces
+
+	uint32_t				m_faceSize;
+	uint8_t					m_order;
+	bool					m_isCached;
+};
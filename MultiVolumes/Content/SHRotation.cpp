@@ -0,0 +1,237 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SHRotation.h"
+#include "SHProjector.h"
+#include "ParallelFor.h"
+#include <chrono>
+
+using namespace std;
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+// Recurrence of Ivanic and Ruedenberg, on band matrices indexed by m in [-l, l]
+//--------------------------------------------------------------------------------------
+static inline double centered(const vector<double>& r, int l, int i, int j)
+{
+	return r[(2 * l + 1) * (i + l) + j + l];
+}
+
+static double funcP(int i, int a, int b, int l, const vector<double>& r1, const vector<double>& rPrev)
+{
+	if (b == l)
+		return centered(r1, 1, i, 1) * centered(rPrev, l - 1, a, l - 1) -
+			centered(r1, 1, i, -1) * centered(rPrev, l - 1, a, -l + 1);
+	else if (b == -l)
+		return centered(r1, 1, i, 1) * centered(rPrev, l - 1, a, -l + 1) +
+			centered(r1, 1, i, -1) * centered(rPrev, l - 1, a, l - 1);
+
+	return centered(r1, 1, i, 0) * centered(rPrev, l - 1, a, b);
+}
+
+static vector<double> computeBandRotation(int l, const vector<double>& r1, const vector<double>& rPrev)
+{
+	vector<double> r((2 * l + 1) * (2 * l + 1));
+	for (auto m = -l; m <= l; ++m)
+	{
+		const auto am = abs(m);
+		const auto d = m == 0 ? 1.0 : 0.0;
+		for (auto n = -l; n <= l; ++n)
+		{
+			const auto denom = abs(n) == l ? 2.0 * l * (2.0 * l - 1.0) : static_cast<double>((l + n) * (l - n));
+			auto u = sqrt((l + m) * (l - m) / denom);
+			auto v = 0.5 * sqrt((1.0 + d) * (l + am - 1.0) * (l + am) / denom) * (1.0 - 2.0 * d);
+			auto w = -0.5 * sqrt((l - am - 1.0) * (l - am) / denom) * (1.0 - d);
+
+			if (u != 0.0) u *= funcP(0, m, n, l, r1, rPrev);
+			if (v != 0.0)
+			{
+				// With the errata for m < 0
+				if (m == 0) v *= funcP(1, 1, n, l, r1, rPrev) + funcP(-1, -1, n, l, r1, rPrev);
+				else if (m > 0) v *= funcP(1, m - 1, n, l, r1, rPrev) * (m == 1 ? sqrt(2.0) : 1.0) -
+					(m == 1 ? 0.0 : funcP(-1, -m + 1, n, l, r1, rPrev));
+				else v *= (m == -1 ? 0.0 : funcP(1, m + 1, n, l, r1, rPrev)) +
+					funcP(-1, -m - 1, n, l, r1, rPrev) * (m == -1 ? sqrt(2.0) : 1.0);
+			}
+			if (w != 0.0)
+			{
+				if (m > 0) w *= funcP(1, m + 1, n, l, r1, rPrev) + funcP(-1, -m - 1, n, l, r1, rPrev);
+				else w *= funcP(1, m - 1, n, l, r1, rPrev) - funcP(-1, -m + 1, n, l, r1, rPrev);
+			}
+
+			r[(2 * l + 1) * (m + l) + n + l] = u + v + w;
+		}
+	}
+
+	return r;
+}
+
+static inline uint32_t getBandOffset(uint32_t l)
+{
+	// Sum of (2k + 1)^2 over the lower bands
+	return l * (2 * l - 1) * (2 * l + 1) / 3;
+}
+
+SHRotation::SHRotation() :
+	m_order(0)
+{
+}
+
+SHRotation::~SHRotation()
+{
+}
+
+void SHRotation::Init(FXMMATRIX rotation, uint8_t order)
+{
+	m_order = (min)((max)(order, static_cast<uint8_t>(1)), MaxOrder);
+	m_bandMatrices.resize(getBandOffset(m_order));
+	m_bandMatrices[0] = 1.0f;
+	if (m_order < 2) return;
+
+	// Column-vector rotation, permuted to the real SH order of band 1, (y, z, x)
+	XMFLOAT3X3 m;
+	XMStoreFloat3x3(&m, rotation);
+	const auto r = [&m](int i, int j) { return static_cast<double>(m.m[j][i]); };
+	const vector<double> r1 =
+	{
+		r(1, 1), r(1, 2), r(1, 0),
+		r(2, 1), r(2, 2), r(2, 0),
+		r(0, 1), r(0, 2), r(0, 0)
+	};
+
+	// The recurrence is on the SH without the Condon-Shortley phase, which flips the
+	// signs of odd m in the basis of SHProjector
+	auto rPrev = r1;
+	for (auto l = 1; l < m_order; ++l)
+	{
+		if (l > 1) rPrev = computeBandRotation(l, r1, rPrev);
+
+		const auto pBand = &m_bandMatrices[getBandOffset(l)];
+		for (auto i = 0; i <= 2 * l; ++i)
+			for (auto j = 0; j <= 2 * l; ++j)
+				pBand[(2 * l + 1) * i + j] = static_cast<float>(((i + j) & 1) ? -rPrev[(2 * l + 1) * i + j] : rPrev[(2 * l + 1) * i + j]);
+	}
+}
+
+void SHRotation::Rotate(const XMFLOAT3* pSrcCoeffs, XMFLOAT3* pDstCoeffs) const
+{
+	XMFLOAT3 temp[2 * MaxOrder - 1];
+	pDstCoeffs[0] = pSrcCoeffs[0];
+	for (uint32_t l = 1; l < m_order; ++l)
+	{
+		const auto bandSize = 2 * l + 1;
+		const auto pBand = &m_bandMatrices[getBandOffset(l)];
+		const auto pSrc = &pSrcCoeffs[l * l];
+		for (auto i = 0u; i < bandSize; ++i)
+		{
+			temp[i] = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			for (auto j = 0u; j < bandSize; ++j)
+			{
+				const auto& weight = pBand[bandSize * i + j];
+				temp[i].x += weight * pSrc[j].x;
+				temp[i].y += weight * pSrc[j].y;
+				temp[i].z += weight * pSrc[j].z;
+			}
+		}
+		memcpy(&pDstCoeffs[l * l], temp, sizeof(XMFLOAT3) * bandSize);
+	}
+}
+
+void SHRotation::RotateBatch(const XMFLOAT3* pSrcCoeffs, XMFLOAT3* pDstCoeffs, uint32_t numProbes) const
+{
+	const uint32_t numCoeffs = m_order * m_order;
+	ParallelFor(numProbes, 256, [&](uint32_t begin, uint32_t end)
+	{
+		XMVECTOR src[2 * MaxOrder - 1];
+		for (auto p = begin; p < end; ++p)
+		{
+			const auto pSrc = &pSrcCoeffs[numCoeffs * p];
+			const auto pDst = &pDstCoeffs[numCoeffs * p];
+			pDst[0] = pSrc[0];
+			for (uint32_t l = 1; l < m_order; ++l)
+			{
+				const auto bandSize = 2 * l + 1;
+				const auto pBand = &m_bandMatrices[getBandOffset(l)];
+				for (auto j = 0u; j < bandSize; ++j) src[j] = XMLoadFloat3(&pSrc[l * l + j]);
+				for (auto i = 0u; i < bandSize; ++i)
+				{
+					auto dst = XMVectorZero();
+					for (auto j = 0u; j < bandSize; ++j)
+						dst = XMVectorMultiplyAdd(XMVectorReplicate(pBand[bandSize * i + j]), src[j], dst);
+					XMStoreFloat3(&pDst[l * l + i], dst);
+				}
+			}
+		}
+	});
+}
+
+const float* SHRotation::GetBandMatrix(uint8_t l) const
+{
+	return l < m_order ? &m_bandMatrices[getBandOffset(l)] : nullptr;
+}
+
+uint8_t SHRotation::GetOrder() const
+{
+	return m_order;
+}
+
+SHRotation::EvaluationResult SHRotation::Evaluate(const EvaluationDesc& desc)
+{
+	EvaluationResult result = {};
+	const auto order = (min)((max)(desc.Order, static_cast<uint8_t>(1)), MaxOrder);
+	const uint32_t numCoeffs = order * order;
+	const auto numProbes = (max)(desc.NumProbes, 1u);
+
+	// Deterministic pseudo-random probes
+	auto seed = 1u;
+	const auto random = [&seed]()
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return static_cast<float>(seed >> 8) / (1u << 24) * 2.0f - 1.0f;
+	};
+	vector<XMFLOAT3> probes(numCoeffs * numProbes), rotated(probes.size()), batched(probes.size());
+	for (auto& coeff : probes) coeff = XMFLOAT3(random(), random(), random());
+
+	const auto rotation = XMMatrixRotationRollPitchYaw(0.3f, 1.1f, -0.7f);
+	SHRotation shRotation;
+	auto startTime = chrono::steady_clock::now();
+	shRotation.Init(rotation, order);
+	result.InitTime = chrono::duration<double, micro>(chrono::steady_clock::now() - startTime).count();
+
+	startTime = chrono::steady_clock::now();
+	for (auto p = 0u; p < numProbes; ++p)
+		shRotation.Rotate(&probes[numCoeffs * p], &rotated[numCoeffs * p]);
+	result.RotateTime = chrono::duration<double, micro>(chrono::steady_clock::now() - startTime).count() / numProbes;
+
+	startTime = chrono::steady_clock::now();
+	shRotation.RotateBatch(probes.data(), batched.data(), numProbes);
+	result.BatchTime = chrono::duration<double, micro>(chrono::steady_clock::now() - startTime).count() / numProbes;
+
+	// The rotated expansion at rotated directions equals the original one
+	float basis[SHProjector::MaxOrder * SHProjector::MaxOrder], rotatedBasis[SHProjector::MaxOrder * SHProjector::MaxOrder];
+	for (auto i = 0u; i < desc.NumDirs; ++i)
+	{
+		XMFLOAT3 dir, rotatedDir;
+		XMStoreFloat3(&dir, XMVector3Normalize(XMVectorSet(random(), random(), random(), 0.0f)));
+		XMStoreFloat3(&rotatedDir, XMVector3TransformNormal(XMLoadFloat3(&dir), rotation));
+		SHProjector::EvaluateBasis(dir, order, basis);
+		SHProjector::EvaluateBasis(rotatedDir, order, rotatedBasis);
+
+		const auto p = i % numProbes;
+		for (const auto& coeffs : { rotated.data(), batched.data() })
+		{
+			auto value = XMVectorZero(), rotatedValue = XMVectorZero();
+			for (auto k = 0u; k < numCoeffs; ++k)
+			{
+				value += XMLoadFloat3(&probes[numCoeffs * p + k]) * basis[k];
+				rotatedValue += XMLoadFloat3(&coeffs[numCoeffs * p + k]) * rotatedBasis[k];
+			}
+			XMFLOAT3 error;
+			XMStoreFloat3(&error, XMVectorAbs(value - rotatedValue));
+			result.MaxError = (max)(result.MaxError, (max)(error.x, (max)(error.y, error.z)));
+		}
+	}
+
+	return result;
+}
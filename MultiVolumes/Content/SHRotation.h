@@ -0,0 +1,52 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Rotation of SH coefficients in the basis of SHProjector, as if the environment were
+// rotated by a 3x3 matrix (DirectXMath row-vector convention). Band 1 is a signed
+// permutation of the matrix, and each higher band follows from the previous one by the
+// recurrence of Ivanic and Ruedenberg (1996, with the 1998 errata). The band matrices are
+// built once per rotation, so the probes are rotated by small matrix products only.
+class SHRotation
+{
+public:
+	struct EvaluationDesc
+	{
+		uint32_t NumProbes;
+		uint32_t NumDirs;		// Directions the rotated expansions are compared at
+		uint8_t Order;
+	};
+
+	struct EvaluationResult
+	{
+		float MaxError;			// Against the original expansion at the unrotated directions
+		double InitTime;		// In microseconds
+		double RotateTime;		// Per probe, in microseconds
+		double BatchTime;		// Per probe, in microseconds
+	};
+
+	SHRotation();
+	virtual ~SHRotation();
+
+	void Init(DirectX::FXMMATRIX rotation, uint8_t order);
+
+	// The source and destination may be the same
+	void Rotate(const DirectX::XMFLOAT3* pSrcCoeffs, DirectX::XMFLOAT3* pDstCoeffs) const;
+
+	// Probes of order^2 coefficients each, over RGB at once with DirectXMath and in
+	// parallel over probes
+	void RotateBatch(const DirectX::XMFLOAT3* pSrcCoeffs, DirectX::XMFLOAT3* pDstCoeffs, uint32_t numProbes) const;
+
+	const float* GetBandMatrix(uint8_t l) const;
+	uint8_t GetOrder() const;
+
+	static EvaluationResult Evaluate(const EvaluationDesc& desc);
+
+	static const uint8_t MaxOrder = 5;	// As SHProjector
+
+protected:
+	std::vector<float> m_bandMatrices;	// Row-major (2l + 1)^2 for each band l
+	uint8_t m_order;
+};
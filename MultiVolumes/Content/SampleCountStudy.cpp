@@ -0,0 +1,138 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SampleCountStudy.h"
+#include "HeadlessRenderer.h"
+#include "GoldenImages.h"
+#include <chrono>
+
+using namespace std;
+using namespace DirectX;
+
+const uint32_t SampleCountStudy::Fractions[] = { 1, 2, 4, 8 };
+
+//--------------------------------------------------------------------------------------
+// Renders the average of the frames of the jitter slices 0, ..., numFrames - 1
+//--------------------------------------------------------------------------------------
+static double render(const HeadlessRenderer& renderer, uint32_t numFrames, float sampleScale, const XMFLOAT3& eyePt,
+	const XMFLOAT3& focusPt, vector<XMFLOAT4>& firstFrame, vector<XMFLOAT4>& average)
+{
+	HeadlessRenderer::FrameContext context;
+	renderer.InitFrameContext(context);
+	context.RaySampleScale = sampleScale;
+
+	const auto numPixels = renderer.GetWidth() * renderer.GetHeight();
+	average.assign(numPixels, XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+	auto renderTime = 0.0;
+	for (auto f = 0u; f < numFrames; ++f)
+	{
+		const auto startTime = chrono::steady_clock::now();
+		context.FrameIndex = f;
+		renderer.Render(context, eyePt, focusPt);
+		renderTime += chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+
+		if (f == 0) firstFrame = context.SceneColors;
+		for (auto i = 0u; i < numPixels; ++i)
+			XMStoreFloat4(&average[i], XMLoadFloat4(&average[i]) + XMLoadFloat4(&context.SceneColors[i]) / static_cast<float>(numFrames));
+	}
+
+	return renderTime / numFrames;
+}
+
+static float computeRMSE(const vector<XMFLOAT4>& colors, const vector<XMFLOAT4>& refs)
+{
+	auto sum = 0.0;
+	for (size_t i = 0; i < colors.size(); ++i)
+	{
+		const auto dr = colors[i].x - refs[i].x;
+		const auto dg = colors[i].y - refs[i].y;
+		const auto db = colors[i].z - refs[i].z;
+		sum += dr * dr + dg * dg + db * db;
+	}
+
+	return static_cast<float>(sqrt(sum / (3.0 * (max)(colors.size(), static_cast<size_t>(1)))));
+}
+
+SampleCountStudy::RunDesc SampleCountStudy::GetDefaultDesc()
+{
+	RunDesc desc;
+	desc.Width = 320;
+	desc.Height = 200;
+	desc.NumVolumes = 4;
+	desc.GridSize = 64;
+	desc.LightGridSize = 64;
+	desc.LightSamples = 128;
+	desc.ReferenceScale = 16;
+	desc.NumFrames = 8;
+	desc.NoiseSize = 64;
+	desc.NoiseDepth = 16;
+
+	return desc;
+}
+
+vector<SampleCountStudy::CaseResult> SampleCountStudy::Run(const RunDesc& desc)
+{
+	vector<CaseResult> results;
+
+	// Procedural volumes, framed as in GoldenImages
+	SceneSettings settings;
+	settings.VolumeFiles[0] = L"";
+	settings.NumVolumes = desc.NumVolumes;
+	settings.GridSize = desc.GridSize;
+	settings.LightGridSize = desc.LightGridSize;
+	settings.MaxRaySamples = UINT16_MAX;	// Unclamped counts of the culler
+
+	const auto rowLength = static_cast<uint32_t>(ceilf(sqrtf(static_cast<float>(desc.NumVolumes))));
+	const auto radius = 20.0f + 35.0f * rowLength;
+	const XMFLOAT3 eyePt(sinf(0.6f) * radius, 0.4f * radius, -cosf(0.6f) * radius);
+	const XMFLOAT3 focusPt(0.0f, 0.0f, 0.0f);
+
+	const auto numPixels = desc.Width * desc.Height;
+	vector<XMFLOAT4> reference, colors, accumulated;
+	vector<uint8_t> refRGBs(3 * numPixels), rgbs(3 * numPixels);
+	{
+		settings.MaxLightSamples = desc.LightSamples * desc.ReferenceScale;
+		HeadlessRenderer renderer;
+		if (!renderer.Init(settings, desc.Width, desc.Height)) return results;
+		render(renderer, 1, static_cast<float>(desc.ReferenceScale), eyePt, focusPt, reference, accumulated);
+		HeadlessRenderer::ToneMap(reference.data(), numPixels, refRGBs.data());
+	}
+
+	BlueNoise blueNoise;
+	blueNoise.Generate(desc.NoiseSize, desc.NoiseDepth);
+
+	for (const auto& fraction : Fractions)
+	{
+		const auto sampleScale = 1.0f / fraction;
+		settings.MaxLightSamples = (max)(desc.LightSamples / fraction, 1u);
+
+		for (uint8_t isJittered = 0; isJittered < 2; ++isJittered)
+		{
+			HeadlessRenderer renderer;
+			if (!renderer.Init(settings, desc.Width, desc.Height, nullptr, isJittered ? &blueNoise : nullptr)) continue;
+
+			CaseResult result = {};
+			result.Name = string(isJittered ? "jittered" : "fixed") + "_1/" + to_string(fraction);
+			result.SampleScale = sampleScale;
+			result.LightSamples = settings.MaxLightSamples;
+			result.IsJittered = isJittered != 0;
+
+			// Fixed starts render the same frame every time
+			result.RenderTime = render(renderer, isJittered ? desc.NumFrames : 1, sampleScale, eyePt, focusPt, colors, accumulated);
+			result.RMSE = computeRMSE(colors, reference);
+
+			HeadlessRenderer::ToneMap(colors.data(), numPixels, rgbs.data());
+			result.PSNR = GoldenImages::ComputePSNR(rgbs.data(), refRGBs.data(), numPixels);
+			result.SSIM = GoldenImages::ComputeSSIM(rgbs.data(), refRGBs.data(), desc.Width, desc.Height);
+
+			HeadlessRenderer::ToneMap(accumulated.data(), numPixels, rgbs.data());
+			result.AccumulatedPSNR = GoldenImages::ComputePSNR(rgbs.data(), refRGBs.data(), numPixels);
+			result.AccumulatedSSIM = GoldenImages::ComputeSSIM(rgbs.data(), refRGBs.data(), desc.Width, desc.Height);
+
+			results.push_back(result);
+		}
+	}
+
+	return results;
+}
@@ -0,0 +1,50 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "BlueNoise.h"
+
+// Error of the headless renderer against a reference of many ray and light samples, for
+// fractions of the shipped sample counts (the ray counts of the culler at the same cube-map
+// LODs, and the light samples), with fixed ray starts and with blue-noise jittered ones. The
+// jittered cases are also accumulated over frames of the spatiotemporal jitters, as the
+// temporal AA of MultiVolumes would.
+class SampleCountStudy
+{
+public:
+	struct RunDesc
+	{
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t NumVolumes;
+		uint32_t GridSize;
+		uint32_t LightGridSize;
+		uint32_t LightSamples;		// Shipped count, of which the fractions are evaluated
+		uint32_t ReferenceScale;	// Of the shipped counts for the reference
+		uint32_t NumFrames;			// Accumulated frames of the jittered cases
+		uint32_t NoiseSize;
+		uint32_t NoiseDepth;		// Temporal slices of the blue noise
+	};
+
+	struct CaseResult
+	{
+		std::string Name;
+		float SampleScale;			// Of the shipped counts
+		uint32_t LightSamples;
+		bool IsJittered;
+		float RMSE;					// Linear HDR, of a single frame
+		float PSNR;					// Tone mapped, of a single frame
+		float SSIM;
+		float AccumulatedPSNR;		// Over the frames
+		float AccumulatedSSIM;
+		double RenderTime;			// Per frame, in milliseconds
+	};
+
+	static RunDesc GetDefaultDesc();
+	static std::vector<CaseResult> Run(const RunDesc& desc);
+
+	static const uint32_t NumFractions = 4;
+	static const uint32_t Fractions[NumFractions];	// Divisors of the shipped counts
+};
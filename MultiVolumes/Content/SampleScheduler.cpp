@@ -0,0 +1,369 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SharedConsts.h"
+#include "SampleScheduler.h"
+#include "VolumeCuller.h"
+#include <random>
+
+using namespace std;
+using namespace DirectX;
+
+static uint32_t countBits(uint32_t x)
+{
+	auto count = 0u;
+	for (; x; x &= x - 1) ++count;
+
+	return count;
+}
+
+SampleScheduler::SampleScheduler() :
+	m_budget(8.0f),
+	m_globalCostPerWork(1.0e-7f),
+	m_predictedTime(0.0f),
+	m_kp(0.3f),
+	m_ki(0.25f),
+	m_integral(0.0f),
+	m_correction(0.0f),
+	m_budgetScale(1.0f),
+	m_isSaturated(false),
+	m_maxSamples(256),
+	m_minSamples(8)
+{
+}
+
+SampleScheduler::~SampleScheduler()
+{
+}
+
+void SampleScheduler::Init(uint32_t numVolumes, float budgetMs, uint32_t maxSamples, uint32_t minSamples)
+{
+	m_costPerWorks.assign(numVolumes, 0.0f);
+	m_works.assign(numVolumes, 0.0f);
+	m_priorities.assign(numVolumes, 0.0f);
+	m_scheduled.clear();
+	m_scheduled.reserve(numVolumes);
+
+	m_budget = budgetMs;
+	m_maxSamples = maxSamples;
+	m_minSamples = (min)(minSamples, maxSamples);
+	m_integral = 0.0f;
+	m_correction = 0.0f;
+}
+
+void SampleScheduler::SetBudget(float budgetMs)
+{
+	m_budget = budgetMs;
+}
+
+void SampleScheduler::SetGains(float kp, float ki)
+{
+	m_kp = kp;
+	m_ki = ki;
+}
+
+void SampleScheduler::Schedule(const uint32_t* pVisibleVolumes, uint32_t numVisible,
+	const VolumeStats* pStats, VolumeInfo* pVolumeInfos)
+{
+	m_scheduled.assign(pVisibleVolumes, pVisibleVolumes + numVisible);
+	if (m_scheduled.empty())
+	{
+		m_predictedTime = 0.0f;
+		m_isSaturated = true;
+		return;
+	}
+
+	// Priorities from coverage and distance, relative to the mean
+	auto meanCostPerWork = 0.0f;
+	auto meanPriority = 0.0f;
+	for (const auto& i : m_scheduled)
+	{
+		const auto& stats = pStats[i];
+		m_priorities[i] = sqrtf((max)(stats.ProjCoverage, 0.0f)) / (1.0f + stats.Distance * 0.01f);
+		meanPriority += m_priorities[i];
+		meanCostPerWork += getCostPerWork(i);
+	}
+	meanPriority /= numVisible;
+	meanCostPerWork /= numVisible;
+
+	// Volumes that measured expensive get relatively fewer samples
+	for (const auto& i : m_scheduled)
+	{
+		auto& priority = m_priorities[i];
+		priority = meanPriority > 0.0f ? priority / meanPriority : 1.0f;
+		priority *= sqrtf(meanCostPerWork / getCostPerWork(i));
+	}
+
+	const auto getSampleCount = [&](uint32_t i, float scale)
+	{
+		const auto sampleCount = static_cast<uint32_t>(ceilf(scale * m_priorities[i] * m_maxSamples));
+
+		return (min)((max)(sampleCount, m_minSamples), m_maxSamples);
+	};
+
+	const auto predict = [&](float scale)
+	{
+		auto time = 0.0f;
+		for (const auto& i : m_scheduled)
+		{
+			auto sampleCount = getSampleCount(i, scale);
+			uint8_t mipLevel;
+			time += getCostPerWork(i) * getWork(pStats[i], pVolumeInfos[i].FaceMask, sampleCount, mipLevel);
+		}
+
+		return time;
+	};
+
+	// Find the largest scale that fits the corrected budget by bisection in log space
+	const auto target = m_budget * expf(m_correction);
+	auto lo = -12.0f, hi = 4.0f;
+	m_isSaturated = predict(exp2f(hi)) <= target;
+	if (m_isSaturated) lo = hi;
+	else if (predict(exp2f(lo)) < target)
+	{
+		for (uint8_t n = 0; n < 20; ++n)
+		{
+			const auto mid = 0.5f * (lo + hi);
+			if (predict(exp2f(mid)) <= target) lo = mid;
+			else hi = mid;
+		}
+	}
+	m_budgetScale = exp2f(lo);
+
+	// Assign sample counts and mip levels
+	m_predictedTime = 0.0f;
+	for (const auto& i : m_scheduled)
+	{
+		auto& volumeInfo = pVolumeInfos[i];
+		const auto& stats = pStats[i];
+		const auto faceMask = volumeInfo.FaceMask & ~g_cubeMapRayMarchBit;
+
+		auto sampleCount = getSampleCount(i, m_budgetScale);
+		uint8_t mipLevel;
+		m_works[i] = getWork(stats, faceMask, sampleCount, mipLevel);
+		m_predictedTime += getCostPerWork(i) * m_works[i];
+
+		// Same render-scheme selection as CSVolumeCull.hlsl
+		const auto mipSize = static_cast<float>(stats.CubeMapSize >> mipLevel);
+		const auto cubeMapPix = mipSize * mipSize * countBits(faceMask);
+		volumeInfo.MipLevel = mipLevel;
+		volumeInfo.SmpCount = static_cast<uint16_t>(sampleCount);
+		volumeInfo.FaceMask = static_cast<uint16_t>(cubeMapPix <= stats.ProjCoverage ? (faceMask | g_cubeMapRayMarchBit) : faceMask);
+	}
+}
+
+void SampleScheduler::Feedback(float frameTimeMs, const float* pVolumeCosts)
+{
+	if (m_scheduled.empty() || frameTimeMs <= 0.0f) return;
+
+	// Update the cost model
+	const auto rate = 0.25f;
+	auto totalWork = 0.0f;
+	auto totalCost = 0.0f;
+	for (const auto& i : m_scheduled)
+	{
+		const auto work = m_works[i];
+		totalWork += work;
+		if (pVolumeCosts && work > 0.0f)
+		{
+			const auto costPerWork = pVolumeCosts[i] / work;
+			auto& model = m_costPerWorks[i];
+			model = model > 0.0f ? model + (costPerWork - model) * rate : costPerWork;
+			totalCost += pVolumeCosts[i];
+		}
+	}
+
+	if (totalWork > 0.0f)
+	{
+		const auto costPerWork = (pVolumeCosts ? totalCost : frameTimeMs) / totalWork;
+		m_globalCostPerWork += (costPerWork - m_globalCostPerWork) * rate;
+	}
+
+	// PI controller in log space, with the integral clamped against windup
+	const auto error = logf(m_budget / frameTimeMs);
+	m_integral = (min)((max)(m_integral + error, -4.0f), 4.0f);
+	m_correction = m_kp * error + m_ki * m_integral;
+}
+
+float SampleScheduler::GetPredictedTime() const
+{
+	return m_predictedTime;
+}
+
+float SampleScheduler::GetBudgetScale() const
+{
+	return m_budgetScale;
+}
+
+bool SampleScheduler::IsSaturated() const
+{
+	return m_isSaturated;
+}
+
+const float* SampleScheduler::GetWorks() const
+{
+	return m_works.data();
+}
+
+SampleScheduler::SimulationResult SampleScheduler::Simulate(const SimulationDesc& desc)
+{
+	SimulationResult result = {};
+	result.FrameTimes.resize(desc.NumFrames);
+	vector<bool> saturated(desc.NumFrames);
+
+	const auto maxSamples = 256u;
+	const auto cubeMapSize = 128u;
+	const XMFLOAT2 viewport(1280.0f, 720.0f);
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, viewport.x / viewport.y, g_zNear, g_zFar);
+
+	// Scene as laid out by MultiRayCaster::SetVolumesWorld(), with hidden per-volume costs
+	mt19937 rng(desc.Seed);
+	uniform_real_distribution<float> costDist(0.5f, 2.0f);
+	normal_distribution<float> noiseDist(0.0f, desc.Noise > 0.0f ? desc.Noise : 1.0f);	// Only sampled with noise
+
+	VolumeCuller culler;
+	culler.Init(desc.NumVolumes);
+	vector<XMFLOAT3> centers(desc.NumVolumes);
+	vector<float> costScales(desc.NumVolumes);
+	const auto size = 20.0f;
+	const auto rowLength = static_cast<uint32_t>(ceilf(sqrtf(static_cast<float>(desc.NumVolumes))));
+	for (auto i = 0u; i < desc.NumVolumes; ++i)
+	{
+		centers[i].x = (static_cast<float>(i % rowLength) - (rowLength - 1) / 2.0f) * size * 1.5f;
+		centers[i].y = 0.0f;
+		centers[i].z = (static_cast<float>(i / rowLength) - (rowLength - 1) / 2.0f) * size * 1.5f;
+
+		XMFLOAT3X4 world;
+		XMStoreFloat3x4(&world, XMMatrixScaling(size * 0.5f, size * 0.5f, size * 0.5f) *
+			XMMatrixTranslation(centers[i].x, centers[i].y, centers[i].z));
+
+		VolumeDesc volumeDesc;
+		volumeDesc.VolTexId = i;
+		volumeDesc.NumMips = NUM_CUBE_MIP;
+		volumeDesc.CubeMapSize = cubeMapSize;
+		culler.SetVolume(i, world, volumeDesc);
+		costScales[i] = costDist(rng);
+	}
+
+	SampleScheduler scheduler;
+	scheduler.Init(desc.NumVolumes, desc.BudgetMs, maxSamples);
+
+	vector<VolumeStats> stats(desc.NumVolumes);
+	vector<VolumeInfo> volumeInfos(desc.NumVolumes);
+	vector<float> volumeCosts(desc.NumVolumes);
+	const auto trueCostPerWork = 2.0e-7f;
+	const auto overhead = 0.25f;
+	const auto extent = rowLength * size * 1.5f;
+
+	auto qualitySum = 0.0f;
+	auto mipBiasSum = 0.0f;
+	auto numMipSamples = 0u;
+	for (auto f = 0u; f < desc.NumFrames; ++f)
+	{
+		// Synthetic camera paths
+		const auto t = desc.NumFrames > 1 ? static_cast<float>(f) / (desc.NumFrames - 1) : 0.0f;
+		XMFLOAT3 eyePt, focusPt(0.0f, 0.0f, 0.0f);
+		switch (desc.Path)
+		{
+		case PATH_DOLLY:
+			eyePt = XMFLOAT3(4.0f, 16.0f, -(extent + 100.0f) * (1.0f - t) - 30.0f * t);
+			break;
+		case PATH_FLY_THROUGH:
+			eyePt = XMFLOAT3(extent * (t - 0.5f), 12.0f, -extent * 0.5f - 20.0f + extent * t);
+			focusPt = XMFLOAT3(eyePt.x + 10.0f, 0.0f, eyePt.z + 40.0f);
+			break;
+		default:
+			eyePt = XMFLOAT3(sinf(XM_2PI * t) * (extent + 60.0f), 16.0f, -cosf(XM_2PI * t) * (extent + 60.0f));
+		}
+		const auto view = XMMatrixLookAtLH(XMLoadFloat3(&eyePt), XMLoadFloat3(&focusPt), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+
+		culler.Cull(view * proj, eyePt, viewport, maxSamples);
+		const auto& visibleVolumes = culler.GetVisibleVolumes();
+		for (const auto& i : visibleVolumes)
+		{
+			const auto dx = centers[i].x - eyePt.x, dy = centers[i].y - eyePt.y, dz = centers[i].z - eyePt.z;
+			stats[i].ProjCoverage = culler.GetProjCoverages()[i];
+			stats[i].MaxEdgeLength = culler.GetMaxEdgeLengths()[i];
+			stats[i].Distance = sqrtf(dx * dx + dy * dy + dz * dz);
+			stats[i].CubeMapSize = cubeMapSize;
+			stats[i].NumMips = NUM_CUBE_MIP;
+			volumeInfos[i] = culler.GetVolumeInfos()[i];
+		}
+
+		const auto numVisible = static_cast<uint32_t>(visibleVolumes.size());
+		scheduler.Schedule(visibleVolumes.data(), numVisible, stats.data(), volumeInfos.data());
+
+		// "Measure" the frame
+		auto frameTime = overhead;
+		auto coverageSum = 0.0f, qualitySumFrame = 0.0f;
+		for (const auto& i : visibleVolumes)
+		{
+			volumeCosts[i] = trueCostPerWork * costScales[i] * scheduler.GetWorks()[i];
+			frameTime += volumeCosts[i];
+
+			const auto& ideal = culler.GetVolumeInfos()[i];
+			coverageSum += stats[i].ProjCoverage;
+			qualitySumFrame += stats[i].ProjCoverage * volumeInfos[i].SmpCount / (max)(ideal.SmpCount, uint16_t(1));
+			mipBiasSum += static_cast<float>(volumeInfos[i].MipLevel) - ideal.MipLevel;
+			++numMipSamples;
+		}
+		if (desc.Noise > 0.0f) frameTime *= (max)(1.0f + noiseDist(rng), 0.1f);
+		qualitySum += coverageSum > 0.0f ? qualitySumFrame / coverageSum : 1.0f;
+		result.FrameTimes[f] = frameTime;
+		saturated[f] = scheduler.IsSaturated();
+
+		scheduler.Feedback(frameTime, desc.PerVolumeTiming ? volumeCosts.data() : nullptr);
+	}
+
+	// Convergence and error metrics
+	const auto tolerance = 0.05f + 2.0f * desc.Noise;
+	const auto isInTolerance = [&](uint32_t f)
+	{
+		const auto error = (result.FrameTimes[f] - desc.BudgetMs) / desc.BudgetMs;
+
+		return error <= tolerance && (error >= -tolerance || saturated[f]);
+	};
+
+	result.ConvergenceFrame = desc.NumFrames;
+	for (auto f = desc.NumFrames; f-- > 0 && isInTolerance(f);) result.ConvergenceFrame = f;
+
+	auto numInTolerance = 0u;
+	for (auto f = 0u; f < desc.NumFrames; ++f) numInTolerance += isInTolerance(f) ? 1 : 0;
+	result.InTolerance = desc.NumFrames > 0 ? static_cast<float>(numInTolerance) / desc.NumFrames : 0.0f;
+
+	auto numConverged = 0u;
+	for (auto f = result.ConvergenceFrame; f < desc.NumFrames; ++f, ++numConverged)
+	{
+		const auto error = (result.FrameTimes[f] - desc.BudgetMs) / desc.BudgetMs;
+		result.MeanError += saturated[f] ? (max)(error, 0.0f) : fabsf(error);
+		result.MaxOvershoot = (max)(result.MaxOvershoot, error);
+	}
+	if (numConverged > 0) result.MeanError /= numConverged;
+	result.SampleQuality = desc.NumFrames > 0 ? qualitySum / desc.NumFrames : 0.0f;
+	result.MipBias = numMipSamples > 0 ? mipBiasSum / numMipSamples : 0.0f;
+
+	return result;
+}
+
+float SampleScheduler::getCostPerWork(uint32_t volumeId) const
+{
+	const auto costPerWork = m_costPerWorks[volumeId];
+
+	return costPerWork > 0.0f ? costPerWork : m_globalCostPerWork;
+}
+
+float SampleScheduler::getWork(const VolumeStats& stats, uint32_t faceMask,
+	uint32_t& sampleCount, uint8_t& mipLevel) const
+{
+	// Fewer samples allow a coarser cube map, as in EstimateCubeMapLOD()
+	mipLevel = VolumeCuller::EstimateCubeMapLOD(sampleCount, stats.NumMips,
+		static_cast<float>(stats.CubeMapSize), stats.MaxEdgeLength);
+	sampleCount = (max)(sampleCount, 1u);
+
+	// Either the visible cube-map texels or the covered pixels are ray marched
+	const auto mipSize = static_cast<float>(stats.CubeMapSize >> mipLevel);
+	const auto cubeMapPix = mipSize * mipSize * countBits(faceMask & ~g_cubeMapRayMarchBit);
+
+	return (min)(cubeMapPix, stats.ProjCoverage) * sampleCount;
+}
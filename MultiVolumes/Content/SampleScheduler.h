@@ -0,0 +1,93 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VolumeTypes.h"
+
+// Distributes a frame-time budget over the visible volumes as per-volume ray sample
+// counts and cube-map mip levels. A per-volume cost model predicts the frame time,
+// and a PI controller on the measured frame time trims the remaining error.
+class SampleScheduler
+{
+public:
+	enum CameraPath : uint8_t
+	{
+		PATH_ORBIT,
+		PATH_DOLLY,
+		PATH_FLY_THROUGH,
+
+		NUM_CAMERA_PATH
+	};
+
+	struct VolumeStats
+	{
+		float ProjCoverage;		// Projected coverage in pixels
+		float MaxEdgeLength;	// Max projected cube edge length in pixels
+		float Distance;			// Distance from the eye
+		uint32_t CubeMapSize;
+		uint8_t NumMips;
+	};
+
+	struct SimulationDesc
+	{
+		uint32_t NumVolumes;
+		uint32_t NumFrames;
+		float BudgetMs;
+		CameraPath Path;
+		float Noise;			// Relative standard deviation of the measured frame time
+		bool PerVolumeTiming;	// Feed back per-volume costs, not only the frame time
+		uint32_t Seed;
+	};
+
+	struct SimulationResult
+	{
+		std::vector<float> FrameTimes;
+		uint32_t ConvergenceFrame;	// The frame time stays within the tolerance (or saturated) from here on
+		float InTolerance;			// Fraction of the frames within the tolerance (or saturated)
+		float MeanError;			// Mean relative error after convergence
+		float MaxOvershoot;			// Max relative overshoot after convergence
+		float SampleQuality;		// Coverage-weighted ratio of assigned to ideal sample counts
+		float MipBias;				// Mean extra cube-map mip levels over the ideal ones
+	};
+
+	SampleScheduler();
+	virtual ~SampleScheduler();
+
+	void Init(uint32_t numVolumes, float budgetMs, uint32_t maxSamples, uint32_t minSamples = 8);
+	void SetBudget(float budgetMs);
+	void SetGains(float kp, float ki);
+	void Schedule(const uint32_t* pVisibleVolumes, uint32_t numVisible,
+		const VolumeStats* pStats, VolumeInfo* pVolumeInfos);
+	void Feedback(float frameTimeMs, const float* pVolumeCosts = nullptr);
+
+	float GetPredictedTime() const;
+	float GetBudgetScale() const;
+	bool IsSaturated() const;	// All volumes got their ideal samples within the budget
+	const float* GetWorks() const;
+
+	static SimulationResult Simulate(const SimulationDesc& desc);
+
+protected:
+	float getCostPerWork(uint32_t volumeId) const;
+	float getWork(const VolumeStats& stats, uint32_t faceMask, uint32_t& sampleCount, uint8_t& mipLevel) const;
+
+	std::vector<float>		m_costPerWorks;	// Per-volume cost model, 0 if never measured
+	std::vector<float>		m_works;		// Work of the last schedule
+	std::vector<float>		m_priorities;
+	std::vector<uint32_t>	m_scheduled;
+
+	float		m_budget;
+	float		m_globalCostPerWork;
+	float		m_predictedTime;
+	float		m_kp;
+	float		m_ki;
+	float		m_integral;
+	float		m_correction;	// Log-space PI output
+	float		m_budgetScale;
+	bool		m_isSaturated;
+
+	uint32_t	m_maxSamples;
+	uint32_t	m_minSamples;
+};
@@ -0,0 +1,408 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SampleSequence.h"
+#include <chrono>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+// Lanes of indices, 8 with AVX2 and 1 otherwise
+//--------------------------------------------------------------------------------------
+#if defined(__AVX2__)
+struct ULanes { __m256i v; };
+static const uint32_t g_numLanes = 8;
+
+static inline ULanes ulanes(uint32_t s) { return { _mm256_set1_epi32(static_cast<int32_t>(s)) }; }
+static inline ULanes indices(uint32_t first) { return { _mm256_add_epi32(ulanes(first).v, _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)) }; }
+static inline void store(uint32_t* p, ULanes a) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), a.v); }
+static inline ULanes operator+(ULanes a, ULanes b) { return { _mm256_add_epi32(a.v, b.v) }; }
+static inline ULanes operator-(ULanes a, ULanes b) { return { _mm256_sub_epi32(a.v, b.v) }; }
+static inline ULanes operator*(ULanes a, ULanes b) { return { _mm256_mullo_epi32(a.v, b.v) }; }
+static inline ULanes operator&(ULanes a, ULanes b) { return { _mm256_and_si256(a.v, b.v) }; }
+static inline ULanes operator|(ULanes a, ULanes b) { return { _mm256_or_si256(a.v, b.v) }; }
+static inline ULanes operator^(ULanes a, ULanes b) { return { _mm256_xor_si256(a.v, b.v) }; }
+static inline ULanes operator<<(ULanes a, uint32_t n) { return { _mm256_sllv_epi32(a.v, ulanes(n).v) }; }
+static inline ULanes operator>>(ULanes a, uint32_t n) { return { _mm256_srlv_epi32(a.v, ulanes(n).v) }; }
+#else
+struct ULanes { uint32_t v; };
+static const uint32_t g_numLanes = 1;
+
+static inline ULanes ulanes(uint32_t s) { return { s }; }
+static inline ULanes indices(uint32_t first) { return { first }; }
+static inline void store(uint32_t* p, ULanes a) { *p = a.v; }
+static inline ULanes operator+(ULanes a, ULanes b) { return { a.v + b.v }; }
+static inline ULanes operator-(ULanes a, ULanes b) { return { a.v - b.v }; }
+static inline ULanes operator*(ULanes a, ULanes b) { return { a.v * b.v }; }
+static inline ULanes operator&(ULanes a, ULanes b) { return { a.v & b.v }; }
+static inline ULanes operator|(ULanes a, ULanes b) { return { a.v | b.v }; }
+static inline ULanes operator^(ULanes a, ULanes b) { return { a.v ^ b.v }; }
+static inline ULanes operator<<(ULanes a, uint32_t n) { return { a.v << n }; }
+static inline ULanes operator>>(ULanes a, uint32_t n) { return { a.v >> n }; }
+#endif
+
+//--------------------------------------------------------------------------------------
+// Points are generated in 0.32 fixed point, so that the rotations wrap around exactly
+//--------------------------------------------------------------------------------------
+static const uint32_t g_r2Alphas[] = { 0xc13fa9a9u, 0x91e10da6u };	// 1 / phi2 and 1 / phi2^2, as 0.32
+
+// Void-and-cluster ranks (Ulichney, sigma 1.5) of a 16x16 torus
+static const uint8_t g_blueNoiseRanks[SampleSequence::BlueNoiseSize * SampleSequence::BlueNoiseSize] =
+{
+	234,  50, 188,  19,  58, 171, 121,  47, 163,   2, 247, 104,  22, 132,  14,  65,
+	209,   8, 118,  97, 240, 205,  23, 228, 138,  64, 123, 170,  72, 224,  99, 149,
+	 85, 139, 229, 165,  78, 146, 111,  84, 176, 216,  30, 231, 153, 201,  42, 180,
+	 25,  62, 195,  29,  43, 185,   7, 249,  41, 100, 191,  48,  87,   5, 128, 243,
+	221, 152, 101, 253, 130, 220,  59, 200, 156,  12, 136, 112, 255, 174,  69, 109,
+	 46, 189,   3,  73, 172,  90, 142, 116,  80, 237, 210,  61, 147,  33, 206, 160,
+	 81, 124, 217, 113, 208,  15, 241,  27, 168,  45, 178,  20, 193,  96, 225,  18,
+	242, 164,  60,  35, 157,  53, 181,  68, 223, 105, 125,  83, 236, 131,  55, 141,
+	197,  10, 227, 134, 246,  95, 126, 198, 148,   1, 244, 161,  71,   9, 182, 106,
+	 40,  93, 179,  75, 192,   6, 218,  36,  91,  57, 202,  34, 215, 155, 233,  74,
+	252, 120, 150,  24, 110,  63, 166, 119, 232, 183, 133, 103,  49, 117,  31, 167,
+	 16, 212,  51, 238, 207, 137, 254,  21,  76, 151,  13, 250, 190,  88, 203, 135,
+	102, 184,  82, 169,  38,  89, 187,  52, 204,  98, 173,  67, 129,   4, 222,  56,
+	230, 144,   0, 127, 226,  11, 154, 114, 239,  39, 219,  28, 235, 145, 175,  77,
+	196,  37, 248,  70, 107, 199,  66, 177,  17, 143, 115, 159,  86,  44, 108,  26,
+	122,  92, 158, 214, 140,  32, 245,  94, 213,  79, 194,  54, 211, 186, 251, 162
+};
+
+// Texel coordinates of each rank, in 4 bits each
+static const uint8_t* getBlueNoisePoints()
+{
+	static const auto points = []()
+	{
+		vector<uint8_t> p(SampleSequence::BlueNoiseSize * SampleSequence::BlueNoiseSize);
+		for (auto i = 0u; i < p.size(); ++i) p[g_blueNoiseRanks[i]] = static_cast<uint8_t>(i);
+
+		return p;
+	}();
+
+	return points.data();
+}
+
+static inline void blueNoiseFixed(uint32_t index, const uint32_t offsets[2], uint32_t& x, uint32_t& y)
+{
+	// Successive tiles of ranks are offset within their texels along R2, from the texel
+	// centers of the first tile; whole R2 steps would nearly repeat the 1/16 grid
+	const auto point = getBlueNoisePoints()[index % (SampleSequence::BlueNoiseSize * SampleSequence::BlueNoiseSize)];
+	const auto tile = index / (SampleSequence::BlueNoiseSize * SampleSequence::BlueNoiseSize);
+	x = (point % SampleSequence::BlueNoiseSize) << 28;
+	y = (point / SampleSequence::BlueNoiseSize) << 28;
+	x += ((0x80000000u + tile * g_r2Alphas[0]) >> 4) + offsets[0];
+	y += ((0x80000000u + tile * g_r2Alphas[1]) >> 4) + offsets[1];
+}
+
+static inline uint32_t hashUint(uint32_t x)
+{
+	// PCG hash
+	const auto state = x * 747796405u + 2891336453u;
+	const auto word = ((state >> ((state >> 28) + 4)) ^ state) * 277803737u;
+
+	return (word >> 22) ^ word;
+}
+
+static inline uint32_t splat(uint32_t s, uint32_t) { return s; }
+static inline ULanes splat(uint32_t s, ULanes) { return ulanes(s); }
+
+template<typename T>
+static inline T reverseBits(T bits)
+{
+	bits = (bits << 16) | (bits >> 16);
+	bits = ((bits & splat(0x55555555, bits)) << 1) | ((bits >> 1) & splat(0x55555555, bits));
+	bits = ((bits & splat(0x33333333, bits)) << 2) | ((bits >> 2) & splat(0x33333333, bits));
+	bits = ((bits & splat(0x0f0f0f0f, bits)) << 4) | ((bits >> 4) & splat(0x0f0f0f0f, bits));
+	bits = ((bits & splat(0x00ff00ff, bits)) << 8) | ((bits >> 8) & splat(0x00ff00ff, bits));
+
+	return bits;
+}
+
+template<typename T>
+static inline T sobol1(T index)
+{
+	// Second Sobol dimension, of the direction numbers v[k] = v[k - 1] ^ (v[k - 1] >> 1)
+	auto result = splat(0, index);
+	auto v = 1u << 31;
+	for (uint8_t k = 0; k < 32; ++k, v ^= v >> 1)
+		result = result ^ ((splat(0, index) - ((index >> k) & splat(1, index))) & splat(v, index));
+
+	return result;
+}
+
+//--------------------------------------------------------------------------------------
+// Radical inverses of other bases than 2 keep the m lowest digits with base^m <= 2^32,
+// which truncates them below 2^-24 for bases up to 256. They are reversed into integers
+// and divided exactly into 0.32 fixed point, so the digit-by-digit carries of consecutive
+// indices give the same points as the indices one by one.
+//--------------------------------------------------------------------------------------
+struct RadicalInverse
+{
+	uint32_t Digits[32];
+	uint32_t Places[32];	// base^(m - 1 - k) of digit k
+	uint32_t Reversed;
+	uint64_t Denominator;	// base^m
+	uint32_t Base;
+	uint32_t NumDigits;
+};
+
+static inline uint32_t toFixed(uint32_t reversed, uint64_t denominator)
+{
+	return static_cast<uint32_t>((static_cast<uint64_t>(reversed) << 32) / denominator);
+}
+
+static inline uint32_t haltonFixed(uint32_t index, uint32_t base)
+{
+	if (base == 2) return reverseBits(index);
+
+	auto reversed = 0u;
+	uint64_t place = 1;
+	for (; index > 0 && place * base <= 4294967296ull; place *= base)
+	{
+		const auto quotient = index / base;
+		reversed = reversed * base + (index - quotient * base);
+		index = quotient;
+	}
+
+	return toFixed(reversed, place);
+}
+
+static void initRadicalInverse(RadicalInverse& radicalInverse, uint32_t index, uint32_t base)
+{
+	uint64_t place = 1;
+	radicalInverse.Base = base;
+	radicalInverse.NumDigits = 0;
+	for (; place * base <= 4294967296ull; place *= base)
+	{
+		radicalInverse.Digits[radicalInverse.NumDigits++] = index % base;
+		index /= base;
+	}
+	radicalInverse.Denominator = place;
+
+	radicalInverse.Reversed = 0;
+	for (auto k = 0u; k < radicalInverse.NumDigits; ++k)
+	{
+		place /= base;
+		radicalInverse.Places[k] = static_cast<uint32_t>(place);
+		radicalInverse.Reversed += radicalInverse.Digits[k] * radicalInverse.Places[k];
+	}
+}
+
+// Returns the fixed-point inverse of the current index and advances it, with amortized
+// O(1) carries; the digits beyond m wrap around as in haltonFixed()
+static inline uint32_t nextRadicalInverse(RadicalInverse& radicalInverse)
+{
+	const auto result = toFixed(radicalInverse.Reversed, radicalInverse.Denominator);
+	for (auto k = 0u; k < radicalInverse.NumDigits; ++k)
+	{
+		if (++radicalInverse.Digits[k] < radicalInverse.Base)
+		{
+			radicalInverse.Reversed += radicalInverse.Places[k];
+			break;
+		}
+		radicalInverse.Digits[k] = 0;
+		radicalInverse.Reversed -= (radicalInverse.Base - 1) * radicalInverse.Places[k];
+	}
+
+	return result;
+}
+
+static inline float toUnitFloat(uint32_t x)
+{
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+//--------------------------------------------------------------------------------------
+// Sample sequence
+//--------------------------------------------------------------------------------------
+SampleSequence::SampleSequence(Type type, uint32_t seed)
+{
+	Init(type, seed);
+}
+
+SampleSequence::~SampleSequence()
+{
+}
+
+void SampleSequence::Init(Type type, uint32_t seed)
+{
+	m_type = type;
+	m_index = 0;
+	m_bases[0] = 2;
+	m_bases[1] = 3;
+	m_offsets[0] = seed ? hashUint(seed) : 0;
+	m_offsets[1] = seed ? hashUint(seed ^ 0x9e3779b9u) : 0;
+}
+
+void SampleSequence::SetHaltonBases(uint32_t baseX, uint32_t baseY)
+{
+	m_bases[0] = (max)(baseX, 2u);
+	m_bases[1] = (max)(baseY, 2u);
+}
+
+void SampleSequence::Reset(uint32_t index)
+{
+	m_index = index;
+}
+
+XMFLOAT2 SampleSequence::Next()
+{
+	return Get(m_index++);
+}
+
+XMFLOAT2 SampleSequence::Get(uint32_t index) const
+{
+	uint32_t x, y;
+	switch (m_type)
+	{
+	case SOBOL:
+		x = reverseBits(index) ^ m_offsets[0];
+		y = sobol1(index) ^ m_offsets[1];
+		break;
+	case R2:
+		x = 0x80000000u + index * g_r2Alphas[0] + m_offsets[0];
+		y = 0x80000000u + index * g_r2Alphas[1] + m_offsets[1];
+		break;
+	case BLUE_NOISE:
+		blueNoiseFixed(index, m_offsets, x, y);
+		break;
+	default:
+		x = haltonFixed(index, m_bases[0]) + m_offsets[0];
+		y = haltonFixed(index, m_bases[1]) + m_offsets[1];
+	}
+
+	return XMFLOAT2(toUnitFloat(x), toUnitFloat(y));
+}
+
+void SampleSequence::Generate(uint32_t firstIndex, uint32_t count, XMFLOAT2* pPoints,
+	const XMFLOAT2& scale, const XMFLOAT2& bias) const
+{
+	uint32_t xs[g_numLanes], ys[g_numLanes];
+	RadicalInverse radicalInverses[2];
+	if (m_type == HALTON)
+		for (uint8_t d = 0; d < 2; ++d)
+			if (m_bases[d] != 2) initRadicalInverse(radicalInverses[d], firstIndex, m_bases[d]);
+
+	for (auto i = 0u; i < count; i += g_numLanes)
+	{
+		const auto index = indices(firstIndex + i);
+		const auto n = (min)(count - i, g_numLanes);
+		switch (m_type)
+		{
+		case SOBOL:
+			store(xs, reverseBits(index) ^ ulanes(m_offsets[0]));
+			store(ys, sobol1(index) ^ ulanes(m_offsets[1]));
+			break;
+		case R2:
+			store(xs, ulanes(0x80000000u) + index * ulanes(g_r2Alphas[0]) + ulanes(m_offsets[0]));
+			store(ys, ulanes(0x80000000u) + index * ulanes(g_r2Alphas[1]) + ulanes(m_offsets[1]));
+			break;
+		case BLUE_NOISE:
+			// Table lookups are per point
+			for (auto j = 0u; j < n; ++j) blueNoiseFixed(firstIndex + i + j, m_offsets, xs[j], ys[j]);
+			break;
+		default:
+			// Base-2 dimensions are bit reversals, and the others are carried from the previous point
+			for (uint8_t d = 0; d < 2; ++d)
+			{
+				const auto pDst = d > 0 ? ys : xs;
+				if (m_bases[d] == 2) store(pDst, reverseBits(index) + ulanes(m_offsets[d]));
+				else for (auto j = 0u; j < n; ++j) pDst[j] = nextRadicalInverse(radicalInverses[d]) + m_offsets[d];
+			}
+		}
+
+		for (auto j = 0u; j < n; ++j)
+		{
+			pPoints[i + j].x = toUnitFloat(xs[j]) * scale.x + bias.x;
+			pPoints[i + j].y = toUnitFloat(ys[j]) * scale.y + bias.y;
+		}
+	}
+}
+
+SampleSequence::Type SampleSequence::GetType() const
+{
+	return m_type;
+}
+
+uint32_t SampleSequence::GetIndex() const
+{
+	return m_index;
+}
+
+float SampleSequence::Halton(uint32_t index, uint32_t base)
+{
+	return toUnitFloat(haltonFixed(index, (max)(base, 2u)));
+}
+
+float SampleSequence::Sobol(uint32_t index, uint8_t dimension, uint32_t scramble)
+{
+	const auto bits = dimension > 0 ? sobol1(index) : reverseBits(index);
+
+	return toUnitFloat(bits ^ scramble);
+}
+
+float SampleSequence::BlueNoise(uint32_t x, uint32_t y)
+{
+	const auto rank = g_blueNoiseRanks[BlueNoiseSize * (y % BlueNoiseSize) + x % BlueNoiseSize];
+
+	return (rank + 0.5f) / (BlueNoiseSize * BlueNoiseSize);
+}
+
+//--------------------------------------------------------------------------------------
+// Evaluation
+//--------------------------------------------------------------------------------------
+static float l2StarDiscrepancy(const vector<XMFLOAT2>& points)
+{
+	// Warnock's formula in 2D
+	const auto n = static_cast<double>(points.size());
+	auto sum1 = 0.0, sum2 = 0.0;
+	for (const auto& p : points)
+	{
+		sum1 += (1.0 - p.x * p.x) * (1.0 - p.y * p.y) * 0.25;
+		for (const auto& q : points)
+			sum2 += (1.0 - (max)(p.x, q.x)) * (1.0 - (max)(p.y, q.y));
+	}
+
+	return static_cast<float>(sqrt((max)(1.0 / 9.0 - 2.0 / n * sum1 + sum2 / (n * n), 0.0)));
+}
+
+SampleSequence::EvaluationResult SampleSequence::Evaluate(const EvaluationDesc& desc)
+{
+	EvaluationResult result = {};
+
+	vector<XMFLOAT2> points(desc.NumSamples);
+	for (auto i = 0u; i < desc.NumSamples; ++i)
+		points[i] = XMFLOAT2(toUnitFloat(hashUint(2 * i)), toUnitFloat(hashUint(2 * i + 1)));
+	result.RandomDiscrepancy = l2StarDiscrepancy(points);
+
+	vector<XMFLOAT2> batch(desc.NumBatchSamples);
+	for (uint8_t t = 0; t < NUM_TYPE; ++t)
+	{
+		SampleSequence sequence(static_cast<Type>(t));
+		sequence.Generate(0, desc.NumSamples, points.data());
+		result.Discrepancies[t] = l2StarDiscrepancy(points);
+
+		// Consume the points so that the loops are kept
+		auto sink = 0.0f;
+		auto startTime = chrono::steady_clock::now();
+		for (auto i = 0u; i < desc.NumBatchSamples; ++i)
+		{
+			const auto point = sequence.Next();
+			sink += point.x + point.y;
+		}
+		auto time = chrono::duration<double, micro>(chrono::steady_clock::now() - startTime).count();
+		result.NextRates[t] = sink >= 0.0f ? desc.NumBatchSamples / (max)(time, 1e-3) : 0.0;
+
+		startTime = chrono::steady_clock::now();
+		sequence.Generate(0, desc.NumBatchSamples, batch.data());
+		time = chrono::duration<double, micro>(chrono::steady_clock::now() - startTime).count();
+		result.BatchRates[t] = batch.empty() || batch.back().x >= 0.0f ? desc.NumBatchSamples / (max)(time, 1e-3) : 0.0;
+	}
+
+	return result;
+}
@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// 2D low-discrepancy sequences with per-instance state, in place of the shared state of
+// XUSG::IncrementalHalton(), so that views and threads each own their sequences. Halton
+// of any bases, XOR-scrambled Sobol, R2 and a progressive tileable blue-noise set are
+// provided; the seed rotates (Halton, R2 and blue noise) or scrambles (Sobol) the points.
+// Batches are generated 8 points at a time with AVX2 where the sequence is integer
+// arithmetic only (Sobol, R2 and base-2 Halton dimensions); the digits of the other Halton
+// dimensions are carried from one point to the next instead of reversed per point.
+class SampleSequence
+{
+public:
+	enum Type : uint8_t
+	{
+		HALTON,
+		SOBOL,
+		R2,
+		BLUE_NOISE,
+
+		NUM_TYPE
+	};
+
+	struct EvaluationDesc
+	{
+		uint32_t NumSamples;	// Of the discrepancy of each sequence
+		uint32_t NumBatchSamples;	// Of the throughput of each sequence
+	};
+
+	struct EvaluationResult
+	{
+		float Discrepancies[NUM_TYPE];	// L2-star, by Warnock's formula
+		float RandomDiscrepancy;		// Of uniform random points, for reference
+		double NextRates[NUM_TYPE];		// Points per microsecond of Next()
+		double BatchRates[NUM_TYPE];	// Points per microsecond of Generate()
+	};
+
+	SampleSequence(Type type = HALTON, uint32_t seed = 0);
+	virtual ~SampleSequence();
+
+	void Init(Type type, uint32_t seed = 0);
+	void SetHaltonBases(uint32_t baseX, uint32_t baseY);
+	void Reset(uint32_t index = 0);
+
+	// Returns the point at the current index and advances it
+	DirectX::XMFLOAT2 Next();
+	DirectX::XMFLOAT2 Get(uint32_t index) const;
+
+	// Points firstIndex, ..., firstIndex + count - 1, as point * scale + bias, e.g. for the
+	// subpixel jitters of a frame sequence or the ray offsets of a tile
+	void Generate(uint32_t firstIndex, uint32_t count, DirectX::XMFLOAT2* pPoints,
+		const DirectX::XMFLOAT2& scale = DirectX::XMFLOAT2(1.0f, 1.0f),
+		const DirectX::XMFLOAT2& bias = DirectX::XMFLOAT2(0.0f, 0.0f)) const;
+
+	Type GetType() const;
+	uint32_t GetIndex() const;
+
+	static float Halton(uint32_t index, uint32_t base);
+	static float Sobol(uint32_t index, uint8_t dimension, uint32_t scramble = 0);	// Dimensions 0 and 1
+	static float BlueNoise(uint32_t x, uint32_t y);	// Tiled dither threshold in [0, 1)
+	static EvaluationResult Evaluate(const EvaluationDesc& desc);
+
+	static const uint32_t BlueNoiseSize = 16;
+
+protected:
+	Type		m_type;
+	uint32_t	m_index;
+	uint32_t	m_bases[2];
+	uint32_t	m_offsets[2];	// 0.32 fixed-point rotations, or the Sobol scrambles
+};
@@ -0,0 +1,218 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SharedConsts.h"
+#include "SceneScaling.h"
+#include "MemoryBudget.h"
+#include "VolumeTransforms.h"
+#include "VolumeCuller.h"
+#include <chrono>
+
+using namespace std;
+using namespace DirectX;
+
+const uint32_t SceneScaling::VolumeCounts[] = { 1, 16, 64, 256, 1024, 4096, 10000 };
+const uint32_t SceneScaling::GridSizes[] = { 32, 64, 128, 256, 512 };
+const uint32_t SceneScaling::LightGridSizes[] = { 64, 128, 256, 512, 768, 1024 };
+const uint32_t SceneScaling::OITLayerCounts[] = { 4, NUM_OIT_LAYERS, 16 };
+
+static const char* g_categoryNames[] =
+{
+	"volumes",
+	"radiance_cubes",
+	"depth_cubes",
+	"light_map",
+	"k_buffers",
+	"depth",
+	"buffers"
+};
+
+// Of MultiRayCaster
+static const uint8_t g_frameCount = 3;
+static const uint32_t g_cbPerFrameSize = 256;	// sizeof(CBPerFrame)
+
+//--------------------------------------------------------------------------------------
+// Scene scaling
+//--------------------------------------------------------------------------------------
+SceneScaling::Footprint SceneScaling::ComputeFootprint(const SceneDesc& scene)
+{
+	Footprint footprint = {};
+	auto& bytes = footprint.Bytes;
+
+	// Volume sources, R16G16B16A16_FLOAT
+	const auto gridSize = scene.GridSize;
+	bytes[VOLUMES] = scene.NumVolumeSrcs * MemoryBudget::GetTextureSize(gridSize, gridSize, gridSize, 1, 1, 64);
+
+	// Radiance (R16G16B16A16_FLOAT) and depth (R32_FLOAT) cube maps per volume
+	bytes[RADIANCE_CUBES] = scene.NumVolumes * MemoryBudget::GetTextureSize(gridSize, gridSize, 1, 6, scene.NumCubeMips, 64);
+	bytes[DEPTH_CUBES] = scene.NumVolumes * MemoryBudget::GetTextureSize(gridSize, gridSize, 1, 6, scene.NumCubeMips, 32);
+
+	// Light map, R11G11B10_FLOAT
+	const auto lightGridSize = scene.LightGridSize;
+	bytes[LIGHT_MAP] = MemoryBudget::GetTextureSize(lightGridSize, lightGridSize, lightGridSize, 1, 1, 32);
+
+	// K-buffers of SetViewport(), R32_UINT depths and R16G16B16A16_FLOAT colors
+	bytes[K_BUFFERS] = MemoryBudget::GetTextureSize(scene.Width, scene.Height, 1, scene.NumOITLayers, 1, 32) +
+		MemoryBudget::GetTextureSize(scene.Width, scene.Height, 1, scene.NumOITLayers, 1, 64);
+
+	// DepthIncCubes of SetRenderTargets(), D32_FLOAT
+	bytes[DEPTH] = MemoryBudget::GetTextureSize(scene.Width, scene.Height, 1, 1, 1, 32);
+
+	// Per-object matrices for each frame, volume descs, visible list, attributes, and the
+	// small buffers of the counters, indirect arguments, constants and cube geometry
+	bytes[BUFFERS] = MemoryBudget::GetBufferSize(sizeof(PerObject) * scene.NumVolumes * g_frameCount) +
+		MemoryBudget::GetBufferSize(sizeof(VolumeDesc) * scene.NumVolumes) +
+		MemoryBudget::GetBufferSize(sizeof(uint32_t) * scene.NumVolumes) +
+		MemoryBudget::GetBufferSize(sizeof(VolumeInfo) * scene.NumVolumes) +
+		MemoryBudget::GetBufferSize(sizeof(uint32_t)) * 2 +
+		MemoryBudget::GetBufferSize(sizeof(uint32_t[3])) + MemoryBudget::GetBufferSize(sizeof(uint32_t[5])) +
+		MemoryBudget::GetBufferSize(g_cbPerFrameSize * g_frameCount) +
+		MemoryBudget::GetBufferSize(sizeof(float[3]) * 24) + MemoryBudget::GetBufferSize(sizeof(uint16_t) * 36);
+
+	for (const auto& size : bytes) footprint.Total += size;
+
+	return footprint;
+}
+
+const char* SceneScaling::GetCategoryName(Category category)
+{
+	return category < NUM_CATEGORY ? g_categoryNames[category] : "";
+}
+
+SceneScaling::SceneDesc SceneScaling::GetDefaultScene()
+{
+	// As MultiVolumes with the default settings
+	SceneDesc scene;
+	scene.NumVolumes = 2;
+	scene.NumVolumeSrcs = 10;
+	scene.GridSize = 128;
+	scene.LightGridSize = 512;
+	scene.NumCubeMips = NUM_CUBE_MIP;
+	scene.NumOITLayers = NUM_OIT_LAYERS;
+	scene.Width = 1280;
+	scene.Height = 800;
+
+	return scene;
+}
+
+SceneScaling::RunDesc SceneScaling::GetDefaultDesc()
+{
+	RunDesc desc;
+	desc.Width = 1280;
+	desc.Height = 800;
+	desc.NumFrames = 16;
+	desc.Budget = 4096ull << 20;
+
+	return desc;
+}
+
+vector<SceneScaling::CaseResult> SceneScaling::Run(const RunDesc& desc)
+{
+	vector<CaseResult> results;
+	results.reserve(NumVolumeCounts * NumGridSizes * NumLightGridSizes * NumOITLayerCounts);
+
+	auto scene = GetDefaultScene();
+	scene.Width = desc.Width;
+	scene.Height = desc.Height;
+
+	const XMFLOAT2 viewport(static_cast<float>(desc.Width), static_cast<float>(desc.Height));
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, viewport.x / viewport.y, g_zNear, g_zFar);
+	const auto numFrames = (max)(desc.NumFrames, 1u);
+
+	for (const auto& numVolumes : VolumeCounts)
+	{
+		scene.NumVolumes = numVolumes;
+
+		// Lay out the volumes as MultiRayCaster::SetVolumesWorld() does
+		VolumeTransforms transforms;
+		VolumeCuller culler;
+		transforms.Init(numVolumes, g_frameCount);
+		culler.Init(numVolumes);
+		vector<XMFLOAT3X4> worlds(numVolumes);
+		const auto size = 20.0f, halfSize = 0.5f * size;
+		const auto rowLength = static_cast<uint32_t>(ceilf(sqrtf(static_cast<float>(numVolumes))));
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const XMFLOAT3 pos((static_cast<float>(i % rowLength) - rowLength / 2.0f + 0.5f) * size * 1.5f, 0.0f,
+				(static_cast<float>(i / rowLength) - rowLength / 2.0f + 0.5f) * size * 1.5f);
+			transforms.SetWorld(i, XMFLOAT3(halfSize, halfSize, halfSize), pos);
+			XMStoreFloat3x4(&worlds[i], XMMatrixScaling(halfSize, halfSize, halfSize) * XMMatrixTranslation(pos.x, pos.y, pos.z));
+		}
+		vector<PerObject> perObjects(static_cast<size_t>(numVolumes) * g_frameCount);
+
+		for (const auto& gridSize : GridSizes)
+		{
+			scene.GridSize = gridSize;
+
+			// The cube-map size only changes the LODs and sample counts of the culler
+			for (auto i = 0u; i < numVolumes; ++i)
+			{
+				VolumeDesc volumeDesc;
+				volumeDesc.VolTexId = i % scene.NumVolumeSrcs;
+				volumeDesc.NumMips = scene.NumCubeMips;
+				volumeDesc.CubeMapSize = gridSize;
+				culler.SetVolume(i, worlds[i], volumeDesc);
+			}
+
+			// Orbit the camera, so that every frame updates all transforms
+			auto updateTime = 0.0, cullTime = 0.0;
+			for (auto i = 0u; i < numFrames; ++i)
+			{
+				const auto angle = XM_2PI * i / numFrames;
+				const XMFLOAT3 eyePt(sinf(angle) * 80.0f, 16.0f, cosf(angle) * 80.0f);
+				const auto view = XMMatrixLookAtLH(XMLoadFloat3(&eyePt), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+				const auto frameIndex = static_cast<uint8_t>(i % g_frameCount);
+
+				auto startTime = chrono::steady_clock::now();
+				transforms.Update(frameIndex, view * proj, &perObjects[static_cast<size_t>(numVolumes) * frameIndex]);
+				updateTime += chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+
+				startTime = chrono::steady_clock::now();
+				culler.Cull(view * proj, eyePt, viewport, 256);
+				cullTime += chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+			}
+
+			for (const auto& lightGridSize : LightGridSizes)
+			{
+				scene.LightGridSize = lightGridSize;
+				for (const auto& numOITLayers : OITLayerCounts)
+				{
+					scene.NumOITLayers = numOITLayers;
+
+					CaseResult result;
+					result.Scene = scene;
+					result.Memory = ComputeFootprint(scene);
+					result.UpdateTime = updateTime / numFrames;
+					result.CullTime = cullTime / numFrames;
+					result.IsOverBudget = desc.Budget > 0 && result.Memory.Total > desc.Budget;
+					results.push_back(result);
+				}
+			}
+		}
+	}
+
+	return results;
+}
+
+bool SceneScaling::WriteCSV(const char* fileName, const vector<CaseResult>& results)
+{
+	ofstream file(fileName);
+	if (!file) return false;
+
+	// Sizes in MB
+	file << "num_volumes,grid_size,light_grid_size,oit_layers";
+	for (uint8_t i = 0; i < NUM_CATEGORY; ++i) file << "," << GetCategoryName(static_cast<Category>(i)) << "_mb";
+	file << ",total_mb,update_ms,cull_ms,over_budget" << endl;
+
+	for (const auto& result : results)
+	{
+		const auto& scene = result.Scene;
+		file << scene.NumVolumes << "," << scene.GridSize << "," << scene.LightGridSize << "," << scene.NumOITLayers;
+		for (const auto& size : result.Memory.Bytes) file << "," << size / 1048576.0;
+		file << "," << result.Memory.Total / 1048576.0 << "," << result.UpdateTime << "," << result.CullTime
+			<< "," << (result.IsOverBudget ? 1 : 0) << endl;
+	}
+
+	return static_cast<bool>(file);
+}
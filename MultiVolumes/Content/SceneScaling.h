@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Stress sweep of the scene scale: the number of volumes, the grid and light-grid sizes, and
+// the K-buffer layers. For each configuration, the GPU memory of the resources created by
+// MultiRayCaster::Init() and SetViewport() is computed from their exact shapes and formats,
+// and the CPU per-frame work (the transforms of UpdateFrame() and the host culler) is timed,
+// so that the limits of a scene can be predicted before it is deployed. Sizes are those of
+// MemoryBudget; the layouts chosen by drivers may pad small mips further. The largest light
+// grid that fits the memory budget is reported per volume count and grid size.
+class SceneScaling
+{
+public:
+	enum Category : uint8_t
+	{
+		VOLUMES,
+		RADIANCE_CUBES,
+		DEPTH_CUBES,
+		LIGHT_MAP,
+		K_BUFFERS,
+		DEPTH,
+		BUFFERS,
+
+		NUM_CATEGORY
+	};
+
+	struct SceneDesc
+	{
+		uint32_t NumVolumes;
+		uint32_t NumVolumeSrcs;
+		uint32_t GridSize;
+		uint32_t LightGridSize;
+		uint32_t NumCubeMips;
+		uint32_t NumOITLayers;
+		uint32_t Width;
+		uint32_t Height;
+	};
+
+	struct Footprint
+	{
+		uint64_t Bytes[NUM_CATEGORY];
+		uint64_t Total;
+	};
+
+	struct RunDesc
+	{
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t NumFrames;			// Timed per number of volumes and grid size
+		uint64_t Budget;			// In bytes, of the GPU memory available to the scene
+	};
+
+	struct CaseResult
+	{
+		SceneDesc Scene;
+		Footprint Memory;
+		double UpdateTime;			// Per frame, in milliseconds
+		double CullTime;
+		bool IsOverBudget;
+	};
+
+	static Footprint ComputeFootprint(const SceneDesc& scene);
+	static const char* GetCategoryName(Category category);
+
+	static SceneDesc GetDefaultScene();
+	static RunDesc GetDefaultDesc();
+	static std::vector<CaseResult> Run(const RunDesc& desc);
+
+	static bool WriteCSV(const char* fileName, const std::vector<CaseResult>& results);
+
+	static const uint32_t NumVolumeCounts = 7;
+	static const uint32_t NumGridSizes = 5;
+	static const uint32_t NumLightGridSizes = 6;
+	static const uint32_t NumOITLayerCounts = 3;
+	static const uint32_t VolumeCounts[NumVolumeCounts];
+	static const uint32_t GridSizes[NumGridSizes];
+	static const uint32_t LightGridSizes[NumLightGridSizes];
+	static const uint32_t OITLayerCounts[NumOITLayerCounts];
+};
@@ -0,0 +1,148 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SceneSettings.h"
+#include <cwchar>
+#include <cwctype>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+// Numeric arguments are optional; returns 1 if consumed, as swscanf_s() does
+//--------------------------------------------------------------------------------------
+static int scanArg(const wchar_t* arg, uint32_t& value)
+{
+	wchar_t* end;
+	const auto parsed = wcstoul(arg, &end, 10);
+	if (end == arg) return 0;
+	value = static_cast<uint32_t>(parsed);
+
+	return 1;
+}
+
+static int scanArg(const wchar_t* arg, float& value)
+{
+	wchar_t* end;
+	const auto parsed = wcstof(arg, &end);
+	if (end == arg) return 0;
+	value = parsed;
+
+	return 1;
+}
+
+const uint32_t SceneSettings::NumVolumeSrcs;
+
+SceneSettings::SceneSettings() :
+	GridSize(128),
+	LightGridSize(512),
+	MaxRaySamples(256),
+	MaxLightSamples(128),
+	NumVolumes(2),
+	RadianceFile(L""),
+	IrradianceFile(L""),
+	MeshFileName("Assets/bunny.obj"),
+	VolPosScale(0.0f, 0.0f, 0.0f, 10.0f),
+	MeshPosScale(0.0f, -10.0f, 0.0f, 1.5f),
+	LightMapScale(32.0f),
+	MemoryBudget(0)
+{
+	VolumeFiles[0] = L"Assets/bunny.dds";
+	VolumeFiles[1] = L"Assets/buddha.dds";
+	VolumeFiles[2] = L"Assets/dragon.dds";
+	VolumeFiles[3] = L"Assets/Eagle.dds";
+	VolumeFiles[4] = L"Assets/Jacquemart.dds";
+	VolumeFiles[5] = L"Assets/lucy.dds";
+	VolumeFiles[6] = L"Assets/penelope.dds";
+	VolumeFiles[7] = L"Assets/Cloud1.dds";
+	VolumeFiles[8] = L"Assets/Cloud2.dds";
+	VolumeFiles[9] = L"Assets/Devil.dds";
+}
+
+void SceneSettings::ParseCommandLineArgs(wchar_t* argv[], int argc)
+{
+	for (auto i = 1; i < argc; ++i)
+	{
+		if (MatchArg(argv[i], L"mesh"))
+		{
+			if (i + 1 < argc)
+			{
+				MeshFileName.resize(wcslen(argv[++i]));
+				for (size_t j = 0; j < MeshFileName.size(); ++j)
+					MeshFileName[j] = static_cast<char>(argv[i][j]);
+			}
+			if (i + 1 < argc) i += scanArg(argv[i + 1], MeshPosScale.x);
+			if (i + 1 < argc) i += scanArg(argv[i + 1], MeshPosScale.y);
+			if (i + 1 < argc) i += scanArg(argv[i + 1], MeshPosScale.z);
+			if (i + 1 < argc) i += scanArg(argv[i + 1], MeshPosScale.w);
+		}
+		else if (MatchArg(argv[i], L"gridSize"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], GridSize);
+		}
+		else if (MatchArg(argv[i], L"lightGridSize"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], LightGridSize);
+		}
+		else if (MatchArg(argv[i], L"volume"))
+		{
+			VolumeFiles[0] = i + 1 < argc ? argv[++i] : VolumeFiles[0];
+			if (i + 1 < argc) i += scanArg(argv[i + 1], VolPosScale.x);
+			if (i + 1 < argc) i += scanArg(argv[i + 1], VolPosScale.y);
+			if (i + 1 < argc) i += scanArg(argv[i + 1], VolPosScale.z);
+			if (i + 1 < argc) i += scanArg(argv[i + 1], VolPosScale.w);
+		}
+		else if (MatchArg(argv[i], L"lightMapScale"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], LightMapScale);
+		}
+		else if (MatchArg(argv[i], L"maxRaySamples"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], MaxRaySamples);
+		}
+		else if (MatchArg(argv[i], L"maxLightSamples"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], MaxLightSamples);
+		}
+		else if (MatchArg(argv[i], L"numVolumes"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], NumVolumes);
+		}
+		else if (MatchArg(argv[i], L"radiance"))
+		{
+			RadianceFile = i + 1 < argc ? argv[++i] : RadianceFile;
+		}
+		else if (MatchArg(argv[i], L"memoryBudget"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], MemoryBudget);
+		}
+	}
+}
+
+void SceneSettings::ParseCommandLineArgs(char* argv[], int argc)
+{
+	// Widened byte-wise, so that file names narrow back losslessly
+	vector<wstring> args(argc);
+	vector<wchar_t*> wargv(argc);
+	for (auto i = 0; i < argc; ++i)
+	{
+		args[i].assign(argv[i], argv[i] + strlen(argv[i]));
+		wargv[i] = &args[i][0];
+	}
+
+	ParseCommandLineArgs(wargv.data(), argc);
+}
+
+bool SceneSettings::MatchArg(const wchar_t* arg, const wchar_t* name)
+{
+	if (arg[0] != L'-' && arg[0] != L'/') return false;
+
+	// The argument may be an abbreviation of the name, but not longer
+	for (auto i = 1u; arg[i] != L'\0'; ++i, ++name)
+		if (*name == L'\0' || towlower(arg[i]) != towlower(*name)) return false;
+
+	return true;
+}
@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// User external settings shared by the viewer and the headless renderer, with the
+// command-line syntax of MultiVolumes: -flag or /flag, case-insensitive and abbreviable.
+struct SceneSettings
+{
+	static const uint32_t NumVolumeSrcs = 10;
+
+	SceneSettings();
+
+	void ParseCommandLineArgs(wchar_t* argv[], int argc);
+	void ParseCommandLineArgs(char* argv[], int argc);
+
+	// Same abbreviation rule as _wcsnicmp(arg, L"-name", wcslen(arg)) == 0
+	static bool MatchArg(const wchar_t* arg, const wchar_t* name);
+
+	uint32_t GridSize;
+	uint32_t LightGridSize;
+	uint32_t MaxRaySamples;
+	uint32_t MaxLightSamples;
+	uint32_t NumVolumes;
+	std::wstring VolumeFiles[NumVolumeSrcs];
+	std::wstring RadianceFile;
+	std::wstring IrradianceFile;
+	std::string MeshFileName;
+	DirectX::XMFLOAT4 VolPosScale;
+	DirectX::XMFLOAT4 MeshPosScale;
+	float LightMapScale;
+	uint32_t MemoryBudget;		// Of the GPU memory in MB, 0 if unlimited
+};
@@ -270,7 +270,8 @@ void main(uint2 DTid : SV_DispatchThreadID)
 	HALF curHistoryBlur = historyBlurs.x + historyBlurs.y;
 
 	// Evaluate history weight that indicates the convergence from metadata
-	HALF historyBlur = HALF(1.0 - history.w);
+	const HALF convergence = HALF(history.w);
+	HALF historyBlur = 1.0 - convergence;
 	historyBlur = max(historyBlur, curHistoryBlur);
 	history.w = history.w * g_historyMax + 1.0;
 
@@ -299,14 +300,14 @@ void main(uint2 DTid : SV_DispatchThreadID)
 #endif
 	const HALF contrast = neighborMax.w - neighborMin.w;
 
-	// Add aliasing
+	// Add aliasing, less as the history converges, which then holds the jittered samples
 #if _USE_YCOCG_
 	static const HALF lumContrastFactor = 32.0 * 4.0;
 #else
 	static const HALF lumContrastFactor = 32.0;
 #endif
 	HALF addAlias = historyBlur * 0.5 + 0.25;
-	addAlias = saturate(addAlias + 1.0 / (1.0 + contrast * lumContrastFactor));
+	addAlias = saturate(addAlias + 1.0 / (1.0 + contrast * lumContrastFactor) + convergence);
 	filtered.xyz = lerp(filtered.xyz, currentTM.xyz, addAlias);
 
 	// Calculate blend factor
@@ -9,6 +9,7 @@
 
 #define IRRADIANCE_BIT	1
 #define RADIANCE_BIT	2
+#define PREFILTERED_BIT	4
 
 //--------------------------------------------------------------------------------------
 // Struct
@@ -113,9 +114,20 @@ PSOut main(PSIn input)
 	const min16float3 V = min16float3(normalize(g_eyePos - input.WSPos));
 	float3 radiance = 0.0;
 #ifdef _HAS_LIGHT_PROBE_
+	const min16float roughness = 0.4;
 	const min16float3 R = reflect(-V, N);
 	const bool hasRadiance = g_hasLightProbes & RADIANCE_BIT;
-	if (hasRadiance) radiance = g_txRadiance.SampleBias(g_smpLinear, R, 2.0);
+	if (hasRadiance)
+	{
+		if (g_hasLightProbes & PREFILTERED_BIT)
+		{
+			// The prefiltered mip levels are linear in roughness
+			uint width, height, numMips;
+			g_txRadiance.GetDimensions(0, width, height, numMips);
+			radiance = g_txRadiance.SampleLevel(g_smpLinear, R, roughness * (numMips - 1.0));
+		}
+		else radiance = g_txRadiance.SampleBias(g_smpLinear, R, 2.0);
+	}
 #endif
 
 	// Specular related
@@ -131,7 +143,6 @@ PSOut main(PSIn input)
 	ambient = hasIrradiance ? min16float3(irradiance) : ambient;
 
 	// Radiance
-	const min16float roughness = 0.4;
 	const min16float4 c0 = { -1.0, -0.0275, -0.572, 0.022 };
 	const min16float4 c1 = { 1.0, 0.0425, 1.04, -0.04 };
 	const min16float4 r = roughness * c0 + c1;
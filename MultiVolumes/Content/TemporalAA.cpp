@@ -0,0 +1,474 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "TemporalAA.h"
+#include "ParallelFor.h"
+#include "SampleSequence.h"
+#include <chrono>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+// Lanes of pixels in a row, 8 with AVX2 and 1 otherwise
+//--------------------------------------------------------------------------------------
+#if defined(__AVX2__)
+struct Lanes { __m256 v; };
+struct Mask { __m256 v; };
+static const uint32_t g_numLanes = 8;
+
+static inline Lanes lanes(float s) { return { _mm256_set1_ps(s) }; }
+static inline Lanes load(const float* p) { return { _mm256_loadu_ps(p) }; }
+static inline void store(float* p, Lanes a) { _mm256_storeu_ps(p, a.v); }
+static inline Lanes operator+(Lanes a, Lanes b) { return { _mm256_add_ps(a.v, b.v) }; }
+static inline Lanes operator-(Lanes a, Lanes b) { return { _mm256_sub_ps(a.v, b.v) }; }
+static inline Lanes operator*(Lanes a, Lanes b) { return { _mm256_mul_ps(a.v, b.v) }; }
+static inline Lanes operator/(Lanes a, Lanes b) { return { _mm256_div_ps(a.v, b.v) }; }
+static inline Lanes vmin(Lanes a, Lanes b) { return { _mm256_min_ps(a.v, b.v) }; }
+static inline Lanes vmax(Lanes a, Lanes b) { return { _mm256_max_ps(a.v, b.v) }; }
+static inline Lanes vsqrt(Lanes a) { return { _mm256_sqrt_ps(a.v) }; }
+static inline Lanes vabs(Lanes a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+static inline Mask vless(Lanes a, Lanes b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+static inline Mask vgreater(Lanes a, Lanes b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+static inline Mask visnan(Lanes a) { return { _mm256_cmp_ps(a.v, a.v, _CMP_UNORD_Q) }; }
+static inline Mask operator|(Mask a, Mask b) { return { _mm256_or_ps(a.v, b.v) }; }
+static inline Lanes vselect(Mask m, Lanes a, Lanes b) { return { _mm256_blendv_ps(b.v, a.v, m.v) }; }
+#else
+struct Lanes { float v; };
+struct Mask { bool v; };
+static const uint32_t g_numLanes = 1;
+
+static inline Lanes lanes(float s) { return { s }; }
+static inline Lanes load(const float* p) { return { *p }; }
+static inline void store(float* p, Lanes a) { *p = a.v; }
+static inline Lanes operator+(Lanes a, Lanes b) { return { a.v + b.v }; }
+static inline Lanes operator-(Lanes a, Lanes b) { return { a.v - b.v }; }
+static inline Lanes operator*(Lanes a, Lanes b) { return { a.v * b.v }; }
+static inline Lanes operator/(Lanes a, Lanes b) { return { a.v / b.v }; }
+static inline Lanes vmin(Lanes a, Lanes b) { return { (min)(a.v, b.v) }; }
+static inline Lanes vmax(Lanes a, Lanes b) { return { (max)(a.v, b.v) }; }
+static inline Lanes vsqrt(Lanes a) { return { sqrtf(a.v) }; }
+static inline Lanes vabs(Lanes a) { return { fabsf(a.v) }; }
+static inline Mask vless(Lanes a, Lanes b) { return { a.v < b.v }; }
+static inline Mask vgreater(Lanes a, Lanes b) { return { a.v > b.v }; }
+static inline Mask visnan(Lanes a) { return { a.v != a.v }; }
+static inline Mask operator|(Mask a, Mask b) { return { a.v || b.v }; }
+static inline Lanes vselect(Mask m, Lanes a, Lanes b) { return { m.v ? a.v : b.v }; }
+#endif
+
+static inline Lanes vsaturate(Lanes a) { return vmin(vmax(a, lanes(0.0f)), lanes(1.0f)); }
+static inline Lanes vlerp(Lanes a, Lanes b, Lanes t) { return a + (b - a) * t; }
+
+static const float g_historyMax = 15.0f;	// 4-bit history counter
+static const int g_texOffsets[][2] =
+{
+	{ -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 },
+	{ -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 }
+};
+static const float g_neighborWeights[] = { 0.5f, 0.5f, 0.5f, 0.5f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+// A fast invertible tone map in YCoCg (Reinhard)
+static inline void toneMap(float r, float g, float b, float& y, float& co, float& cg)
+{
+	y = r + 2.0f * g + b;
+	co = 2.0f * r - 2.0f * b;
+	cg = -r + 2.0f * g - b;
+
+	const auto scale = 1.0f / (4.0f + y);
+	y *= scale;
+	co *= scale;
+	cg *= scale;
+}
+
+static inline void toneMap(Lanes r, Lanes g, Lanes b, Lanes& y, Lanes& co, Lanes& cg)
+{
+	y = r + lanes(2.0f) * g + b;
+	co = lanes(2.0f) * (r - b);
+	cg = lanes(2.0f) * g - r - b;
+
+	const auto scale = lanes(1.0f) / (lanes(4.0f) + y);
+	y = y * scale;
+	co = co * scale;
+	cg = cg * scale;
+}
+
+// Inverse of the preceding function
+static inline void inverseToneMap(Lanes y, Lanes co, Lanes cg, Lanes& r, Lanes& g, Lanes& b)
+{
+	const auto scale = lanes(1.0f) / (lanes(1.0f) - y);
+	y = y * scale;
+	co = co * scale;
+	cg = cg * scale;
+
+	r = y + co - cg;
+	g = y + cg;
+	b = y - co - cg;
+}
+
+TemporalAA::TemporalAA() :
+	m_params(GetDefaultParams()),
+	m_width(0),
+	m_height(0),
+	m_pitch(0),
+	m_historyIndex(0)
+{
+}
+
+TemporalAA::~TemporalAA()
+{
+}
+
+void TemporalAA::Init(uint32_t width, uint32_t height)
+{
+	m_width = width;
+	m_height = height;
+
+	// Whole tiles plus the border, so that the lanes never leave the planes
+	m_pitch = (width + TileSize - 1) / TileSize * TileSize + 2;
+	const auto numRows = (height + TileSize - 1) / TileSize * TileSize + 2;
+	for (auto& plane : m_planes) plane.assign(static_cast<size_t>(m_pitch) * numRows, 0.0f);
+
+	for (auto& history : m_histories) history.resize(static_cast<size_t>(width) * height);
+	Reset();
+}
+
+void TemporalAA::SetParams(const Params& params)
+{
+	m_params = params;
+}
+
+void TemporalAA::Reset()
+{
+	for (auto& history : m_histories) fill(history.begin(), history.end(), XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+	m_historyIndex = 0;
+}
+
+const XMFLOAT4* TemporalAA::Resolve(const XMFLOAT4* pCurrent, const XMFLOAT2* pVelocities)
+{
+	m_historyIndex = !m_historyIndex;
+
+	ParallelFor(m_height, TileSize, [&](uint32_t begin, uint32_t end)
+	{
+		loadPlanes(begin, end, pCurrent, pVelocities);
+	});
+
+	const auto numTilesX = (m_width + TileSize - 1) / TileSize;
+	const auto numTilesY = (m_height + TileSize - 1) / TileSize;
+	ParallelFor(numTilesX * numTilesY, 4, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i) resolveTile(i % numTilesX, i / numTilesX);
+	});
+
+	return GetOutput();
+}
+
+const XMFLOAT4* TemporalAA::GetOutput() const
+{
+	return m_histories[m_historyIndex].data();
+}
+
+const TemporalAA::Params& TemporalAA::GetParams() const
+{
+	return m_params;
+}
+
+TemporalAA::Params TemporalAA::GetDefaultParams()
+{
+	// As built for ObjectRenderer, with ALPHA_BOUND = 1.0
+	Params params;
+	params.Gamma = 16.0f;
+	params.AlphaBound = 1.0f;
+	params.LumContrastFactor = 32.0f * 4.0f;
+	params.MaxBlend = 0.25f;
+	params.HistoryBlurAmp = 4.0f;
+
+	return params;
+}
+
+TemporalAA::EvaluationResult TemporalAA::Evaluate(const EvaluationDesc& desc)
+{
+	EvaluationResult result = {};
+
+	// Aliasing-prone pattern of a checker board and high-frequency stripes
+	const auto pattern = [](float x, float y)
+	{
+		const auto checker = (static_cast<int>(floorf(x / 4.0f)) + static_cast<int>(floorf(y / 4.0f))) & 0x1;
+
+		return XMFLOAT3(checker ? 0.9f : 0.1f, 0.5f + 0.5f * sinf(2.1f * x + 0.4f * y), 0.5f + 0.5f * sinf(1.7f * y));
+	};
+
+	const auto numPixels = static_cast<size_t>(desc.Width) * desc.Height;
+	vector<XMFLOAT4> current(numPixels);
+	vector<XMFLOAT3> reference(numPixels);
+	vector<float> inputErrors(numPixels * 3), errors(numPixels * 3);
+	const vector<XMFLOAT2> velocities(numPixels, XMFLOAT2(-desc.Velocity.x / desc.Width, -desc.Velocity.y / desc.Height));
+
+	TemporalAA taa;
+	taa.Init(desc.Width, desc.Height);
+	taa.SetParams(desc.Parameters);
+
+	const auto warmUpFrames = desc.NumWarmUpFrames;
+	auto numMeasured = 0u, numFlickerMeasured = 0u;
+	double inputErrorSum = 0.0, errorSum = 0.0, inputFlickerSum = 0.0, flickerSum = 0.0;
+	for (auto f = 0u; f < desc.NumFrames; ++f)
+	{
+		const auto offsetX = desc.Velocity.x * f;
+		const auto offsetY = desc.Velocity.y * f;
+		const auto jitterX = SampleSequence::Halton(f % 16 + 1, 2) - 0.5f;
+		const auto jitterY = SampleSequence::Halton(f % 16 + 1, 3) - 0.5f;
+
+		// Jittered point samples, and the 4x4 supersampled reference
+		ParallelFor(desc.Height, 16, [&](uint32_t begin, uint32_t end)
+		{
+			for (auto y = begin; y < end; ++y)
+			{
+				for (auto x = 0u; x < desc.Width; ++x)
+				{
+					const auto i = desc.Width * y + x;
+					const auto px = x + offsetX, py = y + offsetY;
+					const auto color = pattern(px + 0.5f + jitterX, py + 0.5f + jitterY);
+					current[i] = XMFLOAT4(color.x, color.y, color.z, 1.0f);
+
+					XMFLOAT3 sum(0.0f, 0.0f, 0.0f);
+					for (uint8_t s = 0; s < 16; ++s)
+					{
+						const auto sample = pattern(px + ((s & 3) + 0.5f) / 4.0f, py + ((s >> 2) + 0.5f) / 4.0f);
+						sum.x += sample.x;
+						sum.y += sample.y;
+						sum.z += sample.z;
+					}
+					reference[i] = XMFLOAT3(sum.x / 16.0f, sum.y / 16.0f, sum.z / 16.0f);
+				}
+			}
+		});
+
+		const auto start = chrono::steady_clock::now();
+		const auto pOutput = taa.Resolve(current.data(), velocities.data());
+		result.FrameTime += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+		if (f < warmUpFrames) continue;
+
+		// The 1-pixel border is skipped, where the zero out-of-bounds loads darken the neighborhood
+		for (auto y = 1u; y + 1 < desc.Height; ++y)
+		for (auto x = 1u; x + 1 < desc.Width; ++x)
+		{
+			const auto i = desc.Width * y + x;
+			const float inputErrs[] = { current[i].x - reference[i].x, current[i].y - reference[i].y, current[i].z - reference[i].z };
+			const float errs[] = { pOutput[i].x - reference[i].x, pOutput[i].y - reference[i].y, pOutput[i].z - reference[i].z };
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				inputErrorSum += inputErrs[c] * inputErrs[c];
+				errorSum += errs[c] * errs[c];
+				if (f > warmUpFrames)
+				{
+					inputFlickerSum += fabsf(inputErrs[c] - inputErrors[i * 3 + c]);
+					flickerSum += fabsf(errs[c] - errors[i * 3 + c]);
+				}
+				inputErrors[i * 3 + c] = inputErrs[c];
+				errors[i * 3 + c] = errs[c];
+			}
+		}
+		++numMeasured;
+		numFlickerMeasured += f > warmUpFrames ? 1 : 0;
+	}
+
+	const auto numInteriors = static_cast<double>(desc.Width - 2) * (desc.Height - 2);
+	const auto numMeasuredValues = numInteriors * 3 * numMeasured;
+	const auto numFlickerValues = numInteriors * 3 * numFlickerMeasured;
+	result.InputRMSE = numMeasured > 0 ? static_cast<float>(sqrt(inputErrorSum / numMeasuredValues)) : 0.0f;
+	result.RMSE = numMeasured > 0 ? static_cast<float>(sqrt(errorSum / numMeasuredValues)) : 0.0f;
+	result.InputFlicker = numFlickerMeasured > 0 ? static_cast<float>(inputFlickerSum / numFlickerValues) : 0.0f;
+	result.Flicker = numFlickerMeasured > 0 ? static_cast<float>(flickerSum / numFlickerValues) : 0.0f;
+	result.FrameTime = desc.NumFrames > 0 ? result.FrameTime / desc.NumFrames : 0.0;
+
+	return result;
+}
+
+void TemporalAA::loadPlanes(uint32_t begin, uint32_t end, const XMFLOAT4* pCurrent, const XMFLOAT2* pVelocities)
+{
+	for (auto y = begin; y < end; ++y)
+	{
+		const auto base = (y + 1) * m_pitch + 1;
+		for (auto x = 0u; x < m_width; ++x)
+		{
+			const auto& current = pCurrent[m_width * y + x];
+			const auto& velocity = pVelocities[m_width * y + x];
+			const auto i = base + x;
+
+			toneMap(current.x, current.y, current.z, m_planes[PLANE_Y][i], m_planes[PLANE_CO][i], m_planes[PLANE_CG][i]);
+			m_planes[PLANE_ALPHA][i] = current.w < m_params.AlphaBound ? 0.0f : 1.0f;
+			m_planes[PLANE_VELOCITY_X][i] = velocity.x;
+			m_planes[PLANE_VELOCITY_Y][i] = velocity.y;
+		}
+	}
+}
+
+void TemporalAA::resolveTile(uint32_t tileX, uint32_t tileY)
+{
+	const auto& params = m_params;
+	const auto& planes = m_planes;
+	auto& output = m_histories[m_historyIndex];
+	const auto texWidth = static_cast<float>(m_width);
+	const auto texHeight = static_cast<float>(m_height);
+
+	const auto xEnd = (min)((tileX + 1) * TileSize, m_width);
+	const auto yEnd = (min)((tileY + 1) * TileSize, m_height);
+	for (auto y = tileY * TileSize; y < yEnd; ++y)
+	{
+		for (auto x0 = tileX * TileSize; x0 < xEnd; x0 += g_numLanes)
+		{
+			const auto base = (y + 1) * m_pitch + x0 + 1;
+			const auto loadPlane = [&](uint8_t plane, int dx, int dy)
+			{
+				return load(&planes[plane][base + dy * static_cast<int>(m_pitch) + dx]);
+			};
+
+			// Maximum velocity of the center and its diagonal neighbors
+			auto velocityX = loadPlane(PLANE_VELOCITY_X, 0, 0);
+			auto velocityY = loadPlane(PLANE_VELOCITY_Y, 0, 0);
+			auto speedSq = velocityX * velocityX + velocityY * velocityY;
+			for (uint8_t i = 4; i < 8; ++i)
+			{
+				const auto neighborX = loadPlane(PLANE_VELOCITY_X, g_texOffsets[i][0], g_texOffsets[i][1]);
+				const auto neighborY = loadPlane(PLANE_VELOCITY_Y, g_texOffsets[i][0], g_texOffsets[i][1]);
+				const auto speedSqN = neighborX * neighborX + neighborY * neighborY;
+				const auto isFaster = vgreater(speedSqN, speedSq);
+				velocityX = vselect(isFaster, neighborX, velocityX);
+				velocityY = vselect(isFaster, neighborY, velocityY);
+				speedSq = vselect(isFaster, speedSqN, speedSq);
+			}
+
+			// Bilinear history samples are gathered per pixel
+			float vx[g_numLanes], vy[g_numLanes];
+			float histories[4][g_numLanes] = {};
+			store(vx, velocityX);
+			store(vy, velocityY);
+			for (auto l = 0u; l < g_numLanes && x0 + l < xEnd; ++l)
+			{
+				const auto history = sampleHistory((x0 + l + 0.5f) / texWidth - vx[l], (y + 0.5f) / texHeight - vy[l]);
+				histories[0][l] = history.x;
+				histories[1][l] = history.y;
+				histories[2][l] = history.z;
+				histories[3][l] = history.w;
+			}
+			const auto historyW = load(histories[3]);
+
+			// Speed to history blur, and the history weight from the metadata
+			auto curHistoryBlur = vabs(velocityX) * lanes(params.HistoryBlurAmp * texWidth) +
+				vabs(velocityY) * lanes(params.HistoryBlurAmp * texHeight);
+			auto historyBlur = vmax(lanes(1.0f) - historyW, curHistoryBlur);
+			const auto historyCount = historyW * lanes(g_historyMax) + lanes(1.0f);
+
+			// Variance AABB of the neighbors in YCoCg
+			const Lanes currentTM[] = { loadPlane(PLANE_Y, 0, 0), loadPlane(PLANE_CO, 0, 0), loadPlane(PLANE_CG, 0, 0) };
+			const auto currentAlpha = loadPlane(PLANE_ALPHA, 0, 0);
+			const auto gamma = vselect(vgreater(historyBlur, lanes(0.0f)) | vless(currentAlpha, lanes(0.5f)),
+				lanes(1.0f), lanes(params.Gamma));
+
+			Lanes m1[3], m2[3], filtered[4];
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				m1[c] = currentTM[c];
+				m2[c] = currentTM[c] * currentTM[c];
+				filtered[c] = currentTM[c];
+			}
+			filtered[3] = currentAlpha;
+
+			for (uint8_t i = 0; i < 8; ++i)
+			{
+				const auto weight = lanes(g_neighborWeights[i]);
+				for (uint8_t c = 0; c < 4; ++c)
+				{
+					const auto neighbor = loadPlane(c, g_texOffsets[i][0], g_texOffsets[i][1]);
+					filtered[c] = filtered[c] + neighbor * weight;
+					if (c < 3)
+					{
+						m1[c] = m1[c] + neighbor;
+						m2[c] = m2[c] + neighbor * neighbor;
+					}
+				}
+			}
+
+			Lanes neighborMin[3], neighborMax[3], mu[3], sigma[3];
+			for (uint8_t c = 0; c < 4; ++c) filtered[c] = filtered[c] * lanes(0.25f);
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				mu[c] = m1[c] * lanes(1.0f / 9.0f);
+				sigma[c] = vsqrt(vabs(m2[c] * lanes(1.0f / 9.0f) - mu[c] * mu[c]));
+				neighborMin[c] = vmin(mu[c] - gamma * sigma[c], filtered[c]);
+				neighborMax[c] = vmax(mu[c] + gamma * sigma[c], filtered[c]);
+			}
+			const auto neighborMinW = mu[0] - sigma[0];
+			const auto neighborMaxW = mu[0] + sigma[0];
+
+			curHistoryBlur = vsaturate(curHistoryBlur);
+			historyBlur = vsaturate(historyBlur);
+
+			// Clip historical color
+			Lanes historyTM[3];
+			toneMap(load(histories[0]), load(histories[1]), load(histories[2]), historyTM[0], historyTM[1], historyTM[2]);
+			for (uint8_t c = 0; c < 3; ++c) historyTM[c] = vmin(vmax(historyTM[c], neighborMin[c]), neighborMax[c]);
+			const auto contrast = neighborMaxW - neighborMinW;
+
+			// Add aliasing, less as the history converges, which then holds the jittered samples
+			const auto addAlias = vsaturate(historyBlur * lanes(0.5f) + lanes(0.25f) +
+				lanes(1.0f) / (lanes(1.0f) + contrast * lanes(params.LumContrastFactor)) + historyW);
+			for (uint8_t c = 0; c < 3; ++c) filtered[c] = vlerp(filtered[c], currentTM[c], addAlias);
+
+			// Calculate blend factor
+			const auto distToClamp = vmin(vabs(neighborMinW - historyTM[0]), vabs(neighborMaxW - historyTM[0]));
+			const auto historyAmt = vmin(lanes(1.0f) / historyCount + historyBlur * lanes(1.0f / 8.0f), lanes(1.0f));
+			auto blend = lanes(params.MaxBlend) / vlerp(lanes(8.0f), distToClamp + contrast, historyAmt);
+			blend = vmin(blend, lanes(params.MaxBlend));
+			blend = vselect(vgreater(filtered[3], lanes(0.0f)), blend, lanes(1.0f));
+
+			Lanes result[3], fallback[3];
+			inverseToneMap(vlerp(historyTM[0], filtered[0], blend), vlerp(historyTM[1], filtered[1], blend),
+				vlerp(historyTM[2], filtered[2], blend), result[0], result[1], result[2]);
+			inverseToneMap(filtered[0], filtered[1], filtered[2], fallback[0], fallback[1], fallback[2]);
+			const auto isNaN = visnan(result[0]) | visnan(result[1]) | visnan(result[2]);
+			const auto metadata = vmin(historyCount * lanes(1.0f / g_historyMax), lanes(1.0f) - curHistoryBlur);
+
+			float outputs[4][g_numLanes];
+			for (uint8_t c = 0; c < 3; ++c) store(outputs[c], vselect(isNaN, fallback[c], result[c]));
+			store(outputs[3], metadata);
+			for (auto l = 0u; l < g_numLanes && x0 + l < xEnd; ++l)
+				output[m_width * y + x0 + l] = XMFLOAT4(outputs[0][l], outputs[1][l], outputs[2][l], outputs[3][l]);
+		}
+	}
+}
+
+XMFLOAT4 TemporalAA::sampleHistory(float u, float v) const
+{
+	// Bilinear with wrap addressing, as the LINEAR_WRAP static sampler
+	const auto& history = m_histories[!m_historyIndex];
+	const auto x = u * m_width - 0.5f;
+	const auto y = v * m_height - 0.5f;
+	const auto xf = floorf(x), yf = floorf(y);
+	const auto fx = x - xf, fy = y - yf;
+
+	const auto wrap = [](int i, uint32_t size)
+	{
+		const auto n = static_cast<int>(size);
+		i %= n;
+
+		return static_cast<uint32_t>(i < 0 ? i + n : i);
+	};
+	const auto x0 = wrap(static_cast<int>(xf), m_width), x1 = wrap(static_cast<int>(xf) + 1, m_width);
+	const auto y0 = wrap(static_cast<int>(yf), m_height), y1 = wrap(static_cast<int>(yf) + 1, m_height);
+
+	const auto t00 = XMLoadFloat4(&history[m_width * y0 + x0]);
+	const auto t10 = XMLoadFloat4(&history[m_width * y0 + x1]);
+	const auto t01 = XMLoadFloat4(&history[m_width * y1 + x0]);
+	const auto t11 = XMLoadFloat4(&history[m_width * y1 + x1]);
+
+	XMFLOAT4 result;
+	XMStoreFloat4(&result, XMVectorLerp(XMVectorLerp(t00, t10, fx), XMVectorLerp(t01, t11, fx), fy));
+
+	return result;
+}
@@ -0,0 +1,87 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Host-side port of CSTemporalAA.hlsl as used by ObjectRenderer::TemporalAA(), with
+// YCoCg variance clipping and the 4-bit history counter in the alpha channel. Tiles
+// of 16x16 pixels are resolved in parallel, over 8 pixels of a row at once with AVX2.
+// The filtered neighborhood blended into the current frame fades as the history converges,
+// so a static, converged pixel accumulates its jittered samples unfiltered.
+class TemporalAA
+{
+public:
+	struct Params
+	{
+		float Gamma;				// Variance AABB scale for converged, static pixels
+		float AlphaBound;			// ALPHA_BOUND
+		float LumContrastFactor;	// Aliasing added back for low-contrast neighborhoods
+		float MaxBlend;				// Max weight of the current frame
+		float HistoryBlurAmp;		// Speed in texels to history blur
+	};
+
+	struct EvaluationDesc
+	{
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t NumFrames;
+		uint32_t NumWarmUpFrames;	// Left out of the measures while the history converges
+		DirectX::XMFLOAT2 Velocity;	// Pan speed in pixels per frame
+		Params Parameters;
+	};
+
+	struct EvaluationResult
+	{
+		float InputRMSE;		// Of the jittered, aliased input against the supersampled reference
+		float InputFlicker;		// Mean frame-to-frame change of the input error
+		float RMSE;
+		float Flicker;
+		double FrameTime;		// In milliseconds
+	};
+
+	TemporalAA();
+	virtual ~TemporalAA();
+
+	void Init(uint32_t width, uint32_t height);
+	void SetParams(const Params& params);
+	void Reset();
+
+	// Velocities are in texture space, as in the velocity render target
+	const DirectX::XMFLOAT4* Resolve(const DirectX::XMFLOAT4* pCurrent, const DirectX::XMFLOAT2* pVelocities);
+
+	const DirectX::XMFLOAT4* GetOutput() const;
+	const Params& GetParams() const;
+
+	static Params GetDefaultParams();
+	static EvaluationResult Evaluate(const EvaluationDesc& desc);
+
+	static const uint32_t TileSize = 16;
+
+protected:
+	enum Plane : uint8_t
+	{
+		PLANE_Y,
+		PLANE_CO,
+		PLANE_CG,
+		PLANE_ALPHA,
+		PLANE_VELOCITY_X,
+		PLANE_VELOCITY_Y,
+
+		NUM_PLANE
+	};
+
+	void loadPlanes(uint32_t begin, uint32_t end, const DirectX::XMFLOAT4* pCurrent, const DirectX::XMFLOAT2* pVelocities);
+	void resolveTile(uint32_t tileX, uint32_t tileY);
+	DirectX::XMFLOAT4 sampleHistory(float u, float v) const;
+
+	// Tone-mapped YCoCg, binarized alpha and velocities with a zero border, as out-of-bounds loads on the GPU
+	std::vector<float>		m_planes[NUM_PLANE];
+	std::vector<DirectX::XMFLOAT4> m_histories[2];
+
+	Params		m_params;
+	uint32_t	m_width;
+	uint32_t	m_height;
+	uint32_t	m_pitch;
+	uint8_t		m_historyIndex;
+};
@@ -0,0 +1,178 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "TraceRecorder.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+//--------------------------------------------------------------------------------------
+// Per-thread event rings, written by their threads and drained by the flush
+//--------------------------------------------------------------------------------------
+struct TraceEvent
+{
+	const char* Name;
+	int64_t Time;	// In nanoseconds since the start time
+	char Phase;		// 'B' or 'E'
+};
+
+struct TraceRing
+{
+	TraceEvent Events[TraceRecorder::RingSize];
+	atomic<uint32_t> Head;		// Written by the owner thread
+	atomic<uint32_t> Tail;		// Written by the flush
+	atomic<uint32_t> NumDropped;
+	atomic<bool> IsInUse;
+	uint32_t ThreadId;			// Lane of the timeline
+};
+
+struct TraceRingHolder
+{
+	~TraceRingHolder()
+	{
+		// Hand the ring to a later thread, with its events still to be flushed
+		if (pRing) pRing->IsInUse.store(false, memory_order_release);
+	}
+
+	TraceRing* pRing;
+};
+
+static const auto g_startTime = chrono::steady_clock::now();
+static mutex g_ringMutex;
+static vector<unique_ptr<TraceRing>> g_rings;
+static thread_local TraceRingHolder g_ringHolder = { nullptr };
+static uint64_t g_numDropped = 0;
+
+static TraceRing* getThreadRing()
+{
+	if (g_ringHolder.pRing) return g_ringHolder.pRing;
+
+	// First event of the thread: reuse the ring of an exited thread, or add one
+	lock_guard<mutex> lock(g_ringMutex);
+	for (auto& ring : g_rings)
+	{
+		auto isInUse = false;
+		if (ring->IsInUse.compare_exchange_strong(isInUse, true, memory_order_acquire))
+			return g_ringHolder.pRing = ring.get();
+	}
+
+	unique_ptr<TraceRing> ring(new TraceRing);
+	ring->Head.store(0, memory_order_relaxed);
+	ring->Tail.store(0, memory_order_relaxed);
+	ring->NumDropped.store(0, memory_order_relaxed);
+	ring->IsInUse.store(true, memory_order_relaxed);
+	ring->ThreadId = static_cast<uint32_t>(g_rings.size() + 1);
+	g_rings.push_back(move(ring));
+
+	return g_ringHolder.pRing = g_rings.back().get();
+}
+
+static inline void pushEvent(const char* name, char phase)
+{
+	const auto time = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - g_startTime).count();
+
+	const auto pRing = getThreadRing();
+	const auto head = pRing->Head.load(memory_order_relaxed);
+	if (head - pRing->Tail.load(memory_order_acquire) >= TraceRecorder::RingSize)
+	{
+		pRing->NumDropped.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	auto& event = pRing->Events[head % TraceRecorder::RingSize];
+	event.Name = name;
+	event.Time = time;
+	event.Phase = phase;
+	pRing->Head.store(head + 1, memory_order_release);
+}
+
+//--------------------------------------------------------------------------------------
+// Trace recorder
+//--------------------------------------------------------------------------------------
+void TraceRecorder::Begin(const char* name)
+{
+	pushEvent(name, 'B');
+}
+
+void TraceRecorder::End(const char* name)
+{
+	pushEvent(name, 'E');
+}
+
+bool TraceRecorder::Flush(const char* fileName)
+{
+	ofstream file(fileName);
+	if (!file) return false;
+
+	lock_guard<mutex> lock(g_ringMutex);
+
+	// Timestamps in microseconds
+	file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << endl;
+	file << fixed << setprecision(3);
+	auto isFirst = true;
+	for (auto& ring : g_rings)
+	{
+		const auto head = ring->Head.load(memory_order_acquire);
+		auto tail = ring->Tail.load(memory_order_relaxed);
+		for (; tail != head; ++tail)
+		{
+			const auto& event = ring->Events[tail % RingSize];
+			file << (isFirst ? "" : ",\n") << "{\"name\": \"" << event.Name << "\", \"ph\": \"" << event.Phase
+				<< "\", \"ts\": " << event.Time / 1000.0 << ", \"pid\": 1, \"tid\": " << ring->ThreadId << "}";
+			isFirst = false;
+		}
+		ring->Tail.store(tail, memory_order_release);
+		g_numDropped += ring->NumDropped.exchange(0, memory_order_relaxed);
+	}
+	file << endl << "]}" << endl;
+
+	return static_cast<bool>(file);
+}
+
+bool TraceRecorder::IsCompiledIn()
+{
+#if defined(_ENABLE_TRACE_)
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint64_t TraceRecorder::GetNumDropped()
+{
+	lock_guard<mutex> lock(g_ringMutex);
+
+	return g_numDropped;
+}
+
+double TraceRecorder::Benchmark(uint32_t numEvents)
+{
+	const auto pRing = getThreadRing();
+
+	// No flush in between, so that the benchmark events can be discarded by rewinding the head
+	lock_guard<mutex> lock(g_ringMutex);
+	const auto head = pRing->Head.load(memory_order_relaxed);
+	const auto batchSize = (max)((RingSize - (head - pRing->Tail.load(memory_order_relaxed))) / 2, 1u);
+
+	auto time = 0.0;
+	for (auto n = 0u; n < numEvents;)
+	{
+		const auto count = (min)(batchSize, numEvents - n);
+		const auto startTime = chrono::steady_clock::now();
+		for (auto i = 0u; i < count; ++i)
+		{
+			Begin("Benchmark");
+			End("Benchmark");
+		}
+		time += chrono::duration<double, nano>(chrono::steady_clock::now() - startTime).count();
+
+		pRing->Head.store(head, memory_order_release);
+		n += count;
+	}
+
+	return time / (2.0 * (max)(numEvents, 1u));
+}
@@ -0,0 +1,51 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Timeline of the CPU work as begin and end events, flushed on demand to the Chrome trace
+// JSON format (chrome://tracing, ui.perfetto.dev). Events are pushed into a ring buffer of
+// the calling thread without locks, and dropped when it is full rather than waiting for a
+// flush. The TRACE_ macros compile to nothing unless _ENABLE_TRACE_ is defined; names must
+// be string literals, as only their pointers are recorded. [T] in MultiVolumes flushes the
+// trace to MultiVolumes.trace.json, and MultiVolumesHeadless -trace after rendering.
+#if defined(_ENABLE_TRACE_)
+#define TRACE_CONCAT_(a, b)	a##b
+#define TRACE_CONCAT(a, b)	TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name)	const TraceRecorder::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_BEGIN(name)	TraceRecorder::Begin(name)
+#define TRACE_END(name)		TraceRecorder::End(name)
+#else
+#define TRACE_SCOPE(name)	((void)0)
+#define TRACE_BEGIN(name)	((void)0)
+#define TRACE_END(name)		((void)0)
+#endif
+
+class TraceRecorder
+{
+public:
+	class Scope
+	{
+	public:
+		Scope(const char* name) : m_name(name) { Begin(name); }
+		~Scope() { End(m_name); }
+
+	protected:
+		const char* m_name;
+	};
+
+	static void Begin(const char* name);
+	static void End(const char* name);
+
+	// Writes the events recorded since the last flush as a complete trace
+	static bool Flush(const char* fileName);
+
+	static bool IsCompiledIn();		// Whether the TRACE_ macros record
+	static uint64_t GetNumDropped();
+
+	// Nanoseconds per recorded event, of numEvents begin and end pairs on the calling thread
+	static double Benchmark(uint32_t numEvents);
+
+	static const uint32_t RingSize = 1 << 16;
+};
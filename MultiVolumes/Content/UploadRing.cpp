@@ -0,0 +1,90 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "UploadRing.h"
+#include "MemoryBudget.h"
+
+using namespace std;
+using namespace XUSG;
+
+UploadRing::UploadRing() :
+	m_pData(nullptr)
+{
+}
+
+UploadRing::~UploadRing()
+{
+	if (m_pData) m_buffer->Unmap();
+}
+
+bool UploadRing::Init(const Device* pDevice, uint64_t capacity, const Flush& flush)
+{
+	m_allocator.Init(capacity);
+	m_flush = flush;
+
+	m_buffer = Buffer::MakeUnique();
+	XUSG_N_RETURN(m_buffer->Create(pDevice, capacity, ResourceFlag::NONE, MemoryType::UPLOAD,
+		0, nullptr, 0, nullptr, MemoryFlag::NONE, L"UploadRing"), false);
+	MemoryBudget::Register("UploadRing", MemoryBudget::GetBufferSize(capacity), MemoryBudget::BUFFERS);
+
+	// Upload heaps stay mapped for their lifetime
+	m_pData = static_cast<uint8_t*>(m_buffer->Map());
+
+	return m_pData != nullptr;
+}
+
+bool UploadRing::Upload(CommandList* pCommandList, Resource* pDstBuffer, const void* pData, size_t size,
+	ResourceState dstState, uint64_t dstOffset)
+{
+	ResourceBarrier barrier;
+	auto numBarriers = pDstBuffer->SetBarrier(&barrier, ResourceState::COPY_DEST);
+	pCommandList->Barrier(numBarriers, &barrier);
+
+	// Stream the data in chunks of at most the ring
+	const auto pSrc = static_cast<const uint8_t*>(pData);
+	for (uint64_t offset = 0; offset < size;)
+	{
+		const auto chunkSize = (min)(static_cast<uint64_t>(size) - offset, m_allocator.GetCapacity());
+
+		uint64_t ringOffset;
+		if (!m_allocator.Allocate(chunkSize, Alignment, ringOffset))
+		{
+			// Execute the copies recorded so far, and recycle their staging memory
+			uint64_t fenceValue;
+			XUSG_N_RETURN(m_flush && m_flush(fenceValue), false);
+			m_allocator.Submit(fenceValue);
+			m_allocator.Reclaim(fenceValue);
+			XUSG_N_RETURN(m_allocator.Allocate(chunkSize, Alignment, ringOffset), false);
+		}
+
+		memcpy(&m_pData[ringOffset], &pSrc[offset], chunkSize);
+		pCommandList->CopyBufferRegion(pDstBuffer, dstOffset + offset, m_buffer.get(), ringOffset, chunkSize);
+		offset += chunkSize;
+	}
+
+	numBarriers = pDstBuffer->SetBarrier(&barrier, dstState);
+	pCommandList->Barrier(numBarriers, &barrier);
+
+	return true;
+}
+
+void UploadRing::Submit(uint64_t fenceValue)
+{
+	m_allocator.Submit(fenceValue);
+}
+
+void UploadRing::Reclaim(uint64_t completedFenceValue)
+{
+	m_allocator.Reclaim(completedFenceValue);
+}
+
+uint64_t UploadRing::GetCapacity() const
+{
+	return m_allocator.GetCapacity();
+}
+
+uint64_t UploadRing::GetPeakBytes() const
+{
+	return m_allocator.GetPeakBytes();
+}
@@ -0,0 +1,41 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Core/XUSG.h"
+#include "RingAllocator.h"
+
+// Persistently mapped upload buffer, suballocated by a RingAllocator, through which the
+// loaders stage their buffer data instead of creating an uploader per resource. When the ring
+// is full, the flush callback executes the recorded copies, waits on them, and returns the fence
+// value they were signaled with, so that their staging memory can be reclaimed; uploads larger
+// than the ring are streamed through it in chunks. Textures still go through the DDS loader,
+// which creates its own uploaders.
+class UploadRing
+{
+public:
+	using Flush = std::function<bool(uint64_t& fenceValue)>;
+
+	UploadRing();
+	virtual ~UploadRing();
+
+	bool Init(const XUSG::Device* pDevice, uint64_t capacity, const Flush& flush);
+	bool Upload(XUSG::CommandList* pCommandList, XUSG::Resource* pDstBuffer, const void* pData, size_t size,
+		XUSG::ResourceState dstState = XUSG::ResourceState::COMMON, uint64_t dstOffset = 0);
+
+	void Submit(uint64_t fenceValue);
+	void Reclaim(uint64_t completedFenceValue);
+
+	uint64_t GetCapacity() const;
+	uint64_t GetPeakBytes() const;
+
+	static const uint64_t Alignment = 16;
+
+protected:
+	RingAllocator		m_allocator;
+	XUSG::Buffer::uptr	m_buffer;
+	uint8_t*			m_pData;
+	Flush				m_flush;
+};
@@ -0,0 +1,368 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "VolumeBVH.h"
+#include "ParallelFor.h"
+#include <cfloat>
+#include <numeric>
+
+using namespace std;
+using namespace DirectX;
+
+static float getSurfaceArea(const XMFLOAT3& minPt, const XMFLOAT3& maxPt)
+{
+	const auto x = maxPt.x - minPt.x;
+	const auto y = maxPt.y - minPt.y;
+	const auto z = maxPt.z - minPt.z;
+
+	return 2.0f * (x * y + y * z + z * x);
+}
+
+static void mergeBounds(XMFLOAT3& minPt, XMFLOAT3& maxPt, const XMFLOAT3& minIn, const XMFLOAT3& maxIn)
+{
+	minPt.x = (min)(minPt.x, minIn.x);
+	minPt.y = (min)(minPt.y, minIn.y);
+	minPt.z = (min)(minPt.z, minIn.z);
+	maxPt.x = (max)(maxPt.x, maxIn.x);
+	maxPt.y = (max)(maxPt.y, maxIn.y);
+	maxPt.z = (max)(maxPt.z, maxIn.z);
+}
+
+static void resetBounds(XMFLOAT3& minPt, XMFLOAT3& maxPt)
+{
+	minPt = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	maxPt = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+static float getDistanceSq(const XMFLOAT3& minPt, const XMFLOAT3& maxPt, const XMFLOAT3& pt)
+{
+	const auto x = (minPt.x + maxPt.x) * 0.5f - pt.x;
+	const auto y = (minPt.y + maxPt.y) * 0.5f - pt.y;
+	const auto z = (minPt.z + maxPt.z) * 0.5f - pt.z;
+
+	return x * x + y * y + z * z;
+}
+
+// Returns false if the box is outside any of the planes in the mask, and
+// removes the planes that the box is completely inside of from the mask
+static bool testBox(const XMFLOAT3& minPt, const XMFLOAT3& maxPt, const XMFLOAT4* planes, uint8_t& planeMask)
+{
+	const XMFLOAT3 c((minPt.x + maxPt.x) * 0.5f, (minPt.y + maxPt.y) * 0.5f, (minPt.z + maxPt.z) * 0.5f);
+	const XMFLOAT3 e((maxPt.x - minPt.x) * 0.5f, (maxPt.y - minPt.y) * 0.5f, (maxPt.z - minPt.z) * 0.5f);
+
+	for (uint8_t i = 0; i < 6; ++i)
+	{
+		if ((planeMask & (1 << i)) == 0) continue;
+
+		const auto& p = planes[i];
+		const auto d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+		const auto r = fabsf(p.x) * e.x + fabsf(p.y) * e.y + fabsf(p.z) * e.z;
+		if (d + r < 0.0f) return false;
+		if (d - r >= 0.0f) planeMask &= ~(1 << i);
+	}
+
+	return true;
+}
+
+VolumeBVH::VolumeBVH() :
+	m_numVolumes(0),
+	m_buildCost(0.0f),
+	m_cost(0.0f),
+	m_rebuildThreshold(1.5f)
+{
+}
+
+VolumeBVH::~VolumeBVH()
+{
+}
+
+void VolumeBVH::Build(const XMFLOAT3X4* worlds, uint32_t numVolumes)
+{
+	m_numVolumes = numVolumes;
+	m_boundMins.resize(numVolumes);
+	m_boundMaxs.resize(numVolumes);
+
+	computeBounds(worlds);
+	buildNodes();
+}
+
+void VolumeBVH::Refit(const XMFLOAT3X4* worlds)
+{
+	computeBounds(worlds);
+	m_cost = refitNodes();
+}
+
+bool VolumeBVH::Update(const XMFLOAT3X4* worlds)
+{
+	Refit(worlds);
+
+	// Rebuild if the refitted tree has degraded too much
+	const auto needRebuild = m_cost > m_buildCost * m_rebuildThreshold;
+	if (needRebuild) buildNodes();
+
+	return needRebuild;
+}
+
+void VolumeBVH::Cull(CXMMATRIX viewProj, const XMFLOAT3& eyePt, vector<uint32_t>& visibleVolumes) const
+{
+	visibleVolumes.clear();
+	if (m_nodes.empty()) return;
+
+	// Extract the frustum planes (left, right, bottom, top, near, far)
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, viewProj);
+	XMFLOAT4 planes[6];
+	for (uint8_t i = 0; i < 4; ++i)
+	{
+		const auto c0 = m.m[i][0], c1 = m.m[i][1], c2 = m.m[i][2], c3 = m.m[i][3];
+		(&planes[0].x)[i] = c3 + c0;
+		(&planes[1].x)[i] = c3 - c0;
+		(&planes[2].x)[i] = c3 + c1;
+		(&planes[3].x)[i] = c3 - c1;
+		(&planes[4].x)[i] = c2;
+		(&planes[5].x)[i] = c3 - c2;
+	}
+
+	// Traverse the tree with the nearer child first
+	vector<pair<uint32_t, uint8_t>> stack;
+	stack.reserve(64);
+	stack.emplace_back(0, 0x3f);
+	while (!stack.empty())
+	{
+		const auto nodeIdx = stack.back().first;
+		auto planeMask = stack.back().second;
+		stack.pop_back();
+
+		const auto& node = m_nodes[nodeIdx];
+		if (planeMask && !testBox(node.Min, node.Max, planes, planeMask)) continue;
+
+		if (node.Count > 0)
+		{
+			for (auto i = 0u; i < node.Count; ++i)
+			{
+				const auto volumeId = m_indices[node.LeftFirst + i];
+				auto volumeMask = planeMask;
+				if (!volumeMask || testBox(m_boundMins[volumeId], m_boundMaxs[volumeId], planes, volumeMask))
+					visibleVolumes.push_back(volumeId);
+			}
+		}
+		else
+		{
+			const auto& left = m_nodes[node.LeftFirst];
+			const auto& right = m_nodes[node.LeftFirst + 1];
+			const auto isLeftNearer = getDistanceSq(left.Min, left.Max, eyePt) < getDistanceSq(right.Min, right.Max, eyePt);
+			stack.emplace_back(isLeftNearer ? node.LeftFirst + 1 : node.LeftFirst, planeMask);
+			stack.emplace_back(isLeftNearer ? node.LeftFirst : node.LeftFirst + 1, planeMask);
+		}
+	}
+
+	// Exact front-to-back order; the traversal has left the list nearly sorted
+	vector<pair<float, uint32_t>> keys(visibleVolumes.size());
+	for (size_t i = 0; i < visibleVolumes.size(); ++i)
+	{
+		const auto volumeId = visibleVolumes[i];
+		keys[i] = make_pair(getDistanceSq(m_boundMins[volumeId], m_boundMaxs[volumeId], eyePt), volumeId);
+	}
+
+	sort(keys.begin(), keys.end());
+	for (size_t i = 0; i < keys.size(); ++i) visibleVolumes[i] = keys[i].second;
+}
+
+void VolumeBVH::SetRebuildThreshold(float threshold)
+{
+	m_rebuildThreshold = threshold;
+}
+
+uint32_t VolumeBVH::GetNumVolumes() const
+{
+	return m_numVolumes;
+}
+
+uint32_t VolumeBVH::GetNumNodes() const
+{
+	return static_cast<uint32_t>(m_nodes.size());
+}
+
+float VolumeBVH::GetDegradation() const
+{
+	return m_buildCost > 0.0f ? m_cost / m_buildCost : 1.0f;
+}
+
+void VolumeBVH::computeBounds(const XMFLOAT3X4* worlds)
+{
+	// World-space AABBs of the unit cubes
+	ParallelFor(m_numVolumes, 4096, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto& world = worlds[i];
+			for (uint8_t r = 0; r < 3; ++r)
+			{
+				const auto center = world.m[r][3];
+				const auto extent = fabsf(world.m[r][0]) + fabsf(world.m[r][1]) + fabsf(world.m[r][2]);
+				(&m_boundMins[i].x)[r] = center - extent;
+				(&m_boundMaxs[i].x)[r] = center + extent;
+			}
+		}
+	});
+}
+
+void VolumeBVH::buildNodes()
+{
+	m_indices.resize(m_numVolumes);
+	iota(m_indices.begin(), m_indices.end(), 0u);
+
+	m_nodes.clear();
+	m_nodes.reserve(m_numVolumes > 0 ? 2 * m_numVolumes - 1 : 0);
+	if (m_numVolumes > 0)
+	{
+		Node root = {};
+		root.LeftFirst = 0;
+		root.Count = m_numVolumes;
+		m_nodes.push_back(root);
+
+		// Children are always stored after their parents
+		for (auto i = 0u; i < m_nodes.size(); ++i) partitionNode(i);
+	}
+
+	m_buildCost = m_cost = refitNodes();
+}
+
+void VolumeBVH::partitionNode(uint32_t nodeIdx)
+{
+	const auto first = m_nodes[nodeIdx].LeftFirst;
+	const auto count = m_nodes[nodeIdx].Count;
+	if (count <= MaxLeafSize) return;
+
+	const auto getCentroid = [this](uint32_t i, uint8_t axis)
+	{
+		return ((&m_boundMins[i].x)[axis] + (&m_boundMaxs[i].x)[axis]) * 0.5f;
+	};
+
+	// Centroid bounds
+	XMFLOAT3 cMin, cMax;
+	resetBounds(cMin, cMax);
+	for (auto i = first; i < first + count; ++i)
+	{
+		const auto volumeId = m_indices[i];
+		const XMFLOAT3 c(getCentroid(volumeId, 0), getCentroid(volumeId, 1), getCentroid(volumeId, 2));
+		mergeBounds(cMin, cMax, c, c);
+	}
+
+	const XMFLOAT3 cExt(cMax.x - cMin.x, cMax.y - cMin.y, cMax.z - cMin.z);
+	const uint8_t axis = cExt.x > cExt.y ? (cExt.x > cExt.z ? 0 : 2) : (cExt.y > cExt.z ? 1 : 2);
+	const auto axisMin = (&cMin.x)[axis];
+	const auto axisExt = (&cExt.x)[axis];
+
+	auto mid = first + count / 2;
+	if (axisExt > 0.0f)
+	{
+		// Binned SAH
+		const auto binScale = NumBins / axisExt;
+		const auto getBin = [&](uint32_t volumeId)
+		{
+			const auto bin = static_cast<uint32_t>((getCentroid(volumeId, axis) - axisMin) * binScale);
+
+			return (min)(bin, NumBins - 1);
+		};
+
+		uint32_t binCounts[NumBins] = {};
+		XMFLOAT3 binMins[NumBins], binMaxs[NumBins];
+		for (auto b = 0u; b < NumBins; ++b) resetBounds(binMins[b], binMaxs[b]);
+		for (auto i = first; i < first + count; ++i)
+		{
+			const auto volumeId = m_indices[i];
+			const auto b = getBin(volumeId);
+			++binCounts[b];
+			mergeBounds(binMins[b], binMaxs[b], m_boundMins[volumeId], m_boundMaxs[volumeId]);
+		}
+
+		// Sweep from the right for the right-side costs
+		float rightAreas[NumBins];
+		uint32_t rightCounts[NumBins];
+		XMFLOAT3 minPt, maxPt;
+		resetBounds(minPt, maxPt);
+		auto rightCount = 0u;
+		for (auto b = NumBins - 1; b > 0; --b)
+		{
+			rightCount += binCounts[b];
+			if (binCounts[b] > 0) mergeBounds(minPt, maxPt, binMins[b], binMaxs[b]);
+			rightCounts[b] = rightCount;
+			rightAreas[b] = rightCount > 0 ? getSurfaceArea(minPt, maxPt) : 0.0f;
+		}
+
+		// Sweep from the left and pick the cheapest split
+		auto bestCost = FLT_MAX;
+		auto bestBin = 0u;
+		auto leftCount = 0u;
+		resetBounds(minPt, maxPt);
+		for (auto b = 0u; b + 1 < NumBins; ++b)
+		{
+			leftCount += binCounts[b];
+			if (binCounts[b] > 0) mergeBounds(minPt, maxPt, binMins[b], binMaxs[b]);
+			if (leftCount == 0 || rightCounts[b + 1] == 0) continue;
+
+			const auto cost = leftCount * getSurfaceArea(minPt, maxPt) + rightCounts[b + 1] * rightAreas[b + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestBin = b;
+			}
+		}
+
+		const auto pMid = partition(m_indices.begin() + first, m_indices.begin() + first + count,
+			[&](uint32_t volumeId) { return getBin(volumeId) <= bestBin; });
+		mid = static_cast<uint32_t>(pMid - m_indices.begin());
+	}
+
+	// Fall back to the median split for degenerate partitions
+	if (mid == first || mid == first + count)
+	{
+		mid = first + count / 2;
+		nth_element(m_indices.begin() + first, m_indices.begin() + mid, m_indices.begin() + first + count,
+			[&](uint32_t a, uint32_t b) { return getCentroid(a, axis) < getCentroid(b, axis); });
+	}
+
+	Node left = {}, right = {};
+	left.LeftFirst = first;
+	left.Count = mid - first;
+	right.LeftFirst = mid;
+	right.Count = first + count - mid;
+
+	auto& node = m_nodes[nodeIdx];
+	node.LeftFirst = static_cast<uint32_t>(m_nodes.size());
+	node.Count = 0;
+	m_nodes.push_back(left);
+	m_nodes.push_back(right);
+}
+
+float VolumeBVH::refitNodes()
+{
+	// Bottom-up, since children are always stored after their parents
+	auto cost = 0.0f;
+	for (auto i = static_cast<uint32_t>(m_nodes.size()); i-- > 0;)
+	{
+		auto& node = m_nodes[i];
+		resetBounds(node.Min, node.Max);
+		if (node.Count > 0)
+		{
+			for (auto j = node.LeftFirst; j < node.LeftFirst + node.Count; ++j)
+			{
+				const auto volumeId = m_indices[j];
+				mergeBounds(node.Min, node.Max, m_boundMins[volumeId], m_boundMaxs[volumeId]);
+			}
+		}
+		else
+		{
+			const auto& left = m_nodes[node.LeftFirst];
+			const auto& right = m_nodes[node.LeftFirst + 1];
+			mergeBounds(node.Min, node.Max, left.Min, left.Max);
+			mergeBounds(node.Min, node.Max, right.Min, right.Max);
+		}
+
+		cost += getSurfaceArea(node.Min, node.Max);
+	}
+
+	return cost;
+}
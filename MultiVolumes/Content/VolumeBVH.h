@@ -0,0 +1,53 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Dynamic bounding volume hierarchy over the volume instances. Moved volumes are
+// refitted, and the tree is rebuilt once refitting has degraded its surface-area cost by
+// more than the rebuild threshold (1.5x by default).
+class VolumeBVH
+{
+public:
+	struct Node
+	{
+		DirectX::XMFLOAT3 Min;
+		uint32_t LeftFirst;		// Left child for inner nodes, first index for leaves
+		DirectX::XMFLOAT3 Max;
+		uint32_t Count;			// 0 for inner nodes
+	};
+
+	VolumeBVH();
+	virtual ~VolumeBVH();
+
+	void Build(const DirectX::XMFLOAT3X4* worlds, uint32_t numVolumes);
+	void Refit(const DirectX::XMFLOAT3X4* worlds);
+	bool Update(const DirectX::XMFLOAT3X4* worlds);
+	void Cull(DirectX::CXMMATRIX viewProj, const DirectX::XMFLOAT3& eyePt,
+		std::vector<uint32_t>& visibleVolumes) const;
+	void SetRebuildThreshold(float threshold);
+
+	uint32_t GetNumVolumes() const;
+	uint32_t GetNumNodes() const;
+	float GetDegradation() const;
+
+	static const uint32_t MaxLeafSize = 4;
+	static const uint32_t NumBins = 16;
+
+protected:
+	void computeBounds(const DirectX::XMFLOAT3X4* worlds);
+	void buildNodes();
+	void partitionNode(uint32_t nodeIdx);
+	float refitNodes();
+
+	std::vector<Node>		m_nodes;
+	std::vector<uint32_t>	m_indices;
+	std::vector<DirectX::XMFLOAT3> m_boundMins;
+	std::vector<DirectX::XMFLOAT3> m_boundMaxs;
+
+	uint32_t				m_numVolumes;
+	float					m_buildCost;
+	float					m_cost;
+	float					m_rebuildThreshold;
+};
@@ -0,0 +1,525 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SharedConsts.h"
+#include "VolumeCuller.h"
+#include "ParallelFor.h"
+#include <algorithm>
+
+using namespace std;
+using namespace DirectX;
+
+// Cube corners in the same order as ProjectToViewport() in VolumeCull.hlsli
+static const float g_cubeCorners[8][3] =
+{
+	{ 1.0f, 1.0f, 1.0f },
+	{ -1.0f, 1.0f, 1.0f },
+	{ 1.0f, -1.0f, 1.0f },
+	{ -1.0f, -1.0f, 1.0f },
+
+	{ -1.0f, 1.0f, -1.0f },
+	{ 1.0f, 1.0f, -1.0f },
+	{ -1.0f, -1.0f, -1.0f },
+	{ 1.0f, -1.0f, -1.0f }
+};
+
+// Map from unique edge Ids to vertex indices, as in GetCubeEdge()
+static const uint8_t g_cubeEdges[12][2] =
+{
+	{ 0, 1 },
+	{ 3, 2 },
+
+	{ 1, 3 },
+	{ 2, 0 },
+
+	{ 4, 5 },
+	{ 7, 6 },
+
+	{ 5, 7 },
+	{ 6, 4 },
+
+	{ 1, 4 },
+	{ 6, 3 },
+
+	{ 5, 0 },
+	{ 2, 7 }
+};
+
+// Map from per-face edge indices to unique edge Ids, as in GetCubeFaceEdges()
+static const uint8_t g_cubeFaceEdges[6][4] =
+{
+	{ 10,  3, 11,  6 },	// +X
+	{  8,  7,  9,  2 },	// -X
+
+	{  0, 10,  4,  8 },	// +Y
+	{  5, 11,  1,  9 },	// -Y
+
+	{  0,  2,  1,  3 },	// +Z
+	{  4,  6,  5,  7 }	// -Z
+};
+
+static uint32_t countBits(uint32_t x)
+{
+	auto count = 0u;
+	for (; x; x &= x - 1) ++count;
+
+	return count;
+}
+
+//--------------------------------------------------------------------------------------
+// Scalar port of CSVolumeCull.hlsl for a single volume, with the per-lane wave operations
+// of VolumeCull.hlsli unrolled; returns false if the volume is culled
+//--------------------------------------------------------------------------------------
+static bool cullAsShader(const XMFLOAT3X4& world, const VolumeDesc& volumeIn, CXMMATRIX viewProj,
+	const XMFLOAT3& eyePt, const XMFLOAT2& viewport, uint32_t numSamples, VolumeInfo& volumeOut)
+{
+	const auto worldM = XMLoadFloat3x4(&world);
+	const auto worldViewProj = worldM * viewProj;
+
+	// Project vertices to viewport space, as ProjectToViewport()
+	XMFLOAT2 v[8];
+	auto isInView = false;
+	for (uint8_t i = 0; i < 8; ++i)
+	{
+		XMFLOAT4 p;
+		const auto& c = g_cubeCorners[i];
+		XMStoreFloat4(&p, XMVector4Transform(XMVectorSet(c[0], c[1], c[2], 1.0f), worldViewProj));
+		v[i].x = (p.x / p.w * 0.5f + 0.5f) * viewport.x;
+		v[i].y = (1.0f - (p.y / p.w * 0.5f + 0.5f)) * viewport.y;
+
+		// If any vertices are inside viewport
+		isInView = isInView || (v[i].x <= viewport.x && v[i].y <= viewport.y && v[i].x >= 0.0f && v[i].y >= 0.0f);
+	}
+
+	// Viewport-visibility culling
+	if (!isInView) return false;
+
+	// Visibility mask, as GenVisibilityMask()
+	XMFLOAT3 localSpaceEyePt;
+	XMStoreFloat3(&localSpaceEyePt, XMVector3TransformCoord(XMLoadFloat3(&eyePt), XMMatrixInverse(nullptr, worldM)));
+	auto faceMask = 0u;
+	for (uint8_t f = 0; f < 6; ++f)
+	{
+		const auto viewComp = (&localSpaceEyePt.x)[f >> 1];
+		faceMask |= ((f & 0x1) ? viewComp > -1.0f : viewComp < 1.0f) ? (1 << f) : 0;
+	}
+
+	// Cube edges, as GetCubeEdgePairPerLane()
+	XMFLOAT2 e[12];
+	auto maxEdgeLength = 0.0f;
+	for (uint8_t i = 0; i < 12; ++i)
+	{
+		e[i].x = v[g_cubeEdges[i][1]].x - v[g_cubeEdges[i][0]].x;
+		e[i].y = v[g_cubeEdges[i][1]].y - v[g_cubeEdges[i][0]].y;
+		maxEdgeLength = (max)(maxEdgeLength, sqrtf(e[i].x * e[i].x + e[i].y * e[i].y));
+	}
+
+	// Cube map LOD, as EstimateCubeMapLOD() of the shader, which truncates the level before clamping it
+	const auto cubeMapSize = static_cast<float>(volumeIn.CubeMapSize);
+	auto s = maxEdgeLength / 2.0f;
+	auto raySampleAmt = 2.0f * s / sqrtf(3.0f);
+	const auto raySampleCount = (min)(static_cast<uint32_t>(ceilf(raySampleAmt)), numSamples);
+	raySampleAmt = (min)(raySampleAmt, static_cast<float>(raySampleCount));
+	s = raySampleAmt / 2.0f * sqrtf(3.0f);
+	const auto level = static_cast<uint32_t>((max)(log2f(cubeMapSize / s), 0.0f));
+	const auto mipLevel = (min)(level, volumeIn.NumMips - 1u);
+
+	// Volume projection coverage, as EstimateProjCoverage()
+	auto projCov = 0.0f;
+	for (uint8_t f = 0; f < 6; ++f)
+	{
+		if ((faceMask & (1 << f)) == 0) continue;
+		const auto fe = g_cubeFaceEdges[f];
+		projCov += 0.5f * fabsf(e[fe[0]].x * e[fe[1]].y - e[fe[0]].y * e[fe[1]].x);
+		projCov += 0.5f * fabsf(e[fe[2]].x * e[fe[3]].y - e[fe[2]].y * e[fe[3]].x);
+	}
+
+	// Visible pixels of the cube map
+	const auto mipSize = static_cast<float>(volumeIn.CubeMapSize >> mipLevel);
+	const auto cubeMapPix = mipSize * mipSize * countBits(faceMask);
+	const auto maskBits = cubeMapPix <= projCov ? (faceMask | g_cubeMapRayMarchBit) : faceMask;
+
+	volumeOut.MipLevel = static_cast<uint16_t>(mipLevel);
+	volumeOut.SmpCount = static_cast<uint16_t>(raySampleCount);
+	volumeOut.FaceMask = static_cast<uint16_t>(maskBits);
+	volumeOut.VolTexId = volumeIn.VolTexId;
+
+	return true;
+}
+
+VolumeCuller::VolumeCuller() :
+	m_isBVHDirty(true),
+	m_numVolumes(0)
+{
+}
+
+VolumeCuller::~VolumeCuller()
+{
+}
+
+void VolumeCuller::Init(uint32_t numVolumes)
+{
+	m_numVolumes = numVolumes;
+
+	// Pad the SoA streams to whole SIMD vectors
+	const auto paddedCount = (numVolumes + LaneCount - 1) / LaneCount * LaneCount;
+	for (auto& world : m_worlds) world.assign(paddedCount, 0.0f);
+	for (auto& worldI : m_worldIs) worldI.assign(paddedCount, 0.0f);
+
+	m_volumeDescs.assign(numVolumes, VolumeDesc());
+	m_volumeInfos.assign(numVolumes, VolumeInfo());
+	m_projCoverages.assign(numVolumes, 0.0f);
+	m_maxEdgeLengths.assign(numVolumes, 0.0f);
+	m_chunkVisibleVolumes.resize((numVolumes + ChunkSize - 1) / ChunkSize);
+	m_visibleVolumes.reserve(numVolumes);
+
+	m_worldMatrices.assign(numVolumes, XMFLOAT3X4());
+	m_bvh = VolumeBVH();
+	m_isBVHDirty = true;
+}
+
+void VolumeCuller::SetVolume(uint32_t i, const XMFLOAT3X4& world, const VolumeDesc& desc)
+{
+	m_volumeDescs[i] = desc;
+	SetVolumeWorld(i, world);
+}
+
+void VolumeCuller::SetVolumeWorld(uint32_t i, const XMFLOAT3X4& world)
+{
+	m_worldMatrices[i] = world;
+	m_isBVHDirty = true;
+
+	XMFLOAT3X4 worldI;
+	XMStoreFloat3x4(&worldI, XMMatrixInverse(nullptr, XMLoadFloat3x4(&world)));
+
+	for (uint8_t r = 0; r < 3; ++r)
+	{
+		for (uint8_t c = 0; c < 4; ++c)
+		{
+			m_worlds[r * 4 + c][i] = world.m[r][c];
+			m_worldIs[r * 4 + c][i] = worldI.m[r][c];
+		}
+	}
+}
+
+void VolumeCuller::Cull(CXMMATRIX viewProj, const XMFLOAT3& eyePt, const XMFLOAT2& viewport, uint32_t numSamples)
+{
+	CullParams params;
+	XMStoreFloat4x4(&params.ViewProj, viewProj);
+	params.EyePt = eyePt;
+	params.Viewport = viewport;
+	params.NumSamples = numSamples;
+
+	// Refit the BVH to the moved volumes, or rebuild it once refitting has degraded it
+	if (m_isBVHDirty)
+	{
+		if (m_bvh.GetNumVolumes() != m_numVolumes) m_bvh.Build(m_worldMatrices.data(), m_numVolumes);
+		else m_bvh.Update(m_worldMatrices.data());
+		m_isBVHDirty = false;
+	}
+
+	// Only the volumes whose bounds intersect the frustum are culled as the shader does
+	m_bvh.Cull(viewProj, eyePt, m_candidates);
+	const auto numCandidates = static_cast<uint32_t>(m_candidates.size());
+	ParallelFor(numCandidates, ChunkSize, [&](uint32_t begin, uint32_t end)
+	{
+		auto& visibleVolumes = m_chunkVisibleVolumes[begin / ChunkSize];
+		visibleVolumes.clear();
+		cullChunk(begin, end, params, visibleVolumes);
+	});
+
+	// Gather the visible list in candidate order, front to back, to keep the results deterministic
+	const auto numChunks = (numCandidates + ChunkSize - 1) / ChunkSize;
+	m_visibleVolumes.clear();
+	for (auto i = 0u; i < numChunks; ++i)
+	{
+		const auto& visibleVolumes = m_chunkVisibleVolumes[i];
+		m_visibleVolumes.insert(m_visibleVolumes.end(), visibleVolumes.cbegin(), visibleVolumes.cend());
+	}
+}
+
+uint32_t VolumeCuller::GetNumVolumes() const
+{
+	return m_numVolumes;
+}
+
+const VolumeInfo* VolumeCuller::GetVolumeInfos() const
+{
+	return m_volumeInfos.data();
+}
+
+const float* VolumeCuller::GetProjCoverages() const
+{
+	return m_projCoverages.data();
+}
+
+const float* VolumeCuller::GetMaxEdgeLengths() const
+{
+	return m_maxEdgeLengths.data();
+}
+
+const vector<uint32_t>& VolumeCuller::GetVisibleVolumes() const
+{
+	return m_visibleVolumes;
+}
+
+uint8_t VolumeCuller::EstimateCubeMapLOD(uint32_t& raySampleCount, uint32_t numMips, float cubeMapSize,
+	float maxEdgeLength, float upscale, float raySampleCountScale)
+{
+	// Calulate the ideal cube-map resolution
+	auto s = maxEdgeLength / upscale;
+
+	// Get the ideal ray sample amount
+	auto raySampleAmt = raySampleCountScale * s / sqrtf(3.0f);
+
+	// Clamp the ideal ray sample amount using the user-specified upper bound of ray sample count
+	const auto raySampleCnt = static_cast<uint32_t>(ceilf(raySampleAmt));
+	raySampleCount = (min)(raySampleCnt, raySampleCount);
+
+	// Inversely derive the cube-map resolution from the clamped ray sample amount
+	raySampleAmt = (min)(raySampleAmt, static_cast<float>(raySampleCount));
+	s = raySampleAmt / raySampleCountScale * sqrtf(3.0f);
+
+	// Use the more detailed integer level for conservation
+	const auto maxLevel = static_cast<float>(numMips - 1);
+	const auto level = (min)((max)(log2f(cubeMapSize / s), 0.0f), maxLevel);
+
+	return static_cast<uint8_t>(level);
+}
+
+VolumeCuller::EvaluationResult VolumeCuller::Evaluate()
+{
+	EvaluationResult result = {};
+
+	// Fixed volumes of 2 units at a scale, in front of the eye at (0, 0, -20) looking at the origin
+	struct TestVolume
+	{
+		XMFLOAT3 Center;
+		float Scale;
+		bool IsDepthCulled;		// Only kept by the shader
+		VolumeInfo Expected;	// Of the shader, all 0 if culled
+	};
+
+	static const uint16_t rayMarch = g_cubeMapRayMarchBit;
+	static const TestVolume testVolumes[] =
+	{
+		{ XMFLOAT3(0.0f, 0.0f, 0.0f), 1.0f, false, { 1, 53, 0x1f, 0 } },				// Near the eye
+		{ XMFLOAT3(0.0f, 0.0f, 40.0f), 1.0f, false, { 3, 18, 0x1f, 1 } },				// Mid distance
+		{ XMFLOAT3(0.0f, 0.0f, 400.0f), 1.0f, false, { 4, 3, 0x1f, 2 } },				// At the coarsest mip
+		{ XMFLOAT3(-14.5f, 3.0f, 0.0f), 1.0f, false, { 1, 53, rayMarch | 0x16, 3 } },	// Across the left edge of the viewport
+		{ XMFLOAT3(0.0f, 0.0f, -13.0f), 1.5f, false, { 0, 256, rayMarch | 0x1f, 4 } },	// At the max ray samples
+		{ XMFLOAT3(4.0f, -2.0f, 10.0f), 4.0f, false, { 0, 155, rayMarch | 0x1d, 5 } },	// Large, ray marched in cube-map space
+		{ XMFLOAT3(60.0f, 0.0f, 0.0f), 1.0f, false, {} },								// Right of the viewport
+		{ XMFLOAT3(0.0f, 0.0f, -19.5f), 1.0f, false, {} },								// Across the near plane, no corner in the viewport
+		{ XMFLOAT3(0.0f, 0.0f, 1100.0f), 20.0f, true, { 3, 19, 0x1f, 8 } },				// Beyond the far plane
+		{ XMFLOAT3(0.0f, 0.0f, -40.0f), 1.0f, true, { 1, 53, 0x2f, 9 } }				// Behind the eye, mirrored into the viewport
+	};
+	const auto numVolumes = static_cast<uint32_t>(size(testVolumes));
+
+	const XMFLOAT3 eyePt(0.0f, 0.0f, -20.0f);
+	const XMFLOAT2 viewport(1280.0f, 720.0f);
+	const auto numSamples = 256u;
+	const auto view = XMMatrixLookAtLH(XMLoadFloat3(&eyePt), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	const auto viewProj = view * XMMatrixPerspectiveFovLH(XM_PIDIV4, viewport.x / viewport.y, g_zNear, g_zFar);
+
+	VolumeCuller culler;
+	culler.Init(numVolumes);
+	vector<XMFLOAT3X4> worlds(numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		const auto& testVolume = testVolumes[i];
+		XMStoreFloat3x4(&worlds[i], XMMatrixScaling(testVolume.Scale, testVolume.Scale, testVolume.Scale) *
+			XMMatrixTranslation(testVolume.Center.x, testVolume.Center.y, testVolume.Center.z));
+
+		VolumeDesc desc;
+		desc.VolTexId = i;
+		desc.NumMips = NUM_CUBE_MIP;
+		desc.CubeMapSize = 128;
+		culler.SetVolume(i, worlds[i], desc);
+	}
+	culler.Cull(viewProj, eyePt, viewport, numSamples);
+
+	const auto& visibleVolumes = culler.GetVisibleVolumes();
+	const auto isSame = [](const VolumeInfo& a, const VolumeInfo& b)
+	{
+		return a.MipLevel == b.MipLevel && a.SmpCount == b.SmpCount && a.FaceMask == b.FaceMask && a.VolTexId == b.VolTexId;
+	};
+
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		const auto& testVolume = testVolumes[i];
+		const auto& expected = testVolume.Expected;
+		const auto isExpectedVisible = expected.SmpCount > 0;
+
+		VolumeInfo shaderInfo = {};
+		const auto isShaderVisible = cullAsShader(worlds[i], culler.m_volumeDescs[i], viewProj, eyePt, viewport, numSamples, shaderInfo);
+		const auto isVisible = find(visibleVolumes.cbegin(), visibleVolumes.cend(), i) != visibleVolumes.cend();
+
+		// The shader port keeps the depth-culled volumes, which the culler must drop
+		auto isFailed = isShaderVisible != isExpectedVisible || (isShaderVisible && !isSame(shaderInfo, expected));
+		if (testVolume.IsDepthCulled) isFailed = isFailed || isVisible;
+		else isFailed = isFailed || isVisible != isExpectedVisible ||
+			(isVisible && !isSame(culler.GetVolumeInfos()[i], expected));
+
+		result.NumDepthCulled += testVolume.IsDepthCulled && isShaderVisible && !isVisible ? 1 : 0;
+		result.NumFailed += isFailed ? 1 : 0;
+	}
+
+	// The visible list is front to back
+	for (size_t i = 1; i < visibleVolumes.size(); ++i)
+	{
+		const auto& a = testVolumes[visibleVolumes[i - 1]].Center;
+		const auto& b = testVolumes[visibleVolumes[i]].Center;
+		const auto distA = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&a) - XMLoadFloat3(&eyePt)));
+		const auto distB = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&b) - XMLoadFloat3(&eyePt)));
+		result.NumFailed += distA > distB ? 1 : 0;
+	}
+
+	result.NumVolumes = numVolumes;
+	result.NumVisible = static_cast<uint32_t>(visibleVolumes.size());
+
+	return result;
+}
+
+void VolumeCuller::cullChunk(uint32_t begin, uint32_t end, const CullParams& params, vector<uint32_t>& visibleVolumes)
+{
+	const auto& vp = params.ViewProj;
+	const auto zero = XMVectorZero();
+	const auto half = XMVectorReplicate(0.5f);
+	const auto one = XMVectorSplatOne();
+	const auto negOne = XMVectorNegate(one);
+	const auto viewportW = XMVectorReplicate(params.Viewport.x);
+	const auto viewportH = XMVectorReplicate(params.Viewport.y);
+
+	for (auto i = begin; i < end; i += LaneCount)
+	{
+		// Gather the candidates into the lanes, repeating the last one past the end
+		const auto laneCount = (min)(static_cast<uint32_t>(LaneCount), end - i);
+		uint32_t volumeIds[LaneCount];
+		for (auto l = 0u; l < LaneCount; ++l) volumeIds[l] = m_candidates[i + (min)(l, laneCount - 1)];
+
+		XMVECTOR world[12], worldI[12];
+		for (uint8_t j = 0; j < 12; ++j)
+		{
+			const auto& w = m_worlds[j];
+			const auto& wI = m_worldIs[j];
+			world[j] = XMVectorSet(w[volumeIds[0]], w[volumeIds[1]], w[volumeIds[2]], w[volumeIds[3]]);
+			worldI[j] = XMVectorSet(wI[volumeIds[0]], wI[volumeIds[1]], wI[volumeIds[2]], wI[volumeIds[3]]);
+		}
+
+		// Clip-space center and axes of the cubes; the corners are their signed sums
+		XMVECTOR center[4], axes[3][4];
+		for (uint8_t j = 0; j < 4; ++j)
+		{
+			center[j] = XMVectorMultiplyAdd(world[3], XMVectorReplicate(vp.m[0][j]), XMVectorReplicate(vp.m[3][j]));
+			center[j] = XMVectorMultiplyAdd(world[7], XMVectorReplicate(vp.m[1][j]), center[j]);
+			center[j] = XMVectorMultiplyAdd(world[11], XMVectorReplicate(vp.m[2][j]), center[j]);
+
+			for (uint8_t k = 0; k < 3; ++k)
+			{
+				axes[k][j] = XMVectorMultiply(world[k], XMVectorReplicate(vp.m[0][j]));
+				axes[k][j] = XMVectorMultiplyAdd(world[k + 4], XMVectorReplicate(vp.m[1][j]), axes[k][j]);
+				axes[k][j] = XMVectorMultiplyAdd(world[k + 8], XMVectorReplicate(vp.m[2][j]), axes[k][j]);
+			}
+		}
+
+		// Project vertices to viewport space
+		XMVECTOR vx[8], vy[8];
+		auto isInView = XMVectorFalseInt();
+		for (uint8_t k = 0; k < 8; ++k)
+		{
+			XMVECTOR p[4];
+			for (uint8_t j = 0; j < 4; ++j)
+			{
+				p[j] = center[j];
+				for (uint8_t a = 0; a < 3; ++a)
+					p[j] = g_cubeCorners[k][a] > 0.0f ? XMVectorAdd(p[j], axes[a][j]) : XMVectorSubtract(p[j], axes[a][j]);
+			}
+
+			const auto rcpW = XMVectorReciprocal(p[3]);
+			vx[k] = XMVectorMultiply(XMVectorMultiplyAdd(XMVectorMultiply(p[0], rcpW), half, half), viewportW);
+			vy[k] = XMVectorMultiply(XMVectorNegativeMultiplySubtract(XMVectorMultiply(p[1], rcpW), half, half), viewportH);
+
+			// If any vertices are inside viewport
+			auto isInside = XMVectorAndInt(XMVectorLessOrEqual(vx[k], viewportW), XMVectorGreaterOrEqual(vx[k], zero));
+			isInside = XMVectorAndInt(isInside, XMVectorLessOrEqual(vy[k], viewportH));
+			isInside = XMVectorAndInt(isInside, XMVectorGreaterOrEqual(vy[k], zero));
+			isInView = XMVectorOrInt(isInView, isInside);
+		}
+
+		uint32_t inView[LaneCount];
+		XMStoreInt4(inView, isInView);
+		if ((inView[0] | inView[1] | inView[2] | inView[3]) == 0) continue;
+
+		// Cube edges and the max edge length
+		XMVECTOR ex[12], ey[12];
+		auto maxEdgeLength = zero;
+		for (uint8_t e = 0; e < 12; ++e)
+		{
+			ex[e] = XMVectorSubtract(vx[g_cubeEdges[e][1]], vx[g_cubeEdges[e][0]]);
+			ey[e] = XMVectorSubtract(vy[g_cubeEdges[e][1]], vy[g_cubeEdges[e][0]]);
+			const auto edgeLength = XMVectorSqrt(XMVectorMultiplyAdd(ex[e], ex[e], XMVectorMultiply(ey[e], ey[e])));
+			maxEdgeLength = XMVectorMax(maxEdgeLength, edgeLength);
+		}
+
+		// Local-space eye position for the face visibility
+		XMVECTOR localEyePt[3];
+		for (uint8_t r = 0; r < 3; ++r)
+		{
+			localEyePt[r] = XMVectorMultiplyAdd(worldI[r * 4], XMVectorReplicate(params.EyePt.x), worldI[r * 4 + 3]);
+			localEyePt[r] = XMVectorMultiplyAdd(worldI[r * 4 + 1], XMVectorReplicate(params.EyePt.y), localEyePt[r]);
+			localEyePt[r] = XMVectorMultiplyAdd(worldI[r * 4 + 2], XMVectorReplicate(params.EyePt.z), localEyePt[r]);
+		}
+
+		// Volume projection coverage of the visible faces
+		uint32_t faceVis[6][LaneCount];
+		auto projCoverage = zero;
+		for (uint8_t f = 0; f < 6; ++f)
+		{
+			const auto& viewComp = localEyePt[f >> 1];
+			const auto isFaceVisible = (f & 0x1) ? XMVectorGreater(viewComp, negOne) : XMVectorLess(viewComp, one);
+			XMStoreInt4(faceVis[f], isFaceVisible);
+
+			const auto e = g_cubeFaceEdges[f];
+			auto faceArea = XMVectorAbs(XMVectorSubtract(XMVectorMultiply(ex[e[0]], ey[e[1]]), XMVectorMultiply(ey[e[0]], ex[e[1]])));
+			faceArea = XMVectorAdd(faceArea, XMVectorAbs(XMVectorSubtract(XMVectorMultiply(ex[e[2]], ey[e[3]]), XMVectorMultiply(ey[e[2]], ex[e[3]]))));
+			projCoverage = XMVectorAdd(projCoverage, XMVectorSelect(zero, XMVectorMultiply(faceArea, half), isFaceVisible));
+		}
+
+		XMFLOAT4 maxEdgeLengths, projCoverages;
+		XMStoreFloat4(&maxEdgeLengths, maxEdgeLength);
+		XMStoreFloat4(&projCoverages, projCoverage);
+
+		// Per-volume LOD and render scheme
+		for (auto l = 0u; l < laneCount; ++l)
+		{
+			if (!inView[l]) continue;
+
+			const auto volumeId = volumeIds[l];
+			const auto& volumeDesc = m_volumeDescs[volumeId];
+
+			auto faceMask = 0u;
+			for (uint8_t f = 0; f < 6; ++f) faceMask |= faceVis[f][l] ? (1 << f) : 0;
+
+			auto raySampleCount = params.NumSamples;
+			const auto cubeMapSize = volumeDesc.CubeMapSize;
+			const auto mipLevel = EstimateCubeMapLOD(raySampleCount, volumeDesc.NumMips,
+				static_cast<float>(cubeMapSize), (&maxEdgeLengths.x)[l]);
+
+			// Visible pixels of the cube map
+			const auto mipSize = static_cast<float>(cubeMapSize >> mipLevel);
+			const auto cubeMapPix = mipSize * mipSize * countBits(faceMask);
+			const auto maskBits = cubeMapPix <= (&projCoverages.x)[l] ? (faceMask | g_cubeMapRayMarchBit) : faceMask;
+
+			auto& volumeInfo = m_volumeInfos[volumeId];
+			volumeInfo.MipLevel = mipLevel;
+			volumeInfo.SmpCount = static_cast<uint16_t>(raySampleCount);
+			volumeInfo.FaceMask = static_cast<uint16_t>(maskBits);
+			volumeInfo.VolTexId = volumeDesc.VolTexId;
+			m_projCoverages[volumeId] = (&projCoverages.x)[l];
+			m_maxEdgeLengths[volumeId] = (&maxEdgeLengths.x)[l];
+			visibleVolumes.push_back(volumeId);
+		}
+	}
+}
@@ -0,0 +1,80 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VolumeTypes.h"
+#include "VolumeBVH.h"
+
+// Host-side replica of CSVolumeCull.hlsl. A BVH over the volume bounds, refitted after the
+// volumes move, first finds the volumes intersecting the frustum, front to back; those are
+// then culled as the shader does, 4 per SIMD vector gathered from SoA streams, while chunks
+// of them are culled in parallel. The visible list stays front to back.
+// The shader only tests the projected corners against the viewport, so it keeps volumes
+// beyond the far plane and behind the eye whose corners project into it; the BVH frustum
+// test culls those. Evaluate() checks a fixed scene against a scalar port of the shader
+// and against the expected LODs of every volume, including such volumes.
+class VolumeCuller
+{
+public:
+	struct EvaluationResult
+	{
+		uint32_t NumVolumes;
+		uint32_t NumVisible;		// By the culler
+		uint32_t NumDepthCulled;	// In the viewport but beyond the near or far plane, only kept by the shader
+		uint32_t NumFailed;			// Volumes of the shader port or the culler differing from the expected
+	};
+
+	VolumeCuller();
+	virtual ~VolumeCuller();
+
+	void Init(uint32_t numVolumes);
+	void SetVolume(uint32_t i, const DirectX::XMFLOAT3X4& world, const VolumeDesc& desc);
+	void SetVolumeWorld(uint32_t i, const DirectX::XMFLOAT3X4& world);
+	void Cull(DirectX::CXMMATRIX viewProj, const DirectX::XMFLOAT3& eyePt,
+		const DirectX::XMFLOAT2& viewport, uint32_t numSamples);
+
+	uint32_t GetNumVolumes() const;
+	const VolumeInfo* GetVolumeInfos() const;	// Only valid for the volumes in the visible list
+	const float* GetProjCoverages() const;		// In pixels, only valid for the visible volumes
+	const float* GetMaxEdgeLengths() const;		// In pixels, only valid for the visible volumes
+	const std::vector<uint32_t>& GetVisibleVolumes() const;
+
+	// Same LOD heuristics as EstimateCubeMapLOD() in VolumeCull.hlsli
+	static uint8_t EstimateCubeMapLOD(uint32_t& raySampleCount, uint32_t numMips, float cubeMapSize,
+		float maxEdgeLength, float upscale = 2.0f, float raySampleCountScale = 2.0f);
+
+	static EvaluationResult Evaluate();
+
+	static const uint32_t LaneCount = 4;
+	static const uint32_t ChunkSize = 1024;
+
+protected:
+	struct CullParams
+	{
+		DirectX::XMFLOAT4X4 ViewProj;
+		DirectX::XMFLOAT3 EyePt;
+		DirectX::XMFLOAT2 Viewport;
+		uint32_t NumSamples;
+	};
+
+	void cullChunk(uint32_t begin, uint32_t end, const CullParams& params, std::vector<uint32_t>& visibleVolumes);
+
+	VolumeBVH				m_bvh;
+	std::vector<DirectX::XMFLOAT3X4> m_worldMatrices;	// Of the BVH
+	std::vector<uint32_t>	m_candidates;				// Volumes in the frustum, front to back
+	bool					m_isBVHDirty;
+
+	std::vector<float>		m_worlds[12];
+	std::vector<float>		m_worldIs[12];
+	std::vector<VolumeDesc>	m_volumeDescs;
+	std::vector<VolumeInfo>	m_volumeInfos;
+	std::vector<float>		m_projCoverages;
+	std::vector<float>		m_maxEdgeLengths;
+
+	std::vector<std::vector<uint32_t>> m_chunkVisibleVolumes;
+	std::vector<uint32_t>	m_visibleVolumes;
+
+	uint32_t				m_numVolumes;
+};
@@ -0,0 +1,314 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "VolumeTransforms.h"
+#include "ParallelFor.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <random>
+
+using namespace std;
+using namespace DirectX;
+
+static_assert(sizeof(PerObject) % 16 == 0, "PerObject should be a multiple of 16 bytes for streaming stores");
+
+// Write-combined upload memory is written with non-temporal stores when possible
+static inline void storeVector(float* pDst, FXMVECTOR v, bool isAligned)
+{
+#if defined(_XM_SSE_INTRINSICS_)
+	if (isAligned) _mm_stream_ps(pDst, v);
+	else _mm_storeu_ps(pDst, v);
+#else
+	(void)isAligned;
+	XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(pDst), v);
+#endif
+}
+
+VolumeTransforms::VolumeTransforms() :
+	m_numVolumes(0),
+	m_frameCount(0),
+	m_viewProjMask(0)
+{
+	XMStoreFloat3x4(&m_lightWorld, XMMatrixIdentity());
+	XMStoreFloat4x4(&m_lightWorldI, XMMatrixIdentity());
+}
+
+VolumeTransforms::~VolumeTransforms()
+{
+}
+
+void VolumeTransforms::Init(uint32_t numVolumes, uint8_t frameCount)
+{
+	assert(frameCount <= 8);
+	m_numVolumes = numVolumes;
+	m_frameCount = frameCount;
+	m_viewProjMask = 0;
+
+	const uint8_t allSlots = (1 << frameCount) - 1;
+	for (auto& scale : m_scales) scale.assign(numVolumes, 1.0f);
+	for (auto& translation : m_translations) translation.assign(numVolumes, 0.0f);
+	m_dirtyMasks.assign(numVolumes, allSlots);
+	m_batchDirtyMasks.assign((numVolumes + BatchSize - 1) / BatchSize, allSlots);
+	m_viewProjs.resize(frameCount);
+}
+
+void VolumeTransforms::SetWorld(uint32_t i, const XMFLOAT3& scale, const XMFLOAT3& translation)
+{
+	m_scales[0][i] = scale.x;
+	m_scales[1][i] = scale.y;
+	m_scales[2][i] = scale.z;
+	m_translations[0][i] = translation.x;
+	m_translations[1][i] = translation.y;
+	m_translations[2][i] = translation.z;
+
+	const uint8_t allSlots = (1 << m_frameCount) - 1;
+	m_dirtyMasks[i] = allSlots;
+	m_batchDirtyMasks[i / BatchSize] = allSlots;
+}
+
+void VolumeTransforms::SetLightWorld(const XMFLOAT3X4& lightWorld)
+{
+	if (memcmp(&lightWorld, &m_lightWorld, sizeof(XMFLOAT3X4)) == 0) return;
+
+	m_lightWorld = lightWorld;
+	XMStoreFloat4x4(&m_lightWorldI, XMMatrixInverse(nullptr, XMLoadFloat3x4(&lightWorld)));
+
+	// LocalToLight of every volume depends on the light-map world
+	const uint8_t allSlots = (1 << m_frameCount) - 1;
+	fill(m_dirtyMasks.begin(), m_dirtyMasks.end(), allSlots);
+	fill(m_batchDirtyMasks.begin(), m_batchDirtyMasks.end(), allSlots);
+}
+
+uint32_t VolumeTransforms::Update(uint8_t frameIndex, CXMMATRIX viewProj, PerObject* pMappedData)
+{
+	const uint8_t slotBit = 1 << frameIndex;
+
+	// WorldViewProj and WorldViewProjI of all volumes must be rewritten if the camera has changed
+	XMFLOAT4X4 vp;
+	XMStoreFloat4x4(&vp, viewProj);
+	const auto viewProjChanged = (m_viewProjMask & slotBit) == 0 ||
+		memcmp(&vp, &m_viewProjs[frameIndex], sizeof(XMFLOAT4X4)) != 0;
+	m_viewProjs[frameIndex] = vp;
+	m_viewProjMask |= slotBit;
+
+	// Transposed, so that the rows are the columns to store. WorldViewProj and WorldViewProjI
+	// of the moved volumes are rewritten even if the camera is static.
+	const auto isAnyDirty = any_of(m_batchDirtyMasks.cbegin(), m_batchDirtyMasks.cend(),
+		[slotBit](uint8_t mask) { return (mask & slotBit) != 0; });
+	XMMATRIX transposes[3];
+	if (viewProjChanged || isAnyDirty)
+	{
+		transposes[0] = XMMatrixTranspose(viewProj);
+		transposes[1] = XMMatrixTranspose(XMMatrixInverse(nullptr, viewProj));
+	}
+	transposes[2] = XMMatrixTranspose(XMLoadFloat4x4(&m_lightWorldI));
+
+	atomic<uint32_t> numUpdated(0);
+	ParallelFor(m_numVolumes, BatchSize, [&](uint32_t begin, uint32_t end)
+	{
+		auto& batchDirtyMask = m_batchDirtyMasks[begin / BatchSize];
+		if (!viewProjChanged && (batchDirtyMask & slotBit) == 0) return;
+
+		numUpdated += updateBatch(begin, end, frameIndex, viewProjChanged, transposes, pMappedData);
+		batchDirtyMask &= ~slotBit;
+	});
+
+#if defined(_XM_SSE_INTRINSICS_)
+	_mm_sfence();
+#endif
+
+	return numUpdated;
+}
+
+uint32_t VolumeTransforms::GetNumVolumes() const
+{
+	return m_numVolumes;
+}
+
+void VolumeTransforms::GetWorld(uint32_t i, XMFLOAT3X4& world) const
+{
+	world = {};
+	for (uint8_t r = 0; r < 3; ++r)
+	{
+		world.m[r][r] = m_scales[r][i];
+		world.m[r][3] = m_translations[r][i];
+	}
+}
+
+VolumeTransforms::EvaluationResult VolumeTransforms::Evaluate(const EvaluationDesc& desc)
+{
+	EvaluationResult result = {};
+
+	const auto numVolumes = desc.NumVolumes;
+	const auto frameCount = static_cast<uint8_t>((min)((max)(desc.FrameCount, static_cast<uint8_t>(1)), static_cast<uint8_t>(8)));
+	mt19937 rng(desc.Seed);
+	uniform_real_distribution<float> unorm(0.0f, 1.0f);
+
+	VolumeTransforms transforms;
+	transforms.Init(numVolumes, frameCount);
+	vector<XMFLOAT3X4> worlds(numVolumes);
+	const auto setWorld = [&](uint32_t i)
+	{
+		const auto scale = 0.5f + 10.0f * unorm(rng);
+		const XMFLOAT3 s(scale, scale, scale);
+		const XMFLOAT3 t(200.0f * unorm(rng) - 100.0f, 20.0f * unorm(rng) - 10.0f, 200.0f * unorm(rng) - 100.0f);
+		transforms.SetWorld(i, s, t);
+		XMStoreFloat3x4(&worlds[i], XMMatrixScaling(s.x, s.y, s.z) * XMMatrixTranslation(t.x, t.y, t.z));
+	};
+	for (auto i = 0u; i < numVolumes; ++i) setWorld(i);
+
+	XMFLOAT3X4 lightWorld;
+	XMStoreFloat3x4(&lightWorld, XMMatrixScaling(64.0f, 64.0f, 64.0f));
+	const auto proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 1000.0f);
+	auto angle = 0.0f;
+	auto numMovingFrames = 0u;
+
+	// The slots keep their contents across frames, as the mapped upload buffer does
+	vector<PerObject> perObjects(static_cast<size_t>(numVolumes) * frameCount);
+	const auto isClose = [](const float* pValues, const float* pRefs, uint8_t count)
+	{
+		auto scale = 1.0f;
+		for (uint8_t i = 0; i < count; ++i) scale = (max)(scale, fabsf(pRefs[i]));
+		for (uint8_t i = 0; i < count; ++i) if (fabsf(pValues[i] - pRefs[i]) > 1e-4f * scale) return false;
+
+		return true;
+	};
+
+	for (auto frame = 0u; frame < desc.NumFrames; ++frame)
+	{
+		const auto frameIndex = static_cast<uint8_t>(frame % frameCount);
+		const auto cameraMoved = frame == 0 || unorm(rng) < desc.CameraMoveRate;
+		const auto lightMoved = unorm(rng) < desc.LightMoveRate;
+		if (cameraMoved) angle += 0.05f + unorm(rng);
+		if (lightMoved) XMStoreFloat3x4(&lightWorld, XMMatrixScaling(64.0f, 32.0f + 64.0f * unorm(rng), 64.0f) *
+			XMMatrixTranslation(0.0f, 16.0f * unorm(rng), 0.0f));
+		for (auto i = 0u; i < numVolumes; ++i) if (unorm(rng) < desc.MoveRate) setWorld(i);
+
+		const auto eyePt = XMVectorSet(sinf(angle) * 80.0f, 16.0f, cosf(angle) * 80.0f, 1.0f);
+		const auto view = XMMatrixLookAtLH(eyePt, XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		const auto viewProj = view * proj;
+		const auto pMappedData = &perObjects[static_cast<size_t>(numVolumes) * frameIndex];
+
+		const auto startTime = chrono::steady_clock::now();
+		transforms.SetLightWorld(lightWorld);
+		result.NumUpdated += transforms.Update(frameIndex, viewProj, pMappedData);
+		const auto time = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+		if (cameraMoved)
+		{
+			result.MovingTime += time;
+			++numMovingFrames;
+		}
+		else if (!lightMoved)
+		{
+			result.StaticTime += time;
+			++result.NumStaticFrames;
+		}
+
+		// Every volume of the slot must match the transforms of MultiRayCaster before batching
+		const auto lightWorldI = XMMatrixInverse(nullptr, XMLoadFloat3x4(&lightWorld));
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto world = XMLoadFloat3x4(&worlds[i]);
+			const auto worldViewProj = world * viewProj;
+
+			PerObject ref;
+			XMStoreFloat4x4(&ref.WorldViewProj, XMMatrixTranspose(worldViewProj));
+			XMStoreFloat4x4(&ref.WorldViewProjI, XMMatrixTranspose(XMMatrixInverse(nullptr, worldViewProj)));
+			XMStoreFloat3x4(&ref.WorldI, XMMatrixInverse(nullptr, world));
+			ref.World = worlds[i];
+			XMStoreFloat3x4(&ref.LocalToLight, world * lightWorldI);
+
+			const auto& data = pMappedData[i];
+			if (!isClose(&data.WorldViewProj._11, &ref.WorldViewProj._11, 16) ||
+				!isClose(&data.WorldViewProjI._11, &ref.WorldViewProjI._11, 16) ||
+				!isClose(&data.WorldI._11, &ref.WorldI._11, 12) ||
+				!isClose(&data.World._11, &ref.World._11, 12) ||
+				!isClose(&data.LocalToLight._11, &ref.LocalToLight._11, 12))
+				++result.NumFailed;
+		}
+
+		result.NumChecked += numVolumes;
+		++result.NumFrames;
+	}
+
+	result.StaticTime = result.NumStaticFrames > 0 ? result.StaticTime / result.NumStaticFrames : 0.0;
+	result.MovingTime = numMovingFrames > 0 ? result.MovingTime / numMovingFrames : 0.0;
+
+	return result;
+}
+
+uint32_t VolumeTransforms::updateBatch(uint32_t begin, uint32_t end, uint8_t frameIndex,
+	bool viewProjChanged, const XMMATRIX* pTransposes, PerObject* pMappedData)
+{
+	const uint8_t slotBit = 1 << frameIndex;
+	const auto isAligned = (reinterpret_cast<uintptr_t>(pMappedData) & 0xf) == 0;
+	const auto& viewProjT = pTransposes[0];
+	const auto& viewProjIT = pTransposes[1];
+	const auto& lightWorldIT = pTransposes[2];
+	const auto selectW = g_XMSelect0001.v;
+
+	auto numUpdated = 0u;
+	for (auto i = begin; i < end; ++i)
+	{
+		auto& dirtyMask = m_dirtyMasks[i];
+		const auto isDirty = (dirtyMask & slotBit) != 0;
+		if (!isDirty && !viewProjChanged) continue;
+
+		const XMFLOAT3 s(m_scales[0][i], m_scales[1][i], m_scales[2][i]);
+		const XMFLOAT3 t(m_translations[0][i], m_translations[1][i], m_translations[2][i]);
+		const auto scale = XMVectorSet(s.x, s.y, s.z, 1.0f);
+		const auto translation = XMVectorSet(t.x, t.y, t.z, 1.0f);
+		auto pDst = reinterpret_cast<float*>(&pMappedData[i]);
+
+		// Worlds are scale-translations, so world * M only scales the rows of M
+		// and moves its last row, and the inverses are closed-form
+		if (viewProjChanged || isDirty)
+		{
+			// WorldViewProj
+			for (uint8_t j = 0; j < 4; ++j)
+			{
+				const auto& col = viewProjT.r[j];
+				const auto v = XMVectorSelect(XMVectorMultiply(col, scale), XMVector4Dot(col, translation), selectW);
+				storeVector(pDst + 4 * j, v, isAligned);
+			}
+
+			// WorldViewProjI = ViewProjI * WorldI
+			const auto& col3 = viewProjIT.r[3];
+			const float invS[] = { 1.0f / s.x, 1.0f / s.y, 1.0f / s.z };
+			const float ts[] = { t.x, t.y, t.z };
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				const auto v = XMVectorScale(XMVectorNegativeMultiplySubtract(col3, XMVectorReplicate(ts[j]), viewProjIT.r[j]), invS[j]);
+				storeVector(pDst + 16 + 4 * j, v, isAligned);
+			}
+			storeVector(pDst + 28, col3, isAligned);
+		}
+
+		if (isDirty)
+		{
+			// WorldI and World
+			storeVector(pDst + 32, XMVectorSet(1.0f / s.x, 0.0f, 0.0f, -t.x / s.x), isAligned);
+			storeVector(pDst + 36, XMVectorSet(0.0f, 1.0f / s.y, 0.0f, -t.y / s.y), isAligned);
+			storeVector(pDst + 40, XMVectorSet(0.0f, 0.0f, 1.0f / s.z, -t.z / s.z), isAligned);
+			storeVector(pDst + 44, XMVectorSet(s.x, 0.0f, 0.0f, t.x), isAligned);
+			storeVector(pDst + 48, XMVectorSet(0.0f, s.y, 0.0f, t.y), isAligned);
+			storeVector(pDst + 52, XMVectorSet(0.0f, 0.0f, s.z, t.z), isAligned);
+
+			// LocalToLight = World * LightWorldI
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				const auto& col = lightWorldIT.r[j];
+				const auto v = XMVectorSelect(XMVectorMultiply(col, scale), XMVector4Dot(col, translation), selectW);
+				storeVector(pDst + 56 + 4 * j, v, isAligned);
+			}
+
+			dirtyMask &= ~slotBit;
+		}
+
+		++numUpdated;
+	}
+
+	return numUpdated;
+}
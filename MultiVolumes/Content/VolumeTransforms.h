@@ -0,0 +1,68 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VolumeTypes.h"
+
+// Scale-translation volume transforms in SoA layout. Each frame slot of the mapped
+// per-object buffer is only rewritten for the volumes and matrices that changed, i.e. the
+// volumes that moved since the slot was last written, or all volumes once the camera moved.
+class VolumeTransforms
+{
+public:
+	struct EvaluationDesc
+	{
+		uint32_t NumVolumes;
+		uint32_t NumFrames;
+		uint8_t FrameCount;			// Frame slots of the per-object buffer
+		float MoveRate;				// Chance of a volume moving per frame
+		float CameraMoveRate;		// Chance of the camera moving per frame
+		float LightMoveRate;		// Chance of the light-map world changing per frame
+		uint32_t Seed;
+	};
+
+	struct EvaluationResult
+	{
+		uint32_t NumFrames;
+		uint32_t NumStaticFrames;	// With the camera not moving
+		uint64_t NumChecked;		// Volumes compared with the reference per frame
+		uint64_t NumUpdated;		// Volumes rewritten by Update()
+		uint32_t NumFailed;			// Volumes of a slot differing from the reference
+		double MovingTime;			// Per frame with the camera moving, in milliseconds
+		double StaticTime;			// Per frame with the camera and the light static, in milliseconds
+	};
+
+	VolumeTransforms();
+	virtual ~VolumeTransforms();
+
+	void Init(uint32_t numVolumes, uint8_t frameCount);
+	void SetWorld(uint32_t i, const DirectX::XMFLOAT3& scale, const DirectX::XMFLOAT3& translation);
+	void SetLightWorld(const DirectX::XMFLOAT3X4& lightWorld);
+	uint32_t Update(uint8_t frameIndex, DirectX::CXMMATRIX viewProj, PerObject* pMappedData);
+
+	uint32_t GetNumVolumes() const;
+	void GetWorld(uint32_t i, DirectX::XMFLOAT3X4& world) const;
+
+	static EvaluationResult Evaluate(const EvaluationDesc& desc);
+
+	static const uint32_t BatchSize = 1024;
+
+protected:
+	uint32_t updateBatch(uint32_t begin, uint32_t end, uint8_t frameIndex, bool viewProjChanged,
+		const DirectX::XMMATRIX* pTransposes, PerObject* pMappedData);
+
+	std::vector<float>		m_scales[3];
+	std::vector<float>		m_translations[3];
+	std::vector<uint8_t>	m_dirtyMasks;		// One bit per frame slot
+	std::vector<uint8_t>	m_batchDirtyMasks;	// Union of the volume masks in each batch
+
+	std::vector<DirectX::XMFLOAT4X4> m_viewProjs;
+	DirectX::XMFLOAT3X4		m_lightWorld;
+	DirectX::XMFLOAT4X4		m_lightWorldI;
+
+	uint32_t				m_numVolumes;
+	uint8_t					m_frameCount;
+	uint8_t					m_viewProjMask;		// Frame slots holding a valid m_viewProjs entry
+};
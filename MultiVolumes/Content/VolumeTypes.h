@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+
+// Host-side mirrors of the structs in Shaders/Common.hlsli
+struct PerObject
+{
+	DirectX::XMFLOAT4X4 WorldViewProj;
+	DirectX::XMFLOAT4X4 WorldViewProjI;
+	DirectX::XMFLOAT3X4 WorldI;
+	DirectX::XMFLOAT3X4 World;
+	DirectX::XMFLOAT3X4 LocalToLight;
+};
+
+struct VolumeDesc
+{
+	uint32_t VolTexId : 14;
+	uint32_t NumMips : 4;
+	uint32_t CubeMapSize : 14;
+};
+
+struct VolumeInfo
+{
+	uint16_t MipLevel;
+	uint16_t SmpCount;
+	uint16_t FaceMask;
+	uint16_t VolTexId;
+};
+
+// Highest bit in VolumeInfo::FaceMask: ray march the cube map instead of the screen
+static const uint16_t g_cubeMapRayMarchBit = 1 << 15;
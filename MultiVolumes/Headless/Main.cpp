@@ -0,0 +1,1097 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+// Headless offline renderer. Takes the command-line settings of MultiVolumes, plus:
+//   -output <prefix>		frames are written to <prefix>_0000.ppm, ... (default "frame")
+//   -format <ppm|pfm>		8-bit tone-mapped, or linear HDR before tone mapping
+//   -width <w> -height <h>	frame size (default 1280 x 800)
+//   -frames <n>			number of frames of the camera path (default 120)
+//   -orbit <r> <y>			turntable radius and height, as the animated camera (default 60 6)
+//   -camera <file>			keyframes "eyeX eyeY eyeZ focusX focusY focusZ" per line,
+//							linearly interpolated over the frames instead of the turntable
+//   -frameJobs <n>			frames rendered concurrently, each in parallel (default 1)
+//   -skyRotation <deg>		rotates the light probe of -radiance about the y axis
+//   -irradianceVolume <n> [rays]	bakes n^3 irradiance probes over the light map, with the
+//							given rays per probe (default 256), in place of the AO rays
+//   -prefilterRadiance		writes the GGX-prefiltered cube of -radiance to its cache
+//							<radiance>.ggx.dds for the light probe, then exits
+//   -profile <file>		writes the p50/p95/p99 times of the passes and frames to <file>,
+//							as JSON if it ends with .json, otherwise as CSV
+//   -trace <file>			writes the timeline of the CPU work to <file> as Chrome trace JSON;
+//							the events are only recorded when built with _ENABLE_TRACE_
+//   -frameBudget <ms>		reassigns the per-volume sample counts and mip levels every frame to fit
+//							the ray marching and cube rendering into <ms>, with the sample scheduler
+//   -reuseCubeMaps			only re-marches the cube-map faces that are stale for the eye
+//   -showMesh				draws the -mesh of the settings under the volumes, as [M] in MultiVolumes
+//   -taa					resolves the frames with the TAA of MultiVolumes, in order on one frame job
+//   -jitterRays			starts the rays at spatiotemporal blue-noise offsets
+//   -sampleStudy			measures the error of reduced sample counts, with and without
+//							the ray jitters, against a 16x-sample reference instead
+//   -benchmark <file>		runs the microbenchmarks of the CPU hot paths instead, and writes
+//							their times to <file> as CSV
+//   -benchmarkFilter <s>	with -benchmark, only runs the cases whose names contain <s>
+//   -baseline <file>		with -benchmark, fails if any case is slower than in the CSV <file>
+//							by more than the threshold
+//   -regressionThreshold <pct>	of -baseline (default 10)
+//   -sceneScaling <file>	sweeps the number of volumes, the grid and light-grid sizes and the
+//							K-buffer layers instead, and writes the GPU memory and CPU frame
+//							times of each configuration to <file> as CSV
+//   -memoryBudget <MB>		of -sceneScaling, to report the configurations over it (default 4096),
+//							and of -planMemory
+//   -planMemory			prints the settings that fit the GPU memory of the scene at the frame
+//							size into -memoryBudget, and validates the planner, instead
+//   -renderGraph			prints the compiled frame graph of each OIT method, with its barriers
+//							and transient memory, and validates the compiler, instead
+//   -sampleScheduler		simulates the sample scheduler over the camera paths, and validates its
+//							convergence to the frame budget, instead
+//   -cubeMapCache			measures the cube-map face reuse over a camera orbit, and validates that
+//							no reused face exceeds the max tolerance, instead
+//   -oitEngine				compares the host OIT methods against an exact sort, with their memory,
+//							times and dropped fragments, and validates their errors, instead
+//   -temporalAA			measures the error and flicker of the TAA against a supersampled pattern,
+//							static and panning, and validates that it reduces both, instead
+//   -shProjection			compares the SH projection of a band-limited cube map against its closed
+//							form and the weights of the SH shader, and validates their errors, instead
+//   -shRotation			validates the SH rotation of random probes at rotated directions, and
+//							times it per probe, instead
+//   -sampleSequence		measures the discrepancy and generation rates of the sample sequences, and
+//							validates that their discrepancy is below that of random points, instead
+//   -volumeCuller			validates the visibility and LODs of a fixed scene against the culling
+//							shader and the expected values instead
+//   -volumeTransforms		validates the incremental per-object transforms against a full update,
+//							with the camera, the light and the volumes moving at random, instead
+//   -uploadRing			validates the upload ring allocator against a simulated fence instead
+//   -frameArena			validates the per-frame allocator of the constants instead
+//   -jobSystem				validates the dependency ordering of the job system, and times its
+//							scheduling overhead, instead
+//   -recordCommands			validates the ordering of the parallel command recording against a
+//							mock command sink, and times its concurrency, instead
+//   -golden <dir>			runs the golden-image regression against <dir>, e.g. Headless/Golden, instead
+//   -updateGolden			with -golden, stores the renders as the new goldens
+
+#include "HeadlessRenderer.h"
+#include "GoldenImages.h"
+#include "SampleCountStudy.h"
+#include "BenchmarkSuite.h"
+#include "SceneScaling.h"
+#include "MemoryBudget.h"
+#include "RenderGraph.h"
+#include "SampleScheduler.h"
+#include "CubeMapCache.h"
+#include "VolumeCuller.h"
+#include "VolumeTransforms.h"
+#include "RingAllocator.h"
+#include "FrameAllocator.h"
+#include "JobSystem.h"
+#include "CommandRecorder.h"
+#include "SHProjector.h"
+#include "SHRotation.h"
+#include "SampleSequence.h"
+#include "RadiancePrefilter.h"
+#include "FrameProfiler.h"
+#include "TraceRecorder.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+using namespace DirectX;
+
+struct CameraKey
+{
+	XMFLOAT3 EyePt;
+	XMFLOAT3 FocusPt;
+};
+
+static bool matchArg(const char* arg, const wchar_t* name)
+{
+	const wstring warg(arg, arg + strlen(arg));
+
+	return SceneSettings::MatchArg(warg.c_str(), name);
+}
+
+static int scanArg(const char* arg, uint32_t& value)
+{
+	char* end;
+	const auto parsed = strtoul(arg, &end, 10);
+	if (end == arg) return 0;
+	value = static_cast<uint32_t>(parsed);
+
+	return 1;
+}
+
+static int scanArg(const char* arg, float& value)
+{
+	char* end;
+	const auto parsed = strtof(arg, &end);
+	if (end == arg) return 0;
+	value = parsed;
+
+	return 1;
+}
+
+static bool loadCameraPath(const string& fileName, vector<CameraKey>& keys)
+{
+	ifstream file(fileName);
+	if (!file) return false;
+
+	string line;
+	while (getline(file, line))
+	{
+		istringstream stream(line);
+		CameraKey key;
+		if (stream >> key.EyePt.x >> key.EyePt.y >> key.EyePt.z >> key.FocusPt.x >> key.FocusPt.y >> key.FocusPt.z)
+			keys.push_back(key);
+	}
+
+	return !keys.empty();
+}
+
+static int runGoldenImages(const GoldenImages::RunDesc& desc)
+{
+	const auto startTime = chrono::steady_clock::now();
+	const auto results = GoldenImages::Run(desc);
+
+	auto numFailed = 0u, numMissing = 0u;
+	cout << left << setw(34) << "Case" << right << setw(10) << "PSNR" << setw(10) << "SSIM"
+		<< setw(10) << "Failed%" << setw(12) << "Time (ms)" << endl;
+	for (const auto& result : results)
+	{
+		cout << left << setw(34) << result.Name << right << fixed;
+		if (desc.Update) cout << setw(42) << (result.Passed ? "updated" : "FAILED TO WRITE");
+		else if (!result.HasGolden) cout << setw(42) << "MISSING GOLDEN";
+		else cout << setprecision(2) << setw(10) << result.PSNR << setprecision(4) << setw(10) << result.SSIM
+			<< setprecision(3) << setw(10) << 100.0f * result.FailedRatio << setprecision(1) << setw(12) << result.RenderTime
+			<< (result.Passed ? "" : "  FAILED");
+		cout << defaultfloat << endl;
+		if (!result.Passed) ++numFailed;
+		if (!desc.Update && !result.HasGolden) ++numMissing;
+	}
+
+	cout << setprecision(1) << fixed << results.size() - numFailed << " of " << results.size() << " cases passed in "
+		<< chrono::duration<double>(chrono::steady_clock::now() - startTime).count() << " s" << defaultfloat << endl;
+	if (numMissing > 0) cerr << numMissing << " goldens are missing from " << desc.Directory << ", or not of "
+		<< desc.Width << "x" << desc.Height << "; run from the MultiVolumes directory, or regenerate them with -golden "
+		<< desc.Directory << " -updateGolden." << endl;
+
+	return numFailed > 0 || results.empty() ? 1 : 0;
+}
+
+static int runSampleCountStudy(const SampleCountStudy::RunDesc& desc)
+{
+	const auto startTime = chrono::steady_clock::now();
+	const auto results = SampleCountStudy::Run(desc);
+
+	cout << left << setw(16) << "Case" << right << setw(8) << "Scale" << setw(8) << "Light" << setw(10) << "RMSE"
+		<< setw(8) << "PSNR" << setw(8) << "SSIM" << setw(10) << "AccPSNR" << setw(10) << "AccSSIM"
+		<< setw(12) << "Time (ms)" << endl;
+	for (const auto& result : results)
+	{
+		cout << left << setw(16) << result.Name << right << fixed << setprecision(3) << setw(8) << result.SampleScale
+			<< setw(8) << result.LightSamples << setprecision(5) << setw(10) << result.RMSE
+			<< setprecision(2) << setw(8) << result.PSNR << setprecision(4) << setw(8) << result.SSIM
+			<< setprecision(2) << setw(10) << result.AccumulatedPSNR << setprecision(4) << setw(10) << result.AccumulatedSSIM
+			<< setprecision(1) << setw(12) << result.RenderTime << defaultfloat << endl;
+	}
+
+	cout << results.size() << " cases in " << chrono::duration<double>(chrono::steady_clock::now() - startTime).count()
+		<< " s" << endl;
+
+	return results.empty() ? 1 : 0;
+}
+
+static bool writeProfile(const string& fileName)
+{
+	FrameProfiler::Aggregate();
+	cout << left << setw(20) << "Pass" << right << setw(8) << "Count" << setw(10) << "p50 (ms)"
+		<< setw(10) << "p95 (ms)" << setw(10) << "p99 (ms)" << setw(10) << "Max (ms)" << endl;
+	for (uint8_t i = 0; i < FrameProfiler::NUM_SCOPE; ++i)
+	{
+		const auto scope = static_cast<FrameProfiler::Scope>(i);
+		const auto stats = FrameProfiler::GetStats(scope);
+		if (stats.Count == 0) continue;
+
+		cout << left << setw(20) << FrameProfiler::GetScopeName(scope) << right << setw(8) << stats.Count
+			<< fixed << setprecision(3) << setw(10) << stats.P50 << setw(10) << stats.P95 << setw(10) << stats.P99
+			<< setw(10) << stats.Max << defaultfloat << endl;
+	}
+
+	const auto isJSON = fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0;
+	const auto succeeded = isJSON ? FrameProfiler::ExportJSON(fileName.c_str()) : FrameProfiler::ExportCSV(fileName.c_str());
+	if (!succeeded) cerr << "Failed to write " << fileName << "." << endl;
+
+	return succeeded;
+}
+
+static bool writeTrace(const string& fileName)
+{
+	if (!TraceRecorder::IsCompiledIn()) cerr << "Built without _ENABLE_TRACE_, the trace is empty." << endl;
+	else cout << "Trace events cost " << TraceRecorder::Benchmark(1 << 20) << " ns each" << endl;
+
+	const auto succeeded = TraceRecorder::Flush(fileName.c_str());
+	if (!succeeded) cerr << "Failed to write " << fileName << "." << endl;
+	else if (TraceRecorder::GetNumDropped() > 0) cout << TraceRecorder::GetNumDropped() << " trace events dropped" << endl;
+
+	return succeeded;
+}
+
+static CameraKey getCamera(const vector<CameraKey>& keys, const XMFLOAT2& orbit, uint32_t frame, uint32_t numFrames)
+{
+	CameraKey camera;
+
+	if (keys.empty())
+	{
+		// Turntable, as the animated camera of MultiVolumes::OnUpdate()
+		const auto tParam = XM_2PI * frame / numFrames;
+		camera.EyePt = XMFLOAT3(sinf(tParam) * orbit.x, orbit.y, cosf(tParam) * orbit.x);
+		camera.FocusPt = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	}
+	else
+	{
+		// Keyframes evenly spread over the frames
+		const auto s = numFrames > 1 ? static_cast<float>(keys.size() - 1) * frame / (numFrames - 1) : 0.0f;
+		const auto k = (min)(static_cast<size_t>(s), keys.size() - 1);
+		const auto& key0 = keys[k];
+		const auto& key1 = keys[(min)(k + 1, keys.size() - 1)];
+		const auto t = s - k;
+		XMStoreFloat3(&camera.EyePt, XMVectorLerp(XMLoadFloat3(&key0.EyePt), XMLoadFloat3(&key1.EyePt), t));
+		XMStoreFloat3(&camera.FocusPt, XMVectorLerp(XMLoadFloat3(&key0.FocusPt), XMLoadFloat3(&key1.FocusPt), t));
+	}
+
+	return camera;
+}
+
+static int runBenchmarks(const BenchmarkSuite::RunDesc& desc, const string& outputFile,
+	const string& baselineFile, float threshold)
+{
+	const auto startTime = chrono::steady_clock::now();
+	auto results = BenchmarkSuite::Run(desc);
+
+	auto numRegressions = 0;
+	if (!baselineFile.empty())
+	{
+		numRegressions = BenchmarkSuite::CompareBaseline(baselineFile.c_str(), threshold / 100.0f, results);
+		if (numRegressions < 0) cerr << "Failed to read the baseline " << baselineFile << endl;
+	}
+
+	cout << left << setw(28) << "Case" << right << setw(8) << "Iters" << setw(12) << "Median (ms)"
+		<< setw(12) << "Min (ms)" << setw(12) << "Mean (ms)" << setw(10) << "Change" << endl;
+	for (const auto& result : results)
+	{
+		cout << left << setw(28) << result.Name << right << setw(8) << result.Iterations << fixed << setprecision(4)
+			<< setw(12) << result.Median << setw(12) << result.Min << setw(12) << result.Mean;
+		if (result.Baseline > 0.0) cout << setprecision(1) << setw(9) << 100.0f * result.Change << "%"
+			<< (result.IsRegression ? "  REGRESSED" : "");
+		cout << defaultfloat << endl;
+	}
+
+	if (!BenchmarkSuite::WriteCSV(outputFile.c_str(), results))
+	{
+		cerr << "Failed to write " << outputFile << endl;
+
+		return 1;
+	}
+
+	cout << results.size() << " cases in " << setprecision(3) << chrono::duration<double>(chrono::steady_clock::now() - startTime).count()
+		<< " s";
+	if (!baselineFile.empty() && numRegressions >= 0) cout << ", " << numRegressions << " regressed by more than "
+		<< threshold << "%";
+	cout << endl;
+
+	return numRegressions != 0 || results.empty() ? 1 : 0;
+}
+
+static int runSceneScaling(const SceneScaling::RunDesc& desc, const string& outputFile)
+{
+	const auto startTime = chrono::steady_clock::now();
+	const auto results = SceneScaling::Run(desc);
+	if (results.empty()) return 1;
+
+	// Results are ordered by the volume counts, grid sizes, light-grid sizes and OIT layers
+	const auto getResult = [&results](uint32_t v, uint32_t g, uint32_t l, uint32_t o) -> const SceneScaling::CaseResult&
+	{
+		return results[((v * SceneScaling::NumGridSizes + g) * SceneScaling::NumLightGridSizes + l) *
+			SceneScaling::NumOITLayerCounts + o];
+	};
+	const auto defaultOITLayers = 1u;
+	const auto defaultGrid = 2u;
+	const auto defaultLightGrid = 3u;
+	assert(SceneScaling::GridSizes[defaultGrid] == SceneScaling::GetDefaultScene().GridSize);
+	assert(SceneScaling::LightGridSizes[defaultLightGrid] == SceneScaling::GetDefaultScene().LightGridSize);
+
+	const auto printHeader = [](const string& title, bool hasTimes)
+	{
+		cout << endl << title << endl << left << setw(10) << "Volumes" << right;
+		for (const auto& gridSize : SceneScaling::GridSizes) cout << setw(10) << ("grid " + to_string(gridSize));
+		if (hasTimes) cout << setw(14) << "Update (ms)" << setw(12) << "Cull (ms)";
+		cout << endl;
+	};
+
+	printHeader("Total MB, light grid " + to_string(SceneScaling::LightGridSizes[defaultLightGrid]) + ", " +
+		to_string(SceneScaling::OITLayerCounts[defaultOITLayers]) + " OIT layers; CPU per frame at grid " +
+		to_string(SceneScaling::GridSizes[defaultGrid]), true);
+	for (auto v = 0u; v < SceneScaling::NumVolumeCounts; ++v)
+	{
+		cout << left << setw(10) << SceneScaling::VolumeCounts[v] << right << fixed << setprecision(0);
+		for (auto g = 0u; g < SceneScaling::NumGridSizes; ++g)
+		{
+			const auto& result = getResult(v, g, defaultLightGrid, defaultOITLayers);
+			cout << setw(10) << result.Memory.Total / 1048576.0;
+		}
+		const auto& result = getResult(v, defaultGrid, defaultLightGrid, defaultOITLayers);
+		cout << setprecision(3) << setw(14) << result.UpdateTime << setw(12) << result.CullTime << defaultfloat << endl;
+	}
+
+	printHeader("Largest light grid within " + to_string(desc.Budget >> 20) + " MB (- if none)", false);
+	for (auto v = 0u; v < SceneScaling::NumVolumeCounts; ++v)
+	{
+		cout << left << setw(10) << SceneScaling::VolumeCounts[v] << right;
+		for (auto g = 0u; g < SceneScaling::NumGridSizes; ++g)
+		{
+			string lightGridSize = "-";
+			for (auto l = 0u; l < SceneScaling::NumLightGridSizes; ++l)
+				if (!getResult(v, g, l, defaultOITLayers).IsOverBudget)
+					lightGridSize = to_string(SceneScaling::LightGridSizes[l]);
+			cout << setw(10) << lightGridSize;
+		}
+		cout << endl;
+	}
+
+	auto numOverBudget = 0u;
+	for (const auto& result : results) numOverBudget += result.IsOverBudget ? 1 : 0;
+	cout << endl << results.size() << " configurations, " << numOverBudget << " over budget, in "
+		<< setprecision(3) << chrono::duration<double>(chrono::steady_clock::now() - startTime).count() << " s" << endl;
+
+	if (!SceneScaling::WriteCSV(outputFile.c_str(), results))
+	{
+		cerr << "Failed to write " << outputFile << endl;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static int runMemoryPlan(const SceneSettings& settings, uint32_t width, uint32_t height)
+{
+	auto planDesc = MemoryBudget::GetDefaultPlanDesc(settings, width, height);
+	planDesc.ReservedBytes = static_cast<uint64_t>(width) * height * 4 * 3;	// Swap chain
+	const auto plan = MemoryBudget::MakePlan(planDesc);
+	MemoryBudget::PrintPlan(cout, planDesc, plan);
+
+	MemoryBudget::EvaluationDesc evaluationDesc;
+	evaluationDesc.NumBudgets = 64;
+	const auto result = MemoryBudget::Evaluate(evaluationDesc);
+	cout << endl << result.NumPlans << " plans validated, " << result.NumFailed << " failed, " << setprecision(3)
+		<< result.PlanTime << " us per plan" << endl;
+
+	return result.NumFailed > 0 ? 1 : 0;
+}
+
+static int runRenderGraph(const SceneSettings& settings, uint32_t width, uint32_t height)
+{
+	auto frameDesc = RenderGraph::GetDefaultFrameDesc();
+	frameDesc.Width = width;
+	frameDesc.Height = height;
+	frameDesc.NumVolumes = settings.NumVolumes;
+	frameDesc.GridSize = settings.GridSize;
+	frameDesc.LightGridSize = settings.LightGridSize;
+	frameDesc.HasLightProbe = !settings.RadianceFile.empty();
+
+	RenderGraph graph;
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		frameDesc.OITMethod = i;
+		graph.Reset();
+		graph.BuildFrame(frameDesc);
+		if (!graph.Compile())
+		{
+			cerr << "Failed to compile the frame graph: " << graph.GetError() << endl;
+
+			return 1;
+		}
+
+		cout << "Frame graph, " << RenderGraph::GetOITMethodName(i) << ": ";
+		graph.Print(cout);
+		cout << endl;
+	}
+
+	RenderGraph::EvaluationDesc evaluationDesc;
+	evaluationDesc.NumRandomGraphs = 1000;
+	evaluationDesc.NumRandomPasses = 24;
+	evaluationDesc.NumRandomResources = 16;
+	evaluationDesc.Seed = 1;
+	const auto result = RenderGraph::Evaluate(evaluationDesc);
+	cout << result.NumGraphs << " graphs validated, " << result.NumFailed << " failed; default frame of "
+		<< result.NumFramePasses << " passes with " << result.NumFrameBarriers << " barriers, " << fixed << setprecision(1)
+		<< result.FrameTransientBytes / 1048576.0 << " MB transient in a " << result.FrameHeapBytes / 1048576.0
+		<< " MB heap, compiled in " << result.CompileTime << " us" << defaultfloat << endl;
+
+	return result.NumFailed > 0 ? 1 : 0;
+}
+
+static int runSampleScheduler()
+{
+	static const char* pathNames[] = { "orbit", "dolly", "fly-through" };
+
+	auto numFailed = 0u;
+	for (uint8_t path = 0; path < SampleScheduler::NUM_CAMERA_PATH; ++path)
+	{
+		for (const auto& noise : { 0.0f, 0.05f })
+		{
+			SampleScheduler::SimulationDesc simulationDesc;
+			simulationDesc.NumVolumes = 1000;
+			simulationDesc.NumFrames = 300;
+			simulationDesc.BudgetMs = 4.0f;
+			simulationDesc.Path = static_cast<SampleScheduler::CameraPath>(path);
+			simulationDesc.Noise = noise;
+			simulationDesc.PerVolumeTiming = true;
+			simulationDesc.Seed = 1;
+			const auto result = SampleScheduler::Simulate(simulationDesc);
+
+			// Volumes entering the view are scheduled before their costs are measured, so the
+			// frame time only has to be within the tolerance of Simulate() most of the time
+			const auto isFailed = result.InTolerance < 0.6f;
+			numFailed += isFailed ? 1 : 0;
+			cout << left << setw(12) << pathNames[path] << right << " noise " << fixed << setprecision(2) << noise
+				<< ": " << setprecision(1) << result.InTolerance * 100.0f << "% of the frames within the budget, settled at frame "
+				<< result.ConvergenceFrame << ", max overshoot " << result.MaxOvershoot * 100.0f << "%, sample quality "
+				<< setprecision(2) << result.SampleQuality << ", mip bias " << result.MipBias << defaultfloat
+				<< (isFailed ? "  FAILED" : "") << endl;
+		}
+	}
+
+	return numFailed > 0 ? 1 : 0;
+}
+
+static int runCubeMapCache()
+{
+	auto numFailed = 0u;
+	for (const auto& lightInterval : { 0u, 60u })
+	{
+		for (const auto& maxRefreshFaces : { UINT32_MAX, 64u })
+		{
+			CubeMapCache::EvaluationDesc evaluationDesc;
+			evaluationDesc.NumVolumes = 1000;
+			evaluationDesc.NumFrames = 360;
+			evaluationDesc.OrbitFrames = 360;
+			evaluationDesc.LightInterval = lightInterval;
+			evaluationDesc.Tolerance = 0.5f;
+			evaluationDesc.MaxTolerance = 2.0f;
+			evaluationDesc.MaxRefreshFaces = maxRefreshFaces;
+			const auto result = CubeMapCache::Evaluate(evaluationDesc);
+
+			const auto isFailed = result.MaxError > evaluationDesc.MaxTolerance;
+			numFailed += isFailed ? 1 : 0;
+			cout << "light interval " << setw(3) << lightInterval << ", max refreshed faces " << setw(10)
+				<< (maxRefreshFaces == UINT32_MAX ? string("unbounded") : to_string(maxRefreshFaces)) << ": " << fixed
+				<< setprecision(1) << result.ReuseRatio * 100.0f << "% of " << result.NumVisibleFaces << " faces reused, peak "
+				<< result.PeakRefreshedFaces << " re-marched, mean error " << setprecision(3) << result.MeanError
+				<< " texels, max " << result.MaxError << defaultfloat << (isFailed ? "  FAILED" : "") << endl;
+		}
+	}
+
+	return numFailed > 0 ? 1 : 0;
+}
+
+static int runOITEngine()
+{
+	static const char* methodNames[] = { "k-buffer", "linked list", "weighted blended", "adaptive" };
+	static const float maxRMSEs[] = { 0.05f, 1.0e-5f, 0.1f, 0.05f };
+
+	OITEngine::EvaluationDesc evaluationDesc;
+	evaluationDesc.Width = 1280;
+	evaluationDesc.Height = 720;
+	evaluationDesc.NumProxies = 256;
+	evaluationDesc.NumKLayers = 8;
+	evaluationDesc.NumAdaptiveLayers = 4;
+	evaluationDesc.NodesPerPixel = 16;
+	evaluationDesc.Seed = 1;
+	const auto result = OITEngine::Evaluate(evaluationDesc);
+	cout << "depth complexity " << fixed << setprecision(2) << result.MeanDepthComplexity << " mean, "
+		<< result.MaxDepthComplexity << " max; rasterized in " << setprecision(3) << result.RasterTime << " ms" << endl;
+
+	auto numFailed = 0u;
+	for (uint8_t m = 0; m < OITEngine::NUM_METHOD; ++m)
+	{
+		const auto& methodResult = result.Methods[m];
+		const auto isFailed = !(methodResult.RMSE <= maxRMSEs[m]);
+		numFailed += isFailed ? 1 : 0;
+		cout << left << setw(17) << methodNames[m] << right << setprecision(1) << setw(8)
+			<< methodResult.MemorySize / (1024.0 * 1024.0) << " MB, insert " << setprecision(3) << setw(8)
+			<< methodResult.InsertTime << " ms, resolve " << setw(8) << methodResult.ResolveTime << " ms, RMSE "
+			<< setprecision(6) << methodResult.RMSE << ", max error " << methodResult.MaxError << ", "
+			<< setprecision(2) << methodResult.DroppedRatio * 100.0f << "% dropped" << (isFailed ? "  FAILED" : "") << endl;
+	}
+	cout << defaultfloat;
+
+	return numFailed > 0 ? 1 : 0;
+}
+
+static int runTemporalAA()
+{
+	auto numFailed = 0u;
+	for (const auto& velocity : { XMFLOAT2(0.0f, 0.0f), XMFLOAT2(0.5f, 0.25f), XMFLOAT2(2.0f, 1.0f) })
+	{
+		TemporalAA::EvaluationDesc evaluationDesc;
+		evaluationDesc.Width = 256;
+		evaluationDesc.Height = 256;
+		evaluationDesc.NumFrames = 80;
+		evaluationDesc.NumWarmUpFrames = 48;
+		evaluationDesc.Velocity = velocity;
+		evaluationDesc.Parameters = TemporalAA::GetDefaultParams();
+		const auto result = TemporalAA::Evaluate(evaluationDesc);
+
+		// The resolved frames must neither flicker more nor be further from the reference than the input
+		const auto isFailed = !(result.Flicker < result.InputFlicker) || !(result.RMSE <= result.InputRMSE);
+		numFailed += isFailed ? 1 : 0;
+		cout << "pan " << fixed << setprecision(2) << velocity.x << ", " << velocity.y << " pixels: RMSE " << setprecision(4)
+			<< result.InputRMSE << " -> " << result.RMSE << ", flicker " << result.InputFlicker << " -> " << result.Flicker
+			<< ", " << setprecision(3) << result.FrameTime << " ms per frame" << defaultfloat << (isFailed ? "  FAILED" : "") << endl;
+	}
+
+	return numFailed > 0 ? 1 : 0;
+}
+
+static int runSHProjection()
+{
+	auto numFailed = 0u;
+	for (const auto order : { static_cast<uint8_t>(3), SHProjector::MaxOrder })
+	{
+		for (const auto faceSize : { 32u, 128u, SHProjector::MaxFaceSize })
+		{
+			SHProjector::EvaluationDesc evaluationDesc;
+			evaluationDesc.FaceSize = faceSize;
+			evaluationDesc.Order = order;
+			const auto result = SHProjector::Evaluate(evaluationDesc);
+
+			// The solid angles of the texels converge as 1 / faceSize^2
+			const auto maxError = 1.0f / (faceSize * faceSize);
+			const auto isFailed = !(result.MaxAnalyticError < maxError) || !(result.MaxShaderError < maxError);
+			numFailed += isFailed ? 1 : 0;
+			cout << "order " << static_cast<uint32_t>(order) << ", " << faceSize << "^2 faces: max error " << scientific
+				<< setprecision(2) << result.MaxAnalyticError << " analytic, " << result.MaxShaderError << " to the shader; "
+				<< fixed << setprecision(3) << result.ProjectTime << " ms, " << result.ShaderTime << " ms as the shader"
+				<< defaultfloat << (isFailed ? "  FAILED" : "") << endl;
+		}
+	}
+
+	return numFailed > 0 ? 1 : 0;
+}
+
+static int runSHRotation()
+{
+	auto numFailed = 0u;
+	for (uint8_t order = 2; order <= SHRotation::MaxOrder; ++order)
+	{
+		SHRotation::EvaluationDesc evaluationDesc;
+		evaluationDesc.NumProbes = 4096;
+		evaluationDesc.NumDirs = 4096;
+		evaluationDesc.Order = order;
+		const auto result = SHRotation::Evaluate(evaluationDesc);
+
+		const auto isFailed = !(result.MaxError < 1.0e-5f);
+		numFailed += isFailed ? 1 : 0;
+		cout << "order " << static_cast<uint32_t>(order) << ": max error " << scientific << setprecision(2) << result.MaxError
+			<< "; " << fixed << setprecision(3) << result.InitTime << " us to init, " << result.RotateTime << " us per probe, "
+			<< result.BatchTime << " us per probe batched" << defaultfloat << (isFailed ? "  FAILED" : "") << endl;
+	}
+
+	return numFailed > 0 ? 1 : 0;
+}
+
+static int runSampleSequence()
+{
+	static const char* typeNames[] = { "Halton", "Sobol", "R2", "blue noise" };
+
+	SampleSequence::EvaluationDesc evaluationDesc;
+	evaluationDesc.NumSamples = 1024;
+	evaluationDesc.NumBatchSamples = 65536;
+	const auto result = SampleSequence::Evaluate(evaluationDesc);
+
+	// Expectation of uniform random points, sqrt((1/4 - 1/9) / n) in 2D
+	const auto randomDiscrepancy = sqrtf((1.0f / 4.0f - 1.0f / 9.0f) / evaluationDesc.NumSamples);
+	cout << evaluationDesc.NumSamples << " points: L2-star discrepancy " << scientific << setprecision(3)
+		<< result.RandomDiscrepancy << " of hashed random points, " << randomDiscrepancy << " expected" << endl;
+
+	// The blue-noise set is only stratified per texel, so it must merely beat random points
+	auto numFailed = 0u;
+	for (uint8_t t = 0; t < SampleSequence::NUM_TYPE; ++t)
+	{
+		const auto maxDiscrepancy = t == SampleSequence::BLUE_NOISE ? randomDiscrepancy : 0.5f * randomDiscrepancy;
+		const auto isFailed = !(result.Discrepancies[t] < maxDiscrepancy);
+		numFailed += isFailed ? 1 : 0;
+		cout << left << setw(11) << typeNames[t] << right << " L2-star discrepancy " << scientific << setprecision(3)
+			<< result.Discrepancies[t] << "; " << fixed << setprecision(1) << result.NextRates[t] << " points/us by Next(), "
+			<< result.BatchRates[t] << " batched" << defaultfloat << (isFailed ? "  FAILED" : "") << endl;
+	}
+
+	return numFailed > 0 ? 1 : 0;
+}
+
+static int runVolumeCuller()
+{
+	const auto result = VolumeCuller::Evaluate();
+	cout << result.NumVolumes << " volumes validated against CSVolumeCull.hlsl, " << result.NumFailed << " failed; "
+		<< result.NumVisible << " visible, " << result.NumDepthCulled << " beyond the near or far plane culled by the BVH only"
+		<< endl;
+
+	return result.NumFailed > 0 ? 1 : 0;
+}
+
+static int runVolumeTransforms()
+{
+	VolumeTransforms::EvaluationDesc evaluationDesc;
+	evaluationDesc.NumVolumes = 10000;
+	evaluationDesc.NumFrames = 200;
+	evaluationDesc.FrameCount = 3;
+	evaluationDesc.MoveRate = 0.01f;
+	evaluationDesc.CameraMoveRate = 0.5f;
+	evaluationDesc.LightMoveRate = 0.05f;
+	evaluationDesc.Seed = 1;
+	const auto result = VolumeTransforms::Evaluate(evaluationDesc);
+	cout << result.NumFrames << " frames of " << evaluationDesc.NumVolumes << " volumes validated, " << result.NumFailed
+		<< " failed; " << result.NumUpdated << " of " << result.NumChecked << " volumes rewritten, " << fixed << setprecision(3)
+		<< result.MovingTime << " ms per frame with the camera moving, " << result.StaticTime << " ms over "
+		<< result.NumStaticFrames << " static frames" << defaultfloat << endl;
+
+	return result.NumFailed > 0 ? 1 : 0;
+}
+
+static int runUploadRing()
+{
+	RingAllocator::EvaluationDesc evaluationDesc;
+	evaluationDesc.NumAllocations = 100000;
+	evaluationDesc.Capacity = 8 << 20;
+	evaluationDesc.MaxSize = 1 << 20;
+	evaluationDesc.MaxInFlight = 3;
+	evaluationDesc.Seed = 1;
+	const auto result = RingAllocator::Evaluate(evaluationDesc);
+	cout << result.NumAllocations << " allocations validated, " << result.NumFailed << " failed; "
+		<< result.NumStalls << " stalls and " << result.NumWraps << " wraps streaming " << fixed << setprecision(1)
+		<< result.TotalBytes / 1048576.0 << " MB through " << evaluationDesc.Capacity / 1048576.0 << " MB, peak "
+		<< result.PeakBytes / 1048576.0 << " MB, " << result.AllocateTime << " ns per allocation" << defaultfloat << endl;
+
+	return result.NumFailed > 0 ? 1 : 0;
+}
+
+static int runFrameArena()
+{
+	FrameAllocator::EvaluationDesc evaluationDesc;
+	evaluationDesc.NumFrames = 10000;
+	evaluationDesc.Capacity = 256 << 10;
+	evaluationDesc.MaxAllocations = 64;
+	evaluationDesc.MaxSize = 4096;
+	evaluationDesc.Seed = 1;
+	const auto result = FrameAllocator::Evaluate(evaluationDesc);
+	cout << result.NumFrames << " frames of " << result.NumAllocations << " allocations validated, " << result.NumFailed
+		<< " failed; " << result.NumOverflows << " overflows, peak " << fixed << setprecision(1) << result.PeakBytes / 1024.0
+		<< " KB of " << evaluationDesc.Capacity / 1024.0 << " KB, " << result.AllocateTime << " ns per constant buffer"
+		<< defaultfloat << endl;
+
+	return result.NumFailed > 0 ? 1 : 0;
+}
+
+static int runJobSystem()
+{
+	JobSystem::EvaluationDesc evaluationDesc;
+	evaluationDesc.NumGraphs = 100;
+	evaluationDesc.NumTasks = 1000;
+	evaluationDesc.MaxDependencies = 4;
+	evaluationDesc.NumSpawns = 10000;
+	evaluationDesc.Seed = 1;
+	const auto result = JobSystem::Evaluate(evaluationDesc);
+	cout << result.NumGraphs << " graphs of " << result.NumTasks << " tasks with " << result.NumDependencies
+		<< " dependencies validated on " << result.NumWorkers << " workers, " << result.NumFailed << " failed; "
+		<< fixed << setprecision(1) << result.SpawnTime << " ns per task, " << result.ChunkTime
+		<< " ns per parallel-for chunk" << defaultfloat << endl;
+
+	return result.NumFailed > 0 ? 1 : 0;
+}
+
+static int runCommandRecorder()
+{
+	CommandRecorder::EvaluationDesc evaluationDesc;
+	evaluationDesc.NumFrames = 10000;
+	evaluationDesc.MaxSegments = 6;
+	evaluationDesc.MaxCommands = 32;
+	evaluationDesc.NumTimedFrames = 200;
+	evaluationDesc.RecordTime = 200.0;
+	evaluationDesc.Seed = 1;
+	const auto result = CommandRecorder::Evaluate(evaluationDesc);
+	cout << result.NumFrames << " frames of " << result.NumSegments << " segments and " << result.NumCommands
+		<< " commands validated, " << result.NumFailed << " failed; up to " << result.PeakConcurrency
+		<< " segments recording at once, " << fixed << setprecision(3) << result.SerialTime << " ms serial, "
+		<< result.ParallelTime << " ms parallel per frame of " << evaluationDesc.MaxSegments << " segments"
+		<< defaultfloat << endl;
+
+	return result.NumFailed > 0 ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+	SceneSettings settings;
+	settings.ParseCommandLineArgs(argv, argc);
+
+	string outputPrefix = "frame", format = "ppm", cameraFile;
+	uint32_t width = 1280, height = 800;
+	uint32_t numFrames = 120, numFrameJobs = 1;
+	XMFLOAT2 orbit(60.0f, 6.0f);
+	auto skyRotation = 0.0f;
+	uint32_t irradianceGridSize = 0, irradianceRays = 256;
+	auto goldenDesc = GoldenImages::GetDefaultDesc();
+	auto runGolden = false;
+	auto prefilterRadiance = false;
+	auto jitterRays = false;
+	auto runSampleStudy = false;
+	auto benchmarkDesc = BenchmarkSuite::GetDefaultDesc();
+	string benchmarkFile, baselineFile;
+	auto regressionThreshold = 10.0f;
+	auto scalingDesc = SceneScaling::GetDefaultDesc();
+	string scalingFile;
+	auto planMemory = false;
+	auto printRenderGraph = false;
+	auto simulateScheduler = false;
+	auto evaluateCubeMapCache = false;
+	auto evaluateOIT = false;
+	auto evaluateTAA = false;
+	auto evaluateSHProjection = false;
+	auto evaluateSHRotation = false;
+	auto evaluateSampleSequence = false;
+	auto reuseCubeMaps = false;
+	auto useTemporalAA = false;
+	auto showMesh = false;
+	auto validateCuller = false;
+	auto validateTransforms = false;
+	auto frameBudget = 0.0f;
+	auto validateUploadRing = false;
+	auto validateFrameArena = false;
+	auto validateJobSystem = false;
+	auto validateRecording = false;
+	string profileFile, traceFile;
+	for (auto i = 1; i < argc; ++i)
+	{
+		if (matchArg(argv[i], L"output"))
+		{
+			outputPrefix = i + 1 < argc ? argv[++i] : outputPrefix;
+		}
+		else if (matchArg(argv[i], L"format"))
+		{
+			format = i + 1 < argc ? argv[++i] : format;
+		}
+		else if (matchArg(argv[i], L"width"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], width);
+		}
+		else if (matchArg(argv[i], L"height"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], height);
+		}
+		else if (matchArg(argv[i], L"frames"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], numFrames);
+		}
+		else if (matchArg(argv[i], L"orbit"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], orbit.x);
+			if (i + 1 < argc) i += scanArg(argv[i + 1], orbit.y);
+		}
+		else if (matchArg(argv[i], L"camera"))
+		{
+			cameraFile = i + 1 < argc ? argv[++i] : cameraFile;
+		}
+		else if (matchArg(argv[i], L"frameJobs"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], numFrameJobs);
+		}
+		else if (matchArg(argv[i], L"skyRotation"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], skyRotation);
+		}
+		else if (matchArg(argv[i], L"irradianceVolume"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], irradianceGridSize);
+			if (i + 1 < argc) i += scanArg(argv[i + 1], irradianceRays);
+		}
+		else if (matchArg(argv[i], L"prefilterRadiance"))
+		{
+			prefilterRadiance = true;
+		}
+		else if (matchArg(argv[i], L"profile"))
+		{
+			profileFile = i + 1 < argc ? argv[++i] : profileFile;
+		}
+		else if (matchArg(argv[i], L"trace"))
+		{
+			traceFile = i + 1 < argc ? argv[++i] : traceFile;
+		}
+		else if (matchArg(argv[i], L"frameBudget"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], frameBudget);
+		}
+		else if (matchArg(argv[i], L"reuseCubeMaps"))
+		{
+			reuseCubeMaps = true;
+		}
+		else if (matchArg(argv[i], L"showMesh"))
+		{
+			showMesh = true;
+		}
+		else if (matchArg(argv[i], L"taa"))
+		{
+			useTemporalAA = true;
+		}
+		else if (matchArg(argv[i], L"jitterRays"))
+		{
+			jitterRays = true;
+		}
+		else if (matchArg(argv[i], L"sampleStudy"))
+		{
+			runSampleStudy = true;
+		}
+		else if (matchArg(argv[i], L"benchmark"))
+		{
+			benchmarkFile = i + 1 < argc ? argv[++i] : benchmarkFile;
+		}
+		else if (matchArg(argv[i], L"benchmarkFilter"))
+		{
+			benchmarkDesc.Filter = i + 1 < argc ? argv[++i] : benchmarkDesc.Filter;
+		}
+		else if (matchArg(argv[i], L"baseline"))
+		{
+			baselineFile = i + 1 < argc ? argv[++i] : baselineFile;
+		}
+		else if (matchArg(argv[i], L"regressionThreshold"))
+		{
+			if (i + 1 < argc) i += scanArg(argv[i + 1], regressionThreshold);
+		}
+		else if (matchArg(argv[i], L"sceneScaling"))
+		{
+			scalingFile = i + 1 < argc ? argv[++i] : scalingFile;
+		}
+		else if (matchArg(argv[i], L"planMemory"))
+		{
+			planMemory = true;
+		}
+		else if (matchArg(argv[i], L"renderGraph"))
+		{
+			printRenderGraph = true;
+		}
+		else if (matchArg(argv[i], L"sampleScheduler"))
+		{
+			simulateScheduler = true;
+		}
+		else if (matchArg(argv[i], L"cubeMapCache"))
+		{
+			evaluateCubeMapCache = true;
+		}
+		else if (matchArg(argv[i], L"oitEngine"))
+		{
+			evaluateOIT = true;
+		}
+		else if (matchArg(argv[i], L"temporalAA"))
+		{
+			evaluateTAA = true;
+		}
+		else if (matchArg(argv[i], L"shProjection"))
+		{
+			evaluateSHProjection = true;
+		}
+		else if (matchArg(argv[i], L"shRotation"))
+		{
+			evaluateSHRotation = true;
+		}
+		else if (matchArg(argv[i], L"sampleSequence"))
+		{
+			evaluateSampleSequence = true;
+		}
+		else if (matchArg(argv[i], L"volumeCuller"))
+		{
+			validateCuller = true;
+		}
+		else if (matchArg(argv[i], L"volumeTransforms"))
+		{
+			validateTransforms = true;
+		}
+		else if (matchArg(argv[i], L"uploadRing"))
+		{
+			validateUploadRing = true;
+		}
+		else if (matchArg(argv[i], L"frameArena"))
+		{
+			validateFrameArena = true;
+		}
+		else if (matchArg(argv[i], L"jobSystem"))
+		{
+			validateJobSystem = true;
+		}
+		else if (matchArg(argv[i], L"recordCommands"))
+		{
+			validateRecording = true;
+		}
+		else if (matchArg(argv[i], L"golden"))
+		{
+			runGolden = true;
+			goldenDesc.Directory = i + 1 < argc ? argv[++i] : goldenDesc.Directory;
+		}
+		else if (matchArg(argv[i], L"updateGolden"))
+		{
+			goldenDesc.Update = true;
+		}
+	}
+
+	if (runGolden) return runGoldenImages(goldenDesc);
+	if (runSampleStudy) return runSampleCountStudy(SampleCountStudy::GetDefaultDesc());
+	if (planMemory) return runMemoryPlan(settings, width, height);
+	if (printRenderGraph) return runRenderGraph(settings, width, height);
+	if (simulateScheduler) return runSampleScheduler();
+	if (evaluateCubeMapCache) return runCubeMapCache();
+	if (evaluateOIT) return runOITEngine();
+	if (evaluateTAA) return runTemporalAA();
+	if (evaluateSHProjection) return runSHProjection();
+	if (evaluateSHRotation) return runSHRotation();
+	if (evaluateSampleSequence) return runSampleSequence();
+	if (validateCuller) return runVolumeCuller();
+	if (validateTransforms) return runVolumeTransforms();
+	if (validateUploadRing) return runUploadRing();
+	if (validateFrameArena) return runFrameArena();
+	if (validateJobSystem) return runJobSystem();
+	if (validateRecording) return runCommandRecorder();
+	if (!scalingFile.empty())
+	{
+		scalingDesc.Width = width;
+		scalingDesc.Height = height;
+		if (settings.MemoryBudget > 0) scalingDesc.Budget = static_cast<uint64_t>(settings.MemoryBudget) << 20;
+
+		return runSceneScaling(scalingDesc, scalingFile);
+	}
+	if (!benchmarkFile.empty()) return runBenchmarks(benchmarkDesc, benchmarkFile, baselineFile, regressionThreshold);
+
+	if (prefilterRadiance)
+	{
+		const auto startTime = chrono::steady_clock::now();
+		RadiancePrefilter prefilter;
+		if (!prefilter.Load(settings.RadianceFile) || prefilter.GetCacheFileName().empty())
+		{
+			wcerr << L"Failed to prefilter the radiance " << settings.RadianceFile << L"." << endl;
+
+			return 1;
+		}
+
+		wcout << (prefilter.IsCached() ? L"Up to date: " : L"Prefiltered: ") << prefilter.GetCacheFileName() << L" in "
+			<< chrono::duration<double>(chrono::steady_clock::now() - startTime).count() << L" s" << endl;
+
+		return 0;
+	}
+
+	const auto isHDR = format == "pfm";
+	vector<CameraKey> cameraKeys;
+	if (!cameraFile.empty() && !loadCameraPath(cameraFile, cameraKeys))
+	{
+		cerr << "Failed to load the camera path " << cameraFile << "." << endl;
+
+		return 1;
+	}
+
+	auto startTime = chrono::steady_clock::now();
+	SHProjector shProjector;
+	const XMFLOAT3* pSHCoeffs = nullptr;
+	if (!settings.RadianceFile.empty())
+	{
+		// Same order as SH_ORDER of the shaders
+		if (shProjector.Load(settings.RadianceFile, 3)) pSHCoeffs = shProjector.GetSHCoefficients();
+		else wcerr << L"Failed to load the radiance " << settings.RadianceFile << L", using no light probe." << endl;
+	}
+
+	XMFLOAT3 rotatedSH[9];
+	if (pSHCoeffs && skyRotation != 0.0f)
+	{
+		SHRotation shRotation;
+		shRotation.Init(XMMatrixRotationY(XMConvertToRadians(skyRotation)), 3);
+		shRotation.Rotate(pSHCoeffs, rotatedSH);
+		pSHCoeffs = rotatedSH;
+	}
+
+	BlueNoise rayJitters;
+	if (jitterRays) rayJitters.Generate(64, 16);
+
+	HeadlessRenderer renderer;
+	if (!renderer.Init(settings, width, height, pSHCoeffs, jitterRays ? &rayJitters : nullptr))
+	{
+		cerr << "Invalid settings." << endl;
+
+		return 1;
+	}
+
+	if (showMesh && !renderer.LoadMesh(settings.MeshFileName.c_str(), settings.MeshPosScale))
+		cerr << "Failed to load the mesh " << settings.MeshFileName << ", using no mesh." << endl;
+
+	cout << "Scene and light map ready in " << chrono::duration<double>(chrono::steady_clock::now() - startTime).count()
+		<< " s" << endl;
+
+	if (irradianceGridSize > 0)
+	{
+		startTime = chrono::steady_clock::now();
+		renderer.BakeIrradianceVolume(irradianceGridSize, irradianceRays);
+		const auto& irradianceVolume = renderer.GetIrradianceVolume();
+		cout << "Irradiance volume of " << irradianceGridSize << "^3 probes (" << irradianceVolume.GetMemorySize() / 1024.0
+			<< " KB) baked in " << chrono::duration<double>(chrono::steady_clock::now() - startTime).count() << " s" << endl;
+	}
+
+	// Frames are distributed over the frame jobs, while each frame is rendered in parallel
+	startTime = chrono::steady_clock::now();
+	atomic<uint32_t> nextFrame(0), numFailed(0);
+	mutex outputMutex;
+	const auto worker = [&]()
+	{
+		HeadlessRenderer::FrameContext context;
+		renderer.InitFrameContext(context);
+		context.FrameBudget = frameBudget;
+		context.ReuseCubeMaps = reuseCubeMaps;
+		context.UseTemporalAA = useTemporalAA;
+		vector<uint8_t> rgbs(3 * width * height);
+
+		for (auto f = nextFrame++; f < numFrames; f = nextFrame++)
+		{
+			const auto frameStart = chrono::steady_clock::now();
+			const auto camera = getCamera(cameraKeys, orbit, f, numFrames);
+			context.FrameIndex = f;
+			renderer.Render(context, camera.EyePt, camera.FocusPt);
+
+			char fileName[1024];
+			snprintf(fileName, sizeof(fileName), "%s_%04u.%s", outputPrefix.c_str(), f, isHDR ? "pfm" : "ppm");
+			auto succeeded = false;
+			if (isHDR) succeeded = HeadlessRenderer::WritePFM(fileName, context.SceneColors.data(), width, height);
+			else
+			{
+				HeadlessRenderer::ToneMap(context.SceneColors.data(), width * height, rgbs.data());
+				succeeded = HeadlessRenderer::WritePPM(fileName, rgbs.data(), width, height);
+			}
+			if (!succeeded) ++numFailed;
+
+			const auto frameTime = chrono::duration<double, milli>(chrono::steady_clock::now() - frameStart).count();
+			FrameProfiler::Record(FrameProfiler::FRAME, frameTime);
+			lock_guard<mutex> lock(outputMutex);
+			if (succeeded) cout << fileName << ": " << frameTime << " ms" << endl;
+			else cerr << "Failed to write " << fileName << "." << endl;
+		}
+	};
+
+	vector<thread> threads;
+	numFrameJobs = useTemporalAA ? 1 : (max)((min)(numFrameJobs, numFrames), 1u);
+	for (auto i = 1u; i < numFrameJobs; ++i) threads.emplace_back(worker);
+	worker();
+	for (auto& thread : threads) thread.join();
+
+	cout << numFrames << " frames in " << chrono::duration<double>(chrono::steady_clock::now() - startTime).count()
+		<< " s" << endl;
+
+	if (!profileFile.empty() && !writeProfile(profileFile)) ++numFailed;
+	if (!traceFile.empty() && !writeTrace(traceFile)) ++numFailed;
+
+	return numFailed > 0 ? 1 : 0;
+}
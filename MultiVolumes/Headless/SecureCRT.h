@@ -0,0 +1,176 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+// Secure CRT functions of XUSGObjLoader.cpp for the headless build. As in the secure CRT,
+// every %s, %c and %[ conversion is followed by the size of its buffer, which bounds the
+// characters stored; the format is scanned one conversion at a time, so each conversion gets
+// the width of its own buffer.
+
+#pragma once
+
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+inline int fopen_s(FILE** ppFile, const char* fileName, const char* mode)
+{
+	*ppFile = fopen(fileName, mode);
+
+	return *ppFile ? 0 : errno;
+}
+
+namespace SecureCRT
+{
+	//--------------------------------------------------------------------------------------
+	// Splits the literal text and the next assigning conversion off the format, and returns
+	// the rest. Suppressed conversions (%*d) and %% are kept as literal text.
+	//--------------------------------------------------------------------------------------
+	inline const char* SplitConversion(const char* format, std::string& piece, bool& isSized)
+	{
+		piece.clear();
+		isSized = false;
+		while (*format)
+		{
+			if (*format != '%')
+			{
+				piece += *format++;
+				continue;
+			}
+
+			const auto pStart = format++;
+			const auto isSuppressed = *format == '*';
+			if (isSuppressed) ++format;
+			while (*format >= '0' && *format <= '9') ++format;
+			while (*format && strchr("hljztL", *format)) ++format;
+
+			const auto conversion = *format;
+			if (conversion == '[')
+			{
+				// A scanset may start with ^ and ], which are then part of it
+				++format;
+				if (*format == '^') ++format;
+				if (*format == ']') ++format;
+				while (*format && *format != ']') ++format;
+			}
+			if (*format) ++format;
+			piece.append(pStart, format);
+
+			if (conversion == '%' || isSuppressed) continue;
+
+			isSized = conversion == 's' || conversion == 'c' || conversion == '[';
+
+			return format;
+		}
+
+		return format;
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Bounds the width of the conversion ending the piece by the size of its buffer
+	//--------------------------------------------------------------------------------------
+	inline bool SetWidth(std::string& piece, size_t bufferSize)
+	{
+		const auto pos = piece.rfind('%') + 1;
+		const auto widthEnd = piece.find_first_not_of("0123456789", pos);
+		const auto maxWidth = piece[piece.find_first_not_of("hljztL", widthEnd)] == 'c' ? bufferSize : bufferSize - 1;
+		if (bufferSize == 0 || maxWidth == 0) return false;
+
+		const auto width = widthEnd > pos ? std::stoull(piece.substr(pos, widthEnd - pos)) : maxWidth;
+		piece.replace(pos, widthEnd - pos, std::to_string(width < maxWidth ? width : maxWidth));
+
+		return true;
+	}
+
+	template<typename Scanner>
+	inline int ScanNext(Scanner& scanner, const char* format, int numAssigned)
+	{
+		// The literal text and suppressed conversions after the last argument
+		int numRead;
+		const auto result = *format ? scanner(format, &numRead) : 0;
+
+		return result == EOF && numAssigned == 0 ? EOF : numAssigned;
+	}
+
+	template<typename Scanner, typename T, typename... Args>
+	inline int ScanNext(Scanner&, const char*, int, T, Args...)
+	{
+		// Not a pointer to assign to, or a missing buffer size
+		return EOF;
+	}
+
+	template<typename Scanner, typename T, typename... Args>
+	inline int ScanSized(Scanner& scanner, const char* format, int numAssigned, std::string& piece,
+		T* pArg, Args... args);
+
+	template<typename Scanner, typename T, typename... Args>
+	inline int ScanNext(Scanner& scanner, const char* format, int numAssigned, T* pArg, Args... args)
+	{
+		std::string piece;
+		auto isSized = false;
+		format = SplitConversion(format, piece, isSized);
+		if (isSized) return ScanSized(scanner, format, numAssigned, piece, pArg, args...);
+
+		const auto result = scanner(piece.c_str(), pArg);
+		if (result != 1) return result == EOF && numAssigned == 0 ? EOF : numAssigned;
+
+		return ScanNext(scanner, format, numAssigned + 1, args...);
+	}
+
+	template<typename Scanner, typename T, typename U, typename... Args>
+	inline int ScanSizedBuffer(Scanner& scanner, const char* format, int numAssigned, std::string& piece,
+		T* pArg, U bufferSize, Args... args)
+	{
+		if (!SetWidth(piece, static_cast<size_t>(bufferSize))) return numAssigned;
+
+		const auto result = scanner(piece.c_str(), pArg);
+		if (result != 1) return result == EOF && numAssigned == 0 ? EOF : numAssigned;
+
+		return ScanNext(scanner, format, numAssigned + 1, args...);
+	}
+
+	template<typename Scanner, typename T, typename U, typename... Args>
+	inline int ScanSizedBuffer(Scanner&, const char*, int, std::string&, T*, U*, Args...)
+	{
+		// A missing buffer size
+		return EOF;
+	}
+
+	template<typename Scanner, typename T>
+	inline int ScanSizedBuffer(Scanner&, const char*, int, std::string&, T*)
+	{
+		return EOF;
+	}
+
+	template<typename Scanner, typename T, typename... Args>
+	inline int ScanSized(Scanner& scanner, const char* format, int numAssigned, std::string& piece,
+		T* pArg, Args... args)
+	{
+		return ScanSizedBuffer(scanner, format, numAssigned, piece, pArg, args...);
+	}
+}
+
+template<typename... Args>
+inline int fscanf_s(FILE* pFile, const char* format, Args... args)
+{
+	auto scanner = [pFile](const char* piece, void* pArg) { return fscanf(pFile, piece, pArg); };
+
+	return SecureCRT::ScanNext(scanner, format, 0, args...);
+}
+
+template<typename... Args>
+inline int sscanf_s(const char* buffer, const char* format, Args... args)
+{
+	// Each piece continues where the previous one stopped, as counted by %n
+	auto scanner = [&buffer](const char* piece, void* pArg)
+	{
+		auto numRead = 0;
+		const auto result = sscanf(buffer, (std::string(piece) + "%n").c_str(), pArg, &numRead);
+		buffer += numRead;
+
+		return result;
+	};
+
+	return SecureCRT::ScanNext(scanner, format, 0, args...);
+}
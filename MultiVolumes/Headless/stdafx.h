@@ -0,0 +1,37 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+// Portable counterpart of the Windows stdafx.h, force-included into the headless
+// renderer and the CPU modules of Content it is built from.
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cmath>
+#include <DirectXMath.h>
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+#if !defined(_MSC_VER)
+#include "SecureCRT.h"
+
+// std::size() of C++17, which MSVC also provides to C++14
+#if !defined(__cpp_lib_nonmember_container_access)
+namespace std
+{
+	template<class T, size_t N>
+	constexpr size_t size(const T (&)[N]) noexcept { return N; }
+}
+#endif
+#endif
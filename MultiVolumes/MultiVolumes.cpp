@@ -11,6 +11,11 @@
 
 #include "SharedConsts.h"
 #include "MultiVolumes.h"
+#include "MemoryBudget.h"
+#include "FrameProfiler.h"
+#include "GPUProfiler.h"
+#include "TraceRecorder.h"
+#include "JobSystem.h"
 #include <DirectXColors.h>
 
 using namespace std;
@@ -31,20 +36,10 @@ MultiVolumes::MultiVolumes(uint32_t width, uint32_t height, std::wstring name) :
 	m_oitMethod(MultiRayCaster::OIT_RAY_QUERY),
 	m_animate(false),
 	m_showMesh(false),
+	m_spinSky(false),
 	m_showFPS(true),
 	m_isPaused(false),
-	m_tracking(false),
-	m_gridSize(128),
-	m_lightGridSize(512),
-	m_maxRaySamples(256),
-	m_maxLightSamples(128),
-	m_numVolumes(2),
-	m_radianceFile(L""),
-	m_irradianceFile(L""),
-	m_meshFileName("Assets/bunny.obj"),
-	m_volPosScale(0.0f, 0.0f, 0.0f, 10.0f),
-	m_meshPosScale(0.0f, -10.0f, 0.0f, 1.5f),
-	m_lightMapScale(32.0f)
+	m_tracking(false)
 {
 #if defined (_DEBUG)
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
@@ -54,17 +49,6 @@ MultiVolumes::MultiVolumes(uint32_t width, uint32_t height, std::wstring name) :
 	freopen_s(&stream, "CONOUT$", "w+t", stdout);
 	freopen_s(&stream, "CONOUT$", "w+t", stderr);
 #endif
-
-	m_volumeFiles[0] = L"Assets/bunny.dds";
-	m_volumeFiles[1] = L"Assets/buddha.dds";
-	m_volumeFiles[2] = L"Assets/dragon.dds";
-	m_volumeFiles[3] = L"Assets/Eagle.dds";
-	m_volumeFiles[4] = L"Assets/Jacquemart.dds";
-	m_volumeFiles[5] = L"Assets/lucy.dds";
-	m_volumeFiles[6] = L"Assets/penelope.dds";
-	m_volumeFiles[7] = L"Assets/Cloud1.dds";
-	m_volumeFiles[8] = L"Assets/Cloud2.dds";
-	m_volumeFiles[9] = L"Assets/Devil.dds";
 }
 
 MultiVolumes::~MultiVolumes()
@@ -146,6 +130,11 @@ void MultiVolumes::LoadPipeline()
 			(L"CommandAllocator" + to_wstring(n)).c_str()), ThrowIfFailed(E_FAIL));
 	}
 
+	// Create the command lists recorded per subsystem, each with an allocator per frame.
+	XUSG_X_RETURN(m_commandListSink, make_unique<CommandListSink>(), ThrowIfFailed(E_FAIL));
+	XUSG_N_RETURN(m_commandListSink->Init(m_device.get(), m_commandQueue.get(), FrameCount, MaxSegments),
+		ThrowIfFailed(E_FAIL));
+
 	// Create descriptor table cache.
 	m_descriptorTableCache = DescriptorTableCache::MakeShared(m_device.get(), L"DescriptorTableCache");
 }
@@ -153,6 +142,8 @@ void MultiVolumes::LoadPipeline()
 // Load the sample assets.
 void MultiVolumes::LoadAssets()
 {
+	TRACE_SCOPE("MultiVolumes::LoadAssets");
+
 	// Create the command list.
 	m_commandList = RayTracing::CommandList::MakeUnique();
 	const auto pCommandList = m_commandList.get();
@@ -164,40 +155,90 @@ void MultiVolumes::LoadAssets()
 
 	// Clear color setting
 	m_clearColor = { 0.2f, 0.2f, 0.2f, 0.0f };
-	m_clearColor = m_volumeFiles->empty() ? m_clearColor : DirectX::Colors::CornflowerBlue;
+	m_clearColor = m_settings.VolumeFiles[0].empty() ? m_clearColor : DirectX::Colors::CornflowerBlue;
 	m_clearColor.v = XMVectorPow(m_clearColor, XMVectorReplicate(1.0f / 1.25f));
 	m_clearColor.v = 0.7f * m_clearColor / (XMVectorReplicate(1.25f) - m_clearColor);
 	m_clearColor.f[3] = 0.0f;
 
-	vector<Resource::uptr> uploaders(0);
+	// Create synchronization objects, so that the upload ring can wait on its copies.
+	{
+		if (!m_fence)
+		{
+			m_fence = Fence::MakeUnique();
+			XUSG_N_RETURN(m_fence->Create(m_device.get(), m_fenceValues[m_frameIndex]++, FenceFlag::NONE, L"Fence"), ThrowIfFailed(E_FAIL));
+		}
+
+		// Create an event handle to use for frame synchronization.
+		m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		if (!m_fenceEvent) ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+	}
+
+	// Buffer data is staged through the upload ring; when it is full, the copies recorded so far
+	// are executed and waited on before the ring is reused.
+	const auto flushUploads = [this, pCommandList](uint64_t& fenceValue)
+	{
+		XUSG_N_RETURN(pCommandList->Close(), false);
+		m_commandQueue->ExecuteCommandList(pCommandList);
+		fenceValue = m_fenceValues[m_frameIndex];
+		WaitForGpu();
+		XUSG_N_RETURN(m_commandAllocators[m_frameIndex]->Reset(), false);
+		XUSG_N_RETURN(pCommandList->Reset(m_commandAllocators[m_frameIndex].get(), nullptr), false);
+
+		return true;
+	};
+	XUSG_X_RETURN(m_uploadRing, make_unique<UploadRing>(), ThrowIfFailed(E_FAIL));
+	XUSG_N_RETURN(m_uploadRing->Init(m_device.get(), UploadRingSize, flushUploads), ThrowIfFailed(E_FAIL));
+
+	XUSG_X_RETURN(m_frameArena, make_unique<FrameArena>(), ThrowIfFailed(E_FAIL));
+	XUSG_N_RETURN(m_frameArena->Init(m_device.get(), FrameCount, FrameArenaSize), ThrowIfFailed(E_FAIL));
+	XUSG_N_RETURN(GPUProfiler::Init(m_device.get(), m_commandQueue.get(), FrameCount), ThrowIfFailed(E_FAIL));
+
+	vector<Resource::uptr> uploaders(0);	// Of the textures, created by the DDS loader
 	m_descriptorTableCache->AllocateDescriptorPool(CBV_SRV_UAV_POOL, 600, 0);
 
-	if (!m_radianceFile.empty())
+	if (!m_settings.RadianceFile.empty())
 	{
 		XUSG_X_RETURN(m_lightProbe, make_unique<LightProbe>(), ThrowIfFailed(E_FAIL));
-		XUSG_N_RETURN(m_lightProbe->Init(pCommandList, m_descriptorTableCache, uploaders,
-			m_radianceFile.c_str(), g_rtFormat, g_dsFormat), ThrowIfFailed(E_FAIL));
+		XUSG_N_RETURN(m_lightProbe->Init(pCommandList, m_descriptorTableCache, uploaders, m_frameArena.get(),
+			m_settings.RadianceFile.c_str(), g_rtFormat, g_dsFormat), ThrowIfFailed(E_FAIL));
 	}
 
 	XUSG_X_RETURN(m_objectRenderer, make_unique<ObjectRenderer>(), ThrowIfFailed(E_FAIL));
-	XUSG_N_RETURN(m_objectRenderer->Init(m_commandList.get(), m_descriptorTableCache, uploaders,
-		m_meshFileName.c_str(), g_backFormat, g_rtFormat, g_dsFormat, m_meshPosScale), ThrowIfFailed(E_FAIL));
+	XUSG_N_RETURN(m_objectRenderer->Init(m_commandList.get(), m_descriptorTableCache, m_uploadRing.get(),
+		m_frameArena.get(), m_settings.MeshFileName.c_str(), g_backFormat, g_rtFormat, g_dsFormat, m_settings.MeshPosScale), ThrowIfFailed(E_FAIL));
+
+	const auto numVolumeSrcs = SceneSettings::NumVolumeSrcs;
 
-	const auto numVolumeSrcs = static_cast<uint32_t>(size(m_volumeFiles));
+	// Downscale the grids to the memory budget, counting the light probe loaded above
+	if (m_settings.MemoryBudget > 0)
+	{
+		auto planDesc = MemoryBudget::GetDefaultPlanDesc(m_settings, m_width, m_height);
+		planDesc.LightProbeBytes = MemoryBudget::GetTotal(MemoryBudget::LIGHT_PROBE);
+		planDesc.ReservedBytes = static_cast<uint64_t>(m_width) * m_height * 4 * FrameCount +	// Swap chain
+			MemoryBudget::GetBufferSize(UploadRingSize) + MemoryBudget::GetBufferSize(FrameArenaSize);
+		const auto plan = MemoryBudget::MakePlan(planDesc);
+
+		stringstream ss;
+		MemoryBudget::PrintPlan(ss, planDesc, plan);
+		OutputDebugStringA(ss.str().c_str());
+
+		m_settings.GridSize = plan.Settings.GridSize;
+		m_settings.LightGridSize = plan.Settings.LightGridSize;
+	}
 
 	GeometryBuffer geometry;
 	m_rayCaster = make_unique<MultiRayCaster>();
 	if (!m_rayCaster) ThrowIfFailed(E_FAIL);
 	if (!m_rayCaster->Init(pCommandList, m_descriptorTableCache, g_rtFormat, g_dsFormat,
-		m_gridSize, m_lightGridSize, m_numVolumes, numVolumeSrcs, uploaders,
+		m_settings.GridSize, m_settings.LightGridSize, m_settings.NumVolumes, numVolumeSrcs, m_uploadRing.get(),
 		&geometry, m_dxrSupport)) ThrowIfFailed(E_FAIL);
-	const auto volumeSize = m_volPosScale.w * 2.0f;
-	const auto volumePos = XMFLOAT3(m_volPosScale.x, m_volPosScale.y, m_volPosScale.z);
+	const auto volumeSize = m_settings.VolPosScale.w * 2.0f;
+	const auto volumePos = XMFLOAT3(m_settings.VolPosScale.x, m_settings.VolPosScale.y, m_settings.VolPosScale.z);
 	m_rayCaster->SetVolumesWorld(volumeSize, volumePos);
-	m_rayCaster->SetLightMapWorld(m_lightMapScale * 2.0f, XMFLOAT3(0.0f, 0.0f, 0.0f));
-	m_rayCaster->SetMaxSamples(m_maxRaySamples, m_maxLightSamples);
+	m_rayCaster->SetLightMapWorld(m_settings.LightMapScale * 2.0f, XMFLOAT3(0.0f, 0.0f, 0.0f));
+	m_rayCaster->SetMaxSamples(m_settings.MaxRaySamples, m_settings.MaxLightSamples);
 
-	if (m_volumeFiles->empty())
+	if (m_settings.VolumeFiles[0].empty())
 	{
 		for (auto i = 0u; i < numVolumeSrcs; ++i)
 			m_rayCaster->InitVolumeData(pCommandList, i);
@@ -205,29 +246,22 @@ void MultiVolumes::LoadAssets()
 	else
 	{
 		for (auto i = 0u; i < numVolumeSrcs; ++i)
-			m_rayCaster->LoadVolumeData(pCommandList, i, m_volumeFiles[i].c_str(), uploaders);
+			m_rayCaster->LoadVolumeData(pCommandList, i, m_settings.VolumeFiles[i].c_str(), uploaders);
 	}
 
 	// Close the command list and execute it to begin the initial GPU setup.
 	XUSG_N_RETURN(pCommandList->Close(), ThrowIfFailed(E_FAIL));
 	m_commandQueue->ExecuteCommandList(pCommandList);
 
-	// Create synchronization objects and wait until assets have been uploaded to the GPU.
+	// Wait until assets have been uploaded to the GPU.
 	{
-		if (!m_fence)
-		{
-			m_fence = Fence::MakeUnique();
-			XUSG_N_RETURN(m_fence->Create(m_device.get(), m_fenceValues[m_frameIndex]++, FenceFlag::NONE, L"Fence"), ThrowIfFailed(E_FAIL));
-		}
-
-		// Create an event handle to use for frame synchronization.
-		m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-		if (!m_fenceEvent) ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
-
 		// Wait for the command list to execute; we are reusing the same command 
 		// list in our main loop but for now, we just want to wait for setup to 
 		// complete before continuing.
+		const auto fenceValue = m_fenceValues[m_frameIndex];
+		m_uploadRing->Submit(fenceValue);
 		WaitForGpu();
+		m_uploadRing->Reclaim(fenceValue);
 	}
 
 	// Create window size dependent resources.
@@ -276,7 +310,8 @@ void MultiVolumes::CreateResources()
 	if (m_lightProbe)
 	{
 		XUSG_N_RETURN(m_lightProbe->CreateDescriptorTables(m_device.get()), ThrowIfFailed(E_FAIL));
-		XUSG_N_RETURN(m_objectRenderer->SetRadiance(m_lightProbe->GetRadiance()->GetSRV()), ThrowIfFailed(E_FAIL));
+		XUSG_N_RETURN(m_objectRenderer->SetRadiance(m_lightProbe->GetSpecularRadiance()->GetSRV(),
+			m_lightProbe->IsRadiancePrefiltered()), ThrowIfFailed(E_FAIL));
 	}
 	XUSG_N_RETURN(m_objectRenderer->SetViewport(m_device.get(), m_width, m_height,
 		g_rtFormat, g_dsFormat, m_clearColor, true), ThrowIfFailed(E_FAIL));
@@ -287,10 +322,13 @@ void MultiVolumes::CreateResources()
 // Update frame-based values.
 void MultiVolumes::OnUpdate()
 {
+	TRACE_SCOPE("MultiVolumes::OnUpdate");
+
 	// Timer
 	static auto time = 0.0, pauseTime = 0.0;
 
 	m_timer.Tick();
+	FrameProfiler::Record(FrameProfiler::FRAME, m_timer.GetElapsedSeconds() * 1000.0);
 	float timeStep;
 	const auto totalTime = CalculateFrameStats(&timeStep);
 	pauseTime = m_isPaused ? totalTime - time : pauseTime;
@@ -318,25 +356,44 @@ void MultiVolumes::OnUpdate()
 	m_rayCaster->SetLight(lightPt, lightColor, lightIntensity);
 	m_rayCaster->SetAmbient(ambientColor, ambientIntensity);
 
+	// Sky rotation, with the SH rotated instead of reprojected; the SH transformed on the GPU
+	// cannot be rotated, which turns the spinning off
+	if (m_lightProbe && m_spinSky)
+	{
+		static auto skyAngle = 0.0f;
+		skyAngle += timeStep * 0.2f;
+		m_spinSky = m_lightProbe->SetRotation(XMMatrixRotationY(skyAngle));
+		g_updateLight = true;
+	}
+
 	// View
 	//const auto eyePt = XMLoadFloat3(&m_eyePt);
 	const auto view = XMLoadFloat4x4(&m_view);
 	const auto proj = XMLoadFloat4x4(&m_proj);
 	const auto viewProj = view * proj;
-	m_objectRenderer->UpdateFrame(m_frameIndex, viewProj, m_eyePt);
-	if (m_lightProbe) m_lightProbe->UpdateFrame(m_frameIndex, viewProj, m_eyePt);
-	m_rayCaster->UpdateFrame(m_frameIndex, viewProj, m_objectRenderer->GetShadowVP(), m_eyePt);
+
+	// The ray caster takes the shadow matrix of the object renderer, and the light probe shares
+	// its frame arena, so both wait for it; the volume transforms fork their own batches
+	JobSystem::Group group;
+	const auto pObjectTask = group.Run([&]() { m_objectRenderer->UpdateFrame(m_frameIndex, viewProj, m_eyePt); });
+	if (m_lightProbe) group.Run([&]() { m_lightProbe->UpdateFrame(m_frameIndex, viewProj, m_eyePt); }, &pObjectTask, 1);
+	group.Run([&]()
+	{
+		m_rayCaster->UpdateFrame(m_frameIndex, viewProj, m_objectRenderer->GetShadowVP(), m_eyePt);
+	}, &pObjectTask, 1);
+	group.Wait();
+
+	// Never record the frame with the stale offsets of an overflowing frame arena
+	XUSG_N_RETURN(!m_frameArena->HasOverflowed(), ThrowIfFailed(E_OUTOFMEMORY));
 }
 
 // Render the scene.
 void MultiVolumes::OnRender()
 {
-	// Record all the commands we need to render the scene into the command list.
+	// Record all the commands we need to render the scene into the command lists, and execute
+	// them.
 	PopulateCommandList();
 
-	// Execute the command list.
-	m_commandQueue->ExecuteCommandList(m_commandList.get());
-
 	// Present the frame.
 	XUSG_N_RETURN(m_swapChain->Present(0, PresentFlag::ALLOW_TEARING), ThrowIfFailed(E_FAIL));
 
@@ -348,6 +405,7 @@ void MultiVolumes::OnDestroy()
 	// Ensure that the GPU is no longer referencing resources that are about to be
 	// cleaned up by the destructor.
 	WaitForGpu();
+	GPUProfiler::Destroy();
 
 	CloseHandle(m_fenceEvent);
 }
@@ -434,6 +492,12 @@ void MultiVolumes::OnKeyUp(uint8_t key)
 		m_showMesh = !m_showMesh;
 		g_updateLight = true;
 		break;
+	case 'R':
+		m_spinSky = !m_spinSky;
+		break;
+	case 'T':
+		TraceRecorder::Flush("MultiVolumes.trace.json");
+		break;
 	case 'O':
 		auto inc = (m_oitMethod + 1) % MultiRayCaster::OIT_METHOD_COUNT == MultiRayCaster::OIT_RAY_QUERY &&
 			!(m_dxrSupport & MultiRayCaster::RT_INLINE) ? 2 : 1;
@@ -510,138 +574,178 @@ void MultiVolumes::ParseCommandLineArgs(wchar_t* argv[], int argc)
 {
 	DXFramework::ParseCommandLineArgs(argv, argc);
 
-	for (auto i = 1; i < argc; ++i)
+	m_settings.ParseCommandLineArgs(argv, argc);
+}
+
+void MultiVolumes::PopulateCommandList()
+{
+	TRACE_SCOPE("MultiVolumes::PopulateCommandList");
+
+	// The subsystems record into command lists of their own, concurrently on the job system,
+	// which are executed in the order of the segments below. Command list allocators can only be
+	// reset when the associated command lists have finished execution on the GPU, so each
+	// segment has an allocator per frame, which MoveToNextFrame() has waited on.
+	m_commandListSink->SetFrameIndex(static_cast<uint8_t>(m_frameIndex));
+	m_commandRecorder.Reset();
+
+	// The GPU timings of the frame last recorded at this index, which has completed
+	GPUProfiler::BeginFrame(static_cast<uint8_t>(m_frameIndex));
+
+	// The frame arena is not thread safe, so the bodies only bind what UpdateFrame() wrote.
+	m_frameArena->Close();
+
+	// The entries transition the shared render targets, serially in segment order, and the
+	// bodies only transition the resources of their own subsystems.
+	const auto pSink = m_commandListSink.get();
+	const auto descriptorPool = m_descriptorTableCache->GetDescriptorPool(CBV_SRV_UAV_POOL);
+	const auto pColor = m_objectRenderer->GetRenderTarget(ObjectRenderer::RT_COLOR);
+	const auto pVelocity = m_objectRenderer->GetRenderTarget(ObjectRenderer::RT_VELOCITY);
+	const auto pDepth = m_objectRenderer->GetDepthMap(ObjectRenderer::DEPTH_MAP);
+	const auto pShadow = m_objectRenderer->GetDepthMap(ObjectRenderer::SHADOW_MAP);
+	const Descriptor pRTVs[] = { pColor->GetRTV(), pVelocity->GetRTV() };
+	const Viewport viewport(0.0f, 0.0f, static_cast<float>(m_width), static_cast<float>(m_height));
+	const RectRange scissorRect(0, 0, m_width, m_height);
+	const auto setViewport = [&viewport, &scissorRect](const CommandList* pCommandList)
+	{
+		pCommandList->RSSetViewports(1, &viewport);
+		pCommandList->RSSetScissorRects(1, &scissorRect);
+	};
+	const auto setRenderTargets = [&](const CommandList* pCommandList)
+	{
+		pCommandList->SetDescriptorPools(1, &descriptorPool);
+		pCommandList->OMSetRenderTargets(static_cast<uint32_t>(size(pRTVs)), pRTVs, &pDepth->GetDSV());
+		setViewport(pCommandList);
+	};
+
+	// Record commands.
+	static auto isFirstFrame = true;
+	const auto transformSH = isFirstFrame;
+	if (m_lightProbe && (transformSH || m_spinSky))
 	{
-		if (_wcsnicmp(argv[i], L"-mesh", wcslen(argv[i])) == 0 ||
-			_wcsnicmp(argv[i], L"/mesh", wcslen(argv[i])) == 0)
+		m_commandRecorder.AddSegment("LightProbe", [&](uint32_t i)
 		{
-			if (i + 1 < argc)
+			// Only copies the coefficients rotated by LightProbe::UpdateFrame()
+			m_lightProbe->RotateSH(pSink->GetCommandList(i), m_frameIndex);
+
+			return true;
+		}, [&](uint32_t i)
+		{
+			// The renderers bind the coefficients of the transform
+			if (transformSH)
 			{
-				m_meshFileName.resize(wcslen(argv[++i]));
-				for (size_t j = 0; j < m_meshFileName.size(); ++j)
-					m_meshFileName[j] = static_cast<char>(argv[i][j]);
+				m_lightProbe->TransformSH(pSink->GetCommandList(i));
+				m_objectRenderer->SetSH(m_lightProbe->GetSH());
+				m_rayCaster->SetSH(m_lightProbe->GetSH());
 			}
-			if (i + 1 < argc) i += swscanf_s(argv[i + 1], L"%f", &m_meshPosScale.x);
-			if (i + 1 < argc) i += swscanf_s(argv[i + 1], L"%f", &m_meshPosScale.y);
-			if (i + 1 < argc) i += swscanf_s(argv[i + 1], L"%f", &m_meshPosScale.z);
-			if (i + 1 < argc) i += swscanf_s(argv[i + 1], L"%f", &m_meshPosScale.w);
-		}
-		else if (_wcsnicmp(argv[i], L"-gridSize", wcslen(argv[i])) == 0 ||
-			_wcsnicmp(argv[i], L"/gridSize", wcslen(argv[i])) == 0)
-		{
-			if (i + 1 < argc) i += swscanf_s(argv[i + 1], L"%u", &m_gridSize);
-		}
-		else if (_wcsnicmp(argv[i], L"-lightGridSize", wcslen(argv[i])) == 0 ||
-			_wcsnicmp(argv[i], L"/lightGridSize", wcslen(argv[i])) == 0)
-		{
-			if (i + 1 < argc) i += swscanf_s(argv[i + 1], L"%u", &m_lightGridSize);
-		}
-		else if (_wcsnicmp(argv[i], L"-volume", wcslen(argv[i])) == 0 ||
-			_wcsnicmp(argv[i], L"/volume", wcslen(argv[i])) == 0)
-		{
-			m_volumeFiles[0] = i + 1 < argc ? argv[++i] : m_volumeFiles[0];
-			if (i + 1 < argc) i += swscanf_s(argv[i + 1], L"%f", &m_volPosScale.x);
-			if (i + 1 < argc) i += swscanf_s(argv[i + 1], L"%f", &m_volPosScale.y);
-			if (i + 1 < argc) i += swscanf_s(argv[i + 1], L"%f", &m_volPosScale.z);
-			if (i + 1 < argc) i += swscanf_s(argv[i + 1], L"%f", &m_volPosScale.w);
-		}
-		else if (_wcsnicmp(argv[i], L"-lightMapScale", wcslen(argv[i])) == 0 ||
-			_wcsnicmp(argv[i], L"/lightMapScale", wcslen(argv[i])) == 0)
-		{
-			if (i + 1 < argc) i += swscanf_s(argv[i + 1], L"%f", &m_lightMapScale);
-		}
-		else if (_wcsnicmp(argv[i], L"-maxRaySamples", wcslen(argv[i])) == 0 ||
-			_wcsnicmp(argv[i], L"/maxRaySamples", wcslen(argv[i])) == 0)
-		{
-			if (i + 1 < argc) i += swscanf_s(argv[i + 1], L"%u", &m_maxRaySamples);
-		}
-		else if (_wcsnicmp(argv[i], L"-maxLightSamples", wcslen(argv[i])) == 0 ||
-			_wcsnicmp(argv[i], L"/maxLightSamples", wcslen(argv[i])) == 0)
-		{
-			if (i + 1 < argc) i += swscanf_s(argv[i + 1], L"%u", &m_maxLightSamples);
-		}
-		else if (_wcsnicmp(argv[i], L"-numVolumes", wcslen(argv[i])) == 0 ||
-			_wcsnicmp(argv[i], L"/numVolumes", wcslen(argv[i])) == 0)
+
+			return true;
+		});
+	}
+	isFirstFrame = false;
+
+	const auto updateLight = g_updateLight;
+	if (updateLight)
+	{
+		m_commandRecorder.AddSegment("Shadow", [&](uint32_t i)
 		{
-			if (i + 1 < argc) i += swscanf_s(argv[i + 1], L"%u", &m_numVolumes);
-		}
-		else if (_wcsnicmp(argv[i], L"-radiance", wcslen(argv[i])) == 0 ||
-			_wcsnicmp(argv[i], L"/radiance", wcslen(argv[i])) == 0)
+			const auto pCommandList = pSink->GetCommandList(i);
+			pCommandList->SetDescriptorPools(1, &descriptorPool);
+			m_objectRenderer->RenderShadow(pCommandList, m_frameIndex, m_showMesh);
+
+			return true;
+		}, [&](uint32_t i)
 		{
-			m_radianceFile = i + 1 < argc ? argv[++i] : m_radianceFile;
-		}
+			ResourceBarrier barrier;
+			const auto numBarriers = pShadow->SetBarrier(&barrier, ResourceState::DEPTH_WRITE);
+			pSink->GetCommandList(i)->Barrier(numBarriers, &barrier);
+
+			return true;
+		});
 	}
-}
 
-void MultiVolumes::PopulateCommandList()
-{
-	// Command list allocators can only be reset when the associated 
-	// command lists have finished execution on the GPU; apps should use 
-	// fences to determine GPU execution progress.
-	const auto pCommandAllocator = m_commandAllocators[m_frameIndex].get();
-	XUSG_N_RETURN(pCommandAllocator->Reset(), ThrowIfFailed(E_FAIL));
-
-	// However, when ExecuteCommandList() is called on a particular command 
-	// list, that command list can then be reset at any time and must be before 
-	// re-recording.
-	const auto pCommandList = m_commandList.get();
-	XUSG_N_RETURN(pCommandList->Reset(pCommandAllocator, nullptr), ThrowIfFailed(E_FAIL));
+	m_commandRecorder.AddSegment("ObjectRenderer", [&](uint32_t i)
+	{
+		// Clear render targets
+		const auto pCommandList = pSink->GetCommandList(i);
+		const float clear[4] = {};
+		pCommandList->ClearRenderTargetView(pColor->GetRTV(), m_clearColor);
+		pCommandList->ClearRenderTargetView(pVelocity->GetRTV(), clear);
+		pCommandList->ClearDepthStencilView(pDepth->GetDSV(), ClearFlag::DEPTH, 1.0f);
+		setRenderTargets(pCommandList);
+
+		m_objectRenderer->Render(pCommandList, m_frameIndex, m_showMesh);
+
+		return true;
+	}, [&](uint32_t i)
+	{
+		ResourceBarrier barriers[4];
+		auto numBarriers = pColor->SetBarrier(barriers, ResourceState::RENDER_TARGET);
+		numBarriers = pVelocity->SetBarrier(barriers, ResourceState::RENDER_TARGET, numBarriers);
+		numBarriers = pDepth->SetBarrier(barriers, ResourceState::DEPTH_WRITE, numBarriers);
+		numBarriers = pShadow->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE | ResourceState::PIXEL_SHADER_RESOURCE, numBarriers);
+		pSink->GetCommandList(i)->Barrier(numBarriers, barriers);
+
+		return true;
+	});
 
-	// Record commands.
 	if (m_lightProbe)
 	{
-		static auto isFirstFrame = true;
-		if (isFirstFrame)
+		m_commandRecorder.AddSegment("Environment", [&](uint32_t i)
 		{
-			m_lightProbe->TransformSH(pCommandList);
-			m_objectRenderer->SetSH(m_lightProbe->GetSH());
-			m_rayCaster->SetSH(m_lightProbe->GetSH());
-			isFirstFrame = false;
-		}
-	}
+			const auto pCommandList = pSink->GetCommandList(i);
+			setRenderTargets(pCommandList);
+			m_lightProbe->RenderEnvironment(pCommandList, m_frameIndex);
 
-	const auto descriptorPool = m_descriptorTableCache->GetDescriptorPool(CBV_SRV_UAV_POOL);
-	pCommandList->SetDescriptorPools(1, &descriptorPool);
+			return true;
+		});
+	}
 
-	if (g_updateLight) m_objectRenderer->RenderShadow(pCommandList, m_frameIndex, m_showMesh);
+	m_commandRecorder.AddSegment("MultiRayCaster", [&](uint32_t i)
+	{
+		const auto pCommandList = pSink->GetCommandList(i);
+		setRenderTargets(pCommandList);
+		m_rayCaster->Render(pCommandList, m_frameIndex, pColor, updateLight, m_oitMethod);
 
-	ResourceBarrier barriers[4];
-	const auto pColor = m_objectRenderer->GetRenderTarget(ObjectRenderer::RT_COLOR);
-	const auto pVelocity = m_objectRenderer->GetRenderTarget(ObjectRenderer::RT_VELOCITY);
-	const auto pDepth = m_objectRenderer->GetDepthMap(ObjectRenderer::DEPTH_MAP);
-	const auto pShadow = m_objectRenderer->GetDepthMap(ObjectRenderer::SHADOW_MAP);
-	auto numBarriers = pColor->SetBarrier(barriers, ResourceState::RENDER_TARGET);
-	numBarriers = pVelocity->SetBarrier(barriers, ResourceState::RENDER_TARGET, numBarriers);
-	numBarriers = pDepth->SetBarrier(barriers, ResourceState::DEPTH_WRITE, numBarriers);
-	numBarriers = pShadow->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE | ResourceState::PIXEL_SHADER_RESOURCE, numBarriers);
-	pCommandList->Barrier(numBarriers, barriers);
-
-	// Clear render targets
-	const float clear[4] = {};
-	const Descriptor pRTVs[] = { pColor->GetRTV(), pVelocity->GetRTV() };
-	pCommandList->ClearRenderTargetView(pColor->GetRTV(), m_clearColor);
-	pCommandList->ClearRenderTargetView(pVelocity->GetRTV(), clear);
-	pCommandList->ClearDepthStencilView(pDepth->GetDSV(), ClearFlag::DEPTH, 1.0f);
-	pCommandList->OMSetRenderTargets(static_cast<uint32_t>(size(pRTVs)), pRTVs, &pDepth->GetDSV());
-
-	// Set viewport
-	Viewport viewport(0.0f, 0.0f, static_cast<float>(m_width), static_cast<float>(m_height));
-	RectRange scissorRect(0, 0, m_width, m_height);
-	pCommandList->RSSetViewports(1, &viewport);
-	pCommandList->RSSetScissorRects(1, &scissorRect);
-
-	m_objectRenderer->Render(pCommandList, m_frameIndex, m_showMesh);
-	if (m_lightProbe) m_lightProbe->RenderEnvironment(pCommandList, m_frameIndex);
-	m_rayCaster->Render(pCommandList, m_frameIndex, pColor, g_updateLight, m_oitMethod);
+		return true;
+	}, [&](uint32_t i)
+	{
+		// The volumes ray march against the scene depth, and the ray-tracing OIT writes the color
+		ResourceBarrier barriers[2];
+		auto numBarriers = pDepth->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE |
+			ResourceState::PIXEL_SHADER_RESOURCE);
+		if (m_oitMethod == MultiRayCaster::OIT_RAY_TRACING)
+			numBarriers = pColor->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+		pSink->GetCommandList(i)->Barrier(numBarriers, barriers);
+
+		return true;
+	});
 	g_updateLight = false;
 
-	m_objectRenderer->Postprocess(pCommandList, m_renderTargets[m_frameIndex].get());
-	
-	// Indicate that the back buffer will now be used to present.
-	numBarriers = m_renderTargets[m_frameIndex]->SetBarrier(barriers, ResourceState::PRESENT);
-	pCommandList->Barrier(numBarriers, barriers);
+	m_commandRecorder.AddSegment("Postprocess", [&](uint32_t i)
+	{
+		const auto pCommandList = pSink->GetCommandList(i);
+		pCommandList->SetDescriptorPools(1, &descriptorPool);
+		setViewport(pCommandList);
+		m_objectRenderer->Postprocess(pCommandList, m_renderTargets[m_frameIndex].get());
+
+		// Indicate that the back buffer will now be used to present.
+		ResourceBarrier barrier;
+		const auto numBarriers = m_renderTargets[m_frameIndex]->SetBarrier(&barrier, ResourceState::PRESENT);
+		pCommandList->Barrier(numBarriers, &barrier);
+
+		return true;
+	}, [&](uint32_t i)
+	{
+		ResourceBarrier barriers[2];
+		auto numBarriers = pColor->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+		numBarriers = pVelocity->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+		pSink->GetCommandList(i)->Barrier(numBarriers, barriers);
 
-	XUSG_N_RETURN(pCommandList->Close(), ThrowIfFailed(E_FAIL));
+		return true;
+	});
+
+	// Record, then execute the command lists in segment order.
+	XUSG_N_RETURN(m_commandRecorder.Record(pSink), ThrowIfFailed(E_FAIL));
 }
 
 // Wait for pending GPU work to complete.
@@ -677,6 +781,9 @@ void MultiVolumes::MoveToNextFrame()
 
 	// Set the fence value for the next frame.
 	m_fenceValues[m_frameIndex] = currentFenceValue + 1;
+
+	// The frame that last used this back buffer has retired, and so have its constants.
+	m_frameArena->BeginFrame();
 }
 
 double MultiVolumes::CalculateFrameStats(float* pTimeStep)
@@ -697,13 +804,19 @@ double MultiVolumes::CalculateFrameStats(float* pTimeStep)
 		frameCnt = 0;
 		elapsedTime = totalTime;
 
+		// Tail latency over the rolling window of frames
+		FrameProfiler::Aggregate();
+		const auto frameStats = FrameProfiler::GetStats(FrameProfiler::FRAME);
+
 		wstringstream windowText;
 		windowText << L"    fps: ";
-		if (m_showFPS) windowText << setprecision(2) << fixed << fps;
+		if (m_showFPS) windowText << setprecision(2) << fixed << fps << L"    p99: " << frameStats.P99 << L" ms";
 		else windowText << L"[F1]";
 
 		windowText << L"    [A] " << (m_animate ? "Auto-animation" : "Interaction");
 		windowText << L"    [M] Show/hide mesh";
+		if (m_lightProbe) windowText << L"    [R] " << (m_spinSky ? "Spinning sky" : "Static sky");
+		if (TraceRecorder::IsCompiledIn()) windowText << L"    [T] Save trace";
 
 		windowText << L"    [O] ";
 		switch (m_oitMethod)
@@ -16,6 +16,8 @@
 #include "MultiRayCaster.h"
 #include "LightProbe.h"
 #include "ObjectRenderer.h"
+#include "SceneSettings.h"
+#include "CommandListSink.h"
 
 using namespace DirectX;
 
@@ -50,6 +52,9 @@ public:
 private:
 	static const auto FrameCount = MultiRayCaster::FrameCount;
 	static_assert(FrameCount == ObjectRenderer::FrameCount, "VolumeRender::FrameCount should be equal to ObjectRenderer::FrameCount");
+	static const uint64_t UploadRingSize = 8 << 20;	// Staging memory of the buffer uploads
+	static const uint64_t FrameArenaSize = 64 << 10;	// Constants of the frames in flight
+	static const uint32_t MaxSegments = 6;			// Command lists recorded per frame
 
 	XUSG::com_ptr<IDXGIFactory5> m_factory;
 
@@ -69,6 +74,10 @@ private:
 	std::unique_ptr<MultiRayCaster>	m_rayCaster;
 	std::unique_ptr<LightProbe>		m_lightProbe;
 	std::unique_ptr<ObjectRenderer>	m_objectRenderer;
+	std::unique_ptr<UploadRing>		m_uploadRing;
+	std::unique_ptr<FrameArena>		m_frameArena;
+	std::unique_ptr<CommandListSink> m_commandListSink;
+	CommandRecorder	m_commandRecorder;
 	XMFLOAT4X4	m_proj;
 	XMFLOAT4X4	m_view;
 	XMFLOAT3	m_focusPt;
@@ -84,6 +93,7 @@ private:
 	MultiRayCaster::OITMethod m_oitMethod;
 	bool		m_animate;
 	bool		m_showMesh;
+	bool		m_spinSky;
 	bool		m_showFPS;
 	bool		m_isPaused;
 	StepTimer	m_timer;
@@ -93,18 +103,7 @@ private:
 	XMFLOAT2 m_mousePt;
 
 	// User external settings
-	uint32_t m_gridSize;
-	uint32_t m_lightGridSize;
-	uint32_t m_maxRaySamples;
-	uint32_t m_maxLightSamples;
-	uint32_t m_numVolumes;
-	std::wstring m_volumeFiles[10];
-	std::wstring m_radianceFile;
-	std::wstring m_irradianceFile;
-	std::string m_meshFileName;
-	XMFLOAT4 m_volPosScale;
-	XMFLOAT4 m_meshPosScale;
-	float m_lightMapScale;
+	SceneSettings m_settings;
 	XMVECTORF32 m_clearColor;
 
 	void LoadPipeline();